@@ -17,6 +17,7 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <thread>
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
@@ -34,6 +35,7 @@
 #include "utils.h"
 #include "wave_reader.h"
 #include "clap_utils.h"
+#include "clap_index.h"
 
 // ======================
 // Parameters
@@ -46,6 +48,9 @@
 #define CLAP_TEXT_PROJECTION_WEIGHT_PATH	"CLAP_text_projection_LAION-Audio-630K_with_fusion.onnx"
 #define CLAP_TEXT_PROJECTION_MODEL_PATH		"CLAP_text_projection_LAION-Audio-630K_with_fusion.onnx.prototxt"
 
+#define INDEX_PATH "clap.index"
+#define TOPK 10
+
 #define BENCHMARK_ITERS 5
 
 static std::string weight_audio(CLAP_AUDIO_WEIGHT_PATH);
@@ -62,6 +67,13 @@ static std::string input_wav_path("input.wav");
 static std::vector<std::string> texts;
 static unsigned int token_length = 77;
 
+static std::string build_dir;
+static std::string index_path(INDEX_PATH);
+static bool search_mode = false;
+static int topk = TOPK;
+static int workers = 0;
+static WINDOW_CONFIG window_config;
+
 typedef float TYPE_IDS;
 typedef float TYPE_MASK;
 
@@ -77,6 +89,9 @@ bool debug = false;
 static void print_usage()
 {
     PRINT_OUT("usage: clap [-h] [-i WAV_FILE] [-t TEXT] [-v VOCAB_FILE] [-m MERGE_FILE] [-e ENV_ID]\n");
+    PRINT_OUT("            [--build WAV_DIR] [--index INDEX_FILE] [-s] [-k TOPK] [-w WORKERS]\n");
+    PRINT_OUT("            [--window MODE] [--seed SEED] [--overlap OVERLAP] [--max_windows N]\n");
+    PRINT_OUT("            [--pooling POOLING]\n");
     return;
 }
 
@@ -100,6 +115,21 @@ static void print_help()
 //    PRINT_OUT("                        video mode)\n");
 	PRINT_OUT("  -e ENV_ID, --env_id ENV_ID\n");
 	PRINT_OUT("                        The backend environment id.\n");
+    PRINT_OUT("  --build WAV_DIR       Embed the wav files under WAV_DIR into the index file.\n");
+    PRINT_OUT("                        Files already in the index are not embedded again.\n");
+    PRINT_OUT("  --index INDEX_FILE    The index file. (default: %s)\n", INDEX_PATH);
+    PRINT_OUT("  -s, --search          Search the index with the texts instead of the input wav.\n");
+    PRINT_OUT("  -k TOPK, --topk TOPK  The number of search results per text. (default: %d)\n", TOPK);
+    PRINT_OUT("  -w WORKERS, --workers WORKERS\n");
+    PRINT_OUT("                        The number of audio encoders used to build the index.\n");
+    PRINT_OUT("                        (default: automatic)\n");
+    PRINT_OUT("  --window MODE         Chunks of audio longer than 10 seconds, random, even,\n");
+    PRINT_OUT("                        energy or sliding. (default: random)\n");
+    PRINT_OUT("  --seed SEED           The seed of the random chunk selection. (default: 0)\n");
+    PRINT_OUT("  --overlap OVERLAP     The overlap ratio of the sliding windows. (default: 0.5)\n");
+    PRINT_OUT("  --max_windows N       The maximum number of sliding windows, 0 for no limit.\n");
+    PRINT_OUT("  --pooling POOLING     Pooling of the sliding window embeddings, mean or max.\n");
+    PRINT_OUT("                        (default: mean)\n");
     return;
 }
 
@@ -136,6 +166,58 @@ static int argument_parser(int argc, char **argv)
 		else if (arg == "-e" || arg == "--env_id") {
 			args_env_id = atoi(argv[++i]);
 		}
+		else if (arg == "--build") {
+			build_dir = argv[++i];
+		}
+		else if (arg == "--index") {
+			index_path = argv[++i];
+		}
+		else if (arg == "-s" || arg == "--search") {
+			search_mode = true;
+		}
+		else if (arg == "-k" || arg == "--topk") {
+			topk = atoi(argv[++i]);
+		}
+		else if (arg == "-w" || arg == "--workers") {
+			workers = atoi(argv[++i]);
+		}
+		else if (arg == "--window") {
+			std::string mode = argv[++i];
+			if (mode == "random") {
+				window_config.mode = WINDOW_RANDOM;
+			}
+			else if (mode == "even") {
+				window_config.mode = WINDOW_EVEN;
+			}
+			else if (mode == "energy") {
+				window_config.mode = WINDOW_ENERGY;
+			}
+			else if (mode == "sliding") {
+				window_config.mode = WINDOW_SLIDING;
+			}
+			else {
+				print_usage();
+				print_error(mode);
+				return -1;
+			}
+		}
+		else if (arg == "--seed") {
+			window_config.seed = atoi(argv[++i]);
+		}
+		else if (arg == "--overlap") {
+			window_config.overlap = atof(argv[++i]);
+		}
+		else if (arg == "--max_windows") {
+			window_config.max_windows = atoi(argv[++i]);
+		}
+		else if (arg == "--pooling") {
+			window_config.pooling = argv[++i];
+			if (window_config.pooling != "mean" && window_config.pooling != "max") {
+				print_usage();
+				print_error(window_config.pooling);
+				return -1;
+			}
+		}
 		else {
 			print_usage();
 			print_error(arg);
@@ -173,7 +255,76 @@ static float cos_sim(float* a, float* b, size_t len)
 // ======================
 // Audio embeddings
 // ======================
-static std::vector<float> audio_embedding(AILIANetwork *ailia_audio, std::string wav_file)
+static int encode_audio_windows(AILIANetwork *ailia_audio, unsigned int blob_idx_longer, unsigned int blob_idx_mel_fusion,
+    unsigned int blob_idx_out0, const AILIAShape& item_shape, const float* mel_fusion, int batch,
+    std::vector<float>& embeddings, int* dim)
+{
+    int status;
+    AILIAShape shape;
+
+    AILIAShape longer_shape;
+    status = ailiaGetBlobShape(ailia_audio, &longer_shape, blob_idx_longer, AILIA_SHAPE_VERSION);
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("ailiaGetBlobShape failed %d\n", status);
+        return status;
+    }
+    if (batch > 1) {
+        shape = item_shape;
+        shape.w = batch;
+        shape.dim = 4;
+        status = ailiaSetInputBlobShape(ailia_audio, &shape, blob_idx_mel_fusion, AILIA_SHAPE_VERSION);
+        if (status != AILIA_STATUS_SUCCESS) {
+            return status;
+        }
+        shape.x = batch;
+        shape.y = 1;
+        shape.z = 1;
+        shape.w = 1;
+        shape.dim = 1;
+        status = ailiaSetInputBlobShape(ailia_audio, &shape, blob_idx_longer, AILIA_SHAPE_VERSION);
+        if (status != AILIA_STATUS_SUCCESS) {
+            ailiaSetInputBlobShape(ailia_audio, &item_shape, blob_idx_mel_fusion, AILIA_SHAPE_VERSION);
+            return status;
+        }
+    }
+
+	// set input
+    std::vector<float> longer(batch, 1);   // True, as the single window input
+	status = ailiaSetInputBlobData(ailia_audio, &longer[0], longer.size() * sizeof(float), blob_idx_longer);
+    if (status == AILIA_STATUS_SUCCESS) {
+        status = ailiaSetInputBlobData(ailia_audio, mel_fusion, (size_t)batch * item_shape.x * item_shape.y * item_shape.z * sizeof(float), blob_idx_mel_fusion);
+    }
+    if (status == AILIA_STATUS_SUCCESS) {
+        status = ailiaUpdate(ailia_audio);
+    }
+    if (status == AILIA_STATUS_SUCCESS) {
+        status = ailiaGetBlobShape(ailia_audio, &shape, blob_idx_out0, AILIA_SHAPE_VERSION);
+    }
+    if (status == AILIA_STATUS_SUCCESS && shape.y * shape.z * shape.w != batch) {
+        status = AILIA_STATUS_INVALID_ARGUMENT;
+    }
+    if (status == AILIA_STATUS_SUCCESS) {
+        if(debug){
+            PRINT_OUT("audio output shape=[%d,%d]\n", shape.y, shape.x);
+        }
+        size_t offset = embeddings.size();
+        embeddings.resize(offset + (size_t)batch * shape.x);
+        status = ailiaGetBlobData(ailia_audio, &embeddings[offset], (size_t)batch * shape.x * sizeof(float), blob_idx_out0);
+        *dim = shape.x;
+    }
+    if (status != AILIA_STATUS_SUCCESS && batch == 1) {
+        PRINT_ERR("audio encoder failed %d\n", status);
+    }
+
+    // back to the single window shapes
+    if (batch > 1) {
+        ailiaSetInputBlobShape(ailia_audio, &item_shape, blob_idx_mel_fusion, AILIA_SHAPE_VERSION);
+        ailiaSetInputBlobShape(ailia_audio, &longer_shape, blob_idx_longer, AILIA_SHAPE_VERSION);
+    }
+    return status;
+}
+
+static std::vector<float> audio_embedding(AILIANetwork *ailia_audio, std::string wav_file, float* duration=NULL)
 {
     int status;
     std::vector<float> feature;
@@ -181,6 +332,11 @@ static std::vector<float> audio_embedding(AILIANetwork *ailia_audio, std::string
     const int target_sample_rate = 48000;
     int sampleRate=0, nChannels=0, nSamples=0;
     std::vector<float> audio_waveform = read_wave_file(wav_file.c_str(), &sampleRate, &nChannels, &nSamples);
+    if(audio_waveform.size() == 0){
+        PRINT_ERR("read_wave_file failed : %s\n", wav_file.c_str());
+        return feature;
+    }
+    if(duration) *duration = (float)nSamples / sampleRate;
     if (debug){
         PRINT_OUT("wav sampleRate=%d, nChannels=%d, nSamples=%d : %s\n", sampleRate, nChannels, nSamples, wav_file.c_str());
     }
@@ -215,7 +371,8 @@ static std::vector<float> audio_embedding(AILIANetwork *ailia_audio, std::string
     }
     
     AUDIO_CONFIG audio_config;
-    std::vector<float> mel_fusion = get_audio_features(audio_waveform, 480000, "fusion", "repeatpad", audio_config);
+    const unsigned int max_len = 480000;
+    int window_n = get_audio_window_count(audio_waveform.size(), max_len, window_config);
     
     AILIAShape shape;
 	unsigned int blob_idx_longer, blob_idx_mel_fusion, blob_idx_out0;
@@ -242,49 +399,54 @@ static std::vector<float> audio_embedding(AILIANetwork *ailia_audio, std::string
         return feature;
     }
     if(debug){
-        PRINT_OUT("audio input=%d,%d output=%d mel_fusion shape=[%d,%d,%d]\n", blob_idx_longer, blob_idx_mel_fusion, blob_idx_out0, shape.z, shape.y, shape.x);
-    }
-    if(mel_fusion.size() != (shape.x * shape.y * shape.z)){
-        PRINT_ERR("Invalid length of mel_fusion : %ld must be %d\n", mel_fusion.size(), shape.x * shape.y * shape.z);
-        return feature;
-    }
-
-	// set input
-    float longer = 1;   // True
-	status = ailiaSetInputBlobData(ailia_audio, &longer, sizeof(longer), blob_idx_longer);
-    if (status != AILIA_STATUS_SUCCESS) {
-        PRINT_ERR("ailiaSetInputBlobData failed %d\n", status);
-        return feature;
-    }
-	status = ailiaSetInputBlobData(ailia_audio, &mel_fusion[0], mel_fusion.size() * sizeof(float), blob_idx_mel_fusion);
-    if (status != AILIA_STATUS_SUCCESS) {
-        PRINT_ERR("ailiaSetInputBlobData failed %d\n", status);
-        return feature;
-    }
-
-	// predict ailia_text_robertamodel
-	status = ailiaUpdate(ailia_audio);
-    if (status != AILIA_STATUS_SUCCESS) {
-        PRINT_ERR("ailiaUpdate failed %d\n", status);
-        return feature;
-    }
-	status = ailiaGetBlobShape(ailia_audio, &shape, blob_idx_out0, AILIA_SHAPE_VERSION);
-    if (status != AILIA_STATUS_SUCCESS) {
-        PRINT_ERR("ailiaGetBlobShape failed %d\n", status);
-        return feature;
-    }
-    if(debug){
-        PRINT_OUT("audio output shape=[%d,%d]\n", shape.y, shape.x);
-    }
+        PRINT_OUT("audio input=%d,%d output=%d mel_fusion shape=[%d,%d,%d] windows=%d\n", blob_idx_longer, blob_idx_mel_fusion, blob_idx_out0, shape.z, shape.y, shape.x, window_n);
+    }
+
+    // the sliding windows of long audio are scheduled, encoded and pooled chunk by chunk so that the memory
+    // does not grow with the audio length
+    int chunk_n = (window_config.mode == WINDOW_SLIDING) ? std::max(1, window_config.chunk_windows) : window_n;
+    WINDOW_POOLING pooling(window_config.pooling);
+    bool batch_supported = true;
+    for(int first = 0; first < window_n; first += chunk_n){
+        AUDIO_WINDOWS windows;
+        if(get_audio_windows(audio_waveform, max_len, audio_config, window_config, windows, first, chunk_n) != 0){
+            PRINT_ERR("get_audio_windows failed : %s\n", wav_file.c_str());
+            return feature;
+        }
+        if(windows.item_size != (shape.x * shape.y * shape.z)){
+            PRINT_ERR("Invalid length of mel_fusion : %d must be %d\n", windows.item_size, shape.x * shape.y * shape.z);
+            return feature;
+        }
 
-	// get output
-	feature = std::vector<float>(shape.x);
-	status = ailiaGetBlobData(ailia_audio, &feature[0], feature.size() * sizeof(float), blob_idx_out0);
-    if (status != AILIA_STATUS_SUCCESS) {
-        PRINT_ERR("ailiaGetBlobData failed %d\n", status);
-        return feature;
+        // all windows of the chunk in one inference, one inference per window when the model has a fixed batch size
+        std::vector<float> embeddings;
+        int dim = 0;
+        status = AILIA_STATUS_INVALID_ARGUMENT;
+        if (batch_supported || windows.batch == 1) {
+            status = encode_audio_windows(ailia_audio, blob_idx_longer, blob_idx_mel_fusion, blob_idx_out0, shape,
+                &windows.mel_fusion[0], windows.batch, embeddings, &dim);
+        }
+        if (status != AILIA_STATUS_SUCCESS && windows.batch > 1) {
+            if(debug && batch_supported){
+                PRINT_OUT("batched inference failed, encode the windows one by one\n");
+            }
+            batch_supported = false;
+            embeddings.clear();
+            for(int b = 0; b < windows.batch; b++){
+                status = encode_audio_windows(ailia_audio, blob_idx_longer, blob_idx_mel_fusion, blob_idx_out0, shape,
+                    &windows.mel_fusion[(size_t)b * windows.item_size], 1, embeddings, &dim);
+                if (status != AILIA_STATUS_SUCCESS) {
+                    break;
+                }
+            }
+        }
+        if (status != AILIA_STATUS_SUCCESS) {
+            return feature;
+        }
+        pooling.add(&embeddings[0], windows.batch, dim);
     }
 
+    feature = pooling.result();
     return feature;
 }
 
@@ -495,8 +657,9 @@ static int get_env_id(void)
     return env_id;
 }
 
-static int initialize_ailia(AILIANetwork **ailia, int env_id, std::string model_file, std::string weight_file){
-    int status = ailiaCreate(ailia, env_id, AILIA_MULTITHREAD_AUTO);
+static int initialize_ailia(AILIANetwork **ailia, int env_id, std::string model_file, std::string weight_file,
+    int num_thread=AILIA_MULTITHREAD_AUTO){
+    int status = ailiaCreate(ailia, env_id, num_thread);
     if (status != AILIA_STATUS_SUCCESS) {
         PRINT_ERR("ailiaCreate failed %d\n", status);
         return -1;
@@ -517,6 +680,57 @@ static int initialize_ailia(AILIANetwork **ailia, int env_id, std::string model_
     return AILIA_STATUS_SUCCESS;
 }
 
+static int build_index(int env_id)
+{
+    std::vector<std::string> files;
+    list_wave_files(build_dir, files);
+    if(files.size() == 0){
+        PRINT_ERR("no wav file found in %s\n", build_dir.c_str());
+        return -1;
+    }
+
+    // one audio encoder per worker, the cores are shared between them
+    int cores = std::max(1, (int)std::thread::hardware_concurrency());
+    int worker_n = (workers > 0) ? workers : std::max(1, cores / 4);
+    worker_n = std::min(worker_n, (int)files.size());
+    int num_thread = std::max(1, cores / worker_n);
+    std::vector<AILIANetwork *> ailia_audios;
+    for(int i = 0; i < worker_n; i++){
+        AILIANetwork *ailia_audio;
+        int status = initialize_ailia(&ailia_audio, env_id, model_audio, weight_audio, num_thread);
+        if (status != AILIA_STATUS_SUCCESS) {
+            for(size_t j = 0; j < ailia_audios.size(); j++){
+                ailiaDestroy(ailia_audios[j]);
+            }
+            return -1;
+        }
+        ailia_audios.push_back(ailia_audio);
+    }
+
+    ClapEmbedJob job = [&](int worker_id, const std::string& path, std::vector<float>& feature, float& duration){
+        feature = audio_embedding(ailia_audios[worker_id], path, &duration);
+        return (feature.size() > 0) ? AILIA_STATUS_SUCCESS : -1;
+    };
+    int status = build_clap_index(files, worker_n, job, index_path);
+
+    for(size_t i = 0; i < ailia_audios.size(); i++){
+        ailiaDestroy(ailia_audios[i]);
+    }
+    return status;
+}
+
+static void search_index(const ClapIndex& index, const std::vector<float>& text_features, unsigned int dim_text_feature)
+{
+    std::vector<ClapSearchResult> results;
+    for (int i = 0; i < texts.size(); i++){
+        PRINT_OUT("===== search : %s =====\n", texts[i].c_str());
+        index.search(&text_features[i * dim_text_feature], topk, results);
+        for (size_t j = 0; j < results.size(); j++){
+            PRINT_OUT("cossim=%.4f, duration=%.2f, audio=%s\n", results[j].score, index.duration(results[j].index), index.path(results[j].index));
+        }
+    }
+}
+
 int main(int argc, char **argv)
 {
     int status = argument_parser(argc, argv);
@@ -527,11 +741,33 @@ int main(int argc, char **argv)
 	// env list
     int env_id = get_env_id();
 
+    if (build_dir != ""){
+        status = build_index(env_id);
+        if (status != AILIA_STATUS_SUCCESS) {
+            return -1;
+        }
+        PRINT_OUT("Program finished successfully.\n");
+        return status;
+    }
+
+    // the search mode only needs the text encoder and the index
+    ClapIndex index;
+    if (search_mode){
+        status = index.open(index_path);
+        if (status != AILIA_STATUS_SUCCESS) {
+            PRINT_ERR("index open failed %s\n", index_path.c_str());
+            return -1;
+        }
+        PRINT_OUT("index %s entries %d\n", index_path.c_str(), index.size());
+    }
+
     // net initialize
-    AILIANetwork *ailia_audio;
-    status = initialize_ailia(&ailia_audio, env_id, model_audio, weight_audio);
-    if (status != AILIA_STATUS_SUCCESS) {
-        return -1;
+    AILIANetwork *ailia_audio = NULL;
+    if (!search_mode){
+        status = initialize_ailia(&ailia_audio, env_id, model_audio, weight_audio);
+        if (status != AILIA_STATUS_SUCCESS) {
+            return -1;
+        }
     }
     AILIANetwork *ailia_text_robertamodel;
     status = initialize_ailia(&ailia_text_robertamodel, env_id, model_text_robertamodel, weight_text_robertamodel);
@@ -593,6 +829,18 @@ int main(int argc, char **argv)
     std::vector<float> text_features = text_embedding(ailia_text_robertamodel, ailia_text_projection, 
 		ary_input_ids, ary_attention_mask, &dim_text_feature, num_texts, token_length);
 
+    if (search_mode){
+        if (dim_text_feature == 0 || dim_text_feature != index.dim()){
+            PRINT_ERR("text feature dim %d does not match index dim %d\n", dim_text_feature, index.dim());
+            return -1;
+        }
+        search_index(index, text_features, dim_text_feature);
+        ailiaDestroy(ailia_text_robertamodel);
+        ailiaDestroy(ailia_text_projection);
+        PRINT_OUT("Program finished successfully.\n");
+        return status;
+    }
+
     // audio embedding
     PRINT_OUT("Audio embedding...\n");
     std::vector<float> audio_feature = audio_embedding(ailia_audio, input_wav_path);
@@ -0,0 +1,610 @@
+/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA clap audio embedding index
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include <algorithm>
+#include <queue>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#if defined(_WIN32) || defined(_WIN64)
+#define NOMINMAX
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "ailia.h"
+#include "clap_utils.h"
+#include "clap_index.h"
+
+// lanes of the dot product accumulators, written so that the compiler keeps them in one vector register
+#define DOT_LANES 8
+
+static const char INDEX_MAGIC[8] = {'C', 'L', 'A', 'P', 'I', 'D', 'X', '2'};
+static const char JOURNAL_MAGIC[8] = {'C', 'L', 'A', 'P', 'J', 'N', 'L', '1'};
+static const int INDEX_ALIGN = 64;
+
+struct ClapIndexHeader {
+    char magic[8];
+    int32_t dim;
+    int32_t count;
+    int64_t vector_offset;
+    int64_t meta_offset;
+    int64_t string_offset;
+    int64_t string_size;
+};
+
+struct ClapIndexMeta {
+    int64_t path_offset;
+    int64_t file_size;      // size and modification time of the audio file when it was embedded
+    int64_t file_time;
+    float duration;
+    int32_t reserved;
+};
+
+// journal record, followed by the path and the feature
+struct ClapJournalRecord {
+    int32_t path_size;
+    int32_t dim;
+    int64_t file_size;
+    int64_t file_time;
+    float duration;
+    int32_t reserved;
+};
+
+struct ClapIndexEntry {
+    std::string path;
+    int64_t file_size;
+    int64_t file_time;
+    float duration;
+    std::vector<float> feature;
+};
+
+// ======================
+// Directory walk
+// ======================
+
+static bool is_wave_file(const std::string& name)
+{
+    if(name.size() < 4) return false;
+    std::string ext = name.substr(name.size() - 4);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".wav";
+}
+
+static void walk_directory(const std::string& dir, std::vector<std::string>& files)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    WIN32_FIND_DATAA data;
+    HANDLE handle = FindFirstFileA((dir + "\\*").c_str(), &data);
+    if(handle == INVALID_HANDLE_VALUE) return;
+    do{
+        std::string name = data.cFileName;
+        if(name == "." || name == "..") continue;
+        std::string path = dir + "/" + name;
+        if(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY){
+            walk_directory(path, files);
+        }
+        else if(is_wave_file(name)){
+            files.push_back(path);
+        }
+    }while(FindNextFileA(handle, &data));
+    FindClose(handle);
+#else
+    DIR* d = opendir(dir.c_str());
+    if(d == NULL) return;
+    struct dirent* entry;
+    while((entry = readdir(d)) != NULL){
+        std::string name = entry->d_name;
+        if(name == "." || name == "..") continue;
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0) continue;
+        if(S_ISDIR(st.st_mode)){
+            walk_directory(path, files);
+        }
+        else if(is_wave_file(name)){
+            files.push_back(path);
+        }
+    }
+    closedir(d);
+#endif
+}
+
+int list_wave_files(const std::string& dir, std::vector<std::string>& files)
+{
+    std::string root = dir;
+    while(root.size() > 1 && (root[root.size() - 1] == '/' || root[root.size() - 1] == '\\')){
+        root.erase(root.size() - 1);
+    }
+    files.clear();
+    walk_directory(root, files);
+    std::sort(files.begin(), files.end());
+    return AILIA_STATUS_SUCCESS;
+}
+
+// ======================
+// Index reader
+// ======================
+
+ClapIndex::ClapIndex()
+    : file(NULL), mapping(NULL), base(NULL), length(0), count(0), dimension(0), vectors(NULL)
+{
+}
+
+ClapIndex::~ClapIndex()
+{
+    close();
+}
+
+int ClapIndex::open(const std::string& path)
+{
+    close();
+
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE h = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(h == INVALID_HANDLE_VALUE){
+        return AILIA_STATUS_ERROR_FILE_API;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(h, &size);
+    HANDLE m = CreateFileMappingA(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(m == NULL){
+        CloseHandle(h);
+        return AILIA_STATUS_ERROR_FILE_API;
+    }
+    base = (const unsigned char*)MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    file = h;
+    mapping = m;
+    length = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        return AILIA_STATUS_ERROR_FILE_API;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    length = st.st_size;
+    void* p = (length > 0) ? mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    base = (p == MAP_FAILED) ? NULL : (const unsigned char*)p;
+#endif
+    if(base == NULL){
+        close();
+        return AILIA_STATUS_ERROR_FILE_API;
+    }
+
+    const ClapIndexHeader* header = (const ClapIndexHeader*)base;
+    if(length < sizeof(ClapIndexHeader) || memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+        header->dim <= 0 || header->count < 0 ||
+        header->vector_offset < (int64_t)sizeof(ClapIndexHeader) || header->meta_offset < 0 ||
+        header->string_offset < 0 || header->string_size < 0 ||
+        header->vector_offset + (int64_t)header->count * header->dim * (int64_t)sizeof(float) > (int64_t)length ||
+        header->meta_offset + (int64_t)header->count * (int64_t)sizeof(ClapIndexMeta) > (int64_t)length ||
+        header->string_offset + header->string_size > (int64_t)length){
+        PRINT_ERR("\'%s\' is not a clap index\n", path.c_str());
+        close();
+        return AILIA_STATUS_INVALID_ARGUMENT;
+    }
+
+    // every path must be a NUL terminated string inside the string section, path() reads them unchecked
+    const ClapIndexMeta* meta = (const ClapIndexMeta*)(base + header->meta_offset);
+    const char* strings = (const char*)(base + header->string_offset);
+    for(int i=0; i<header->count; i++){
+        if(meta[i].path_offset < 0 || meta[i].path_offset >= header->string_size ||
+            memchr(strings + meta[i].path_offset, 0, (size_t)(header->string_size - meta[i].path_offset)) == NULL){
+            PRINT_ERR("\'%s\' is broken\n", path.c_str());
+            close();
+            return AILIA_STATUS_INVALID_ARGUMENT;
+        }
+    }
+    count = header->count;
+    dimension = header->dim;
+    vectors = (const float*)(base + header->vector_offset);
+    return AILIA_STATUS_SUCCESS;
+}
+
+void ClapIndex::close()
+{
+#if defined(_WIN32) || defined(_WIN64)
+    if(base) UnmapViewOfFile(base);
+    if(mapping) CloseHandle((HANDLE)mapping);
+    if(file) CloseHandle((HANDLE)file);
+#else
+    if(base) munmap((void*)base, length);
+#endif
+    file = NULL;
+    mapping = NULL;
+    base = NULL;
+    length = 0;
+    count = 0;
+    dimension = 0;
+    vectors = NULL;
+}
+
+const char* ClapIndex::path(int i) const
+{
+    const ClapIndexHeader* header = (const ClapIndexHeader*)base;
+    const ClapIndexMeta* meta = (const ClapIndexMeta*)(base + header->meta_offset);
+    return (const char*)(base + header->string_offset + meta[i].path_offset);
+}
+
+float ClapIndex::duration(int i) const
+{
+    const ClapIndexHeader* header = (const ClapIndexHeader*)base;
+    const ClapIndexMeta* meta = (const ClapIndexMeta*)(base + header->meta_offset);
+    return meta[i].duration;
+}
+
+int64_t ClapIndex::file_size(int i) const
+{
+    const ClapIndexHeader* header = (const ClapIndexHeader*)base;
+    const ClapIndexMeta* meta = (const ClapIndexMeta*)(base + header->meta_offset);
+    return meta[i].file_size;
+}
+
+int64_t ClapIndex::file_time(int i) const
+{
+    const ClapIndexHeader* header = (const ClapIndexHeader*)base;
+    const ClapIndexMeta* meta = (const ClapIndexMeta*)(base + header->meta_offset);
+    return meta[i].file_time;
+}
+
+static inline float dot(const float* a, const float* b, int n)
+{
+    float lanes[DOT_LANES] = {0};
+    int i = 0;
+    for(; i + DOT_LANES <= n; i += DOT_LANES){
+        for(int k=0; k<DOT_LANES; k++){
+            lanes[k] += a[i + k] * b[i + k];
+        }
+    }
+    float sum = 0;
+    for(; i < n; i++){
+        sum += a[i] * b[i];
+    }
+    for(int k=0; k<DOT_LANES; k++){
+        sum += lanes[k];
+    }
+    return sum;
+}
+
+static void normalize(float* v, int n)
+{
+    float norm = sqrtf(dot(v, v, n));
+    if(norm <= 0) return;
+    for(int i=0; i<n; i++){
+        v[i] /= norm;
+    }
+}
+
+struct ResultGreater {
+    bool operator()(const ClapSearchResult& a, const ClapSearchResult& b) const {
+        return a.score > b.score || (a.score == b.score && a.index < b.index);
+    }
+};
+
+void ClapIndex::search(const float* query, int k, std::vector<ClapSearchResult>& results) const
+{
+    results.clear();
+    if(count == 0 || k <= 0) return;
+
+    std::vector<float> q(query, query + dimension);
+    normalize(&q[0], dimension);
+
+    // min heap of the best k, the worst kept score is on top
+    std::priority_queue<ClapSearchResult, std::vector<ClapSearchResult>, ResultGreater> heap;
+    for(int i=0; i<count; i++){
+        ClapSearchResult r = {i, dot(vector(i), &q[0], dimension)};
+        if((int)heap.size() < k){
+            heap.push(r);
+        }
+        else if(ResultGreater()(r, heap.top())){
+            heap.pop();
+            heap.push(r);
+        }
+    }
+    while(!heap.empty()){
+        results.push_back(heap.top());
+        heap.pop();
+    }
+    std::reverse(results.begin(), results.end());
+}
+
+// ======================
+// Index writer
+// ======================
+
+static int64_t align_offset(int64_t offset)
+{
+    return (offset + INDEX_ALIGN - 1) / INDEX_ALIGN * INDEX_ALIGN;
+}
+
+static bool write_at(FILE* fp, int64_t offset, const void* data, size_t size)
+{
+    // fill the alignment gap
+    static const char zero[INDEX_ALIGN] = {0};
+    long pos = ftell(fp);
+    if(pos < 0 || pos > offset) return false;
+    if(offset > pos && fwrite(zero, 1, (size_t)(offset - pos), fp) != (size_t)(offset - pos)) return false;
+    return size == 0 || fwrite(data, 1, size, fp) == size;
+}
+
+static int write_index(const std::string& index_path, const std::vector<ClapIndexEntry>& entries, int dim)
+{
+    ClapIndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.dim = dim;
+    header.count = (int32_t)entries.size();
+
+    std::string strings;
+    std::vector<ClapIndexMeta> meta(entries.size());
+    for(size_t i=0; i<entries.size(); i++){
+        meta[i].path_offset = strings.size();
+        meta[i].file_size = entries[i].file_size;
+        meta[i].file_time = entries[i].file_time;
+        meta[i].duration = entries[i].duration;
+        meta[i].reserved = 0;
+        strings += entries[i].path;
+        strings += '\0';
+    }
+    header.vector_offset = align_offset(sizeof(ClapIndexHeader));
+    header.meta_offset = align_offset(header.vector_offset + (int64_t)entries.size() * dim * sizeof(float));
+    header.string_offset = header.meta_offset + (int64_t)meta.size() * sizeof(ClapIndexMeta);
+    header.string_size = strings.size();
+
+    // written to a temporary file first so that an interrupted build keeps the previous index
+    std::string tmp_path = index_path + ".tmp";
+    FILE* fp = fopen(tmp_path.c_str(), "wb");
+    if(fp == NULL){
+        PRINT_ERR("\'%s\' open failed\n", tmp_path.c_str());
+        return AILIA_STATUS_ERROR_FILE_API;
+    }
+    bool success = write_at(fp, 0, &header, sizeof(header));
+    for(size_t i=0; success && i<entries.size(); i++){
+        int64_t offset = header.vector_offset + (int64_t)i * dim * sizeof(float);
+        success = write_at(fp, offset, &entries[i].feature[0], dim * sizeof(float));
+    }
+    success = success && write_at(fp, header.meta_offset, meta.empty() ? NULL : &meta[0], meta.size() * sizeof(ClapIndexMeta));
+    success = success && write_at(fp, header.string_offset, strings.data(), strings.size());
+    success = (fclose(fp) == 0) && success;
+
+    remove(index_path.c_str());
+    if(!success || rename(tmp_path.c_str(), index_path.c_str()) != 0){
+        PRINT_ERR("\'%s\' write failed\n", index_path.c_str());
+        remove(tmp_path.c_str());
+        return AILIA_STATUS_ERROR_FILE_API;
+    }
+    return AILIA_STATUS_SUCCESS;
+}
+
+// size and modification time of a file, false when it can not be read
+static bool file_stamp(const std::string& path, int64_t& size, int64_t& time)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    struct _stat64 st;
+    if(_stat64(path.c_str(), &st) != 0) return false;
+#else
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0) return false;
+#endif
+    size = st.st_size;
+    time = st.st_mtime;
+    return true;
+}
+
+static int append_journal(const std::string& journal_path, const std::vector<ClapIndexEntry>& entries)
+{
+    FILE* fp = fopen(journal_path.c_str(), "ab");
+    if(fp == NULL){
+        PRINT_ERR("\'%s\' open failed\n", journal_path.c_str());
+        return AILIA_STATUS_ERROR_FILE_API;
+    }
+    bool success = fseek(fp, 0, SEEK_END) == 0;
+    if(success && ftell(fp) == 0){
+        success = fwrite(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC), 1, fp) == 1;
+    }
+    for(size_t i=0; success && i<entries.size(); i++){
+        ClapJournalRecord record;
+        record.path_size = (int32_t)entries[i].path.size();
+        record.dim = (int32_t)entries[i].feature.size();
+        record.file_size = entries[i].file_size;
+        record.file_time = entries[i].file_time;
+        record.duration = entries[i].duration;
+        record.reserved = 0;
+        success = fwrite(&record, sizeof(record), 1, fp) == 1;
+        success = success && fwrite(entries[i].path.data(), 1, entries[i].path.size(), fp) == entries[i].path.size();
+        success = success && fwrite(&entries[i].feature[0], sizeof(float), entries[i].feature.size(), fp) == entries[i].feature.size();
+    }
+    success = (fclose(fp) == 0) && success;
+    if(!success){
+        PRINT_ERR("\'%s\' write failed\n", journal_path.c_str());
+        return AILIA_STATUS_ERROR_FILE_API;
+    }
+    return AILIA_STATUS_SUCCESS;
+}
+
+// entries of the journal of an interrupted build, a record cut by the interruption ends the journal
+static void read_journal(const std::string& journal_path, int& dim, std::map<std::string, ClapIndexEntry>& entries)
+{
+    FILE* fp = fopen(journal_path.c_str(), "rb");
+    if(fp == NULL) return;
+    char magic[sizeof(JOURNAL_MAGIC)];
+    if(fread(magic, sizeof(magic), 1, fp) != 1 || memcmp(magic, JOURNAL_MAGIC, sizeof(magic)) != 0){
+        fclose(fp);
+        return;
+    }
+    ClapJournalRecord record;
+    while(fread(&record, sizeof(record), 1, fp) == 1){
+        if(record.path_size <= 0 || record.path_size > (1 << 16) || record.dim <= 0 || (dim != 0 && record.dim != dim)){
+            break;
+        }
+        ClapIndexEntry entry;
+        entry.path.resize(record.path_size);
+        entry.feature.resize(record.dim);
+        if(fread(&entry.path[0], 1, record.path_size, fp) != (size_t)record.path_size ||
+            fread(&entry.feature[0], sizeof(float), record.dim, fp) != (size_t)record.dim){
+            break;
+        }
+        entry.file_size = record.file_size;
+        entry.file_time = record.file_time;
+        entry.duration = record.duration;
+        dim = record.dim;
+        entries[entry.path] = entry;
+    }
+    fclose(fp);
+}
+
+int build_clap_index(const std::vector<std::string>& files, int worker_n, const ClapEmbedJob& job,
+    const std::string& index_path, int checkpoint_n)
+{
+    // reuse the entries of the existing index and of the journal of an interrupted build, a file whose size or
+    // modification time changed is embedded again
+    std::string journal_path = index_path + ".journal";
+    std::vector<ClapIndexEntry> entries;
+    std::vector<std::string> pending;
+    int dim = 0;
+    {
+        ClapIndex index;
+        std::map<std::string, int> indexed;
+        if(index.open(index_path) == AILIA_STATUS_SUCCESS){
+            dim = index.dim();
+            for(int i=0; i<index.size(); i++){
+                indexed[index.path(i)] = i;
+            }
+        }
+        std::map<std::string, ClapIndexEntry> journal;
+        read_journal(journal_path, dim, journal);
+
+        for(size_t i=0; i<files.size(); i++){
+            int64_t size = -1, time = -1;
+            file_stamp(files[i], size, time);
+            std::map<std::string, ClapIndexEntry>::iterator jt = journal.find(files[i]);
+            if(jt != journal.end() && jt->second.file_size == size && jt->second.file_time == time){
+                entries.push_back(jt->second);
+                continue;
+            }
+            std::map<std::string, int>::iterator it = indexed.find(files[i]);
+            if(it != indexed.end() && index.file_size(it->second) == size && index.file_time(it->second) == time){
+                ClapIndexEntry entry;
+                entry.path = files[i];
+                entry.file_size = size;
+                entry.file_time = time;
+                entry.duration = index.duration(it->second);
+                entry.feature.assign(index.vector(it->second), index.vector(it->second) + dim);
+                entries.push_back(entry);
+                continue;
+            }
+            pending.push_back(files[i]);
+        }
+    }
+    worker_n = std::max(1, std::min(worker_n, (int)pending.size()));
+    PRINT_OUT("index files %d (reuse %d) workers %d\n", (int)pending.size(), (int)entries.size(), worker_n);
+
+    std::atomic<int> next(0);
+    std::atomic<int> failed(0);
+    int done = 0;
+    int journal_status = AILIA_STATUS_SUCCESS;
+    std::vector<ClapIndexEntry> unsaved;    // embedded since the last checkpoint
+    std::mutex entries_mutex;
+    std::mutex journal_mutex;
+
+    auto worker = [&](int worker_id){
+        while(true){
+            int idx = next++;
+            if(idx >= (int)pending.size()){
+                break;
+            }
+            // stamped before the embedding, a file modified meanwhile is embedded again by the next build
+            ClapIndexEntry entry;
+            entry.path = pending[idx];
+            entry.file_size = -1;
+            entry.file_time = -1;
+            entry.duration = 0;
+            file_stamp(entry.path, entry.file_size, entry.file_time);
+            int status = job(worker_id, entry.path, entry.feature, entry.duration);
+
+            std::vector<ClapIndexEntry> checkpoint;
+            int checkpoint_done = 0;
+            {
+                std::lock_guard<std::mutex> lock(entries_mutex);
+                if(status != AILIA_STATUS_SUCCESS || entry.feature.size() == 0 || (dim != 0 && (int)entry.feature.size() != dim)){
+                    failed++;
+                    PRINT_ERR("[%d/%d] %s failed\n", ++done, (int)pending.size(), entry.path.c_str());
+                    continue;
+                }
+                dim = entry.feature.size();
+                normalize(&entry.feature[0], dim);
+                entries.push_back(entry);
+                ++done;
+                if(checkpoint_n > 0){
+                    unsaved.push_back(entry);
+                    if((int)unsaved.size() >= checkpoint_n){
+                        checkpoint.swap(unsaved);
+                        checkpoint_done = done;
+                    }
+                }
+            }
+
+            // only the new entries are appended, outside of the entries lock so that the other workers go on
+            if(!checkpoint.empty()){
+                std::lock_guard<std::mutex> lock(journal_mutex);
+                status = append_journal(journal_path, checkpoint);
+                if(status != AILIA_STATUS_SUCCESS && journal_status == AILIA_STATUS_SUCCESS){
+                    journal_status = status;
+                }
+                PRINT_OUT("[%d/%d] checkpoint\n", checkpoint_done, (int)pending.size());
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for(int i=0; i<worker_n; i++){
+        threads.push_back(std::thread(worker, i));
+    }
+    for(size_t i=0; i<threads.size(); i++){
+        threads[i].join();
+    }
+
+    if(dim == 0){
+        PRINT_ERR("no audio embedded\n");
+        return -1;
+    }
+    std::sort(entries.begin(), entries.end(), [](const ClapIndexEntry& a, const ClapIndexEntry& b){ return a.path < b.path; });
+    int status = write_index(index_path, entries, dim);
+    if(status != AILIA_STATUS_SUCCESS){
+        // the journal keeps the embedded files for the next build
+        if(!unsaved.empty()){
+            append_journal(journal_path, unsaved);
+        }
+        return status;
+    }
+    remove(journal_path.c_str());
+    PRINT_OUT("index %s entries %d dim %d\n", index_path.c_str(), (int)entries.size(), dim);
+    if(journal_status != AILIA_STATUS_SUCCESS){
+        PRINT_ERR("checkpoints were not saved, the index was written at the end\n");
+    }
+    if(failed > 0){
+        PRINT_ERR("%d files failed\n", (int)failed);
+    }
+    return AILIA_STATUS_SUCCESS;
+}
@@ -0,0 +1,67 @@
+/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA clap audio embedding index
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+// Embed one audio file on the given worker, returns AILIA_STATUS_SUCCESS on success
+typedef std::function<int(int worker_id, const std::string& path, std::vector<float>& feature, float& duration)> ClapEmbedJob;
+
+struct ClapSearchResult {
+    int index;
+    float score;
+};
+
+// Collect the .wav files under dir recursively, sorted by path
+int list_wave_files(const std::string& dir, std::vector<std::string>& files);
+
+// Memory mapped index file, normalized float vectors followed by the metadata
+//   header | vectors[count][dim] (64 byte aligned) | meta[count] | path strings
+// The metadata records the size and modification time of each audio file so that a re-encoded file is
+// embedded again
+class ClapIndex {
+public:
+    ClapIndex();
+    ~ClapIndex();
+
+    int open(const std::string& path);
+    void close();
+
+    int size() const { return count; }
+    int dim() const { return dimension; }
+    const float* vector(int i) const { return vectors + (size_t)i * dimension; }
+    const char* path(int i) const;
+    float duration(int i) const;
+    int64_t file_size(int i) const;
+    int64_t file_time(int i) const;
+
+    // Top k entries by cosine similarity to the query, sorted by descending score
+    void search(const float* query, int k, std::vector<ClapSearchResult>& results) const;
+
+private:
+    void* file;
+    void* mapping;
+    const unsigned char* base;
+    size_t length;
+    int count;
+    int dimension;
+    const float* vectors;
+};
+
+// Embed the files on worker_n threads and write the index, entries of an existing index at
+// index_path are reused so an interrupted or extended build only embeds the new or modified files.
+// Every checkpoint_n embedded files are appended to index_path.journal, the index itself is written once at
+// the end and the journal is removed
+int build_clap_index(const std::vector<std::string>& files, int worker_n, const ClapEmbedJob& job,
+    const std::string& index_path, int checkpoint_n = 1000);
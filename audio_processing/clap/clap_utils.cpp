@@ -10,6 +10,8 @@
 #include <string.h>
 #include <math.h>
 #include <stdlib.h>
+#include <algorithm>
+#include <random>
 
 #include "clap_utils.h"
 #include "ailia.h"
@@ -119,8 +121,58 @@ static void resize_bilinear(float* dst, int dh, int dw, float* src, int sh, int
     }
 }
 
+// start frame of the local chunk for each third of the candidate positions
+static void select_chunks(const std::vector<float>& mel, int frame_n, int mel_n, int chunk_frames,
+    const WINDOW_CONFIG& window_cfg, int choices[3])
+{
+    int num = frame_n - chunk_frames + 1;
+    int div = std::max(1, (num / 3));
+
+    // window energy from the prefix sum of the frame power
+    std::vector<double> prefix;
+    if(window_cfg.mode == WINDOW_ENERGY){
+        prefix.resize(frame_n + 1, 0);
+        for(int j=0; j<frame_n; j++){
+            double e = 0;
+            for(int i=0; i<mel_n; i++){
+                e += powf(10.0f, mel[j * mel_n + i] / 10.0f);
+            }
+            prefix[j + 1] = prefix[j] + e;
+        }
+    }
+
+    // mt19937 output is specified by the standard, the distributions are not
+    std::mt19937 rng(window_cfg.seed);
+    for(int last=0, i=0; i<3; i++){
+        int first = last;
+        last = std::min(num, first + div);
+        int choice = 0;
+        if(first < last){
+            if(window_cfg.mode == WINDOW_EVEN){
+                choice = first + (last - first) / 2;
+            }
+            else if(window_cfg.mode == WINDOW_ENERGY){
+                choice = first;
+                for(int c=first; c<last; c++){
+                    if(prefix[c + chunk_frames] - prefix[c] > prefix[choice + chunk_frames] - prefix[choice]){
+                        choice = c;
+                    }
+                }
+            }
+            else{
+                choice = first + (int)(rng() % (unsigned int)(last - first));
+            }
+        }
+        if(debug){
+            PRINT_OUT("  choose %d / %d\n", choice, num);
+        }
+        choices[i] = choice;
+    }
+}
+
 std::vector<float> get_audio_features(std::vector<float>& audio_data, unsigned int max_len, 
-    std::string data_truncating, std::string data_filling, const AUDIO_CONFIG& audio_cfg, bool* plonger)
+    std::string data_truncating, std::string data_filling, const AUDIO_CONFIG& audio_cfg, bool* plonger,
+    const WINDOW_CONFIG& window_cfg)
 {
     std::vector<float> mel_fusion;
     if(plonger) *plonger = false;
@@ -150,20 +202,10 @@ std::vector<float> get_audio_features(std::vector<float>& audio_data, unsigned i
                 // split to three parts
                 const int frame_size = chunk_frames * mel_n;
                 mel_fusion = std::vector<float>(frame_size * 4);
-                int num = total_frames - chunk_frames + 1;
-                int div = std::max(1, (num / 3));
-                for(int last=0, i=0; i<3; i++){
-                    int first = last;
-                    last = std::min(num, first + div);
-                    int choice = 0;
-                    if(first < last){
-                        // randomly choose index for each part
-                        choice = first + (rand() % (last - first));
-                    }
-                    if(debug){
-                        PRINT_OUT("  random choose %d / %d\n", choice, num);
-                    }
-                    memcpy(&mel_fusion[i * frame_size], &mel[choice * mel_n], frame_size * sizeof(float));
+                int choices[3];
+                select_chunks(mel, total_frames, mel_n, chunk_frames, window_cfg, choices);
+                for(int i=0; i<3; i++){
+                    memcpy(&mel_fusion[i * frame_size], &mel[choices[i] * mel_n], frame_size * sizeof(float));
                 }
                 // shrink the mel
                 resize_bilinear(&mel_fusion[3 * frame_size], chunk_frames, mel_n, &mel[0], frame_n, mel_n);
@@ -217,3 +259,114 @@ std::vector<float> get_audio_features(std::vector<float>& audio_data, unsigned i
     
     return mel_fusion;
 }
+
+// windows of max_len, the last one ends at the end of the audio, empty when the audio is one item
+static std::vector<size_t> get_window_starts(size_t audio_len, unsigned int max_len, const WINDOW_CONFIG& window_cfg)
+{
+    std::vector<size_t> starts;
+    if(window_cfg.mode == WINDOW_SLIDING && audio_len > max_len){
+        size_t hop = std::max<size_t>(1, (size_t)(max_len * (1.0f - std::min(std::max(window_cfg.overlap, 0.0f), 0.95f))));
+        for(size_t start=0; start + max_len < audio_len; start += hop){
+            starts.push_back(start);
+        }
+        starts.push_back(audio_len - max_len);
+        if(window_cfg.max_windows > 0 && (int)starts.size() > window_cfg.max_windows){
+            // keep evenly spaced windows
+            std::vector<size_t> kept(window_cfg.max_windows);
+            for(int i=0; i<window_cfg.max_windows; i++){
+                kept[i] = starts[(size_t)i * (starts.size() - 1) / std::max(1, window_cfg.max_windows - 1)];
+            }
+            starts = kept;
+        }
+    }
+    return starts;
+}
+
+int get_audio_window_count(size_t audio_len, unsigned int max_len, const WINDOW_CONFIG& window_cfg)
+{
+    if(audio_len == 0){
+        return 0;
+    }
+    return std::max(1, (int)get_window_starts(audio_len, max_len, window_cfg).size());
+}
+
+int get_audio_windows(std::vector<float>& audio_data, unsigned int max_len, const AUDIO_CONFIG& audio_cfg,
+    const WINDOW_CONFIG& window_cfg, AUDIO_WINDOWS& windows, int first, int count)
+{
+    windows.mel_fusion.clear();
+    windows.batch = 0;
+    windows.item_size = 0;
+    if(audio_data.size() == 0){
+        return -1;
+    }
+
+    std::vector<size_t> starts = get_window_starts(audio_data.size(), max_len, window_cfg);
+    if(starts.size() == 0){
+        if(first != 0){
+            return -1;
+        }
+        std::vector<float> mel_fusion = get_audio_features(audio_data, max_len, "fusion", "repeatpad", audio_cfg, NULL, window_cfg);
+        if(mel_fusion.size() == 0) return -1;
+        windows.mel_fusion.swap(mel_fusion);
+        windows.item_size = windows.mel_fusion.size();
+        windows.batch = 1;
+        return 0;
+    }
+
+    size_t end = starts.size();
+    if(first < 0 || (size_t)first >= end){
+        return -1;
+    }
+    if(count >= 0){
+        end = std::min(end, (size_t)first + count);
+    }
+    for(size_t i=first; i<end; i++){
+        std::vector<float> window(audio_data.begin() + starts[i], audio_data.begin() + starts[i] + max_len);
+        std::vector<float> mel_fusion = get_audio_features(window, max_len, "fusion", "repeatpad", audio_cfg, NULL, window_cfg);
+        if(mel_fusion.size() == 0 || (windows.item_size != 0 && (int)mel_fusion.size() != windows.item_size)){
+            return -1;
+        }
+        windows.item_size = mel_fusion.size();
+        windows.mel_fusion.insert(windows.mel_fusion.end(), mel_fusion.begin(), mel_fusion.end());
+        windows.batch++;
+    }
+    if(debug){
+        PRINT_OUT("sliding windows %d\n", windows.batch);
+    }
+    return 0;
+}
+
+void WINDOW_POOLING::add(const float* embeddings, int batch, int dim)
+{
+    bool max_pooling = (pooling == "max");
+    int b = 0;
+    if(count == 0 && batch > 0){
+        pooled.assign(embeddings, embeddings + dim);
+        b = 1;
+    }
+    for(; b<batch; b++){
+        const float* e = &embeddings[(size_t)b * dim];
+        for(int i=0; i<dim; i++){
+            pooled[i] = max_pooling ? std::max(pooled[i], e[i]) : pooled[i] + e[i];
+        }
+    }
+    count += batch;
+}
+
+std::vector<float> WINDOW_POOLING::result() const
+{
+    std::vector<float> feature = pooled;
+    if(pooling != "max" && count > 1){
+        for(size_t i=0; i<feature.size(); i++){
+            feature[i] /= count;
+        }
+    }
+    return feature;
+}
+
+std::vector<float> pool_window_embeddings(const std::vector<float>& embeddings, int batch, int dim, const std::string& pooling)
+{
+    WINDOW_POOLING window_pooling(pooling);
+    window_pooling.add(&embeddings[0], batch, dim);
+    return window_pooling.result();
+}
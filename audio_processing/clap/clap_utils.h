@@ -46,5 +46,66 @@ struct AUDIO_CONFIG {
     }
 };
 
+enum WINDOW_MODE {
+    WINDOW_RANDOM = 0,  // one random chunk from each third, as the reference but from a seeded generator
+    WINDOW_EVEN,        // the chunk at the center of each third
+    WINDOW_ENERGY,      // the chunk with the highest energy in each third
+    WINDOW_SLIDING      // every max_len window with overlap, each window is one batch item
+};
+
+struct WINDOW_CONFIG {
+    WINDOW_MODE mode;
+    unsigned int seed;
+    float overlap;          // ratio of overlap between sliding windows
+    int max_windows;        // maximum number of sliding windows, 0 for no limit
+    int chunk_windows;      // sliding windows scheduled and encoded at once, bounds the memory of long audio
+    std::string pooling;    // "mean" or "max" of the window embeddings
+
+    WINDOW_CONFIG(){
+        mode = WINDOW_RANDOM;
+        seed = 0;
+        overlap = 0.5f;
+        max_windows = 0;
+        chunk_windows = 16;
+        pooling = "mean";
+    }
+};
+
+// Encoder inputs of all scheduled windows, mel_fusion is [batch][4][chunk_frames][mel_n]
+struct AUDIO_WINDOWS {
+    std::vector<float> mel_fusion;
+    int batch;
+    int item_size;
+
+    AUDIO_WINDOWS(){
+        batch = 0;
+        item_size = 0;
+    }
+};
+
 std::vector<float> get_audio_features(std::vector<float>& audio_data, unsigned int max_len, 
-    std::string data_truncating, std::string data_filling, const AUDIO_CONFIG& audio_cfg, bool* plonger=NULL);
+    std::string data_truncating, std::string data_filling, const AUDIO_CONFIG& audio_cfg, bool* plonger=NULL,
+    const WINDOW_CONFIG& window_cfg=WINDOW_CONFIG());
+
+// Number of scheduled windows of the audio, one item for the fusion modes and one item per window for sliding
+int get_audio_window_count(size_t audio_len, unsigned int max_len, const WINDOW_CONFIG& window_cfg);
+
+// Encoder inputs of the scheduled windows [first, first + count), all of them when count is negative
+int get_audio_windows(std::vector<float>& audio_data, unsigned int max_len, const AUDIO_CONFIG& audio_cfg,
+    const WINDOW_CONFIG& window_cfg, AUDIO_WINDOWS& windows, int first=0, int count=-1);
+
+// Mean or max pooling of window embeddings which are added chunk by chunk
+struct WINDOW_POOLING {
+    std::string pooling;
+    std::vector<float> pooled;
+    int count;
+
+    WINDOW_POOLING(const std::string& pooling) : pooling(pooling), count(0) {}
+
+    // [batch][dim] embeddings
+    void add(const float* embeddings, int batch, int dim);
+    std::vector<float> result() const;
+};
+
+// Mean or max pooling of [batch][dim] embeddings
+std::vector<float> pool_window_embeddings(const std::vector<float>& embeddings, int batch, int dim, const std::string& pooling);
@@ -22,6 +22,9 @@
 #include "ailia_audio.h"
 #include "wave_reader.h"
 #include "wave_writer.h"
+#include "gpt_sovits_stream.h"
+#include "gpt_sovits_profile.h"
+#include "utils.h"
 
 bool debug = false;
 bool debug_token = false;
@@ -52,9 +55,11 @@ bool debug_token = false;
 const char *MODEL_NAME[5] = {"cnhubert.onnx", "t2s_encoder.onnx", "t2s_fsdec.onnx", "t2s_sdec.onnx", "vits.onnx"};
 
 static bool benchmark  = false;
+static bool stream_mode = false;
 static int args_env_id = -1;
 
 std::string reference_wave = "reference_audio_captured_by_ax.wav";
+std::string profile_dir = "";
 
 #define REF_PHONES_SIZE 37
 #define TEXT_PHONES_SIZE 72
@@ -72,7 +77,7 @@ const char *SYMBOLS[SYMBOLS_N] = {"!", ",", "-", ".", "?", "AA", "AA0", "AA1", "
 
 static void print_usage()
 {
-	PRINT_OUT("usage: gpt-sovits [-h] [-i TEXT] [-b] [-e ENV_ID]\n");
+	PRINT_OUT("usage: gpt-sovits [-h] [-i TEXT] [-b] [-s] [-p DIR] [-e ENV_ID]\n");
 	return;
 }
 
@@ -89,6 +94,11 @@ static void print_help()
 	PRINT_OUT("  -b, --benchmark       Running the inference on the same input 5 times to\n");
 	PRINT_OUT("                        measure execution performance. (Cannot be used in\n");
 	PRINT_OUT("                        video mode)\n");
+	PRINT_OUT("  -s, --stream          Synthesize sentence by sentence and output the audio\n");
+	PRINT_OUT("                        as soon as each sentence is vocoded.\n");
+	PRINT_OUT("  -p DIR, --profile DIR\n");
+	PRINT_OUT("                        Cache the reference speaker features in this\n");
+	PRINT_OUT("                        directory and reuse them on later runs.\n");
 	PRINT_OUT("  -e ENV_ID, --env_id ENV_ID\n");
 	PRINT_OUT("                        The backend environment id.\n");
 	return;
@@ -115,6 +125,12 @@ static int argument_parser(int argc, char **argv)
 			else if (arg == "-b" || arg == "--benchmark") {
 				benchmark = true;
 			}
+			else if (arg == "-s" || arg == "--stream") {
+				stream_mode = true;
+			}
+			else if (arg == "-p" || arg == "--profile") {
+				status = 5;
+			}
 			else if (arg == "-h" || arg == "--help") {
 				print_usage();
 				print_help();
@@ -137,6 +153,9 @@ static int argument_parser(int argc, char **argv)
 			case 4:
 				args_env_id = atoi(arg.c_str());
 				break;
+			case 5:
+				profile_dir = arg;
+				break;
 			default:
 				print_usage();
 				print_error(arg);
@@ -473,6 +492,85 @@ AILIATensor vits_forward(AILIATensor text_seq, AILIATensor pred_semantic, AILIAT
 	return vits_outputs[0];
 }
 
+static void sequence_to_tensor(const std::vector<float> &sequence, AILIATensor &seq, AILIATensor &bert)
+{
+	const int BERT_DIM = 1024;
+
+	seq.data = sequence;
+	seq.shape.x = seq.data.size();
+	seq.shape.y = 1;
+	seq.shape.z = 1;
+	seq.shape.w = 1;
+	seq.shape.dim = 2;
+
+	bert.data = std::vector<float>(seq.data.size() * BERT_DIM);
+	bert.shape.x = BERT_DIM;
+	bert.shape.y = seq.data.size();
+	bert.shape.z = 1;
+	bert.shape.w = 1;
+	bert.shape.dim = 2;
+}
+
+static void text_to_tensor(const char ** phones, int size, AILIATensor &seq, AILIATensor &bert)
+{
+	sequence_to_tensor(cleaned_text_to_sequence(phones, size), seq, bert);
+}
+
+static void recognize_stream(AILIATensor &ref_seq, AILIATensor &ref_bert, AILIATensor &ref_audio, AILIATensor &ssl_content, int sampling_rate, AILIANetwork* net[MODEL_N])
+{
+	StreamConfig config;
+	config.crossfade_samples = sampling_rate / 100; // 10ms
+
+	std::vector<std::vector<const char *>> sentences = split_phones(TEXT_PHONES, TEXT_PHONES_SIZE, config);
+	PRINT_OUT("sentence count %d\n", (int)sentences.size());
+
+	// reference features are computed once and shared by all sentences
+	std::vector<AILIATensor> text_seqs(sentences.size());
+	std::vector<AILIATensor> text_berts(sentences.size());
+	for (int i = 0; i < sentences.size(); i++){
+		text_to_tensor(&sentences[i][0], sentences[i].size(), text_seqs[i], text_berts[i]);
+	}
+
+	StreamT2SFunc t2s = [&](int idx){
+		AILIATensor pred_semantic = t2s_forward(ref_seq, text_seqs[idx], ref_bert, text_berts[idx], ssl_content, net);
+		return pred_semantic.data;
+	};
+
+	StreamVitsFunc vits = [&](int idx, const std::vector<float> &semantic){
+		AILIATensor pred_semantic;
+		pred_semantic.data = semantic;
+		pred_semantic.shape.x = semantic.size();
+		pred_semantic.shape.y = 1;
+		pred_semantic.shape.z = 1;
+		pred_semantic.shape.w = 1;
+		pred_semantic.shape.dim = 3;
+		AILIATensor audio = vits_forward(text_seqs[idx], pred_semantic, ref_audio, net[MODEL_VITS]);
+		return audio.data;
+	};
+
+	// chunks are appended to output.wav as soon as they are vocoded
+	WaveStreamWriter writer;
+	if (writer.open("output.wav", sampling_rate) != 0){
+		PRINT_ERR("output.wav open failed\n");
+		return;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bool first_chunk = true;
+	StreamChunkCallback callback = [&](const float *pcm, int n){
+		if (first_chunk){
+			auto end = std::chrono::high_resolution_clock::now();
+			PRINT_OUT("first chunk latency %lld ms\n", std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count());
+			first_chunk = false;
+		}
+		writer.append(pcm, n);
+	};
+
+	stream_synthesize(sentences.size(), t2s, vits, callback, config);
+
+	writer.finalize();
+}
+
 static int recognize_from_audio(AILIANetwork* net[MODEL_N])
 {
 	int status = AILIA_STATUS_SUCCESS;
@@ -484,64 +582,80 @@ static int recognize_from_audio(AILIANetwork* net[MODEL_N])
 		return AILIA_STATUS_ERROR_FILE_API;
 	}
 
-	// get sequence
-	if (debug_token){
-		PRINT_OUT("ref_seq\n");
-	}
-	AILIATensor ref_seq;
-	ref_seq.data = cleaned_text_to_sequence(REF_PHONES, REF_PHONES_SIZE);
-	ref_seq.shape.x = ref_seq.data.size();
-	ref_seq.shape.y = 1;
-	ref_seq.shape.z = 1;
-	ref_seq.shape.w = 1;
-	ref_seq.shape.dim = 2;
-
-	if (debug_token){
-		PRINT_OUT("text_seq\n");
+	const int vits_hps_data_sampling_rate = 32000;
+	SpeakerProfile profile;
+	uint64_t profile_hash = 0;
+	std::string profile_path;
+	bool profile_loaded = false;
+	if (profile_dir != ""){
+		std::vector<std::string> ssl_files(1, MODEL_NAME[MODEL_SSL]);
+		profile_hash = speaker_profile_hash(wave, sampleRate, nChannels, REF_PHONES, REF_PHONES_SIZE, model_file_version(ssl_files));
+		profile_path = speaker_profile_path(profile_dir, profile_hash);
+		profile_loaded = load_speaker_profile(profile_path, profile_hash, profile);
+		if (profile_loaded){
+			PRINT_OUT("speaker profile loaded (%s)\n", profile_path.c_str());
+		}
 	}
-	AILIATensor text_seq;
-	text_seq.data = cleaned_text_to_sequence(TEXT_PHONES, TEXT_PHONES_SIZE);
-	text_seq.shape.x = text_seq.data.size();
-	text_seq.shape.y = 1;
-	text_seq.shape.z = 1;
-	text_seq.shape.w = 1;
-	text_seq.shape.dim = 2;
 
-	const int BERT_DIM = 1024;
+	AILIATensor ref_seq;
 	AILIATensor ref_bert;
-	AILIATensor text_bert;
-
-	ref_bert.data = std::vector<float>(ref_seq.data.size() * BERT_DIM);
-	ref_bert.shape.x = BERT_DIM;
-	ref_bert.shape.y = ref_seq.data.size();
-	ref_bert.shape.z = 1;
-	ref_bert.shape.w = 1;
-	ref_bert.shape.dim = 2;
-
-	text_bert.data = std::vector<float>(text_seq.data.size() * BERT_DIM);
-	text_bert.shape.x = BERT_DIM;
-	text_bert.shape.y = text_seq.data.size();
-	text_bert.shape.z = 1;
-	text_bert.shape.w = 1;
-	text_bert.shape.dim = 2;
-
-	// resmaple to 16k and 32k
-	const int vits_hps_data_sampling_rate = 32000;
-	std::vector<float> zero_wav(vits_hps_data_sampling_rate * 0.3);
-	std::vector<float> wav16k = resample(wave, 16000, sampleRate, nChannels);
-	std::vector<float> ref_audio_16k = wav16k;
-	ref_audio_16k.insert(ref_audio_16k.end(), zero_wav.begin(), zero_wav.end());
+	AILIATensor ref_audio;
+	AILIATensor ssl_content;
+	if (profile_loaded){
+		sequence_to_tensor(profile.ref_seq, ref_seq, ref_bert);
+		ref_audio.data = profile.ref_audio;
+
+		ssl_content.data = profile.ssl_content;
+		ssl_content.shape = profile.ssl_shape;
+	}else{
+		// get sequence
+		if (debug_token){
+			PRINT_OUT("ref_seq\n");
+		}
+		text_to_tensor(REF_PHONES, REF_PHONES_SIZE, ref_seq, ref_bert);
+
+		// resmaple to 16k and 32k
+		std::vector<float> zero_wav(vits_hps_data_sampling_rate * 0.3);
+		std::vector<float> wav16k = resample(wave, 16000, sampleRate, nChannels);
+		std::vector<float> ref_audio_16k = wav16k;
+		ref_audio_16k.insert(ref_audio_16k.end(), zero_wav.begin(), zero_wav.end());
+
+		ref_audio.data = resample(wave, vits_hps_data_sampling_rate, sampleRate, nChannels);
+
+		// ssl
+		ssl_content = ssl_forward(ref_audio_16k, net[MODEL_SSL]);
+
+		if (profile_dir != ""){
+			profile.ref_seq = ref_seq.data;
+			profile.ssl_content = ssl_content.data;
+			profile.ssl_shape = ssl_content.shape;
+			profile.ref_audio = ref_audio.data;
+			if (save_speaker_profile(profile_path, profile_hash, profile)){
+				PRINT_OUT("speaker profile saved (%s)\n", profile_path.c_str());
+			}else{
+				PRINT_ERR("speaker profile save failed (%s)\n", profile_path.c_str());
+			}
+		}
+	}
 
-	AILIATensor ref_audio;	
-	ref_audio.data = resample(wave, vits_hps_data_sampling_rate, sampleRate, nChannels);
 	ref_audio.shape.x = ref_audio.data.size();
 	ref_audio.shape.y = 1;
 	ref_audio.shape.z = 1;
 	ref_audio.shape.w = 1;
 	ref_audio.shape.dim = 2;
 
-	// ssl
-	AILIATensor ssl_content = ssl_forward(ref_audio_16k, net[MODEL_SSL]);
+	if (stream_mode){
+		recognize_stream(ref_seq, ref_bert, ref_audio, ssl_content, vits_hps_data_sampling_rate, net);
+		PRINT_OUT("Program finished successfully.\n");
+		return AILIA_STATUS_SUCCESS;
+	}
+
+	if (debug_token){
+		PRINT_OUT("text_seq\n");
+	}
+	AILIATensor text_seq;
+	AILIATensor text_bert;
+	text_to_tensor(TEXT_PHONES, TEXT_PHONES_SIZE, text_seq, text_bert);
 
 	// t2s
 	AILIATensor pred_semantic = t2s_forward(ref_seq, text_seq, ref_bert, text_bert, ssl_content, net);
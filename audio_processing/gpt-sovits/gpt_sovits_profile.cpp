@@ -0,0 +1,152 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA GPT-SoVits speaker profile
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gpt_sovits_profile.h"
+
+static const char PROFILE_MAGIC[4] = {'G', 'S', 'V', 'P'};
+
+#pragma pack(1)
+struct ProfileHeader{
+	char magic[4];
+	unsigned int version;
+	uint64_t hash;
+	unsigned int ref_seq_n;
+	unsigned int ssl_shape[5];
+	unsigned int ssl_content_n;
+	unsigned int ref_audio_n;
+};
+#pragma pack()
+
+// FNV-1a
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t size){
+	const unsigned char *p = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++){
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+uint64_t speaker_profile_hash(const std::vector<float> &wave, int sampling_rate, int channels, const char **phones, int phones_size, const std::string &model_version)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	unsigned int version = SPEAKER_PROFILE_VERSION;
+	h = hash_bytes(h, &version, sizeof(version));
+	h = hash_bytes(h, model_version.c_str(), model_version.size() + 1);
+	h = hash_bytes(h, &sampling_rate, sizeof(sampling_rate));
+	h = hash_bytes(h, &channels, sizeof(channels));
+	if (wave.size() > 0){
+		h = hash_bytes(h, &wave[0], wave.size() * sizeof(float));
+	}
+	for (int i = 0; i < phones_size; i++){
+		h = hash_bytes(h, phones[i], strlen(phones[i]) + 1);
+	}
+	return h;
+}
+
+std::string speaker_profile_path(const std::string &dir, uint64_t hash)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "speaker_%016llx.gsvp", (unsigned long long)hash);
+	if (dir.size() == 0){
+		return std::string(name);
+	}
+	char last = dir[dir.size() - 1];
+	if (last == '/' || last == '\\'){
+		return dir + name;
+	}
+	return dir + "/" + name;
+}
+
+static bool read_floats(FILE *fp, std::vector<float> &data, unsigned int n){
+	data.resize(n);
+	if (n == 0){
+		return true;
+	}
+	return fread(&data[0], sizeof(float), n, fp) == n;
+}
+
+static bool write_floats(FILE *fp, const std::vector<float> &data){
+	if (data.size() == 0){
+		return true;
+	}
+	return fwrite(&data[0], sizeof(float), data.size(), fp) == data.size();
+}
+
+bool load_speaker_profile(const std::string &path, uint64_t hash, SpeakerProfile &profile)
+{
+	FILE *fp = fopen(path.c_str(), "rb");
+	if (fp == NULL){
+		return false;
+	}
+
+	ProfileHeader header;
+	bool success = fread(&header, sizeof(header), 1, fp) == 1;
+	success = success && memcmp(header.magic, PROFILE_MAGIC, 4) == 0;
+	success = success && header.version == SPEAKER_PROFILE_VERSION;
+	success = success && header.hash == hash;
+	success = success && header.ssl_content_n == header.ssl_shape[0] * header.ssl_shape[1] * header.ssl_shape[2] * header.ssl_shape[3];
+	success = success && read_floats(fp, profile.ref_seq, header.ref_seq_n);
+	success = success && read_floats(fp, profile.ssl_content, header.ssl_content_n);
+	success = success && read_floats(fp, profile.ref_audio, header.ref_audio_n);
+	fclose(fp);
+
+	if (!success){
+		return false;
+	}
+
+	profile.ssl_shape.x = header.ssl_shape[0];
+	profile.ssl_shape.y = header.ssl_shape[1];
+	profile.ssl_shape.z = header.ssl_shape[2];
+	profile.ssl_shape.w = header.ssl_shape[3];
+	profile.ssl_shape.dim = header.ssl_shape[4];
+	return true;
+}
+
+bool save_speaker_profile(const std::string &path, uint64_t hash, const SpeakerProfile &profile)
+{
+	ProfileHeader header;
+	memcpy(header.magic, PROFILE_MAGIC, 4);
+	header.version = SPEAKER_PROFILE_VERSION;
+	header.hash = hash;
+	header.ref_seq_n = profile.ref_seq.size();
+	header.ssl_shape[0] = profile.ssl_shape.x;
+	header.ssl_shape[1] = profile.ssl_shape.y;
+	header.ssl_shape[2] = profile.ssl_shape.z;
+	header.ssl_shape[3] = profile.ssl_shape.w;
+	header.ssl_shape[4] = profile.ssl_shape.dim;
+	header.ssl_content_n = profile.ssl_content.size();
+	header.ref_audio_n = profile.ref_audio.size();
+
+	// write to a temporary file first so that an interrupted run never leaves a broken profile
+	std::string tmp_path = path + ".tmp";
+	FILE *fp = fopen(tmp_path.c_str(), "wb");
+	if (fp == NULL){
+		return false;
+	}
+	bool success = fwrite(&header, sizeof(header), 1, fp) == 1;
+	success = success && write_floats(fp, profile.ref_seq);
+	success = success && write_floats(fp, profile.ssl_content);
+	success = success && write_floats(fp, profile.ref_audio);
+	success = (fclose(fp) == 0) && success;
+	if (!success){
+		remove(tmp_path.c_str());
+		return false;
+	}
+	remove(path.c_str());
+	if (rename(tmp_path.c_str(), path.c_str()) != 0){
+		remove(tmp_path.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,35 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA GPT-SoVits speaker profile
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+#include "ailia.h"
+
+#define SPEAKER_PROFILE_VERSION 1
+
+// Reference voice features which do not depend on the synthesized text
+struct SpeakerProfile{
+	std::vector<float> ref_seq;			// reference phoneme ids
+	std::vector<float> ssl_content;		// cnhubert output
+	AILIAShape ssl_shape;
+	std::vector<float> ref_audio;		// reference audio resampled to the vits sampling rate
+};
+
+// Content hash of the reference audio, the reference phonemes and the ssl model, model_version is the
+// model_file_version of the ssl model so that a replaced model file does not reuse old profiles
+uint64_t speaker_profile_hash(const std::vector<float> &wave, int sampling_rate, int channels, const char **phones, int phones_size, const std::string &model_version);
+
+std::string speaker_profile_path(const std::string &dir, uint64_t hash);
+bool load_speaker_profile(const std::string &path, uint64_t hash, SpeakerProfile &profile);
+bool save_speaker_profile(const std::string &path, uint64_t hash, const SpeakerProfile &profile);
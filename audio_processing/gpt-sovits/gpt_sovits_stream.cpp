@@ -0,0 +1,146 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA GPT-SoVits streaming synthesis
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <string.h>
+#include <algorithm>
+#include <deque>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+#include "gpt_sovits_stream.h"
+
+static bool is_sentence_end(const char *phone){
+	return strcmp(phone, ".") == 0 || strcmp(phone, "?") == 0 || strcmp(phone, "!") == 0 || strcmp(phone, "…") == 0;
+}
+
+static bool is_phrase_end(const char *phone){
+	return strcmp(phone, ",") == 0;
+}
+
+std::vector<std::vector<const char *>> split_phones(const char **phones, int size, const StreamConfig &config)
+{
+	std::vector<std::vector<const char *>> sentences;
+	std::vector<const char *> current;
+	for (int i = 0; i < size; i++){
+		current.push_back(phones[i]);
+		bool end = is_sentence_end(phones[i]) || (config.split_phrase && is_phrase_end(phones[i]));
+		if (end && (int)current.size() >= config.min_phones){
+			sentences.push_back(current);
+			current.clear();
+		}
+	}
+	if (current.size() > 0){
+		if (sentences.size() > 0 && (int)current.size() < config.min_phones){
+			sentences.back().insert(sentences.back().end(), current.begin(), current.end());
+		}else{
+			sentences.push_back(current);
+		}
+	}
+	return sentences;
+}
+
+void StreamCrossfader::push(const std::vector<float> &pcm, const StreamChunkCallback &callback)
+{
+	// mix the head of the new segment into the end of the kept tail
+	int overlap = std::min((int)tail.size(), (int)pcm.size());
+	int tail_only = tail.size() - overlap;
+	mixed.resize(tail_only + overlap);
+	for (int i = 0; i < tail_only; i++){
+		mixed[i] = tail[i];
+	}
+	for (int i = 0; i < overlap; i++){
+		float w = (i + 0.5f) / overlap;
+		mixed[tail_only + i] = tail[tail_only + i] * (1.0f - w) + pcm[i] * w;
+	}
+
+	// keep back the end of the new segment for the next boundary
+	int body_n = pcm.size() - overlap;
+	int keep_n = std::min(crossfade_n, body_n);
+	mixed.insert(mixed.end(), pcm.begin() + overlap, pcm.begin() + overlap + body_n - keep_n);
+	tail.assign(pcm.end() - keep_n, pcm.end());
+
+	if (mixed.size() > 0){
+		callback(&mixed[0], mixed.size());
+	}
+}
+
+void StreamCrossfader::flush(const StreamChunkCallback &callback)
+{
+	if (tail.size() > 0){
+		callback(&tail[0], tail.size());
+	}
+	tail.clear();
+}
+
+void stream_synthesize(int sentence_n, const StreamT2SFunc &t2s, const StreamVitsFunc &vits, const StreamChunkCallback &callback, const StreamConfig &config)
+{
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::pair<int, std::vector<float>>> queue;
+	bool producer_done = false;
+	bool abort = false;
+	std::exception_ptr producer_error;
+
+	std::thread producer([&]{
+		try{
+			for (int i = 0; i < sentence_n; i++){
+				std::vector<float> semantic = t2s(i);
+				std::unique_lock<std::mutex> lock(mutex);
+				cond.wait(lock, [&]{ return abort || (int)queue.size() < config.queue_size; });
+				if (abort){
+					break;
+				}
+				queue.push_back(std::make_pair(i, std::move(semantic)));
+				cond.notify_all();
+			}
+		}catch(...){
+			producer_error = std::current_exception();
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		producer_done = true;
+		cond.notify_all();
+	});
+
+	StreamCrossfader crossfader(config.crossfade_samples);
+	try{
+		while (true){
+			std::pair<int, std::vector<float>> item;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cond.wait(lock, [&]{ return producer_done || queue.size() > 0; });
+				if (queue.size() == 0){
+					break;
+				}
+				item = std::move(queue.front());
+				queue.pop_front();
+				cond.notify_all();
+			}
+			std::vector<float> pcm = vits(item.first, item.second);
+			crossfader.push(pcm, callback);
+		}
+	}catch(...){
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			abort = true;
+			cond.notify_all();
+		}
+		producer.join();
+		throw;
+	}
+
+	producer.join();
+	if (producer_error){
+		std::rethrow_exception(producer_error);
+	}
+	crossfader.flush(callback);
+}
@@ -0,0 +1,56 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA GPT-SoVits streaming synthesis
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <functional>
+
+// T2S decoding of one sentence, returns the semantic tokens
+typedef std::function<std::vector<float>(int sentence_idx)> StreamT2SFunc;
+
+// VITS vocoding of one sentence, returns the pcm
+typedef std::function<std::vector<float>(int sentence_idx, const std::vector<float> &semantic)> StreamVitsFunc;
+
+// Called for every pcm chunk in playback order
+typedef std::function<void(const float *pcm, int n)> StreamChunkCallback;
+
+struct StreamConfig{
+	bool split_phrase;		// also split at ','
+	int min_phones;			// shorter segments are merged into the next one
+	int crossfade_samples;	// overlap between sentences
+	int queue_size;			// max number of decoded sentences waiting for vits
+
+	StreamConfig(){
+		split_phrase = true;
+		min_phones = 4;
+		crossfade_samples = 320;
+		queue_size = 2;
+	}
+};
+
+// Split the phoneme sequence into sentences at punctuation
+std::vector<std::vector<const char *>> split_phones(const char **phones, int size, const StreamConfig &config);
+
+// Crossfade consecutive pcm segments, keeping back the tail of the last segment
+class StreamCrossfader{
+private:
+	int crossfade_n;
+	std::vector<float> tail;
+	std::vector<float> mixed;
+
+public:
+	StreamCrossfader(int crossfade_samples) : crossfade_n(crossfade_samples) {}
+	void push(const std::vector<float> &pcm, const StreamChunkCallback &callback);
+	void flush(const StreamChunkCallback &callback);
+};
+
+// Run T2S of sentence k+1 on a worker thread while VITS of sentence k runs on the caller thread
+void stream_synthesize(int sentence_n, const StreamT2SFunc &t2s, const StreamVitsFunc &vits, const StreamChunkCallback &callback, const StreamConfig &config);
@@ -5,6 +5,7 @@ cd %~dp0
 set MODEL=whisper
 set FILE1=encoder_small.opt3.onnx
 set FILE2=decoder_small_fix_kv_cache.opt3.onnx
+set FILE3=silero_vad.onnx
 
 rem download
 if not "%1" == "-h" if not "%1" == "--help" (
@@ -18,6 +19,10 @@ if not "%1" == "-h" if not "%1" == "--help" (
         echo Downloading onnx file... ^(save path: %FILE2%^)
         curl https://storage.googleapis.com/ailia-models/%MODEL%/%FILE2% -o %FILE2%
     )
+    if not exist %FILE3% (
+        echo Downloading onnx file... ^(save path: %FILE3%^)
+        curl https://storage.googleapis.com/ailia-models/silero-vad/%FILE3% -o %FILE3%
+    )
     echo ONNX file and Prototxt file are prepared^^!
 )
 rem execute
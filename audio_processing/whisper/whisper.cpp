@@ -12,6 +12,7 @@
 #include <math.h>
 #include <vector>
 #include <string>
+#include <thread>
 
 #include "ailia.h"
 #include "ailia_audio.h"
@@ -20,6 +21,8 @@
 #include "ailia_speech_util.h"
 
 #include "wave_reader.h"
+#include "whisper_batch.h"
+#include "whisper_vad.h"
 
 // ======================
 // Parameters
@@ -36,6 +39,12 @@
 static int args_env_id = -1;
 
 std::string input_file = "demo.wav";
+std::string model_type = "small";
+std::string manifest_file = "";
+std::string output_dir = "";
+static int args_worker_n = 0;
+static int args_memory_mb = 0;
+static bool vad_gating = false;
 
 // ======================
 // Arguemnt Parser
@@ -43,7 +52,7 @@ std::string input_file = "demo.wav";
 
 static void print_usage()
 {
-	PRINT_OUT("usage: whisper [-h] [-i FILE] [-b] [-e ENV_ID]\n");
+	PRINT_OUT("usage: whisper [-h] [-i FILE] [-m MODEL_TYPE] [-l FILE] [-o DIR] [-w N] [--memory_mb MB] [--vad] [-e ENV_ID]\n");
 	return;
 }
 
@@ -57,6 +66,20 @@ static void print_help()
 	PRINT_OUT("  -h, --help            show this help message and exit\n");
 	PRINT_OUT("  -i FILE, --input FILE\n");
 	PRINT_OUT("                        The input file.\n");
+	PRINT_OUT("  -m MODEL_TYPE, --model_type MODEL_TYPE\n");
+	PRINT_OUT("                        tiny, base, small, medium, large or large_v3.\n");
+	PRINT_OUT("  -l FILE, --manifest FILE\n");
+	PRINT_OUT("                        Transcribe all audio files listed in this file\n");
+	PRINT_OUT("                        (one path per line) and write FILE.jsonl for each.\n");
+	PRINT_OUT("                        Already transcribed files are skipped.\n");
+	PRINT_OUT("  -o DIR, --output_dir DIR\n");
+	PRINT_OUT("                        The jsonl output directory of the manifest mode.\n");
+	PRINT_OUT("                        Files are named BASENAME.HASH.jsonl.\n");
+	PRINT_OUT("  -w N, --workers N     The number of parallel whisper instances of the\n");
+	PRINT_OUT("                        manifest mode. (default: cores / 4)\n");
+	PRINT_OUT("  --memory_mb MB        Limit the automatic worker count to this memory.\n");
+	PRINT_OUT("  --vad                 Remove the non-speech parts with silero_vad.onnx\n");
+	PRINT_OUT("                        before transcription.\n");
 	PRINT_OUT("  -e ENV_ID, --env_id ENV_ID\n");
 	PRINT_OUT("                        The backend environment id.\n");
 	return;
@@ -80,6 +103,24 @@ static int argument_parser(int argc, char **argv)
 			if (arg == "-i" || arg == "--input") {
 				status = 1;
 			}
+			else if (arg == "-m" || arg == "--model_type") {
+				status = 2;
+			}
+			else if (arg == "-l" || arg == "--manifest") {
+				status = 3;
+			}
+			else if (arg == "-o" || arg == "--output_dir") {
+				status = 5;
+			}
+			else if (arg == "-w" || arg == "--workers") {
+				status = 6;
+			}
+			else if (arg == "--memory_mb") {
+				status = 7;
+			}
+			else if (arg == "--vad") {
+				vad_gating = true;
+			}
 			else if (arg == "-h" || arg == "--help") {
 				print_usage();
 				print_help();
@@ -99,9 +140,24 @@ static int argument_parser(int argc, char **argv)
 			case 1:
 				input_file = arg;
 				break;
+			case 2:
+				model_type = arg;
+				break;
+			case 3:
+				manifest_file = arg;
+				break;
 			case 4:
 				args_env_id = atoi(arg.c_str());
 				break;
+			case 5:
+				output_dir = arg;
+				break;
+			case 6:
+				args_worker_n = atoi(arg.c_str());
+				break;
+			case 7:
+				args_memory_mb = atoi(arg.c_str());
+				break;
 			default:
 				print_usage();
 				print_error(arg);
@@ -129,7 +185,7 @@ int intermediate_callback(void *handle, const char *text){
 	return 0; // 1で中断
 }
 
-int get_text(struct AILIASpeech* net, bool live_mode){
+int get_text(struct AILIASpeech* net, bool live_mode, std::vector<WhisperSegment> *segments, const std::vector<VadRegion> *regions){
 	unsigned int count = 0;
 	int status = ailiaSpeechGetTextCount(net, &count);
 	if (status != AILIA_STATUS_SUCCESS){
@@ -151,6 +207,21 @@ int get_text(struct AILIASpeech* net, bool live_mode){
 			return -1;
 		}
 
+		if (regions != NULL){
+			text.time_stamp_begin = vad_remap_time(*regions, text.time_stamp_begin);
+			text.time_stamp_end = vad_remap_time(*regions, text.time_stamp_end);
+		}
+
+		if (segments != NULL){
+			WhisperSegment segment;
+			segment.time_stamp_begin = text.time_stamp_begin;
+			segment.time_stamp_end = text.time_stamp_end;
+			segment.confidence = text.confidence;
+			segment.text = text.text;
+			segments->push_back(segment);
+			continue;
+		}
+
 		float cur_time = text.time_stamp_begin;
 		float next_time = text.time_stamp_end;
 		printf("[%02d:%02d.%03d --> %02d:%02d.%03d] ", (int)cur_time/60%60,(int)cur_time%60, (int)(cur_time*1000)%1000, (int)next_time/60%60,(int)next_time%60, (int)(next_time*1000)%1000);
@@ -161,21 +232,18 @@ int get_text(struct AILIASpeech* net, bool live_mode){
 	return AILIA_STATUS_SUCCESS;
 }
 
-int update(struct AILIASpeech* net, const float *wave_buf, int nSamples, int nChannels, int sampleRate, int &push_i, unsigned int &complete, bool translate, bool live_mode){
+int update(struct AILIASpeech* net, const float *chunk, int push_samples, int nChannels, int sampleRate, unsigned int &complete, bool translate, bool live_mode, std::vector<WhisperSegment> *segments, const std::vector<VadRegion> *regions){
 	int status;
 
 	// Push pcm input to queue
-	int push_size = sampleRate;
-	int push_samples = std::max(0, std::min(nSamples - push_i, push_size));
 	if (push_samples >= 1){
 		// Push pcm data
-		status = ailiaSpeechPushInputData(net, &wave_buf[nChannels * push_i], nChannels, push_samples, sampleRate);
+		status = ailiaSpeechPushInputData(net, chunk, nChannels, push_samples, sampleRate);
 		if (status != AILIA_STATUS_SUCCESS){
 			printf("ailiaSpeechPushInputData Error %d\n", status);
 			printf("%s\n", ailiaSpeechGetErrorDetail(net));
 			return -1;
 		}
-		push_i += push_size;
 	}else{
 		// Finalize push pcm data
 		status = ailiaSpeechFinalizeInputData(net);
@@ -215,7 +283,7 @@ int update(struct AILIASpeech* net, const float *wave_buf, int nSamples, int nCh
 		}
 		
 		// Get results
-		status = get_text(net, live_mode);
+		status = get_text(net, live_mode, segments, regions);
 		if (status != AILIA_STATUS_SUCCESS){
 			return status;
 		}
@@ -273,44 +341,16 @@ int get_model_name(std::string &encoder, std::string &decoder, int &model_id, co
 	return AILIA_STATUS_SUCCESS;
 }
 
-int main(int argc, char **argv){
-	int status = argument_parser(argc, argv);
-	if (status != AILIA_STATUS_SUCCESS) {
-		return -1;
-	}
-
-	const char *input_path="./demo.wav";
-	const char *model_type="small";
-	const char *language="auto";
-	const char *task="transcribe";
-
-	// Get environment
-	int env_id = args_env_id;
-	
-	// Load wave file
-	int sampleRate,nChannels,nSamples;
-	std::vector<float> wave_buf = read_wave_file(input_path, &sampleRate, &nChannels, &nSamples);
-	if(wave_buf.size()==0){
-		printf("wav file not found or could not open %s\n", input_path);
-		return -1;
-	}
-	printf("Input wave sec %f\n", (float)nSamples/sampleRate);
-
-	struct AILIASpeech* net;
-
+int create_speech(struct AILIASpeech** net, int env_id, int num_thread, const char *model_type, const char *language, bool translate, bool live_mode){
 	AILIASpeechApiCallback callback = ailiaSpeechUtilGetCallback();
 
-	bool translate = true;
-	bool live_mode = false;
-	
 	int task_id = (translate) ? AILIA_SPEECH_TASK_TRANSLATE:AILIA_SPEECH_TASK_TRANSCRIBE;
 	int flag = (live_mode) ? AILIA_SPEECH_FLAG_LIVE:AILIA_SPEECH_FLAG_NONE;
 	int memory_mode = AILIA_MEMORY_REDUCE_CONSTANT | AILIA_MEMORY_REDUCE_CONSTANT_WITH_INPUT_INITIALIZER | AILIA_MEMORY_REUSE_INTERSTAGE;
 
-	status = ailiaSpeechCreate(&net, AILIA_ENVIRONMENT_ID_AUTO, AILIA_MULTITHREAD_AUTO, memory_mode, task_id, flag, callback, AILIA_SPEECH_API_CALLBACK_VERSION);
+	int status = ailiaSpeechCreate(net, env_id, num_thread, memory_mode, task_id, flag, callback, AILIA_SPEECH_API_CALLBACK_VERSION);
 	if (status != AILIA_STATUS_SUCCESS){
 		printf("ailiaSpeechCreate Error %d\n", status);
-		printf("%s\n", ailiaSpeechGetErrorDetail(net));
 		return -1;
 	}
 
@@ -320,60 +360,224 @@ int main(int argc, char **argv){
 	status = get_model_name(encoder, decoder, model_id, model_type);
 	if (status != AILIA_STATUS_SUCCESS){
 		printf("unknown model type\n");
-		ailiaSpeechDestroy(net);
+		ailiaSpeechDestroy(*net);
 		return -1;
 	}
 
-	status = ailiaSpeechOpenModelFileA(net, encoder.c_str(), decoder.c_str(), model_id);
+	status = ailiaSpeechOpenModelFileA(*net, encoder.c_str(), decoder.c_str(), model_id);
 	if (status != AILIA_STATUS_SUCCESS){
 		printf("ailiaSpeechOpenModelFileA Error %d\n", status);
 		printf("required file : %s and %s\n", encoder.c_str(), decoder.c_str());
-		printf("%s\n", ailiaSpeechGetErrorDetail(net));
+		printf("%s\n", ailiaSpeechGetErrorDetail(*net));
 		if (status == AILIA_STATUS_LICENSE_NOT_FOUND){
 			printf("License file not found.\n");
 			printf("Please place license file.\n");
 		}
+		ailiaSpeechDestroy(*net);
 		return -1;
 	}
 
-	status = ailiaSpeechSetLanguage(net, language);
+	status = ailiaSpeechSetLanguage(*net, language);
 	if (status != AILIA_STATUS_SUCCESS){
 		printf("ailiaSpeechSetLanguage Error %d\n", status);
-		printf("%s\n", ailiaSpeechGetErrorDetail(net));
+		printf("%s\n", ailiaSpeechGetErrorDetail(*net));
+		ailiaSpeechDestroy(*net);
 		return -1;
 	}
 
 	if (live_mode){ // You can also use setIntermediateCallback for normal mode
-		status = ailiaSpeechSetIntermediateCallback(net, &intermediate_callback, NULL);
+		status = ailiaSpeechSetIntermediateCallback(*net, &intermediate_callback, NULL);
 		if (status != AILIA_STATUS_SUCCESS){
 			printf("ailiaSpeechSetIntermediateCallback Error %d\n", status);
-			printf("%s\n", ailiaSpeechGetErrorDetail(net));
+			printf("%s\n", ailiaSpeechGetErrorDetail(*net));
+			ailiaSpeechDestroy(*net);
 			return -1;
 		}
 	}
 
 	bool vad_enable = false;
 	if (vad_enable){
-		status = ailiaSpeechOpenVadFileA(net, "silero_vad.onnx", AILIA_SPEECH_VAD_TYPE_SILERO);
+		status = ailiaSpeechOpenVadFileA(*net, "silero_vad.onnx", AILIA_SPEECH_VAD_TYPE_SILERO);
 		if (status != AILIA_STATUS_SUCCESS){
 			printf("ailiaSpeechOpenVadFileA Error %d\n", status);
 		}
 	}
 
+	return AILIA_STATUS_SUCCESS;
+}
+
+int transcribe_file(struct AILIASpeech* net, WhisperVad *vad, const char *input_path, bool translate, bool live_mode, std::vector<WhisperSegment> *segments){
+	// Open wave file, the pcm is read one chunk at a time unless VAD needs the whole file
+	WaveStreamReader reader;
+	if(reader.open(input_path)!=0 || reader.frames()==0){
+		printf("wav file not found or could not open %s\n", input_path);
+		return -1;
+	}
+	int sampleRate = reader.sample_rate();
+	int nChannels = reader.channels();
+	int nSamples = reader.frames();
+	if (segments == NULL){
+		printf("Input wave sec %f\n", (float)nSamples/sampleRate);
+	}
+
+	// Remove non-speech and transcribe only the speech regions
+	std::vector<float> wave_buf;
+	std::vector<VadRegion> regions;
+	if (vad != NULL){
+		wave_buf.resize((size_t)nSamples * nChannels);
+		reader.read(&wave_buf[0], nSamples);
+		reader.close();
+
+		std::vector<float> wave16k;
+		int status = vad_preprocess(wave_buf, sampleRate, nChannels, wave16k);
+		if (status != AILIA_STATUS_SUCCESS){
+			return -1;
+		}
+		std::vector<float> conf;
+		status = vad->compute(wave16k, conf);
+		if (status != AILIA_STATUS_SUCCESS){
+			return -1;
+		}
+		VadConfig vad_config;
+		regions = get_vad_regions(conf, vad->window_size(), wave16k.size(), vad_config);
+		wave_buf = gate_wave(wave16k, regions, vad_config);
+		if (segments == NULL){
+			printf("VAD speech sec %f (%d regions)\n", (float)wave_buf.size()/VAD_SAMPLE_RATE, (int)regions.size());
+		}
+		if (wave_buf.size() == 0){
+			return AILIA_STATUS_SUCCESS;
+		}
+		sampleRate = VAD_SAMPLE_RATE;
+		nChannels = 1;
+		nSamples = wave_buf.size();
+	}
+
 	int push_i = 0;
+	int push_size = sampleRate;
+	std::vector<float> chunk(push_size * nChannels);
+	int status = AILIA_STATUS_SUCCESS;
 	while(true){
+		const float *push_buf = &chunk[0];
+		int push_samples = 0;
+		if (vad != NULL){
+			push_samples = std::max(0, std::min(nSamples - push_i, push_size));
+			if (push_samples > 0){
+				push_buf = &wave_buf[nChannels * push_i];
+			}
+			push_i += push_samples;
+		}else{
+			push_samples = reader.read(&chunk[0], push_size);
+		}
+
 		unsigned int complete = 0;
-		status = update(net, &wave_buf[0], nSamples, nChannels, sampleRate, push_i, complete, translate, live_mode);
+		status = update(net, push_buf, push_samples, nChannels, sampleRate, complete, translate, live_mode, segments, (vad != NULL) ? &regions : NULL);
 		if (status != AILIA_STATUS_SUCCESS){
-			return -1;
+			break;
 		}
 		if (complete == 1){
 			break;
 		}
 	}
 
-	ailiaSpeechDestroy(net);
-	return 0;
+	// Clear the queue and the decoder state for the next file
+	int reset_status = ailiaSpeechResetTranscribeState(net);
+	if (reset_status != AILIA_STATUS_SUCCESS){
+		printf("ailiaSpeechResetTranscribeState Error %d\n", reset_status);
+		return -1;
+	}
+	return status;
 }
 
+int transcribe_manifest(int env_id, const char *language, bool translate){
+	std::vector<std::string> files;
+	int status = read_manifest(manifest_file.c_str(), files);
+	if (status != AILIA_STATUS_SUCCESS){
+		printf("manifest file not found or could not open %s\n", manifest_file.c_str());
+		return -1;
+	}
+	if (files.size() == 0){
+		printf("manifest is empty\n");
+		return AILIA_STATUS_SUCCESS;
+	}
+
+	// Split the cores between independent instances
+	int worker_n = get_batch_worker_count(args_worker_n, files.size(), model_type.c_str(), args_memory_mb);
+	int num_thread = std::max(1, (int)std::thread::hardware_concurrency() / worker_n);
+
+	std::vector<struct AILIASpeech*> nets;
+	std::vector<WhisperVad> vads(worker_n);
+	for (int i = 0; i < worker_n; i++){
+		struct AILIASpeech* net;
+		status = create_speech(&net, env_id, num_thread, model_type.c_str(), language, translate, false);
+		if (status != AILIA_STATUS_SUCCESS){
+			break;
+		}
+		nets.push_back(net);
+		if (vad_gating){
+			status = vads[i].open(env_id, num_thread, "silero_vad.onnx");
+			if (status != AILIA_STATUS_SUCCESS){
+				break;
+			}
+		}
+	}
+
+	if (status == AILIA_STATUS_SUCCESS){
+		WhisperBatchJob job = [&](int worker_id, const std::string &path, std::vector<WhisperSegment> &segments){
+			return transcribe_file(nets[worker_id], vad_gating ? &vads[worker_id] : NULL, path.c_str(), translate, false, &segments);
+		};
+		status = run_batch(files, output_dir, worker_n, job);
+	}
+
+	for (size_t i = 0; i < nets.size(); i++){
+		ailiaSpeechDestroy(nets[i]);
+		vads[i].close();
+	}
+	return status;
+}
+
+int main(int argc, char **argv){
+	int status = argument_parser(argc, argv);
+	if (status != AILIA_STATUS_SUCCESS) {
+		return -1;
+	}
+
+	const char *language="auto";
+	const char *task="transcribe";
+
+	// Get environment
+	int env_id = args_env_id;
+
+	bool translate = true;
+	bool live_mode = false;
+
+	if (manifest_file != ""){
+		status = transcribe_manifest(env_id, language, translate);
+		if (status != AILIA_STATUS_SUCCESS){
+			return -1;
+		}
+		return 0;
+	}
 
+	struct AILIASpeech* net;
+	status = create_speech(&net, env_id, AILIA_MULTITHREAD_AUTO, model_type.c_str(), language, translate, live_mode);
+	if (status != AILIA_STATUS_SUCCESS){
+		return -1;
+	}
+
+	WhisperVad vad;
+	if (vad_gating){
+		status = vad.open(env_id, AILIA_MULTITHREAD_AUTO, "silero_vad.onnx");
+		if (status != AILIA_STATUS_SUCCESS){
+			ailiaSpeechDestroy(net);
+			return -1;
+		}
+	}
+
+	status = transcribe_file(net, vad_gating ? &vad : NULL, input_file.c_str(), translate, live_mode, NULL);
+	vad.close();
+	ailiaSpeechDestroy(net);
+	if (status != AILIA_STATUS_SUCCESS){
+		return -1;
+	}
+	return 0;
+}
@@ -3,6 +3,7 @@
 MODEL=whisper
 FILE1=encoder_small.opt3.onnx
 FILE2=decoder_small_fix_kv_cache.opt3.onnx
+FILE3=silero_vad.onnx
 
 #download
 if [ ! "$1" = "-h" ] && [ ! "$1" = "--help" ]; then
@@ -16,6 +17,10 @@ if [ ! "$1" = "-h" ] && [ ! "$1" = "--help" ]; then
         echo "Downloading onnx file... save path: ${FILE2}"
         curl https://storage.googleapis.com/ailia-models/${MODEL}/${FILE2} -o ${FILE2}
     fi
+    if [ ! -e ${FILE3} ]; then
+        echo "Downloading onnx file... save path: ${FILE3}"
+        curl https://storage.googleapis.com/ailia-models/silero-vad/${FILE3} -o ${FILE3}
+    fi
     echo "ONNX file and Prototxt file are prepared!"
 fi
 #execute
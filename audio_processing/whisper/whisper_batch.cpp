@@ -0,0 +1,217 @@
+/*******************************************************************
+*
+*    DESCRIPTION:
+*      Whisper batch transcription worker pool
+*    AUTHOR:
+*      ax Inc.
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <map>
+
+#include "ailia.h"
+#include "utils.h"
+#include "whisper_batch.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf_s(stderr, __VA_ARGS__)
+#else
+#define PRINT_OUT(...) fprintf(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+// Threads given to each AILIASpeech instance when the worker count is automatic
+static const int THREADS_PER_WORKER = 4;
+
+int read_manifest(const char *path, std::vector<std::string> &files)
+{
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL){
+		return AILIA_STATUS_ERROR_FILE_API;
+	}
+	char line[4096];
+	while (fgets(line, sizeof(line), fp) != NULL){
+		std::string s = line;
+		while (s.size() > 0 && (s.back() == '\n' || s.back() == '\r' || s.back() == ' ' || s.back() == '\t')){
+			s.pop_back();
+		}
+		if (s.size() == 0 || s[0] == '#'){
+			continue;
+		}
+		files.push_back(s);
+	}
+	fclose(fp);
+	return AILIA_STATUS_SUCCESS;
+}
+
+static int get_model_memory_mb(const char *model_type)
+{
+	// approximate peak usage of one instance with AILIA_MEMORY_REDUCE_CONSTANT
+	if (strcmp(model_type, "tiny") == 0){
+		return 200;
+	}
+	if (strcmp(model_type, "base") == 0){
+		return 350;
+	}
+	if (strcmp(model_type, "small") == 0){
+		return 900;
+	}
+	if (strcmp(model_type, "medium") == 0){
+		return 2400;
+	}
+	return 4800; // large, large_v3
+}
+
+int get_batch_worker_count(int requested, int file_n, const char *model_type, int memory_mb)
+{
+	int worker_n = requested;
+	if (worker_n <= 0){
+		int cores = std::thread::hardware_concurrency();
+		worker_n = std::max(1, cores / THREADS_PER_WORKER);
+		if (memory_mb > 0){
+			worker_n = std::min(worker_n, std::max(1, memory_mb / get_model_memory_mb(model_type)));
+		}
+	}
+	return std::max(1, std::min(worker_n, file_n));
+}
+
+std::string get_batch_output_path(const std::string &input_path, const std::string &output_dir)
+{
+	if (output_dir == ""){
+		return input_path + ".jsonl";
+	}
+	// files of different directories share a basename (a/001.wav, b/001.wav), the hash of the full input path
+	// keeps their outputs apart
+	unsigned int h = 2166136261u;
+	for (size_t i = 0; i < input_path.size(); i++){
+		h ^= (unsigned char)input_path[i];
+		h *= 16777619u;
+	}
+	char hash[16];
+	snprintf(hash, sizeof(hash), ".%08x", h);
+	size_t pos = input_path.find_last_of("/\\");
+	std::string name = ((pos == std::string::npos) ? input_path : input_path.substr(pos + 1)) + hash;
+	char last = output_dir[output_dir.size() - 1];
+	if (last == '/' || last == '\\'){
+		return output_dir + name + ".jsonl";
+	}
+	return output_dir + "/" + name + ".jsonl";
+}
+
+static std::string json_escape(const std::string &s)
+{
+	std::string out;
+	for (size_t i = 0; i < s.size(); i++){
+		unsigned char c = s[i];
+		if (c == '"' || c == '\\'){
+			out += '\\';
+			out += c;
+		}else if (c == '\n'){
+			out += "\\n";
+		}else if (c == '\r'){
+			out += "\\r";
+		}else if (c == '\t'){
+			out += "\\t";
+		}else if (c < 0x20){
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", c);
+			out += buf;
+		}else{
+			out += c;
+		}
+	}
+	return out;
+}
+
+static bool write_jsonl(const std::string &path, const std::vector<WhisperSegment> &segments)
+{
+	// write to a temporary file so that a crash never leaves a jsonl which looks complete
+	std::string tmp_path = path + ".tmp";
+	FILE *fp = fopen(tmp_path.c_str(), "wb");
+	if (fp == NULL){
+		return false;
+	}
+	bool success = true;
+	for (size_t i = 0; i < segments.size(); i++){
+		const WhisperSegment &seg = segments[i];
+		std::string text = json_escape(seg.text);
+		if (fprintf(fp, "{\"start\": %.3f, \"end\": %.3f, \"confidence\": %.4f, \"text\": \"%s\"}\n", seg.time_stamp_begin, seg.time_stamp_end, seg.confidence, text.c_str()) < 0){
+			success = false;
+		}
+	}
+	success = (fclose(fp) == 0) && success;
+	if (!success || rename(tmp_path.c_str(), path.c_str()) != 0){
+		remove(tmp_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+int run_batch(const std::vector<std::string> &files, const std::string &output_dir, int worker_n, const WhisperBatchJob &job)
+{
+	// two workers writing the same jsonl would overwrite each other, fail before any file is transcribed
+	std::map<std::string, std::string> outputs;
+	for (size_t i = 0; i < files.size(); i++){
+		std::string output_path = get_batch_output_path(files[i], output_dir);
+		std::map<std::string, std::string>::const_iterator it = outputs.find(output_path);
+		if (it != outputs.end()){
+			PRINT_ERR("%s and %s have the same output %s\n", it->second.c_str(), files[i].c_str(), output_path.c_str());
+			return AILIA_STATUS_INVALID_ARGUMENT;
+		}
+		outputs[output_path] = files[i];
+	}
+
+	std::vector<std::string> pending;
+	for (size_t i = 0; i < files.size(); i++){
+		if (check_file_existance(get_batch_output_path(files[i], output_dir).c_str())){
+			continue;
+		}
+		pending.push_back(files[i]);
+	}
+	PRINT_OUT("batch files %d (skip %d already transcribed) workers %d\n", (int)pending.size(), (int)(files.size() - pending.size()), worker_n);
+
+	std::atomic<int> next(0);
+	std::atomic<int> done(0);
+	std::atomic<int> failed(0);
+	std::mutex print_mutex;
+
+	auto worker = [&](int worker_id){
+		while (true){
+			int idx = next++;
+			if (idx >= (int)pending.size()){
+				break;
+			}
+			const std::string &path = pending[idx];
+			std::vector<WhisperSegment> segments;
+			int status = job(worker_id, path, segments);
+			bool success = (status == AILIA_STATUS_SUCCESS) && write_jsonl(get_batch_output_path(path, output_dir), segments);
+			if (!success){
+				failed++;
+			}
+			std::lock_guard<std::mutex> lock(print_mutex);
+			PRINT_OUT("[%d/%d] %s %s\n", ++done, (int)pending.size(), path.c_str(), success ? "done" : "failed");
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (int i = 0; i < worker_n; i++){
+		threads.push_back(std::thread(worker, i));
+	}
+	for (size_t i = 0; i < threads.size(); i++){
+		threads[i].join();
+	}
+
+	if (failed > 0){
+		PRINT_ERR("%d files failed\n", (int)failed);
+		return -1;
+	}
+	return AILIA_STATUS_SUCCESS;
+}
@@ -0,0 +1,39 @@
+/*******************************************************************
+*
+*    DESCRIPTION:
+*      Whisper batch transcription worker pool
+*    AUTHOR:
+*      ax Inc.
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+
+struct WhisperSegment{
+	float time_stamp_begin;
+	float time_stamp_end;
+	float confidence;
+	std::string text;
+};
+
+// Transcribe one file on the given worker, returns AILIA_STATUS_SUCCESS on success
+typedef std::function<int(int worker_id, const std::string &path, std::vector<WhisperSegment> &segments)> WhisperBatchJob;
+
+// Read the manifest, one audio file per line (empty lines and lines starting with # are ignored)
+int read_manifest(const char *path, std::vector<std::string> &files);
+
+// Number of workers from the core count and the optional memory budget
+int get_batch_worker_count(int requested, int file_n, const char *model_type, int memory_mb);
+
+// Output path of the jsonl for the input file, under output_dir the name is the basename with a hash of the
+// full input path
+std::string get_batch_output_path(const std::string &input_path, const std::string &output_dir);
+
+// Transcribe all files on worker_n threads, files with an existing jsonl are skipped to resume an interrupted run.
+// Files listed twice (the same output path) are rejected before the run
+int run_batch(const std::vector<std::string> &files, const std::string &output_dir, int worker_n, const WhisperBatchJob &job);
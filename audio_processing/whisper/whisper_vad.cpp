@@ -0,0 +1,266 @@
+/*******************************************************************
+*
+*    DESCRIPTION:
+*      Whisper VAD gating
+*    AUTHOR:
+*      ax Inc.
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "ailia_audio.h"
+#include "whisper_vad.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf_s(stderr, __VA_ARGS__)
+#else
+#define PRINT_OUT(...) fprintf(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+#define NUM_INPUTS 4
+#define NUM_OUTPUTS 3
+
+int WhisperVad::open(int env_id, int num_thread, const char *weight_path)
+{
+	int status = ailiaCreate(&net, env_id, num_thread);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("ailiaCreate failed %d\n", status);
+		net = NULL;
+		return status;
+	}
+	status = ailiaOpenWeightFile(net, weight_path);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("ailiaOpenWeightFile failed %d (%s)\n", status, weight_path);
+		close();
+		return status;
+	}
+	return AILIA_STATUS_SUCCESS;
+}
+
+void WhisperVad::close(void)
+{
+	if (net != NULL){
+		ailiaDestroy(net);
+		net = NULL;
+	}
+}
+
+int WhisperVad::forward(std::vector<float> *inputs[NUM_INPUTS], std::vector<float> *outputs[NUM_OUTPUTS])
+{
+	int status;
+
+	for (int i = 0; i < NUM_INPUTS; i++){
+		unsigned int input_blob_idx = 0;
+		status = ailiaGetBlobIndexByInputIndex(net, &input_blob_idx, i);
+		if (status != AILIA_STATUS_SUCCESS) {
+			PRINT_ERR("ailiaGetBlobIndexByInputIndex failed %s\n", ailiaGetErrorDetail(net));
+			return status;
+		}
+
+		AILIAShape sequence_shape;
+		if (i == 0){
+			sequence_shape.x = inputs[i]->size();
+			sequence_shape.y = 1;
+			sequence_shape.z = 1;
+			sequence_shape.w = 1;
+			sequence_shape.dim = 2;
+		}
+		if (i == 1){
+			sequence_shape.x = inputs[i]->size();
+			sequence_shape.y = 1;
+			sequence_shape.z = 1;
+			sequence_shape.w = 1;
+			sequence_shape.dim = 1;
+		}
+		if (i == 2 || i == 3){
+			sequence_shape.x = inputs[i]->size() / 2;
+			sequence_shape.y = 1;
+			sequence_shape.z = 2;
+			sequence_shape.w = 1;
+			sequence_shape.dim = 3;
+		}
+
+		status = ailiaSetInputBlobShape(net, &sequence_shape, input_blob_idx, AILIA_SHAPE_VERSION);
+		if (status != AILIA_STATUS_SUCCESS){
+			PRINT_ERR("ailiaSetInputBlobShape failed %s\n", ailiaGetErrorDetail(net));
+			return status;
+		}
+
+		status = ailiaSetInputBlobData(net, &(*inputs[i])[0], inputs[i]->size() * sizeof(float), input_blob_idx);
+		if (status != AILIA_STATUS_SUCCESS) {
+			PRINT_ERR("ailiaSetInputBlobData failed %s\n", ailiaGetErrorDetail(net));
+			return status;
+		}
+	}
+
+	status = ailiaUpdate(net);
+	if (status != AILIA_STATUS_SUCCESS) {
+		PRINT_ERR("ailiaUpdate failed %s\n", ailiaGetErrorDetail(net));
+		return status;
+	}
+
+	for (int i = 0; i < NUM_OUTPUTS; i++){
+		unsigned int output_blob_idx = 0;
+		status = ailiaGetBlobIndexByOutputIndex(net, &output_blob_idx, i);
+		if (status != AILIA_STATUS_SUCCESS) {
+			PRINT_ERR("ailiaGetBlobIndexByOutputIndex failed %s\n", ailiaGetErrorDetail(net));
+			return status;
+		}
+
+		AILIAShape output_blob_shape;
+		status = ailiaGetBlobShape(net, &output_blob_shape, output_blob_idx, AILIA_SHAPE_VERSION);
+		if (status != AILIA_STATUS_SUCCESS){
+			PRINT_ERR("ailiaGetBlobShape failed %s\n", ailiaGetErrorDetail(net));
+			return status;
+		}
+
+		outputs[i]->resize(output_blob_shape.x * output_blob_shape.y * output_blob_shape.z * output_blob_shape.w);
+
+		status = ailiaGetBlobData(net, &(*outputs[i])[0], outputs[i]->size() * sizeof(float), output_blob_idx);
+		if (status != AILIA_STATUS_SUCCESS) {
+			PRINT_ERR("ailiaGetBlobData failed %s\n", ailiaGetErrorDetail(net));
+			return status;
+		}
+	}
+
+	return AILIA_STATUS_SUCCESS;
+}
+
+int WhisperVad::compute(const std::vector<float> &wave, std::vector<float> &conf)
+{
+	int sequence = window_size();
+
+	std::vector<float> input(sequence);
+	std::vector<float> sr(1);
+	std::vector<float> h(2 * 64);
+	std::vector<float> c(2 * 64);
+	std::vector<float> output(1);
+
+	conf.clear();
+	for (int s = 0; s < (int)wave.size(); s += sequence){
+		for (int i = 0; i < sequence; i++){
+			input[i] = (s + i < (int)wave.size()) ? wave[s + i] : 0;
+		}
+		sr[0] = VAD_SAMPLE_RATE;
+
+		std::vector<float> *inputs[NUM_INPUTS] = {&input, &sr, &h, &c};
+		std::vector<float> *outputs[NUM_OUTPUTS] = {&output, &h, &c};
+		int status = forward(inputs, outputs);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+
+		conf.push_back(output[0]);
+	}
+
+	return AILIA_STATUS_SUCCESS;
+}
+
+int vad_preprocess(const std::vector<float> &wave, int sample_rate, int channels, std::vector<float> &wave16k)
+{
+	std::vector<float> mono(wave.size() / channels);
+	for (int i = 0; i < (int)mono.size(); i++){
+		float v = 0;
+		for (int ch = 0; ch < channels; ch++){
+			v += wave[i * channels + ch];
+		}
+		mono[i] = v / channels;
+	}
+
+	if (sample_rate == VAD_SAMPLE_RATE || mono.size() == 0){
+		wave16k.swap(mono);
+		return AILIA_STATUS_SUCCESS;
+	}
+
+	int dst_n = 0;
+	int status = ailiaAudioGetResampleLen(&dst_n, VAD_SAMPLE_RATE, mono.size(), sample_rate);
+	if (status != AILIA_STATUS_SUCCESS) {
+		PRINT_ERR("ailiaAudioGetResampleLen failed %d\n", status);
+		return status;
+	}
+	wave16k.resize(dst_n);
+	status = ailiaAudioResample(&wave16k[0], &mono[0], VAD_SAMPLE_RATE, dst_n, sample_rate, mono.size());
+	if (status != AILIA_STATUS_SUCCESS) {
+		PRINT_ERR("ailiaAudioResample failed %d\n", status);
+		return status;
+	}
+	return AILIA_STATUS_SUCCESS;
+}
+
+std::vector<VadRegion> get_vad_regions(const std::vector<float> &conf, int window_size, int sample_n, const VadConfig &config)
+{
+	int min_speech = VAD_SAMPLE_RATE * config.min_speech_ms / 1000;
+	int min_silence = VAD_SAMPLE_RATE * config.min_silence_ms / 1000;
+	int pad = VAD_SAMPLE_RATE * config.pad_ms / 1000;
+
+	// speech windows, merging short silence
+	std::vector<VadRegion> speech;
+	for (int i = 0; i < (int)conf.size(); i++){
+		if (conf[i] < config.threshold){
+			continue;
+		}
+		int begin = i * window_size;
+		int end = std::min((i + 1) * window_size, sample_n);
+		if (speech.size() > 0 && begin - speech.back().src_end < min_silence){
+			speech.back().src_end = end;
+		}else{
+			VadRegion region = {begin, end, 0};
+			speech.push_back(region);
+		}
+	}
+
+	// drop short speech and add padding
+	std::vector<VadRegion> regions;
+	for (int i = 0; i < (int)speech.size(); i++){
+		if (speech[i].src_end - speech[i].src_begin < min_speech){
+			continue;
+		}
+		int begin = std::max(0, speech[i].src_begin - pad);
+		int end = std::min(sample_n, speech[i].src_end + pad);
+		if (regions.size() > 0 && begin <= regions.back().src_end){
+			regions.back().src_end = end;
+		}else{
+			VadRegion region = {begin, end, 0};
+			regions.push_back(region);
+		}
+	}
+	return regions;
+}
+
+std::vector<float> gate_wave(const std::vector<float> &wave, std::vector<VadRegion> &regions, const VadConfig &config)
+{
+	int gap = VAD_SAMPLE_RATE * config.gap_ms / 1000;
+	std::vector<float> gated;
+	for (int i = 0; i < (int)regions.size(); i++){
+		if (i > 0){
+			int silence = regions[i].src_begin - regions[i - 1].src_end;
+			gated.insert(gated.end(), std::min(gap, silence), 0.0f);
+		}
+		regions[i].dst_begin = gated.size();
+		gated.insert(gated.end(), wave.begin() + regions[i].src_begin, wave.begin() + regions[i].src_end);
+	}
+	return gated;
+}
+
+float vad_remap_time(const std::vector<VadRegion> &regions, float sec)
+{
+	if (regions.size() == 0){
+		return sec;
+	}
+	int t = (int)(sec * VAD_SAMPLE_RATE);
+	for (int i = 0; i < (int)regions.size(); i++){
+		const VadRegion &r = regions[i];
+		if (t < r.dst_begin){
+			return (float)r.src_begin / VAD_SAMPLE_RATE;	// inside the gap
+		}
+		if (t <= r.dst_begin + (r.src_end - r.src_begin)){
+			return (float)(r.src_begin + t - r.dst_begin) / VAD_SAMPLE_RATE;
+		}
+	}
+	return (float)regions.back().src_end / VAD_SAMPLE_RATE;
+}
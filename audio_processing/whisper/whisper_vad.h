@@ -0,0 +1,68 @@
+/*******************************************************************
+*
+*    DESCRIPTION:
+*      Whisper VAD gating
+*    AUTHOR:
+*      ax Inc.
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#pragma once
+
+#include <vector>
+
+#include "ailia.h"
+
+#define VAD_SAMPLE_RATE 16000
+
+struct VadConfig{
+	float threshold;		// speech probability threshold
+	int min_speech_ms;		// shorter speech is dropped
+	int min_silence_ms;		// shorter silence is merged into the speech
+	int pad_ms;				// padding added to both sides of the speech
+	int gap_ms;				// silence kept between the speech regions
+
+	VadConfig(){
+		threshold = 0.5f;
+		min_speech_ms = 250;
+		min_silence_ms = 300;
+		pad_ms = 200;
+		gap_ms = 200;
+	}
+};
+
+// Speech region of the original audio and its position in the gated audio
+struct VadRegion{
+	int src_begin;
+	int src_end;
+	int dst_begin;
+};
+
+// Silero VAD network
+class WhisperVad{
+private:
+	AILIANetwork *net;
+	int forward(std::vector<float> *inputs[4], std::vector<float> *outputs[3]);
+
+public:
+	WhisperVad() : net(NULL) {}
+	int open(int env_id, int num_thread, const char *weight_path);
+	void close(void);
+
+	// Speech probability of every VAD window of 16kHz mono audio
+	int compute(const std::vector<float> &wave, std::vector<float> &conf);
+	int window_size(void) const { return 1536; }
+};
+
+// Downmix and resample to 16kHz mono
+int vad_preprocess(const std::vector<float> &wave, int sample_rate, int channels, std::vector<float> &wave16k);
+
+// Speech regions from the window probabilities
+std::vector<VadRegion> get_vad_regions(const std::vector<float> &conf, int window_size, int sample_n, const VadConfig &config);
+
+// Concatenate the speech regions with a short gap, fills dst_begin
+std::vector<float> gate_wave(const std::vector<float> &wave, std::vector<VadRegion> &regions, const VadConfig &config);
+
+// Map a time stamp of the gated audio back to the original audio
+float vad_remap_time(const std::vector<VadRegion> &regions, float sec);
@@ -13,12 +13,16 @@
 #include <time.h>
 #include <vector>
 #include <string>
+#include <thread>
+#include <chrono>
 #include <opencv2/opencv.hpp>
 
 #undef UNICODE
 
 #include "ailia.h"
 #include "u2net_utils.h"
+#include "u2net_tile.h"
+#include "u2net_temporal.h"
 #include "utils.h"
 #include "webcamera_utils.h"
 
@@ -57,6 +61,10 @@ static const std::vector<const char*> OPSET_LISTS = {"10", "11"};
 
 static bool benchmark  = false;
 static bool video_mode = false;
+static bool tile_mode  = false;
+static TileConfig tile_config;
+static bool temporal_mode = false;
+static TemporalConfig temporal_config;
 
 
 // ======================
@@ -66,7 +74,8 @@ static bool video_mode = false;
 static void print_usage()
 {
     PRINT_OUT("usage: u2net [-h] [-i IMAGE] [-v VIDEO] [-a ARCH] [-s SAVE_IMAGE_PATH] [-b]\n");
-    PRINT_OUT("             [-o OPSET]\n");
+    PRINT_OUT("             [-o OPSET] [-t TILE_SIZE] [--overlap OVERLAP] [--coarse]\n");
+    PRINT_OUT("             [-w WORKERS] [-k KEYFRAME_INTERVAL] [--smooth ALPHA]\n");
     return;
 }
 
@@ -91,6 +100,21 @@ static void print_help()
     PRINT_OUT("                        video mode) (default: False)\n");
     PRINT_OUT("  -o OPSET, --opset OPSET\n");
     PRINT_OUT("                        opset lists: 10 | 11 (default: 10)\n");
+    PRINT_OUT("  -t TILE_SIZE, --tile TILE_SIZE\n");
+    PRINT_OUT("                        Predict large images in overlapping tiles of TILE_SIZE\n");
+    PRINT_OUT("                        pixels. 320 runs at the native resolution. (default: None)\n");
+    PRINT_OUT("  --overlap OVERLAP     Minimum overlap between tiles. (default: 64)\n");
+    PRINT_OUT("  --coarse              Refine only the tiles on the object boundary of a\n");
+    PRINT_OUT("                        low resolution pass. (default: False)\n");
+    PRINT_OUT("  -w WORKERS, --workers WORKERS\n");
+    PRINT_OUT("                        Number of networks running tiles in parallel.\n");
+    PRINT_OUT("                        (default: 2)\n");
+    PRINT_OUT("  -k KEYFRAME_INTERVAL, --keyframe KEYFRAME_INTERVAL\n");
+    PRINT_OUT("                        Run the network every KEYFRAME_INTERVAL frames in video\n");
+    PRINT_OUT("                        mode (and on scene changes), the mask of the other\n");
+    PRINT_OUT("                        frames is warped with optical flow. (default: None)\n");
+    PRINT_OUT("  --smooth ALPHA        Weight of the current mask in the temporal smoothing,\n");
+    PRINT_OUT("                        1 disables it. (default: 0.6)\n");
     return;
 }
 
@@ -158,6 +182,26 @@ static int argument_parser(int argc, char **argv)
             else if (arg == "-b" || arg == "--benchmark") {
                 benchmark = true;
             }
+            else if (arg == "-t" || arg == "--tile") {
+                tile_mode = true;
+                status = 6;
+            }
+            else if (arg == "--overlap") {
+                status = 7;
+            }
+            else if (arg == "--coarse") {
+                tile_config.coarse = true;
+            }
+            else if (arg == "-w" || arg == "--workers") {
+                status = 8;
+            }
+            else if (arg == "-k" || arg == "--keyframe") {
+                temporal_mode = true;
+                status = 9;
+            }
+            else if (arg == "--smooth") {
+                status = 10;
+            }
             else if (arg == "-h" || arg == "--help") {
                 print_usage();
                 print_help();
@@ -207,6 +251,21 @@ static int argument_parser(int argc, char **argv)
                     return -1;
                 }
                 break;
+            case 6:
+                tile_config.tile_size = std::max(32, atoi(arg.c_str()));
+                break;
+            case 7:
+                tile_config.overlap = std::max(0, atoi(arg.c_str()));
+                break;
+            case 8:
+                tile_config.workers = std::max(1, atoi(arg.c_str()));
+                break;
+            case 9:
+                temporal_config.keyframe_interval = std::max(1, atoi(arg.c_str()));
+                break;
+            case 10:
+                temporal_config.smooth_alpha = std::min(1.0f, std::max(0.0f, (float)atof(arg.c_str())));
+                break;
             default:
                 print_usage();
                 print_error(arg);
@@ -241,10 +300,141 @@ static int argument_parser(int argc, char **argv)
 }
 
 
+// ======================
+// Secondary functions
+// ======================
+
+static int open_network(AILIANetwork **net, int num_thread)
+{
+    int env_id = AILIA_ENVIRONMENT_ID_AUTO;
+    int status = ailiaCreate(net, env_id, num_thread);
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("ailiaCreate failed %d\n", status);
+        return -1;
+    }
+
+    status = ailiaOpenStreamFile(*net, model.c_str());
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("ailiaOpenStreamFile failed %d\n", status);
+        PRINT_ERR("ailiaGetErrorDetail %s\n", ailiaGetErrorDetail(*net));
+        ailiaDestroy(*net);
+        return -1;
+    }
+
+    status = ailiaOpenWeightFile(*net, weight.c_str());
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("ailiaOpenWeightFile failed %d\n", status);
+        ailiaDestroy(*net);
+        return -1;
+    }
+
+    return AILIA_STATUS_SUCCESS;
+}
+
+
+// mask of img at the size of img
+static int predict_mask(AILIANetwork *net, const cv::Mat& img, cv::Mat& pred)
+{
+    AILIAShape input_shape;
+    int status = ailiaGetInputShape(net, &input_shape, AILIA_SHAPE_VERSION);
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("ailiaGetInputShape failed %d\n", status);
+        return -1;
+    }
+    int input_size = input_shape.x*input_shape.y*input_shape.z*input_shape.w*sizeof(float);
+
+    AILIAShape output_shape;
+    status = ailiaGetOutputShape(net, &output_shape, AILIA_SHAPE_VERSION);
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("ailiaGetOutputShape failed %d\n", status);
+        return -1;
+    }
+    int preds_size = output_shape.x*output_shape.y*output_shape.z*output_shape.w*sizeof(float);
+    cv::Mat preds_ailia(output_shape.y, output_shape.x, CV_32FC1);
+
+    cv::Mat input;
+    transform(img, input, cv::Size(IMAGE_SIZE, IMAGE_SIZE));
+    status = ailiaPredict(net, preds_ailia.data, preds_size, input.data, input_size);
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("ailiaPredict failed %d\n", status);
+        return -1;
+    }
+
+    cv::resize(preds_ailia, pred, img.size(), 0, 0);
+
+    return AILIA_STATUS_SUCCESS;
+}
+
+
 // ======================
 // Main functions
 // ======================
 
+static int recognize_from_image_tiled(AILIANetwork *net)
+{
+    // tiles are predicted at the source resolution
+    cv::Mat img = cv::imread(image_path.c_str(), cv::IMREAD_COLOR);
+    if (img.empty()) {
+        PRINT_ERR("\'%s\' not found\n", image_path.c_str());
+        return -1;
+    }
+    PRINT_OUT("input image shape: (%d, %d, %d)\n", img.cols, img.rows, img.channels());
+
+    // the model has a fixed batch size of 1, so tiles run in parallel on separate networks
+    std::vector<AILIANetwork*> nets(1, net);
+    int num_thread = std::max(1, (int)std::thread::hardware_concurrency() / tile_config.workers);
+    int status = AILIA_STATUS_SUCCESS;
+    for (int i = 1; i < tile_config.workers; i++) {
+        AILIANetwork *worker_net;
+        status = open_network(&worker_net, num_thread);
+        if (status != AILIA_STATUS_SUCCESS) {
+            break;
+        }
+        nets.push_back(worker_net);
+    }
+
+    if (status == AILIA_STATUS_SUCCESS) {
+        PRINT_OUT("Start inference...\n");
+        // wall clock, clock() would add up the time of all workers
+        auto start = std::chrono::steady_clock::now();
+
+        cv::Mat coarse;
+        if (tile_config.coarse) {
+            status = predict_mask(net, img, coarse);
+        }
+
+        cv::Mat mask;
+        if (status == AILIA_STATUS_SUCCESS) {
+            TileConfig config = tile_config;
+            config.workers = nets.size();
+            status = predict_tiled(img, coarse, config,
+                                   [&nets](int worker, const cv::Mat& tile, cv::Mat& pred) {
+                                       return predict_mask(nets[worker], tile, pred);
+                                   }, mask);
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        if (status == AILIA_STATUS_SUCCESS) {
+            long ms = (long)std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+            PRINT_OUT("\tailia processing time %ld ms\n", ms);
+            status = save_result(mask, save_image_path.c_str(), img.size());
+        }
+    }
+
+    for (int i = 1; i < nets.size(); i++) {
+        ailiaDestroy(nets[i]);
+    }
+    if (status != AILIA_STATUS_SUCCESS) {
+        return -1;
+    }
+
+    PRINT_OUT("Program finished successfully.\n");
+
+    return AILIA_STATUS_SUCCESS;
+}
+
+
+
 static int recognize_from_image(AILIANetwork *net)
 {
     // prepare input data
@@ -362,25 +552,40 @@ static int recognize_from_video(AILIANetwork *net)
         }
     }
 
+    MaskPropagator propagator(temporal_config);
+    int frame_count = 0;
+    int keyframe_count = 0;
+
     while (1) {
         cv::Mat frame;
         capture >> frame;
         if ((char)cv::waitKey(1) == 'q' || frame.empty()) {
             break;
         }
-        cv::Mat input;
-        transform(frame, input, cv::Size(IMAGE_SIZE, IMAGE_SIZE));
+        frame_count++;
 
-        // inference
-        status = ailiaPredict(net, preds_ailia.data, preds_size, input.data, input_size);
-        if (status != AILIA_STATUS_SUCCESS) {
-            PRINT_ERR("ailiaPredict failed %d\n", status);
-            return -1;
+        if (!temporal_mode || propagator.next_frame(frame)) {
+            cv::Mat input;
+            transform(frame, input, cv::Size(IMAGE_SIZE, IMAGE_SIZE));
+
+            // inference
+            status = ailiaPredict(net, preds_ailia.data, preds_size, input.data, input_size);
+            if (status != AILIA_STATUS_SUCCESS) {
+                PRINT_ERR("ailiaPredict failed %d\n", status);
+                return -1;
+            }
+            keyframe_count++;
+            if (temporal_mode) {
+                propagator.update(preds_ailia);
+            }
+        }
+        else {
+            propagator.propagate();
         }
 
         // post processing
         cv::Mat pred;
-        cv::resize(preds_ailia, pred, cv::Size(f_w, f_h), 0, 0);
+        cv::resize(temporal_mode ? propagator.result() : preds_ailia, pred, cv::Size(f_w, f_h), 0, 0);
         cv::imshow("frame", pred);
 
         // save results
@@ -391,6 +596,10 @@ static int recognize_from_video(AILIANetwork *net)
     capture.release();
     cv::destroyAllWindows();
 
+    if (temporal_mode) {
+        PRINT_OUT("frames %d keyframes %d\n", frame_count, keyframe_count);
+    }
+
     PRINT_OUT("Program finished successfully.\n");
 
     return AILIA_STATUS_SUCCESS;
@@ -442,6 +651,9 @@ int main(int argc, char **argv)
     if (video_mode) {
         status = recognize_from_video(net);
     }
+    else if (tile_mode) {
+        status = recognize_from_image_tiled(net);
+    }
     else {
         status = recognize_from_image(net);
     }
@@ -0,0 +1,82 @@
+﻿#include <stdio.h>
+#include <stdlib.h>
+#include <opencv2/opencv.hpp>
+
+#include "u2net_temporal.h"
+
+
+bool MaskPropagator::next_frame(const cv::Mat& frame)
+{
+    cv::swap(gray, prev_gray);
+
+    cv::Mat small;
+    int flow_height = std::max(1, frame.rows * config.flow_width / frame.cols);
+    cv::resize(frame, small, cv::Size(config.flow_width, flow_height), 0, 0, cv::INTER_AREA);
+    if (small.channels() == 3) {
+        cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        small.copyTo(gray);
+    }
+
+    scene_changed = false;
+    if (mask.empty() || prev_gray.size() != gray.size()) {
+        return true;
+    }
+
+    // a cut can not be propagated, start over without smoothing across it
+    cv::Mat diff;
+    cv::absdiff(gray, prev_gray, diff);
+    float changed = (float)cv::countNonZero(diff > config.pixel_threshold) / (float)diff.total();
+    if (changed > config.scene_threshold) {
+        scene_changed = true;
+        return true;
+    }
+
+    return since_keyframe + 1 >= config.keyframe_interval;
+}
+
+
+void MaskPropagator::update(const cv::Mat& pred)
+{
+    pred.copyTo(mask);
+    since_keyframe = 0;
+    smooth();
+}
+
+
+void MaskPropagator::propagate()
+{
+    // backward flow, every pixel of the current frame points to its position in the previous frame
+    cv::calcOpticalFlowFarneback(gray, prev_gray, flow, 0.5, 3, 15, 3, 5, 1.2, 0);
+
+    float sx = (float)mask.cols / gray.cols;
+    float sy = (float)mask.rows / gray.rows;
+    cv::resize(flow, flow_up, mask.size(), 0, 0, cv::INTER_LINEAR);
+    map_x.create(mask.size(), CV_32FC1);
+    map_y.create(mask.size(), CV_32FC1);
+    for (int y = 0; y < mask.rows; y++) {
+        const cv::Point2f* d = flow_up.ptr<cv::Point2f>(y);
+        float* mx = map_x.ptr<float>(y);
+        float* my = map_y.ptr<float>(y);
+        for (int x = 0; x < mask.cols; x++) {
+            mx[x] = x + d[x].x * sx;
+            my[x] = y + d[x].y * sy;
+        }
+    }
+    cv::remap(mask, warped, map_x, map_y, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+    cv::swap(mask, warped);
+
+    since_keyframe++;
+    smooth();
+}
+
+
+void MaskPropagator::smooth()
+{
+    if (smoothed.empty() || scene_changed || smoothed.size() != mask.size() || config.smooth_alpha >= 1.0f) {
+        mask.copyTo(smoothed);
+        return;
+    }
+    cv::addWeighted(mask, config.smooth_alpha, smoothed, 1.0f - config.smooth_alpha, 0.0, smoothed);
+}
@@ -0,0 +1,61 @@
+﻿#ifndef _U2NET_TEMPORAL_H_
+#define _U2NET_TEMPORAL_H_
+
+#include <opencv2/opencv.hpp>
+
+#ifndef __cplusplus
+extern "C" {
+#endif
+
+struct TemporalConfig {
+    int   keyframe_interval;    // run the network at least every this many frames
+    float scene_threshold;      // ratio of changed pixels which forces a keyframe
+    int   pixel_threshold;      // gray level difference counted as changed
+    int   flow_width;           // width of the image the optical flow is computed on
+    float smooth_alpha;         // weight of the current mask in the exponential smoothing, 1 disables it
+
+    TemporalConfig() {
+        keyframe_interval = 5;
+        scene_threshold = 0.3f;
+        pixel_threshold = 25;
+        flow_width = 160;
+        smooth_alpha = 0.6f;
+    }
+};
+
+// Propagate the mask of the last keyframe to the following frames with optical flow
+class MaskPropagator {
+private:
+    TemporalConfig config;
+    cv::Mat gray;
+    cv::Mat prev_gray;
+    cv::Mat flow;
+    cv::Mat flow_up;
+    cv::Mat map_x;
+    cv::Mat map_y;
+    cv::Mat mask;
+    cv::Mat warped;
+    cv::Mat smoothed;
+    int  since_keyframe;
+    bool scene_changed;
+
+    void smooth();
+
+public:
+    MaskPropagator(const TemporalConfig& temporal_config) : config(temporal_config), since_keyframe(0), scene_changed(false) {}
+
+    // Returns true when the network has to run on this frame
+    bool next_frame(const cv::Mat& frame);
+    // Mask predicted by the network for the current frame
+    void update(const cv::Mat& pred);
+    // Warp the previous mask to the current frame
+    void propagate();
+    // Smoothed mask of the current frame
+    const cv::Mat& result() const { return smoothed; }
+};
+
+#ifndef __cplusplus
+}
+#endif
+
+#endif
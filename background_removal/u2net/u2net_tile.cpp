@@ -0,0 +1,177 @@
+﻿#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <opencv2/opencv.hpp>
+
+#include "u2net_tile.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf_s(stderr, __VA_ARGS__)
+#else
+#define PRINT_OUT(...) fprintf(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+
+// tile origins spread evenly so that the last tile ends at the image border
+static void tile_positions(int length, int tile, int overlap, std::vector<int>& pos)
+{
+    pos.clear();
+    if (length <= tile) {
+        pos.push_back(0);
+        return;
+    }
+    int step = std::max(1, tile - overlap);
+    int n = (int)ceil((double)(length - overlap) / step);
+    n = std::max(n, 2);
+    for (int i = 0; i < n; i++) {
+        pos.push_back((int)((double)i * (length - tile) / (n - 1) + 0.5));
+    }
+}
+
+
+// linear ramps over the actual overlap with the previous and next tile,
+// the ramps of two neighbors sum to one inside their overlap
+static void ramp(const std::vector<int>& pos, int i, int tile, std::vector<float>& w)
+{
+    int before = (i > 0) ? pos[i-1] + tile - pos[i] : 0;
+    int after  = (i < (int)pos.size() - 1) ? pos[i] + tile - pos[i+1] : 0;
+    w.assign(tile, 1.0f);
+    for (int x = 0; x < tile; x++) {
+        if (x < before) {
+            w[x] = std::min(w[x], (x + 0.5f) / before);
+        }
+        if (x >= tile - after) {
+            w[x] = std::min(w[x], (tile - x - 0.5f) / after);
+        }
+    }
+}
+
+
+void make_tiles(cv::Size size, const TileConfig& config, std::vector<cv::Rect>& tiles, std::vector<cv::Mat>& weights)
+{
+    int tw = std::min(config.tile_size, size.width);
+    int th = std::min(config.tile_size, size.height);
+    std::vector<int> xs, ys;
+    tile_positions(size.width,  tw, config.overlap, xs);
+    tile_positions(size.height, th, config.overlap, ys);
+
+    tiles.clear();
+    weights.clear();
+    std::vector<float> wx, wy;
+    for (int j = 0; j < ys.size(); j++) {
+        ramp(ys, j, th, wy);
+        for (int i = 0; i < xs.size(); i++) {
+            ramp(xs, i, tw, wx);
+            cv::Mat w(th, tw, CV_32FC1);
+            for (int y = 0; y < th; y++) {
+                float* row = w.ptr<float>(y);
+                for (int x = 0; x < tw; x++) {
+                    row[x] = wx[x] * wy[y];
+                }
+            }
+            tiles.push_back(cv::Rect(xs[i], ys[j], tw, th));
+            weights.push_back(w);
+        }
+    }
+}
+
+
+void select_boundary_tiles(const cv::Mat& coarse, const std::vector<cv::Rect>& tiles, const TileConfig& config,
+                           std::vector<int>& selected)
+{
+    // the upsampled coarse mask is smooth, so object edges fall in the uncertain band
+    cv::Mat band = (coarse > config.coarse_low) & (coarse < config.coarse_high);
+
+    selected.clear();
+    for (int i = 0; i < tiles.size(); i++) {
+        if (cv::countNonZero(band(tiles[i])) > 0) {
+            selected.push_back(i);
+        }
+    }
+}
+
+
+int predict_tiled(const cv::Mat& image, const cv::Mat& coarse, const TileConfig& config,
+                  const TilePredictFunc& predict, cv::Mat& mask)
+{
+    std::vector<cv::Rect> tiles;
+    std::vector<cv::Mat>  weights;
+    make_tiles(image.size(), config, tiles, weights);
+
+    std::vector<int> selected;
+    if (coarse.empty()) {
+        for (int i = 0; i < tiles.size(); i++) {
+            selected.push_back(i);
+        }
+    }
+    else {
+        select_boundary_tiles(coarse, tiles, config, selected);
+    }
+    PRINT_OUT("tiles %d refined %d workers %d\n", (int)tiles.size(), (int)selected.size(), config.workers);
+
+    cv::Mat acc  = cv::Mat::zeros(image.size(), CV_32FC1);
+    cv::Mat wsum = cv::Mat::zeros(image.size(), CV_32FC1);
+    std::mutex acc_mutex;
+    std::atomic<int> next(0);
+    std::atomic<int> failed(0);
+
+    auto worker = [&](int worker_id) {
+        cv::Mat pred, weighted;
+        while (failed == 0) {
+            int idx = next++;
+            if (idx >= (int)selected.size()) {
+                break;
+            }
+            const cv::Rect& rect = tiles[selected[idx]];
+            const cv::Mat& w = weights[selected[idx]];
+            if (predict(worker_id, image(rect), pred) != 0) {
+                failed++;
+                break;
+            }
+            cv::multiply(pred, w, weighted);
+
+            std::lock_guard<std::mutex> lock(acc_mutex);
+            cv::Mat acc_roi  = acc(rect);
+            cv::Mat wsum_roi = wsum(rect);
+            acc_roi  += weighted;
+            wsum_roi += w;
+        }
+    };
+
+    int worker_n = std::max(1, std::min(config.workers, (int)selected.size()));
+    std::vector<std::thread> threads;
+    for (int i = 0; i < worker_n; i++) {
+        threads.push_back(std::thread(worker, i));
+    }
+    for (int i = 0; i < threads.size(); i++) {
+        threads[i].join();
+    }
+    if (failed > 0) {
+        return -1;
+    }
+
+    // refined tiles fade into the coarse mask where no other tile covers them
+    mask = cv::Mat(image.size(), CV_32FC1);
+    for (int y = 0; y < mask.rows; y++) {
+        const float* a = acc.ptr<float>(y);
+        const float* s = wsum.ptr<float>(y);
+        const float* c = coarse.empty() ? nullptr : coarse.ptr<float>(y);
+        float* m = mask.ptr<float>(y);
+        for (int x = 0; x < mask.cols; x++) {
+            if (c == nullptr) {
+                m[x] = (s[x] > 0.0f) ? a[x] / s[x] : 0.0f;
+            }
+            else {
+                m[x] = (a[x] + c[x] * std::max(0.0f, 1.0f - s[x])) / std::max(s[x], 1.0f);
+            }
+        }
+    }
+
+    return 0;
+}
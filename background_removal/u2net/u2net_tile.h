@@ -0,0 +1,48 @@
+﻿#ifndef _U2NET_TILE_H_
+#define _U2NET_TILE_H_
+
+#include <vector>
+#include <functional>
+#include <opencv2/opencv.hpp>
+
+#ifndef __cplusplus
+extern "C" {
+#endif
+
+struct TileConfig {
+    int   tile_size;    // tile size in source pixels, the tile is resized to the network input
+    int   overlap;      // minimum overlap between neighboring tiles
+    bool  coarse;       // refine only the tiles on the boundary of a low resolution pass
+    float coarse_low;   // coarse mask values between low and high are boundary
+    float coarse_high;
+    int   workers;      // number of networks running tiles in parallel
+
+    TileConfig() {
+        tile_size = 320;
+        overlap = 64;
+        coarse = false;
+        coarse_low = 0.05f;
+        coarse_high = 0.95f;
+        workers = 2;
+    }
+};
+
+// Predict the mask of img (CV_32FC1, same size as img) on the given worker
+typedef std::function<int(int worker, const cv::Mat& img, cv::Mat& pred)> TilePredictFunc;
+
+// Overlapping tile grid covering the image, weights receives the feathered blend weight of every tile
+void make_tiles(cv::Size size, const TileConfig& config, std::vector<cv::Rect>& tiles, std::vector<cv::Mat>& weights);
+
+// Indices of the tiles containing a boundary of the coarse mask
+void select_boundary_tiles(const cv::Mat& coarse, const std::vector<cv::Rect>& tiles, const TileConfig& config,
+                           std::vector<int>& selected);
+
+// Predict the mask of a large image tile by tile and blend the tiles, coarse (same size as image) may be empty
+int predict_tiled(const cv::Mat& image, const cv::Mat& coarse, const TileConfig& config,
+                  const TilePredictFunc& predict, cv::Mat& mask);
+
+#ifndef __cplusplus
+}
+#endif
+
+#endif
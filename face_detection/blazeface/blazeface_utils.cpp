@@ -5,6 +5,7 @@
 #include <opencv2/opencv.hpp>
 
 #include "mat_utils.h"
+#include "nms_utils.h"
 
 #if defined(_WIN32) || defined(_WIN64)
 #define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
@@ -516,58 +517,6 @@ static void decode_boxes(const cv::Mat& raw_boxes, cv::Mat& boxes)
 }
 
 
-static void intersect(const cv::Mat& box_a, const cv::Mat& box_b, cv::Mat& inter)
-{
-    inter = cv::Mat(1, box_b.rows, CV_32FC1);
-    float* ba_data = (float*)box_a.data;
-    float* bb_data = (float*)box_b.data;
-    float* inter_data = (float*)inter.data;
-    for (int i = 0; i < box_b.rows; i++) {
-        float min_x = std::max(ba_data[1], bb_data[i*4+1]);
-        float min_y = std::max(ba_data[0], bb_data[i*4+0]);
-        float max_x = std::min(ba_data[3], bb_data[i*4+3]);
-        float max_y = std::min(ba_data[2], bb_data[i*4+2]);
-        float w = std::max(0.0f, max_x - min_x);
-        float h = std::max(0.0f, max_y - min_y);
-        inter_data[i] = w * h;
-    }
-
-    return;
-}
-
-
-static void jaccard(const cv::Mat& box_a, const cv::Mat& box_b, cv::Mat& ious)
-{
-    // Compute the jaccard overlap of two sets of boxes.  The jaccard overlap
-    // is simply the intersection over union of two boxes.  Here we operate on
-    // ground truth boxes and default boxes.
-
-    cv::Mat inter;
-    intersect(box_a, box_b, inter);
-
-    ious = cv::Mat(1, box_b.rows, CV_32FC1);
-    float* ba_data = (float*)box_a.data;
-    float* bb_data = (float*)box_b.data;
-    float* inter_data = (float*)inter.data;
-    float* ious_data  = (float*)ious.data;
-    float area_a = (ba_data[3] - ba_data[1]) * (ba_data[2] - ba_data[0]);
-    for (int i = 0; i < box_b.rows; i++) {
-        float area_b = (bb_data[i*4+3] - bb_data[i*4+1]) * (bb_data[i*4+2] - bb_data[i*4+0]);
-        ious_data[i] = inter_data[i] / (area_a + area_b - inter_data[i]);
-    }
-
-    return;
-}
-
-
-static void overlap_similarity(const cv::Mat& first_box, const cv::Mat& other_boxes, cv::Mat& ious)
-{
-    jaccard(first_box, other_boxes, ious);
-
-    return;
-}
-
-
 static void weighted_non_max_suppression(const std::vector<cv::Mat> &detections, std::vector<cv::Mat>& output_detections)
 {
     if (detections.size() == 0) {
@@ -576,71 +525,20 @@ static void weighted_non_max_suppression(const std::vector<cv::Mat> &detections,
 
     float min_suppression_threshold = 0.3f;
 
-    std::vector<float> scores;
+    // (ymin, xmin, ymax, xmax, 6 keypoints, score) per row
+    int cols = detections[0].cols;
+    std::vector<float> rows(detections.size() * cols);
     for (int i = 0; i < detections.size(); i++) {
         float* det_data = (float*)detections[i].data;
-        scores.push_back(det_data[16]);
+        std::copy(det_data, det_data + cols, rows.begin() + i * cols);
     }
 
-    // Sort the scores from highest to lowest score.
-    cv::Mat mat_scores    = cv::Mat_<float>(1, scores.size(), &scores[0]);
-    cv::Mat mat_remaining = cv::Mat_<int>(1, scores.size());
-    cv::sortIdx(mat_scores, mat_remaining, cv::SORT_EVERY_ROW|cv::SORT_DESCENDING);
-    std::vector<int> remaining;
-    remaining.insert(remaining.end(), (int*)mat_remaining.data, (int*)mat_remaining.data+mat_remaining.cols);
-
-    while (remaining.size() > 0) {
-        cv::Mat detection = detections[remaining[0]];
-
-        // Compute the overlap between the first box and the other 
-        // remaining boxes. (Note that the other_boxes also include
-        // the first_box.)
-        cv::Mat first_box = detection.colRange(cv::Range(0, 4));
-        cv::Mat other_boxes = cv::Mat(remaining.size(), 4, CV_32FC1);
-        for (int i = 0; i < remaining.size(); i++) {
-            cv::Rect roi(0, i, 4, 1);
-            detections[remaining[i]].colRange(cv::Range(0, 4)).copyTo(other_boxes(roi));
-        }
-        cv::Mat ious;
-        overlap_similarity(first_box, other_boxes, ious);
-
-        // If two detections don't overlap enough, they are considered
-        // to be from different faces.
-        float* ious_data = (float*)ious.data;
-        std::vector<int> overlapping;
-        std::vector<int> next_remaining;
-        for (int i = 0; i < ious.cols; i++) {
-            if (ious_data[i] > min_suppression_threshold) {
-                overlapping.push_back(remaining[i]);
-            }
-            else {
-                next_remaining.push_back(remaining[i]);
-            }
-        }
-
-        // Take an average of the coordinates from the overlapping
-        // detections, weighted by their confidence scores.
-        cv::Mat weighted_detection = detection;
-        if (overlapping.size() > 1) {
-            float total_score = 0.0f;
-            cv::Mat sum_coordinate = cv::Mat(1, 16, CV_32FC1, 0.0f);
-            for (int i = 0; i < overlapping.size(); i++) {
-                float* det_data = (float*)detections[overlapping[i]].data;
-                float score = det_data[16];
-                total_score += score;
-                cv::Mat coordinate = detections[overlapping[i]].colRange(cv::Range(0, 16));
-                coordinate *= score;
-                sum_coordinate += coordinate;
-            }
-            sum_coordinate /= total_score;
-            cv::Rect roi(0, 0, 16, 1);
-            sum_coordinate.copyTo(weighted_detection(roi));
-            float* wdet_data = (float*)weighted_detection.data;
-            wdet_data[16] = total_score / overlapping.size();
-        }
-        output_detections.push_back(weighted_detection);
+    // average the 16 coordinates of the overlapping detections, weighted by their confidence scores
+    std::vector<float> merged;
+    weighted_nms(rows.data(), detections.size(), cols, 16, 16, min_suppression_threshold, merged);
 
-        remaining = next_remaining;
+    for (int i = 0; i < merged.size() / cols; i++) {
+        output_detections.push_back(cv::Mat(1, cols, CV_32FC1, &merged[i * cols]).clone());
     }
 
     return;
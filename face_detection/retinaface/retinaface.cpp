@@ -25,6 +25,7 @@
 #include "ailia_detector.h"
 #include "utils.h"
 #include "detector_utils.h"
+#include "nms_utils.h"
 #include "webcamera_utils.h"
 
 using namespace std;
@@ -330,52 +331,6 @@ vector<vector<float>> keep_top_k_before_nms(const vector<vector<float>>& src, co
     return dst;
 }
 
-vector<int> nms(const vector<vector<float>>& boxes, const vector<float>& scores, float thresh) {
-    int numBoxes = boxes.size();
-    vector<float> x1(numBoxes), y1(numBoxes), x2(numBoxes), y2(numBoxes);
-    
-    for (int i = 0; i < numBoxes; ++i) {
-        x1[i] = boxes[i][0];
-        y1[i] = boxes[i][1];
-        x2[i] = boxes[i][2];
-        y2[i] = boxes[i][3];
-    }
-
-    vector<float> areas(numBoxes);
-    for (int i = 0; i < numBoxes; ++i) {
-        areas[i] = (x2[i] - x1[i] + 1) * (y2[i] - y1[i] + 1);
-    }
-
-    vector<int> order(numBoxes);
-    iota(order.begin(), order.end(), 0);
-    sort(order.begin(), order.end(), [&scores](int a, int b) { return scores[a] > scores[b]; });
-
-    vector<int> keep;
-    while (!order.empty()) {
-        int i = order[0];
-        keep.push_back(i);
-
-        vector<int> newOrder;
-        for (size_t j = 1; j < order.size(); ++j) {
-            int k = order[j];
-            float xx1 = max(x1[i], x1[k]);
-            float yy1 = max(y1[i], y1[k]);
-            float xx2 = min(x2[i], x2[k]);
-            float yy2 = min(y2[i], y2[k]);
-
-            float w = max(0.0f, xx2 - xx1 + 1);
-            float h = max(0.0f, yy2 - yy1 + 1);
-            float inter = w * h;
-            float ovr = inter / (areas[i] + areas[k] - inter);
-            if (ovr <= thresh) {
-                newOrder.push_back(k);
-            }
-        }
-        order = newOrder;
-    }
-    return keep;
-}
-
 bool compare_indices(const std::pair<int, float>& a, const std::pair<int, float>& b) {
     return a.second > b.second;
 }
@@ -437,7 +392,14 @@ vector<FaceInfo> post_process(const vector<float>& box_data, const vector<float>
     vector<float> top_k_scores = keep_top_k_before_nms(filtered_scores, order, top_k);
     vector<vector<float>> top_k_landmarks = keep_top_k_before_nms(filtered_landmarks, order, top_k);
 
-    vector<int> keep = nms(top_k_boxes, top_k_scores, NMS_THRES);
+    vector<float> flat_boxes(top_k * BOX_DIM);
+    for (int i = 0; i < top_k; i++) {
+        copy(top_k_boxes[i].begin(), top_k_boxes[i].begin() + BOX_DIM, flat_boxes.begin() + i * BOX_DIM);
+    }
+    NmsConfig nms_config(NMS_THRES);
+    nms_config.max_keep = KEEP_TOP_K;
+    vector<int> keep;
+    nms(flat_boxes.data(), top_k_scores.data(), top_k, keep, nms_config);
 
     int row = keep.size();
     vector<vector<float>> nms_boxes(row, vector<float>(BOX_DIM));
@@ -710,14 +672,16 @@ static int recognize_from_video(AILIANetwork* ailia)
 
     std::vector<float> work;
 
+    LetterboxContext letterbox(IMAGE_WIDTH, IMAGE_HEIGHT);
+
     while (1) {
         cv::Mat frame;
         capture >> frame;
         if ((char)cv::waitKey(1) == 'q' || frame.empty()) {
             break;
         }
-        cv::Mat resized_img, img;
-        adjust_frame_size(frame, resized_img, IMAGE_WIDTH, IMAGE_HEIGHT);
+        cv::Mat img;
+        cv::Mat resized_img = letterbox.resize(frame);
         cv::cvtColor(resized_img, img, cv::COLOR_BGR2BGRA);
 
         vector<FaceInfo> results;
@@ -301,14 +301,16 @@ static int recognize_from_video(AILIANetwork *net)
         }
     }
 
+    LetterboxContext letterbox(IMAGE_WIDTH, IMAGE_HEIGHT);
+
     while (1) {
         cv::Mat frame;
         capture >> frame;
         if ((char)cv::waitKey(1) == 'q' || frame.empty()) {
             break;
         }
-        cv::Mat input_image, input;
-        preprocess_frame(frame, input_image, input, IMAGE_WIDTH, IMAGE_HEIGHT, true, "255");
+        cv::Mat input_image = letterbox.padded(frame);
+        const cv::Mat& input = letterbox.tensor(frame, true, "255");
 
         // inference
         status = ailiaPredict(net, preds_ailia.data, preds_size, input.data, input_size);
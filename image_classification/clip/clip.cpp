@@ -32,6 +32,8 @@
 
 #include "utils.h"
 #include "webcamera_utils.h"
+#include "clip_text.h"
+#include "clip_kernels.h"
 
 
 // ======================
@@ -49,8 +51,8 @@
 #define IMAGE_WIDTH  224 // for video mode
 #define IMAGE_HEIGHT 224 // for video mode
 
-#define CONTEXT_LENGTH 77
-#define FEATURE_LENGTH 512
+#define TEXT_CACHE_PATH "ViT-B32-encode_text.cache"
+#define TEXT_BATCH_SIZE 32
 
 #if defined(_WIN32) || defined(_WIN64)
 #define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
@@ -70,6 +72,8 @@ static std::string model_text(MODEL_PATH_TEXT);
 
 static std::string image_path(IMAGE_PATH);
 static std::vector<std::string> texts;
+static std::string text_cache_path(TEXT_CACHE_PATH);
+static int text_batch_size = TEXT_BATCH_SIZE;
 
 static bool benchmark  = false;
 static int args_env_id = -1;
@@ -82,7 +86,8 @@ static bool debug = false;
 
 static void print_usage()
 {
-    PRINT_OUT("usage: clip [-h] [-i IMAGE] [-b] [-e ENV_ID]\n");
+    PRINT_OUT("usage: clip [-h] [-i IMAGE] [-t TEXT] [-c CACHE] [--no_cache]\n");
+    PRINT_OUT("            [--batch_size BATCH_SIZE] [-b] [-e ENV_ID]\n");
     return;
 }
 
@@ -98,6 +103,12 @@ static void print_help()
     PRINT_OUT("                        The input image path.\n");
     PRINT_OUT("  -t TEXT, --text TEXT\n");
     PRINT_OUT("                        The input text.\n");
+    PRINT_OUT("  -c CACHE, --cache CACHE\n");
+    PRINT_OUT("                        The text embedding cache file. (default: %s)\n", TEXT_CACHE_PATH);
+    PRINT_OUT("  --no_cache            Encode the texts without the text embedding cache.\n");
+    PRINT_OUT("  --batch_size BATCH_SIZE\n");
+    PRINT_OUT("                        The number of texts encoded in one inference.\n");
+    PRINT_OUT("                        (default: %d)\n", TEXT_BATCH_SIZE);
     PRINT_OUT("  -b, --benchmark       Running the inference on the same input 5 times to\n");
     PRINT_OUT("                        measure execution performance. (Cannot be used in\n");
     PRINT_OUT("                        video mode)\n");
@@ -138,6 +149,15 @@ static int argument_parser(int argc, char **argv)
 			else if (arg == "-t" || arg == "--text") {
 				status = 5;
 			}
+            else if (arg == "-c" || arg == "--cache") {
+                status = 6;
+            }
+            else if (arg == "--no_cache") {
+                text_cache_path = "";
+            }
+            else if (arg == "--batch_size") {
+                status = 7;
+            }
             else {
                 print_usage();
                 print_error(arg);
@@ -155,6 +175,12 @@ static int argument_parser(int argc, char **argv)
 			case 5:
 				texts.push_back(arg);
 				break;
+            case 6:
+                text_cache_path = arg;
+                break;
+            case 7:
+                text_batch_size = atoi(arg.c_str());
+                break;
             default:
                 print_usage();
                 print_error(arg);
@@ -192,75 +218,30 @@ static void preprocess_image(const cv::Mat& simg, cv::Mat& dimg)
     return;
 }
 
-void softmax(float *data, int n){
-	float sum=0;
-	for(int i=0;i<n;i++){
-		sum+=exp(data[i]);
-	}
-	for(int i=0;i<n;i++){
-		data[i]=exp(data[i])/sum;
-	}
-}
-
-float norm(std::vector<float> & vec1){
-	float norm1 = 0;
-	for (int i = 0; i < vec1.size(); i++){
-		norm1 += vec1[i] * vec1[i];
-	}
-	norm1 = sqrt(norm1);
-	return norm1;
-}
-
-float cos_similarity(std::vector<float> & vec1, std::vector<float> & vec2){
-	float sum = 0;
-	float norm1 = norm(vec1);
-	float norm2 = norm(vec2);
-	for (int i = 0; i < vec1.size(); i++){
-		sum += (vec1[i] / norm1) * (vec2[i] / norm2);
-	}
-	return sum;
-}
-
 // ======================
 // Image embeddings
 // ======================
 
 std::vector<float> resize_and_center_crop(cv::Mat img){
     // rgb order, (/255 - mean )/std
-    // resize to 224 and center crop
-    std::vector<float> input_img(IMAGE_WIDTH * IMAGE_HEIGHT * 3);
-    float mean[3] = {0.48145466, 0.4578275, 0.40821073};
-    float stdf[3] = {0.26862954, 0.26130258, 0.27577711};
-    float ratio_w = 1.0f * img.cols / IMAGE_WIDTH;
-    float ratio_h = 1.0f * img.rows / IMAGE_HEIGHT;
-    float ratio = std::min(ratio_w, ratio_h);
+    // resize to 224 with bicubic and center crop
+    std::vector<float> input_img;
+    clip_resize_crop_normalize(img.data, img.cols, img.rows, (int)img.step, IMAGE_WIDTH, input_img, CLIP_BICUBIC);
+
     if (debug){
-        PRINT_OUT("input %dx%d output %dx%d ratio %fx%f\n", img.cols, img.rows, (int)(IMAGE_WIDTH * ratio), (int)(IMAGE_HEIGHT * ratio), ratio_w, ratio_h);
-    }
-    std::vector<unsigned char> preview(IMAGE_HEIGHT * IMAGE_WIDTH * 4);
-    for (int y = 0; y < IMAGE_HEIGHT; y++){
-        for (int x = 0; x < IMAGE_WIDTH; x++){
-            int y2 = y * ratio + (img.rows - IMAGE_HEIGHT * ratio)/2;
-            int x2 = x * ratio + (img.cols - IMAGE_WIDTH * ratio)/2;
-            if (x2 < img.cols && y2 < img.rows){
-                input_img[0 * IMAGE_WIDTH * IMAGE_HEIGHT + y * IMAGE_WIDTH + x] = (img.data[(img.cols * y2 + x2)*4 + 0] / 255.0f - mean[0])/stdf[0];
-                input_img[1 * IMAGE_WIDTH * IMAGE_HEIGHT + y * IMAGE_WIDTH + x] = (img.data[(img.cols * y2 + x2)*4 + 1] / 255.0f - mean[1])/stdf[1];
-                input_img[2 * IMAGE_WIDTH * IMAGE_HEIGHT + y * IMAGE_WIDTH + x] = (img.data[(img.cols * y2 + x2)*4 + 2] / 255.0f - mean[2])/stdf[2];
-            }else{
-                input_img[0 * IMAGE_WIDTH * IMAGE_HEIGHT + y * IMAGE_WIDTH + x] = 0.0f;
-                input_img[1 * IMAGE_WIDTH * IMAGE_HEIGHT + y * IMAGE_WIDTH + x] = 0.0f;
-                input_img[2 * IMAGE_WIDTH * IMAGE_HEIGHT + y * IMAGE_WIDTH + x] = 0.0f;
-            }
-            if (debug){
+        float mean[3] = {0.48145466, 0.4578275, 0.40821073};
+        float stdf[3] = {0.26862954, 0.26130258, 0.27577711};
+        PRINT_OUT("input %dx%d output %dx%d\n", img.cols, img.rows, IMAGE_WIDTH, IMAGE_HEIGHT);
+        std::vector<unsigned char> preview(IMAGE_HEIGHT * IMAGE_WIDTH * 4, 255);
+        for (int y = 0; y < IMAGE_HEIGHT; y++){
+            for (int x = 0; x < IMAGE_WIDTH; x++){
                 for (int i = 0; i < 3; i++){
                     int v = (input_img[i * IMAGE_WIDTH * IMAGE_HEIGHT + y * IMAGE_WIDTH + x] * stdf[i] + mean[i])*255;
                     preview[(y*IMAGE_WIDTH + x)*4 + i] = std::max(0, std::min(255, v));
                 }
             }
         }
-    }
 
-    if (debug){
         cv::Mat dest(IMAGE_HEIGHT, IMAGE_WIDTH, img.type());
         dest.data = preview.data();
         cv::imwrite("temp1.jpg", dest);
@@ -275,7 +256,7 @@ std::vector<float> resize_and_center_crop(cv::Mat img){
 
 static std::vector<float> image_embedding(AILIANetwork *image_enc, std::string path)
 {
-    std::vector<float> features(FEATURE_LENGTH);
+    std::vector<float> features(CLIP_FEATURE_LENGTH);
 
     // prepare input data
     cv::Mat simg = cv::imread(path.c_str(), cv::IMREAD_UNCHANGED);
@@ -320,80 +301,6 @@ static std::vector<float> image_embedding(AILIANetwork *image_enc, std::string p
     return features;
 }
 
-// ======================
-// Text embeddings
-// ======================
-
-std::vector<int> tokenize(AILIATokenizer * tokenizer, std::string text){
-    if (debug){
-        printf("Input Text : %s\n", text.c_str());
-    }
-	ailiaTokenizerEncode(tokenizer, text.c_str());
-	unsigned int count;
-	ailiaTokenizerGetTokenCount(tokenizer, &count);
-	std::vector<int> tokens(count);
-	ailiaTokenizerGetTokens(tokenizer, &tokens[0], count);
-    std::vector<int> pad_tokens(CONTEXT_LENGTH);
-    for (int i = 0; i < CONTEXT_LENGTH; i++){
-        if (i < tokens.size()){
-            pad_tokens[i] = tokens[i];
-            if (i == CONTEXT_LENGTH - 1){
-                pad_tokens[i] = tokens[tokens.size() - 1]; // SOT
-            }
-        }else{
-            pad_tokens[i] = 0;
-        }
-    }
-    if (debug){
-        printf("Tokens : ");
-        for (int i = 0; i < pad_tokens.size(); i++){
-            printf("%d ", pad_tokens[i]);
-        }
-        printf("\n");
-    }
-    return pad_tokens;
-}
-
-std::vector<float> text_embedding(AILIANetwork *ailia_text, std::vector<int> &tokens){
-    std::vector<float> features(FEATURE_LENGTH);
-
-    unsigned int input_blob_idx = 0;
-    int status = ailiaGetBlobIndexByInputIndex(ailia_text, &input_blob_idx, 0);
-    if (status != AILIA_STATUS_SUCCESS) {
-        PRINT_ERR("TextEmbedding ailiaGetBlobIndexByInputIndex %d", status);
-        return features;
-    }
-
-    AILIAShape sequence_shape;
-    sequence_shape.x=CONTEXT_LENGTH;
-    sequence_shape.y=1;
-    sequence_shape.z=1;
-    sequence_shape.w=1;
-    sequence_shape.dim=2;
-
-    status = ailiaSetInputBlobShape(ailia_text,&sequence_shape,input_blob_idx,AILIA_SHAPE_VERSION);
-    if(status!=AILIA_STATUS_SUCCESS){
-        PRINT_ERR("TextEmbedding ailiaSetInputBlobShape failed %d\n", status);
-        return features;
-    }
-
-    if (tokens.size() != CONTEXT_LENGTH){
-        PRINT_ERR("Invalid token size %lu\n", tokens.size());
-        return features;
-    }
-
-    std::vector<float> tokens_float(CONTEXT_LENGTH);
-    for (int i = 0; i < CONTEXT_LENGTH; i++){
-        tokens_float[i] = (float)tokens[i];
-    }
-    status = ailiaPredict(ailia_text, &features[0], features.size() * sizeof(float), &tokens_float[0], tokens_float.size() * sizeof(float));
-    if (status != AILIA_STATUS_SUCCESS){
-        PRINT_ERR("TextEmbedding ailiaGetErrorDetail %s\n", ailiaGetErrorDetail(ailia_text));
-        return features;
-    }
-    return features;
-}
-
 // ======================
 // Main functions
 // ======================
@@ -497,8 +404,6 @@ int main(int argc, char **argv)
         return -1;
     }
 
-    // Tokenize
-    std::vector<std::vector<int>> tokens;
     if (texts.size() == 0){
         texts.push_back(std::string("a dog"));
         texts.push_back(std::string("a cat"));
@@ -510,19 +415,26 @@ int main(int argc, char **argv)
 		PRINT_ERR("ailiaTokenizerCreate error %d\n", status);
 		return -1;
 	}
-    PRINT_OUT("Tokenize...\n");
-    for (int i = 0; i < texts.size(); i++){
-        std::vector<int>  token = tokenize(tokenizer, texts[i]);
-        tokens.push_back(token);
-    }
-	ailiaTokenizerDestroy(tokenizer);
 
-    // text embedding
+    // text embedding, only the texts missing in the cache are tokenized and encoded
     PRINT_OUT("Text embedding...\n");
+    // the model id follows the file contents (size and hash of the head), a replaced weight with the same
+    // path does not reuse the old embeddings
+    std::vector<std::string> text_model_files;
+    text_model_files.push_back(model_text);
+    text_model_files.push_back(weight_text);
+    ClipTextCache text_cache(model_file_version(text_model_files));
+    if (text_cache_path != ""){
+        text_cache.load(text_cache_path);
+    }
     std::vector< std::vector<float> > text_features;
-    for (int i = 0; i < texts.size(); i++){
-        std::vector<float> features = text_embedding(ailia_text, tokens[i]);
-        text_features.push_back(features);
+    status = clip_text_embeddings(ailia_text, tokenizer, text_cache, texts, text_batch_size, text_features, debug);
+	ailiaTokenizerDestroy(tokenizer);
+    if (status != AILIA_STATUS_SUCCESS){
+        return -1;
+    }
+    if (text_cache_path != ""){
+        text_cache.save(text_cache_path);
     }
 
     // image embedding
@@ -531,15 +443,18 @@ int main(int argc, char **argv)
 
     // distance
     PRINT_OUT("Similarity...\n");
-    std::vector<float> confs;
-    std::vector<float> sims;
+    ClipEmbeddingMatrix text_matrix(CLIP_FEATURE_LENGTH);
+    text_matrix.reserve(texts.size());
     for (int i = 0; i < texts.size(); i++){
-        float sim = cos_similarity(image_features, text_features[i]);
-        confs.push_back(sim * 100);
-        sims.push_back(sim);
+        text_matrix.add(&text_features[i][0]);
     }
-
-    softmax(&confs[0], confs.size());
+    std::vector<float> sims(texts.size());
+    text_matrix.similarity(&image_features[0], &sims[0]);
+    std::vector<float> confs(texts.size());
+    for (int i = 0; i < texts.size(); i++){
+        confs[i] = sims[i] * 100;
+    }
+    clip_softmax(&confs[0], 1, confs.size());
 
     for (int i = 0; i < texts.size(); i++){
         printf("Label %s Confidence %f Similarity %f\n", texts[i].c_str(), confs[i], sims[i]);
@@ -0,0 +1,250 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA clip preprocessing and similarity kernels
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <math.h>
+#include <algorithm>
+
+#include "clip_kernels.h"
+
+// lanes of the dot product accumulators, written so that the compiler keeps them in one vector register
+#define GEMV_LANES 8
+
+
+// ======================
+// Resize and crop
+// ======================
+
+static float bicubic_filter(float x)
+{
+    // a = -0.5 as PIL
+    const float a = -0.5f;
+    x = fabsf(x);
+    if (x < 1.0f) {
+        return ((a + 2.0f) * x - (a + 3.0f)) * x * x + 1.0f;
+    }
+    if (x < 2.0f) {
+        return (((x - 5.0f) * x + 8.0f) * x - 4.0f) * a;
+    }
+    return 0.0f;
+}
+
+
+static float bilinear_filter(float x)
+{
+    x = fabsf(x);
+    return (x < 1.0f) ? 1.0f - x : 0.0f;
+}
+
+
+struct FilterTaps {
+    std::vector<int> begin;     // first source pixel of each output pixel
+    std::vector<int> count;     // number of taps
+    std::vector<float> weights; // max_taps per output pixel
+    int max_taps;
+};
+
+
+// taps of output pixels [offset, offset + n) when in_size is resized to out_size
+static void compute_taps(int in_size, int out_size, int offset, int n, ClipInterpolation interpolation, FilterTaps& taps)
+{
+    float support = (interpolation == CLIP_BICUBIC) ? 2.0f : 1.0f;
+    float scale = (float)in_size / (float)out_size;
+    float filter_scale = std::max(scale, 1.0f);
+    support *= filter_scale;
+
+    taps.max_taps = (int)ceilf(support) * 2 + 1;
+    taps.begin.resize(n);
+    taps.count.resize(n);
+    taps.weights.assign(n * taps.max_taps, 0.0f);
+
+    for (int i = 0; i < n; i++) {
+        float center = (offset + i + 0.5f) * scale;
+        int xmin = std::max((int)(center - support + 0.5f), 0);
+        int xmax = std::min((int)(center + support + 0.5f), in_size);
+        float* w = &taps.weights[i * taps.max_taps];
+        float total = 0.0f;
+        int count = std::min(xmax - xmin, taps.max_taps);
+        for (int k = 0; k < count; k++) {
+            float x = (k + xmin - center + 0.5f) / filter_scale;
+            w[k] = (interpolation == CLIP_BICUBIC) ? bicubic_filter(x) : bilinear_filter(x);
+            total += w[k];
+        }
+        if (total != 0.0f) {
+            for (int k = 0; k < count; k++) {
+                w[k] /= total;
+            }
+        }
+        taps.begin[i] = xmin;
+        taps.count[i] = count;
+    }
+}
+
+
+static inline unsigned char clip_u8(float v)
+{
+    int i = (int)floorf(v + 0.5f);
+    return (unsigned char)std::min(std::max(i, 0), 255);
+}
+
+
+void clip_resize_crop_normalize(const unsigned char* rgba, int width, int height, int stride,
+                                int size, std::vector<float>& chw, ClipInterpolation interpolation)
+{
+    static const float mean[3] = {0.48145466f, 0.4578275f, 0.40821073f};
+    static const float stdf[3] = {0.26862954f, 0.26130258f, 0.27577711f};
+
+    // torchvision Resize(size) then CenterCrop(size)
+    int resized_w, resized_h;
+    if (width <= height) {
+        resized_w = size;
+        resized_h = (int)((long long)size * height / width);
+    }
+    else {
+        resized_h = size;
+        resized_w = (int)((long long)size * width / height);
+    }
+    // python round, half to even
+    int crop_x = (int)nearbyint((resized_w - size) / 2.0);
+    int crop_y = (int)nearbyint((resized_h - size) / 2.0);
+
+    FilterTaps taps_x, taps_y;
+    compute_taps(width, resized_w, crop_x, size, interpolation, taps_x);
+    compute_taps(height, resized_h, crop_y, size, interpolation, taps_y);
+
+    // horizontal pass on the source rows the crop needs
+    int row_begin = taps_y.begin[0];
+    int row_end = taps_y.begin[size - 1] + taps_y.count[size - 1];
+    std::vector<unsigned char> horizontal((size_t)(row_end - row_begin) * size * 3);
+    for (int y = row_begin; y < row_end; y++) {
+        const unsigned char* src = rgba + (size_t)y * stride;
+        unsigned char* dst = &horizontal[(size_t)(y - row_begin) * size * 3];
+        for (int x = 0; x < size; x++) {
+            const float* w = &taps_x.weights[x * taps_x.max_taps];
+            const unsigned char* s = src + taps_x.begin[x] * 4;
+            float r = 0.0f, g = 0.0f, b = 0.0f;
+            for (int k = 0; k < taps_x.count[x]; k++) {
+                r += s[k * 4 + 0] * w[k];
+                g += s[k * 4 + 1] * w[k];
+                b += s[k * 4 + 2] * w[k];
+            }
+            dst[x * 3 + 0] = clip_u8(r);
+            dst[x * 3 + 1] = clip_u8(g);
+            dst[x * 3 + 2] = clip_u8(b);
+        }
+    }
+
+    // vertical pass fused with the normalization into CHW
+    float lut[3][256];
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 256; i++) {
+            lut[c][i] = (i / 255.0f - mean[c]) / stdf[c];
+        }
+    }
+    int plane = size * size;
+    chw.resize(plane * 3);
+    std::vector<float> acc(size * 3);
+    for (int y = 0; y < size; y++) {
+        const float* w = &taps_y.weights[y * taps_y.max_taps];
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        for (int k = 0; k < taps_y.count[y]; k++) {
+            const unsigned char* s = &horizontal[(size_t)(taps_y.begin[y] + k - row_begin) * size * 3];
+            float wk = w[k];
+            for (int i = 0; i < size * 3; i++) {
+                acc[i] += s[i] * wk;
+            }
+        }
+        for (int x = 0; x < size; x++) {
+            for (int c = 0; c < 3; c++) {
+                chw[c * plane + y * size + x] = lut[c][clip_u8(acc[x * 3 + c])];
+            }
+        }
+    }
+}
+
+
+// ======================
+// Similarity
+// ======================
+
+void clip_l2_normalize(float* v, int n)
+{
+    float sum = 0.0f;
+    for (int i = 0; i < n; i++) {
+        sum += v[i] * v[i];
+    }
+    float inv = (sum > 0.0f) ? 1.0f / sqrtf(sum) : 0.0f;
+    for (int i = 0; i < n; i++) {
+        v[i] *= inv;
+    }
+}
+
+
+void ClipEmbeddingMatrix::add(const float* embedding)
+{
+    data.insert(data.end(), embedding, embedding + dim);
+    clip_l2_normalize(&data[(size_t)rows * dim], dim);
+    rows++;
+}
+
+
+static inline float dot(const float* a, const float* b, int n)
+{
+    float lanes[GEMV_LANES] = {0};
+    int i = 0;
+    for (; i + GEMV_LANES <= n; i += GEMV_LANES) {
+        for (int k = 0; k < GEMV_LANES; k++) {
+            lanes[k] += a[i + k] * b[i + k];
+        }
+    }
+    float sum = 0.0f;
+    for (; i < n; i++) {
+        sum += a[i] * b[i];
+    }
+    for (int k = 0; k < GEMV_LANES; k++) {
+        sum += lanes[k];
+    }
+    return sum;
+}
+
+
+void ClipEmbeddingMatrix::similarity(const float* query, float* scores, float scale) const
+{
+    std::vector<float> q(query, query + dim);
+    clip_l2_normalize(&q[0], dim);
+    for (int i = 0; i < dim; i++) {
+        q[i] *= scale;
+    }
+
+    const float* m = data.empty() ? NULL : &data[0];
+    for (int r = 0; r < rows; r++) {
+        scores[r] = dot(m + (size_t)r * dim, &q[0], dim);
+    }
+}
+
+
+void clip_softmax(float* data, int rows, int cols)
+{
+    for (int r = 0; r < rows; r++) {
+        float* v = data + (size_t)r * cols;
+        float max_v = v[0];
+        for (int i = 1; i < cols; i++) {
+            max_v = std::max(max_v, v[i]);
+        }
+        float sum = 0.0f;
+        for (int i = 0; i < cols; i++) {
+            v[i] = expf(v[i] - max_v);
+            sum += v[i];
+        }
+        float inv = 1.0f / sum;
+        for (int i = 0; i < cols; i++) {
+            v[i] *= inv;
+        }
+    }
+}
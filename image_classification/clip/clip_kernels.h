@@ -0,0 +1,54 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA clip preprocessing and similarity kernels
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#ifndef _CLIP_KERNELS_H_
+#define _CLIP_KERNELS_H_
+
+#include <stddef.h>
+#include <vector>
+
+enum ClipInterpolation {
+    CLIP_BICUBIC = 0,   // reference preprocessing
+    CLIP_BILINEAR
+};
+
+// Resize the shorter side to size, center crop size x size and write (x/255 - mean)/std in CHW order.
+// Same resampling as PIL (antialiased separable filter with 8bit intermediate) used by the reference,
+// the filter taps are only computed for the cropped pixels.
+void clip_resize_crop_normalize(const unsigned char* rgba, int width, int height, int stride,
+                                int size, std::vector<float>& chw, ClipInterpolation interpolation = CLIP_BICUBIC);
+
+// L2 normalized embeddings stored row major, similarity of a query to all rows is one GEMV
+class ClipEmbeddingMatrix {
+public:
+    ClipEmbeddingMatrix(int dim) : dim(dim), rows(0) {}
+
+    void clear() { data.clear(); rows = 0; }
+    void reserve(int n) { data.reserve((size_t)n * dim); }
+    // the row is normalized when stored
+    void add(const float* embedding);
+    int size() const { return rows; }
+    const float* row(int i) const { return &data[(size_t)i * dim]; }
+
+    // scores[i] = scale * dot(row(i), normalize(query))
+    void similarity(const float* query, float* scores, float scale = 1.0f) const;
+
+private:
+    int dim;
+    int rows;
+    std::vector<float> data;
+};
+
+void clip_l2_normalize(float* v, int n);
+
+// Row wise softmax of a rows x cols matrix, the row maximum is subtracted before exp
+void clip_softmax(float* data, int rows, int cols);
+
+#endif
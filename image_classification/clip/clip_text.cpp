@@ -0,0 +1,254 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA clip batched text embeddings with a persistent cache
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "clip_text.h"
+#include "clip_kernels.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf_s(stderr, __VA_ARGS__)
+#else
+#define PRINT_OUT(...) fprintf(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+static const char CACHE_MAGIC[8] = {'C', 'L', 'I', 'P', 'T', 'X', 'T', '1'};
+
+
+std::vector<int> clip_tokenize(AILIATokenizer* tokenizer, const std::string& text, bool debug)
+{
+    if (debug) {
+        PRINT_OUT("Input Text : %s\n", text.c_str());
+    }
+    std::vector<int> pad_tokens(CLIP_CONTEXT_LENGTH, 0);
+    int status = ailiaTokenizerEncode(tokenizer, text.c_str());
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("ailiaTokenizerEncode failed %d\n", status);
+        return pad_tokens;
+    }
+    unsigned int count = 0;
+    ailiaTokenizerGetTokenCount(tokenizer, &count);
+    if (count == 0) {
+        return pad_tokens;
+    }
+    std::vector<int> tokens(count);
+    ailiaTokenizerGetTokens(tokenizer, &tokens[0], count);
+
+    int n = std::min((int)count, CLIP_CONTEXT_LENGTH);
+    for (int i = 0; i < n; i++) {
+        pad_tokens[i] = tokens[i];
+    }
+    if ((int)count >= CLIP_CONTEXT_LENGTH) {
+        pad_tokens[CLIP_CONTEXT_LENGTH - 1] = tokens[count - 1]; // EOT
+    }
+    if (debug) {
+        PRINT_OUT("Tokens : ");
+        for (int i = 0; i < (int)pad_tokens.size(); i++) {
+            PRINT_OUT("%d ", pad_tokens[i]);
+        }
+        PRINT_OUT("\n");
+    }
+    return pad_tokens;
+}
+
+
+uint64_t ClipTextCache::key(const std::string& text) const
+{
+    // FNV-1a over the model id, a separator and the prompt
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < model_id.size(); i++) {
+        h = (h ^ (unsigned char)model_id[i]) * 1099511628211ULL;
+    }
+    h = (h ^ 0xff) * 1099511628211ULL;
+    for (size_t i = 0; i < text.size(); i++) {
+        h = (h ^ (unsigned char)text[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+
+const float* ClipTextCache::find(uint64_t key) const
+{
+    std::map<uint64_t, std::vector<float>>::const_iterator it = entries.find(key);
+    if (it == entries.end()) {
+        return NULL;
+    }
+    return &it->second[0];
+}
+
+
+void ClipTextCache::insert(uint64_t key, const float* features)
+{
+    entries[key] = std::vector<float>(features, features + CLIP_FEATURE_LENGTH);
+    modified = true;
+}
+
+
+int ClipTextCache::load(const std::string& path)
+{
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        return AILIA_STATUS_SUCCESS;
+    }
+
+    char magic[8];
+    int feature_length = 0;
+    int count = 0;
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) || memcmp(magic, CACHE_MAGIC, sizeof(magic)) != 0 ||
+        fread(&feature_length, sizeof(int), 1, fp) != 1 || feature_length != CLIP_FEATURE_LENGTH ||
+        fread(&count, sizeof(int), 1, fp) != 1 || count < 0) {
+        PRINT_ERR("\'%s\' is not a text embedding cache, ignored\n", path.c_str());
+        fclose(fp);
+        return AILIA_STATUS_SUCCESS;
+    }
+
+    std::vector<float> features(CLIP_FEATURE_LENGTH);
+    for (int i = 0; i < count; i++) {
+        uint64_t key;
+        if (fread(&key, sizeof(key), 1, fp) != 1 ||
+            fread(&features[0], sizeof(float), CLIP_FEATURE_LENGTH, fp) != CLIP_FEATURE_LENGTH) {
+            PRINT_ERR("\'%s\' is truncated, %d of %d entries loaded\n", path.c_str(), i, count);
+            break;
+        }
+        entries[key] = features;
+    }
+    fclose(fp);
+
+    return AILIA_STATUS_SUCCESS;
+}
+
+
+int ClipTextCache::save(const std::string& path)
+{
+    if (!modified) {
+        return AILIA_STATUS_SUCCESS;
+    }
+
+    // written to a temporary file first so that an interrupted save keeps the previous cache
+    std::string tmp_path = path + ".tmp";
+    FILE* fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == NULL) {
+        PRINT_ERR("\'%s\' open failed\n", tmp_path.c_str());
+        return AILIA_STATUS_ERROR_FILE_API;
+    }
+
+    int feature_length = CLIP_FEATURE_LENGTH;
+    int count = (int)entries.size();
+    bool success = fwrite(CACHE_MAGIC, 1, sizeof(CACHE_MAGIC), fp) == sizeof(CACHE_MAGIC);
+    success = success && fwrite(&feature_length, sizeof(int), 1, fp) == 1;
+    success = success && fwrite(&count, sizeof(int), 1, fp) == 1;
+    std::map<uint64_t, std::vector<float>>::const_iterator it;
+    for (it = entries.begin(); success && it != entries.end(); it++) {
+        success = fwrite(&it->first, sizeof(uint64_t), 1, fp) == 1 &&
+                  fwrite(&it->second[0], sizeof(float), CLIP_FEATURE_LENGTH, fp) == CLIP_FEATURE_LENGTH;
+    }
+    success = (fclose(fp) == 0) && success;
+
+    remove(path.c_str());
+    if (!success || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        PRINT_ERR("\'%s\' write failed\n", path.c_str());
+        remove(tmp_path.c_str());
+        return AILIA_STATUS_ERROR_FILE_API;
+    }
+    modified = false;
+
+    return AILIA_STATUS_SUCCESS;
+}
+
+
+static int encode_batch(AILIANetwork* ailia_text, const std::vector<float>& tokens, int batch, std::vector<float>& features)
+{
+    unsigned int input_blob_idx = 0;
+    int status = ailiaGetBlobIndexByInputIndex(ailia_text, &input_blob_idx, 0);
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("TextEmbedding ailiaGetBlobIndexByInputIndex %d\n", status);
+        return status;
+    }
+
+    // (batch, context) token ids, the batch dimension is dynamic
+    AILIAShape sequence_shape;
+    sequence_shape.x = CLIP_CONTEXT_LENGTH;
+    sequence_shape.y = batch;
+    sequence_shape.z = 1;
+    sequence_shape.w = 1;
+    sequence_shape.dim = 2;
+
+    status = ailiaSetInputBlobShape(ailia_text, &sequence_shape, input_blob_idx, AILIA_SHAPE_VERSION);
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("TextEmbedding ailiaSetInputBlobShape failed %d\n", status);
+        return status;
+    }
+
+    features.resize(batch * CLIP_FEATURE_LENGTH);
+    status = ailiaPredict(ailia_text, &features[0], features.size() * sizeof(float), &tokens[0], batch * CLIP_CONTEXT_LENGTH * sizeof(float));
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("TextEmbedding ailiaGetErrorDetail %s\n", ailiaGetErrorDetail(ailia_text));
+        return status;
+    }
+
+    return AILIA_STATUS_SUCCESS;
+}
+
+
+int clip_text_embeddings(AILIANetwork* ailia_text, AILIATokenizer* tokenizer, ClipTextCache& cache,
+                         const std::vector<std::string>& texts, int batch_size,
+                         std::vector<std::vector<float>>& features, bool debug)
+{
+    batch_size = std::max(1, batch_size);
+
+    // prompts not in the cache, duplicated prompts are encoded once
+    std::vector<uint64_t> keys(texts.size());
+    std::vector<int> misses;
+    std::map<uint64_t, int> pending;
+    for (int i = 0; i < (int)texts.size(); i++) {
+        keys[i] = cache.key(texts[i]);
+        if (cache.find(keys[i]) == NULL && pending.find(keys[i]) == pending.end()) {
+            pending[keys[i]] = i;
+            misses.push_back(i);
+        }
+    }
+    PRINT_OUT("Text embedding cache hit %d miss %d\n", (int)(texts.size() - misses.size()), (int)misses.size());
+
+    std::vector<float> tokens;
+    std::vector<float> batch_features;
+    for (int begin = 0; begin < (int)misses.size(); begin += batch_size) {
+        int batch = std::min(batch_size, (int)misses.size() - begin);
+        tokens.resize(batch * CLIP_CONTEXT_LENGTH);
+        for (int b = 0; b < batch; b++) {
+            std::vector<int> token = clip_tokenize(tokenizer, texts[misses[begin + b]], debug);
+            for (int i = 0; i < CLIP_CONTEXT_LENGTH; i++) {
+                tokens[b * CLIP_CONTEXT_LENGTH + i] = (float)token[i];
+            }
+        }
+
+        int status = encode_batch(ailia_text, tokens, batch, batch_features);
+        if (status != AILIA_STATUS_SUCCESS) {
+            return status;
+        }
+
+        for (int b = 0; b < batch; b++) {
+            float* f = &batch_features[b * CLIP_FEATURE_LENGTH];
+            clip_l2_normalize(f, CLIP_FEATURE_LENGTH);
+            cache.insert(keys[misses[begin + b]], f);
+        }
+    }
+
+    features.resize(texts.size());
+    for (int i = 0; i < (int)texts.size(); i++) {
+        const float* f = cache.find(keys[i]);
+        features[i].assign(f, f + CLIP_FEATURE_LENGTH);
+    }
+
+    return AILIA_STATUS_SUCCESS;
+}
@@ -0,0 +1,54 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA clip batched text embeddings with a persistent cache
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#ifndef _CLIP_TEXT_H_
+#define _CLIP_TEXT_H_
+
+#include <vector>
+#include <string>
+#include <map>
+#include <stdint.h>
+
+#include "ailia.h"
+#include "ailia_tokenizer.h"
+
+#define CLIP_CONTEXT_LENGTH 77
+#define CLIP_FEATURE_LENGTH 512
+
+// Tokens of one prompt padded to CLIP_CONTEXT_LENGTH, the last token is kept when the prompt is truncated
+std::vector<int> clip_tokenize(AILIATokenizer* tokenizer, const std::string& text, bool debug = false);
+
+// L2 normalized text embeddings keyed by the hash of (model, prompt), model_id identifies the model files
+// by their contents, not their path
+class ClipTextCache {
+public:
+    ClipTextCache(const std::string& model_id) : model_id(model_id), modified(false) {}
+
+    uint64_t key(const std::string& text) const;
+    const float* find(uint64_t key) const;
+    void insert(uint64_t key, const float* features);
+
+    // a missing file is an empty cache, save only writes when entries were added
+    int load(const std::string& path);
+    int save(const std::string& path);
+    int size() const { return (int)entries.size(); }
+
+private:
+    std::string model_id;
+    std::map<uint64_t, std::vector<float>> entries;
+    bool modified;
+};
+
+// Encode the prompts in batches of batch_size, prompts found in the cache are not tokenized nor inferred
+int clip_text_embeddings(AILIANetwork* ailia_text, AILIATokenizer* tokenizer, ClipTextCache& cache,
+                         const std::vector<std::string>& texts, int batch_size,
+                         std::vector<std::vector<float>>& features, bool debug = false);
+
+#endif
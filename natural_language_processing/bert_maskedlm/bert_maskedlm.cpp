@@ -15,11 +15,14 @@
 #include <string>
 #include <algorithm>
 #include <math.h>
+#include <chrono>
 
 #undef UNICODE
 
 #include "ailia.h"
 #include "ailia_tokenizer.h"
+#include "topk_utils.h"
+#include "bert_pll.h"
 
 bool debug = false;
 
@@ -53,6 +56,10 @@ static int args_env_id = -1;
 
 std::string input_text = "私は[MASK]で動く。";
 
+static bool pll_mode = false;
+static std::string candidates_path = "";
+static int pll_batch = 32;
+
 
 // ======================
 // Arguemnt Parser
@@ -60,7 +67,8 @@ std::string input_text = "私は[MASK]で動く。";
 
 static void print_usage()
 {
-	PRINT_OUT("usage: bert_maskedlm [-h] [-i TEXT] [-b] [-e ENV_ID]\n");
+	PRINT_OUT("usage: bert_maskedlm [-h] [-i TEXT] [-b] [-e ENV_ID] [--pll]\n");
+	PRINT_OUT("                     [--candidates CANDIDATES] [--pll_batch PLL_BATCH]\n");
 	return;
 }
 
@@ -79,6 +87,11 @@ static void print_help()
 	PRINT_OUT("                        video mode)\n");
 	PRINT_OUT("  -e ENV_ID, --env_id ENV_ID\n");
 	PRINT_OUT("                        The backend environment id.\n");
+	PRINT_OUT("  --pll                 Score the input text by pseudo log likelihood.\n");
+	PRINT_OUT("  --candidates CANDIDATES\n");
+	PRINT_OUT("                        Score and rank the sentences of the file, one per line.\n");
+	PRINT_OUT("  --pll_batch PLL_BATCH\n");
+	PRINT_OUT("                        Masked sentences per inference. (default: 32)\n");
 	return;
 }
 
@@ -111,6 +124,16 @@ static int argument_parser(int argc, char **argv)
 			else if (arg == "-e" || arg == "--env_id") {
 				status = 4;
 			}
+			else if (arg == "--pll") {
+				pll_mode = true;
+			}
+			else if (arg == "--candidates") {
+				pll_mode = true;
+				status = 5;
+			}
+			else if (arg == "--pll_batch") {
+				status = 6;
+			}
 			else {
 				print_usage();
 				print_error(arg);
@@ -125,6 +148,12 @@ static int argument_parser(int argc, char **argv)
 			case 4:
 				args_env_id = atoi(arg.c_str());
 				break;
+			case 5:
+				candidates_path = arg;
+				break;
+			case 6:
+				pll_batch = atoi(arg.c_str());
+				break;
 			default:
 				print_usage();
 				print_error(arg);
@@ -159,27 +188,7 @@ void softmax(float *data, int n){
 
 std::vector<int> topk(const float *logits, int num_words, int kn){
 	std::vector<int> results;
-	for (int k = 0; k < kn; k++){
-		float prob = -INFINITY;
-		int arg_max = 0;
-		for (int j = 0; j < num_words; j++){
-			if (prob < logits[j]){
-				bool already = false;
-				for (int l = 0; l < k; l++){
-					if (results[l] == j){
-						already = true;
-						break;
-					}
-				}
-				if (already){
-					continue;
-				}
-				prob = logits[j];
-				arg_max = j;
-			}
-		}
-		results.push_back(arg_max);
-	}
+	topk_indices(logits, num_words, kn, results);
 	return results;
 }
 
@@ -313,8 +322,82 @@ int forward(AILIANetwork *ailia, std::vector<float> *inputs[NUM_INPUTS], std::ve
 	return AILIA_STATUS_SUCCESS;
 }
 
+static int read_candidates(const std::string &path, std::vector<std::string> &texts)
+{
+	FILE *fp = fopen(path.c_str(), "rb");
+	if (fp == NULL){
+		PRINT_ERR("\'%s\' open failed\n", path.c_str());
+		return AILIA_STATUS_ERROR_FILE_API;
+	}
+	char line[4096];
+	while (fgets(line, sizeof(line), fp) != NULL){
+		std::string s = line;
+		while (s.size() > 0 && (s.back() == '\n' || s.back() == '\r')){
+			s.pop_back();
+		}
+		if (s.size() > 0){
+			texts.push_back(s);
+		}
+	}
+	fclose(fp);
+	return AILIA_STATUS_SUCCESS;
+}
+
+static int score_candidates(AILIANetwork* net, struct AILIATokenizer *tokenizer)
+{
+	std::vector<std::string> texts;
+	if (candidates_path != ""){
+		int status = read_candidates(candidates_path, texts);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+	}else{
+		texts.push_back(input_text);
+	}
+
+	std::vector<std::vector<int>> candidates;
+	for (int i = 0; i < texts.size(); i++){
+		candidates.push_back(encode(texts[i], tokenizer));
+	}
+
+	PllConfig config;
+	config.num_words = NUM_WORDS;
+	config.max_batch = pll_batch;
+	PllScorer scorer(net, config);
+	std::vector<PllResult> results;
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	int status = scorer.score(candidates, results);
+	if (status != AILIA_STATUS_SUCCESS){
+		return status;
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	// higher pseudo log likelihood first, ties keep the input order
+	std::vector<int> order(texts.size());
+	for (int i = 0; i < order.size(); i++){
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b){ return results[a].pll > results[b].pll; });
+
+	PRINT_OUT("Pseudo log likelihood :\n");
+	for (int i = 0; i < order.size(); i++){
+		const PllResult &r = results[order[i]];
+		float pppl = r.token_logp.size() > 0 ? exp(-r.pll / r.token_logp.size()) : 0.0f;
+		PRINT_OUT("%d pll %f pppl %f %s\n", i, r.pll, pppl, texts[order[i]].c_str());
+	}
+	PRINT_OUT("%d inferences %.0f ms\n", scorer.inference_count(), (double)std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count());
+	PRINT_OUT("Program finished successfully.\n");
+
+	return AILIA_STATUS_SUCCESS;
+}
+
 static int recognize_from_text(AILIANetwork* net, struct AILIATokenizer *tokenizer)
 {
+	if (pll_mode){
+		return score_candidates(net, tokenizer);
+	}
+
 	int status = AILIA_STATUS_SUCCESS;
 
 	PRINT_OUT("Input : %s\n", input_text.c_str());
@@ -0,0 +1,223 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA BERT masked LM pseudo log likelihood scoring
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include "bert_pll.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf_s(stderr, __VA_ARGS__)
+#else
+#define PRINT_OUT(...) fprintf(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+#define NUM_INPUTS 3
+
+// One masked variant of a candidate
+struct PllRow{
+	int candidate;
+	int position;	// masked position in the sequence with [CLS]
+	int length;		// sequence length with [CLS] and [SEP]
+};
+
+// log softmax of one logits row evaluated at target only
+static float log_prob(const float *logits, int n, int target)
+{
+	// independent lanes so that the compiler can vectorize the loops
+	float lane_max[8];
+	for (int l = 0; l < 8; l++){
+		lane_max[l] = -INFINITY;
+	}
+	int i = 0;
+	for (; i + 8 <= n; i += 8){
+		for (int l = 0; l < 8; l++){
+			lane_max[l] = std::max(lane_max[l], logits[i + l]);
+		}
+	}
+	float max_v = -INFINITY;
+	for (; i < n; i++){
+		max_v = std::max(max_v, logits[i]);
+	}
+	for (int l = 0; l < 8; l++){
+		max_v = std::max(max_v, lane_max[l]);
+	}
+
+	float lane_sum[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	i = 0;
+	for (; i + 8 <= n; i += 8){
+		for (int l = 0; l < 8; l++){
+			lane_sum[l] += expf(logits[i + l] - max_v);
+		}
+	}
+	float sum = 0;
+	for (; i < n; i++){
+		sum += expf(logits[i] - max_v);
+	}
+	for (int l = 0; l < 8; l++){
+		sum += lane_sum[l];
+	}
+	return logits[target] - max_v - logf(sum);
+}
+
+int PllScorer::forward(const std::vector<float> &input_ids, const std::vector<float> &attention_mask, int batch, int length, std::vector<float> &logits)
+{
+	std::vector<float> token_type_ids(input_ids.size(), 0.0f);
+	const std::vector<float> *inputs[NUM_INPUTS] = {&input_ids, &attention_mask, &token_type_ids};
+
+	int status;
+	for (int i = 0; i < NUM_INPUTS; i++){
+		unsigned int input_blob_idx = 0;
+		status = ailiaGetBlobIndexByInputIndex(net, &input_blob_idx, i);
+		if (status != AILIA_STATUS_SUCCESS){
+			PRINT_ERR("ailiaGetBlobIndexByInputIndex failed %s\n", ailiaGetErrorDetail(net));
+			return status;
+		}
+
+		AILIAShape shape;
+		shape.x = length;
+		shape.y = batch;
+		shape.z = 1;
+		shape.w = 1;
+		shape.dim = 2;
+		status = ailiaSetInputBlobShape(net, &shape, input_blob_idx, AILIA_SHAPE_VERSION);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+		status = ailiaSetInputBlobData(net, &(*inputs[i])[0], inputs[i]->size() * sizeof(float), input_blob_idx);
+		if (status != AILIA_STATUS_SUCCESS){
+			PRINT_ERR("ailiaSetInputBlobData failed %s\n", ailiaGetErrorDetail(net));
+			return status;
+		}
+	}
+
+	status = ailiaUpdate(net);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("ailiaUpdate failed %s\n", ailiaGetErrorDetail(net));
+		return status;
+	}
+	inferences++;
+
+	unsigned int output_blob_idx = 0;
+	status = ailiaGetBlobIndexByOutputIndex(net, &output_blob_idx, 0);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("ailiaGetBlobIndexByOutputIndex failed %s\n", ailiaGetErrorDetail(net));
+		return status;
+	}
+	AILIAShape output_shape;
+	status = ailiaGetBlobShape(net, &output_shape, output_blob_idx, AILIA_SHAPE_VERSION);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("ailiaGetBlobShape failed %s\n", ailiaGetErrorDetail(net));
+		return status;
+	}
+	size_t size = (size_t)output_shape.x * output_shape.y * output_shape.z * output_shape.w;
+	if (size != (size_t)batch * length * config.num_words){
+		PRINT_ERR("unexpected logits shape %d %d %d %d\n", output_shape.x, output_shape.y, output_shape.z, output_shape.w);
+		return AILIA_STATUS_INVALID_ARGUMENT;
+	}
+	logits.resize(size);
+	status = ailiaGetBlobData(net, &logits[0], size * sizeof(float), output_blob_idx);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("ailiaGetBlobData failed %s\n", ailiaGetErrorDetail(net));
+		return status;
+	}
+	return AILIA_STATUS_SUCCESS;
+}
+
+int PllScorer::score(const std::vector<std::vector<int>> &candidates, std::vector<PllResult> &results)
+{
+	inferences = 0;
+	results.assign(candidates.size(), PllResult());
+
+	std::vector<PllRow> rows;
+	for (int c = 0; c < (int)candidates.size(); c++){
+		int n = (int)candidates[c].size();
+		for (int i = 0; i < n; i++){
+			if (candidates[c][i] < 0 || candidates[c][i] >= config.num_words){
+				PRINT_ERR("token %d of candidate %d is out of the vocabulary\n", candidates[c][i], c);
+				return AILIA_STATUS_INVALID_ARGUMENT;
+			}
+		}
+		results[c].pll = 0;
+		results[c].token_logp.assign(n, 0.0f);
+		for (int i = 0; i < n; i++){
+			PllRow row = {c, i + 1, n + 2};
+			rows.push_back(row);
+		}
+	}
+
+	// longest first so that the rows of a batch need little padding
+	std::stable_sort(rows.begin(), rows.end(), [](const PllRow &a, const PllRow &b){ return a.length > b.length; });
+
+	std::vector<float> input_ids;
+	std::vector<float> attention_mask;
+	std::vector<float> logits;
+	size_t start = 0;
+	while (start < rows.size()){
+		// ailia returns the logits of every position, not only the masked one, so the batch is bounded by
+		// the logits size (32 rows of 128 tokens over 32000 words would be 0.5GB)
+		int length = rows[start].length;
+		size_t row_bytes = (size_t)length * config.num_words * sizeof(float);
+		size_t budget_rows = std::max((size_t)config.max_logits_mb * 1024 * 1024 / row_bytes, (size_t)1);
+		int batch = batch_supported ? (int)std::min(std::min((size_t)std::max(config.max_batch, 1), budget_rows), rows.size() - start) : 1;
+
+		input_ids.assign((size_t)batch * length, (float)config.pad_token);
+		attention_mask.assign((size_t)batch * length, 0.0f);
+		for (int b = 0; b < batch; b++){
+			const PllRow &row = rows[start + b];
+			const std::vector<int> &tokens = candidates[row.candidate];
+			float *ids = &input_ids[(size_t)b * length];
+			ids[0] = (float)config.cls_token;
+			for (int i = 0; i < (int)tokens.size(); i++){
+				ids[i + 1] = (float)tokens[i];
+			}
+			ids[tokens.size() + 1] = (float)config.sep_token;
+			ids[row.position] = (float)config.mask_token;
+			std::fill(attention_mask.begin() + (size_t)b * length, attention_mask.begin() + (size_t)b * length + row.length, 1.0f);
+		}
+
+		int status = forward(input_ids, attention_mask, batch, length, logits);
+		if (status != AILIA_STATUS_SUCCESS){
+			if (batch > 1){
+				// the model was exported with a fixed batch
+				PRINT_OUT("batch inference is not supported, falling back to one row per inference\n");
+				batch_supported = false;
+				continue;
+			}
+			return status;
+		}
+
+		// only the row of the masked position is read
+		for (int b = 0; b < batch; b++){
+			const PllRow &row = rows[start + b];
+			const float *row_logits = &logits[((size_t)b * length + row.position) * config.num_words];
+			int target = candidates[row.candidate][row.position - 1];
+			results[row.candidate].token_logp[row.position - 1] = log_prob(row_logits, config.num_words, target);
+		}
+		start += batch;
+	}
+
+	for (size_t c = 0; c < results.size(); c++){
+		// an empty candidate has no token to score, a pll of 0 would rank it above every sentence
+		if (results[c].token_logp.empty()){
+			results[c].pll = -INFINITY;
+			continue;
+		}
+		float pll = 0;
+		for (size_t i = 0; i < results[c].token_logp.size(); i++){
+			pll += results[c].token_logp[i];
+		}
+		results[c].pll = pll;
+	}
+	return AILIA_STATUS_SUCCESS;
+}
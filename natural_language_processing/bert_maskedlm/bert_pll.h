@@ -0,0 +1,64 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA BERT masked LM pseudo log likelihood scoring
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#ifndef _BERT_PLL_H_
+#define _BERT_PLL_H_
+
+#include <vector>
+
+#include "ailia.h"
+
+struct PllConfig{
+	int num_words;		// vocabulary size of the logits
+	int max_batch;		// masked rows per inference
+	int max_logits_mb;	// the batch is reduced so that the batch x length x num_words logits fit in this size
+	int cls_token;
+	int sep_token;
+	int mask_token;
+	int pad_token;
+
+	PllConfig(){
+		num_words = 32000;
+		max_batch = 32;
+		max_logits_mb = 128;
+		cls_token = 2;
+		sep_token = 3;
+		mask_token = 4;
+		pad_token = 0;
+	}
+};
+
+struct PllResult{
+	float pll;						// sum of the token log probabilities, -inf for an empty candidate
+	std::vector<float> token_logp;	// log P(token i | all other tokens)
+};
+
+// Pseudo log likelihood of candidate sentences. Every token of every candidate is masked once, the masked
+// rows of all candidates are sorted by length and packed into batches, and only the logits of the masked
+// position of each row are reduced to a log probability
+class PllScorer{
+public:
+	PllScorer(AILIANetwork *net, const PllConfig &config) : net(net), config(config), batch_supported(true), inferences(0) {}
+
+	// candidates are token ids without [CLS] and [SEP], they are added here
+	int score(const std::vector<std::vector<int>> &candidates, std::vector<PllResult> &results);
+
+	int inference_count() const { return inferences; }
+
+private:
+	AILIANetwork *net;
+	PllConfig config;
+	bool batch_supported;
+	int inferences;
+
+	int forward(const std::vector<float> &input_ids, const std::vector<float> &attention_mask, int batch, int length, std::vector<float> &logits);
+};
+
+#endif
@@ -14,11 +14,18 @@
 #include <vector>
 #include <string>
 #include <math.h>
+#include <fstream>
+#include <chrono>
+#include <random>
 
 #undef UNICODE
 
 #include "ailia.h"
 #include "ailia_tokenizer.h"
+#include "fugumt_speculative.h"
+#include "fugumt_output.h"
+#include "translation_memory.h"
+#include "utils.h"
 
 bool debug = false;
 
@@ -51,8 +58,23 @@ static bool benchmark  = false;
 static int args_env_id = -1;
 
 std::string input_text = "This is a cat.";
+static std::string input_file = "";
+
+static int draft_tokens = 4;
+static bool verify = false;
+
+static std::string tm_path = "";
+static float tm_fuzzy = 0.0f;
+
+static bool sampling = false;
+static float temperature = 1.0f;
+static int sampling_top_k = 50;
+static int seed = 0;
+static std::string lexicon_path = "";
 
 #define MAX_LENGTH 384
+#define NUM_HEADS 8
+#define HEAD_DIM 64
 
 
 // ======================
@@ -61,7 +83,10 @@ std::string input_text = "This is a cat.";
 
 static void print_usage()
 {
-	PRINT_OUT("usage: fugumt [-h] [-i TEXT] [-b] [-e ENV_ID]\n");
+	PRINT_OUT("usage: fugumt [-h] [-i TEXT] [-f FILE] [-b] [-e ENV_ID] [--draft DRAFT]\n");
+	PRINT_OUT("              [--verify] [--tm TM] [--tm_fuzzy TM_FUZZY] [--sampling]\n");
+	PRINT_OUT("              [--temperature TEMPERATURE] [--top_k TOP_K] [--seed SEED]\n");
+	PRINT_OUT("              [--lex LEX]\n");
 	return;
 }
 
@@ -75,11 +100,28 @@ static void print_help()
 	PRINT_OUT("  -h, --help            show this help message and exit\n");
 	PRINT_OUT("  -i TEXT, --input TEXT\n");
 	PRINT_OUT("                        The input text.\n");
+	PRINT_OUT("  -f FILE, --file FILE  Translate the file line by line. Earlier translations\n");
+	PRINT_OUT("                        are used as the draft of later lines.\n");
 	PRINT_OUT("  -b, --benchmark       Running the inference on the same input 5 times to\n");
 	PRINT_OUT("                        measure execution performance. (Cannot be used in\n");
 	PRINT_OUT("                        video mode)\n");
 	PRINT_OUT("  -e ENV_ID, --env_id ENV_ID\n");
 	PRINT_OUT("                        The backend environment id.\n");
+	PRINT_OUT("  --draft DRAFT         Draft tokens verified per decoder pass, 0 disables\n");
+	PRINT_OUT("                        speculative decoding. (default: 4)\n");
+	PRINT_OUT("  --verify              Decode again without draft and compare the tokens.\n");
+	PRINT_OUT("  --tm TM               Translation memory file. Sentences found in it are not\n");
+	PRINT_OUT("                        translated again, new translations are added to it.\n");
+	PRINT_OUT("  --tm_fuzzy TM_FUZZY   Reuse the translation of the most similar sentence\n");
+	PRINT_OUT("                        whose similarity is at least this value (0 to 1). 0\n");
+	PRINT_OUT("                        disables fuzzy matching. (default: 0)\n");
+	PRINT_OUT("  --sampling            Sample the output tokens instead of greedy decoding.\n");
+	PRINT_OUT("  --temperature TEMPERATURE\n");
+	PRINT_OUT("                        Sampling temperature. (default: 1.0)\n");
+	PRINT_OUT("  --top_k TOP_K         Sample from the best TOP_K tokens. (default: 50)\n");
+	PRINT_OUT("  --seed SEED           Random seed of sampling. (default: 0)\n");
+	PRINT_OUT("  --lex LEX             Lexical table for the vocabulary shortlist of sampling,\n");
+	PRINT_OUT("                        lines of \"source_id target_id [target_id ...]\".\n");
 	return;
 }
 
@@ -112,6 +154,36 @@ static int argument_parser(int argc, char **argv)
 			else if (arg == "-e" || arg == "--env_id") {
 				status = 4;
 			}
+			else if (arg == "-f" || arg == "--file") {
+				status = 5;
+			}
+			else if (arg == "--draft") {
+				status = 6;
+			}
+			else if (arg == "--verify") {
+				verify = true;
+			}
+			else if (arg == "--tm") {
+				status = 7;
+			}
+			else if (arg == "--tm_fuzzy") {
+				status = 8;
+			}
+			else if (arg == "--sampling") {
+				sampling = true;
+			}
+			else if (arg == "--temperature") {
+				status = 9;
+			}
+			else if (arg == "--top_k") {
+				status = 10;
+			}
+			else if (arg == "--seed") {
+				status = 11;
+			}
+			else if (arg == "--lex") {
+				status = 12;
+			}
 			else {
 				print_usage();
 				print_error(arg);
@@ -126,6 +198,30 @@ static int argument_parser(int argc, char **argv)
 			case 4:
 				args_env_id = atoi(arg.c_str());
 				break;
+			case 5:
+				input_file = arg;
+				break;
+			case 6:
+				draft_tokens = atoi(arg.c_str());
+				break;
+			case 7:
+				tm_path = arg;
+				break;
+			case 8:
+				tm_fuzzy = (float)atof(arg.c_str());
+				break;
+			case 9:
+				temperature = (float)atof(arg.c_str());
+				break;
+			case 10:
+				sampling_top_k = atoi(arg.c_str());
+				break;
+			case 11:
+				seed = atoi(arg.c_str());
+				break;
+			case 12:
+				lexicon_path = arg;
+				break;
 			default:
 				print_usage();
 				print_error(arg);
@@ -148,23 +244,6 @@ static int argument_parser(int argc, char **argv)
 // Main functions
 // ======================
 
-void log_softmax(float *data, int n){
-	float max_value = -INFINITY;
-	for (int i = 0; i < n; i++){
-		max_value = std::max(max_value, data[i]);
-	}
-
-	float sum = 0;
-	for (int i = 0; i < n; i++){
-		sum += exp(data[i] - max_value);
-	}
-	sum = log(sum);
-
-	for (int i = 0; i < n; i++){
-		data[i] = (data[i] - max_value) - sum;
-	}
-}
-
 void setErrorDetail(const char *func, const char *detail){
 	PRINT_ERR("Error %s Detail %s\n", func, detail);
 }
@@ -237,7 +316,7 @@ int forward(AILIANetwork *ailia, std::vector<float> *inputs[NUM_INPUTS], std::ve
 			sequence_shape.dim=2;
 		}else{
 			if (i == 2){
-				sequence_shape.x=1;
+				sequence_shape.x=inputs[i]->size();
 				sequence_shape.y=batch_size;
 				sequence_shape.z=1;
 				sequence_shape.w=1;
@@ -307,13 +386,46 @@ int forward(AILIANetwork *ailia, std::vector<float> *inputs[NUM_INPUTS], std::ve
 	return AILIA_STATUS_SUCCESS;
 }
 
-static int recognize_from_text(AILIANetwork* net, struct AILIATokenizer *tokenizer_source, struct AILIATokenizer *tokenizer_target)
+static int sample_decode(const DecoderStepFunc &step, OutputLayer &output_layer, std::mt19937 &rng, const SpeculativeConfig &config, std::vector<int> &output, SpeculativeStats &stats)
 {
-	int status = AILIA_STATUS_SUCCESS;
-	int pad_token_id = 32000;
+	output.clear();
+	stats = SpeculativeStats();
 
-	PRINT_OUT("Input : %s\n", input_text.c_str());
-	std::vector<int> tokens = encode(input_text, tokenizer_source);
+	std::vector<int> feed(1, config.start_token);
+	std::vector<float> logits;
+	std::vector<int> ids;
+	std::vector<float> logprobs;
+	std::vector<double> weights;
+	while ((int)output.size() < config.max_length){
+		int status = step(feed, logits);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+		stats.steps++;
+
+		// the probabilities are renormalized over the top k
+		output_layer.topk(&logits[0], std::max(sampling_top_k, 1), temperature, ids, logprobs);
+		weights.resize(ids.size());
+		for (int i = 0; i < ids.size(); i++){
+			weights[i] = exp(logprobs[i]);
+		}
+		std::discrete_distribution<int> distribution(weights.begin(), weights.end());
+		int token = ids[distribution(rng)];
+
+		output.push_back(token);
+		if (token == config.eos_token){
+			break;
+		}
+		feed[0] = token;
+	}
+	stats.tokens = (int)output.size();
+	return AILIA_STATUS_SUCCESS;
+}
+
+static int translate(AILIANetwork* net, struct AILIATokenizer *tokenizer_source, const std::string &text, const NgramDraft &draft, const SpeculativeConfig &config,
+	OutputLayer *sampler, std::mt19937 &rng, std::vector<int> &output, SpeculativeStats &stats)
+{
+	std::vector<int> tokens = encode(text, tokenizer_source);
 	if (tokens.size() > MAX_LENGTH){
 		tokens[MAX_LENGTH - 1] = tokens[tokens.size() - 1];
 		tokens.resize(MAX_LENGTH);
@@ -321,22 +433,21 @@ static int recognize_from_text(AILIANetwork* net, struct AILIATokenizer *tokeniz
 
 	std::vector<float> input_ids(tokens.size());
 	std::vector<float> attention_mask(tokens.size());
-	int num_beams = 1;
-	std::vector<float> decoder_input_ids(num_beams);
+	std::vector<float> decoder_input_ids;
 	std::vector<float> past_key_values[NUM_PAST_KEY];
 
-	PRINT_OUT("Input Tokens :\n");
+	if (debug){
+		PRINT_OUT("Input Tokens :\n");
+	}
 	for (int i = 0; i < tokens.size(); i++){
 		input_ids[i] = (float)tokens[i];
 		attention_mask[i] = 1;
-		PRINT_OUT("%d ", (int)input_ids[i]);
-	}
-	PRINT_OUT("\n");
-	for (int i = 0; i < num_beams; i++){
-		decoder_input_ids[i] = pad_token_id;
+		if (debug){
+			PRINT_OUT("%d ", (int)input_ids[i]);
+		}
 	}
-	for (int i = 0; i < NUM_PAST_KEY; i++){
-		past_key_values[i].resize(num_beams * 8 * 0 * 64);
+	if (debug){
+		PRINT_OUT("\n");
 	}
 
 	std::vector<float> *inputs[NUM_INPUTS];
@@ -348,7 +459,6 @@ static int recognize_from_text(AILIANetwork* net, struct AILIATokenizer *tokeniz
 	}
 
 	std::vector<float> logits;
-	//std::vector<float> past_key_values;
 
 	std::vector<float> *outputs[NUM_OUTPUTS];
 	outputs[0] = &logits;
@@ -356,65 +466,203 @@ static int recognize_from_text(AILIANetwork* net, struct AILIATokenizer *tokeniz
 		outputs[1 + i] = &past_key_values[i];
 	}
 
-	tokens.clear();
-	while(tokens.size() < MAX_LENGTH){
-		if (debug){
-			std::string text = decode(tokens, tokenizer_target);
-			PRINT_OUT("Loop %d %s\n", (int)tokens.size(), text.c_str());
+	// one decoder pass over the tokens following the cache, the logits have one row per token
+	DecoderStepFunc step = [&](const std::vector<int> &feed, std::vector<float> &step_logits){
+		decoder_input_ids.resize(feed.size());
+		for (int i = 0; i < feed.size(); i++){
+			decoder_input_ids[i] = (float)feed[i];
 		}
-
-		status = forward(net, inputs, outputs);
+		int status = forward(net, inputs, outputs);
 		if (status != AILIA_STATUS_SUCCESS){
 			return status;
 		}
+		step_logits.swap(logits);
+		return AILIA_STATUS_SUCCESS;
+	};
+
+	// past_key_values are (decoder key, decoder value, encoder key, encoder value) per layer,
+	// only the decoder self attention grows with the output
+	DecoderRollbackFunc rollback = [&](int n){
+		for (int i = 0; i < NUM_PAST_KEY; i++){
+			if (i % 4 < 2){
+				int length = (int)(past_key_values[i].size() / NUM_HEADS / HEAD_DIM);
+				truncate_past(past_key_values[i], NUM_HEADS, HEAD_DIM, length - n);
+			}
+		}
+	};
 
-		logits[pad_token_id] = -INFINITY;
+	if (sampler != NULL){
+		return sample_decode(step, *sampler, rng, config, output, stats);
+	}
+	return speculative_greedy(step, rollback, draft, config, output, stats);
+}
 
-		int eos_token_id = 0;
+static int recognize_from_text(AILIANetwork* net, struct AILIATokenizer *tokenizer_source, struct AILIATokenizer *tokenizer_target)
+{
+	int status = AILIA_STATUS_SUCCESS;
 
-		log_softmax(&logits[0], logits.size());
+	std::vector<std::string> lines;
+	if (input_file != ""){
+		std::ifstream ifs(input_file);
+		if (ifs.fail()){
+			PRINT_ERR("%s not found\n", input_file.c_str());
+			return AILIA_STATUS_ERROR_FILE_API;
+		}
+		std::string line;
+		while (std::getline(ifs, line)){
+			if (line.size() > 0 && line[line.size() - 1] == '\r'){
+				line.resize(line.size() - 1);
+			}
+			if (line != ""){
+				lines.push_back(line);
+			}
+		}
+	}else{
+		lines.push_back(input_text);
+	}
+
+	SpeculativeConfig config;
+	config.draft_tokens = sampling ? 0 : std::max(draft_tokens, 0);
+	config.max_length = MAX_LENGTH;
+
+	// entries written by another model or tokenizer are invalidated on load
+	std::vector<std::string> model_files;
+	model_files.push_back(weight);
+	model_files.push_back("source.spm");
+	model_files.push_back("target.spm");
+	TranslationMemoryConfig tm_config;
+	tm_config.fuzzy_threshold = tm_fuzzy;
+	TranslationMemory memory(model_file_version(model_files), tm_config);
+	if (tm_path != ""){
+		if (memory.load(tm_path) != 0){
+			return AILIA_STATUS_ERROR_FILE_API;
+		}
+		if (memory.stats().invalidated > 0){
+			PRINT_OUT("Translation memory : %d entries of another model version were discarded\n", memory.stats().invalidated);
+		}
+	}
+
+	OutputConfig output_config;
+	output_config.vocab_size = config.vocab_size;
+	output_config.pad_token = config.pad_token;
+	output_config.eos_token = config.eos_token;
+	OutputLayer output_layer(output_config);
+	if (lexicon_path != ""){
+		status = output_layer.load_lexicon(lexicon_path);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+	}
+	std::mt19937 rng(seed);
 
-		float prob = -INFINITY;
-		int arg_max = 0;
-		for (int i = 0; i < logits.size(); i++){
-			//PRINT_OUT("%f ", logits[i]);
-			if (prob < logits[i]){
-				prob = logits[i];
-				arg_max = i;
+	NgramDraft draft;
+	SpeculativeStats total;
+	double total_time = 0;
+	for (int l = 0; l < lines.size(); l++){
+		PRINT_OUT("Input : %s\n", lines[l].c_str());
+
+		TranslationMemoryMatch match;
+		if (tm_path != "" && memory.lookup(lines[l], match)){
+			if (match.exact){
+				PRINT_OUT("Output : %s (translation memory)\n", match.target.c_str());
+			}else{
+				PRINT_OUT("Output : %s (translation memory, similarity %.2f)\n", match.target.c_str(), match.similarity);
 			}
+			std::vector<int> tokens = encode(match.target, tokenizer_target);
+			draft.add_document(tokens);
+			continue;
 		}
 
-		if (debug){
-			PRINT_OUT("Token %d (%f)\n", arg_max, prob);
+		// words copied from the source (names, numbers, code) are drafted from the source text tokenized
+		// as target, and earlier translations of the document stay in the pool
+		std::vector<int> source_as_target = encode(lines[l], tokenizer_target);
+		if (source_as_target.size() > 0 && source_as_target.back() == config.eos_token){
+			source_as_target.pop_back();
+		}
+		draft.add_document(source_as_target);
+		if (sampling){
+			output_layer.set_shortlist(encode(lines[l], tokenizer_source), source_as_target);
+		}
+
+		std::vector<int> tokens;
+		SpeculativeStats stats;
+		auto start = std::chrono::high_resolution_clock::now();
+		status = translate(net, tokenizer_source, lines[l], draft, config, sampling ? &output_layer : NULL, rng, tokens, stats);
+		auto end = std::chrono::high_resolution_clock::now();
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
 		}
+		double time = std::chrono::duration<double, std::milli>(end - start).count();
+		total_time += time;
 
-		tokens.push_back(arg_max);
+		std::string text = decode(tokens, tokenizer_target);
+		PRINT_OUT("Output : %s\n",text.c_str());
 
-		for (int i = 0; i < num_beams; i++){
-			decoder_input_ids[i] = arg_max;
+		PRINT_OUT("Output Tokens :\n");
+		for (int i = 0; i < tokens.size(); i++){
+			PRINT_OUT("%d ", tokens[i]);
 		}
+		PRINT_OUT("\n");
 
-		if (arg_max == eos_token_id){
-			break;
+		if (config.draft_tokens > 0){
+			PRINT_OUT("Decoder passes %d tokens %d accepted draft %d / %d (%.1f ms)\n", stats.steps, stats.tokens, stats.accepted, stats.proposed, time);
+		}
+
+		if (verify && config.draft_tokens > 0){
+			SpeculativeConfig greedy_config = config;
+			greedy_config.draft_tokens = 0;
+			std::vector<int> greedy_tokens;
+			SpeculativeStats greedy_stats;
+			start = std::chrono::high_resolution_clock::now();
+			status = translate(net, tokenizer_source, lines[l], draft, greedy_config, NULL, rng, greedy_tokens, greedy_stats);
+			end = std::chrono::high_resolution_clock::now();
+			if (status != AILIA_STATUS_SUCCESS){
+				return status;
+			}
+			if (greedy_tokens != tokens){
+				PRINT_ERR("Verify : speculative decoding differs from greedy decoding\n");
+				return AILIA_STATUS_OTHER_ERROR;
+			}
+			PRINT_OUT("Verify : identical to greedy decoding (%.1f ms)\n", std::chrono::duration<double, std::milli>(end - start).count());
+		}
+
+		draft.add_document(tokens);
+		if (tm_path != "" && !sampling){
+			memory.store(lines[l], text);
 		}
+
+		total.steps += stats.steps;
+		total.proposed += stats.proposed;
+		total.accepted += stats.accepted;
+		total.tokens += stats.tokens;
 	}
-	
 
-	std::string text = decode(tokens, tokenizer_target);
-	PRINT_OUT("Output : %s\n",text.c_str());
+	if (sampling){
+		PRINT_OUT("Output layer : shortlist %d tokens, full vocabulary fallback %d / %d steps\n",
+			output_layer.shortlist_size(), output_layer.stats().fallbacks, output_layer.stats().steps);
+	}
 
-	PRINT_OUT("Output Tokens :\n");
-	for (int i = 0; i < tokens.size(); i++){
-		PRINT_OUT("%d ", tokens[i]);
+	if (lines.size() > 1 && config.draft_tokens > 0){
+		PRINT_OUT("Total decoder passes %d tokens %d acceptance %.1f %% (%.1f ms)\n", total.steps, total.tokens,
+			total.proposed > 0 ? 100.0 * total.accepted / total.proposed : 0.0, total_time);
+	}
+
+	if (tm_path != ""){
+		const TranslationMemoryStats &tm_stats = memory.stats();
+		PRINT_OUT("Translation memory : lookups %d exact %d fuzzy %d miss %d entries %d\n",
+			tm_stats.lookups, tm_stats.exact_hits, tm_stats.fuzzy_hits, tm_stats.misses, memory.size());
+		if (tm_stats.stored > 0 || tm_stats.invalidated > 0){
+			if (memory.save(tm_path) != 0){
+				return AILIA_STATUS_ERROR_FILE_API;
+			}
+		}
 	}
-	PRINT_OUT("\n");
 
 	PRINT_OUT("Program finished successfully.\n");
 
 	return AILIA_STATUS_SUCCESS;
 }
 
-
 int main(int argc, char **argv)
 {
 	int status = argument_parser(argc, argv);
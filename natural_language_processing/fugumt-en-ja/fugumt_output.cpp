@@ -0,0 +1,232 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA fugumt output layer token selection
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "ailia.h"
+#include "topk_utils.h"
+#include "fugumt_output.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf_s(stderr, __VA_ARGS__)
+#else
+#define PRINT_OUT(...) fprintf(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+// ======================
+// Argmax
+// ======================
+
+// floats per block of the argmax, only the first block holding the maximum is searched for its index
+static const int ARGMAX_BLOCK = 512;
+
+// argmax of logits[begin..end), best receives its value
+static int argmax_range(const float *logits, int begin, int end, float &best)
+{
+	// independent lanes and a compare and select so that the compiler vectorizes the block loop, NaN never
+	// compares greater and is skipped
+	best = -INFINITY;
+	int best_block = -1;
+	for (int block = begin; block < end; block += ARGMAX_BLOCK){
+		int block_end = std::min(block + ARGMAX_BLOCK, end);
+		float lane_max[8];
+		for (int l = 0; l < 8; l++){
+			lane_max[l] = -INFINITY;
+		}
+		int i = block;
+		for (; i + 8 <= block_end; i += 8){
+			for (int l = 0; l < 8; l++){
+				lane_max[l] = logits[i + l] > lane_max[l] ? logits[i + l] : lane_max[l];
+			}
+		}
+		float block_max = -INFINITY;
+		for (; i < block_end; i++){
+			block_max = logits[i] > block_max ? logits[i] : block_max;
+		}
+		for (int l = 0; l < 8; l++){
+			block_max = lane_max[l] > block_max ? lane_max[l] : block_max;
+		}
+		if (block_max > best){
+			best = block_max;
+			best_block = block;
+		}
+	}
+	if (best_block < 0){
+		return -1;
+	}
+	int block_end = std::min(best_block + ARGMAX_BLOCK, end);
+	for (int i = best_block; i < block_end; i++){
+		if (logits[i] == best){
+			return i;
+		}
+	}
+	return -1;
+}
+
+int output_argmax(const float *logits, int n, int skip_token)
+{
+	if (skip_token < 0 || skip_token >= n){
+		float best;
+		int arg_max = argmax_range(logits, 0, n, best);
+		return arg_max >= 0 ? arg_max : 0;
+	}
+	float best_low, best_high;
+	int low = argmax_range(logits, 0, skip_token, best_low);
+	int high = argmax_range(logits, skip_token + 1, n, best_high);
+	if (high >= 0 && (low < 0 || best_high > best_low)){
+		return high;
+	}
+	return low >= 0 ? low : 0;
+}
+
+// ======================
+// Shortlist
+// ======================
+
+OutputLayer::OutputLayer(const OutputConfig &config) : config(config)
+{
+}
+
+int OutputLayer::load_lexicon(const std::string &path)
+{
+	std::ifstream ifs(path);
+	if (ifs.fail()){
+		PRINT_ERR("%s not found\n", path.c_str());
+		return AILIA_STATUS_ERROR_FILE_API;
+	}
+	lexicon.clear();
+	std::string line;
+	while (std::getline(ifs, line)){
+		std::istringstream iss(line);
+		int source = 0;
+		if (!(iss >> source)){
+			continue;
+		}
+		std::vector<int> &targets = lexicon[source];
+		int target = 0;
+		while (iss >> target){
+			if (target >= 0 && target < config.vocab_size && target != config.pad_token){
+				targets.push_back(target);
+			}
+		}
+	}
+	return AILIA_STATUS_SUCCESS;
+}
+
+void OutputLayer::set_shortlist(const std::vector<int> &source_tokens, const std::vector<int> &source_as_target)
+{
+	in_shortlist.assign(config.vocab_size, 0);
+	int common = std::min(config.common_tokens, config.vocab_size);
+	for (int i = 0; i < common; i++){
+		in_shortlist[i] = 1;
+	}
+	if (config.eos_token >= 0 && config.eos_token < config.vocab_size){
+		in_shortlist[config.eos_token] = 1;
+	}
+	for (size_t i = 0; i < source_as_target.size(); i++){
+		if (source_as_target[i] >= 0 && source_as_target[i] < config.vocab_size){
+			in_shortlist[source_as_target[i]] = 1;
+		}
+	}
+	for (size_t i = 0; i < source_tokens.size(); i++){
+		std::unordered_map<int, std::vector<int>>::const_iterator it = lexicon.find(source_tokens[i]);
+		if (it == lexicon.end()){
+			continue;
+		}
+		for (size_t j = 0; j < it->second.size(); j++){
+			in_shortlist[it->second[j]] = 1;
+		}
+	}
+	if (config.pad_token >= 0 && config.pad_token < config.vocab_size){
+		in_shortlist[config.pad_token] = 0;
+	}
+
+	shortlist.clear();
+	for (int i = 0; i < config.vocab_size; i++){
+		if (in_shortlist[i]){
+			shortlist.push_back(i);
+		}
+	}
+}
+
+void OutputLayer::clear_shortlist()
+{
+	shortlist.clear();
+	in_shortlist.clear();
+}
+
+// ======================
+// Top-k
+// ======================
+
+void OutputLayer::topk(const float *logits, int k, float temperature, std::vector<int> &ids, std::vector<float> &logprobs)
+{
+	statistics.steps++;
+	float inv_t = 1.0f / std::max(temperature, 1e-6f);
+
+	// the shortlist is trusted while it contains the best token of the full vocabulary
+	bool full = shortlist.empty();
+	if (!full){
+		int arg_max = argmax(logits);
+		full = !in_shortlist[arg_max];
+	}
+	if (full){
+		statistics.fallbacks++;
+		scores.assign(logits, logits + config.vocab_size);
+		if (config.pad_token >= 0 && config.pad_token < config.vocab_size){
+			scores[config.pad_token] = NAN;		// never selected by topk_indices
+		}
+	}else{
+		scores.resize(shortlist.size());
+		for (size_t i = 0; i < shortlist.size(); i++){
+			scores[i] = logits[shortlist[i]];
+		}
+	}
+	int n = (int)scores.size();
+	topk_indices(&scores[0], n, k, order);
+	if (order.empty()){
+		ids.clear();
+		logprobs.clear();
+		return;
+	}
+
+	// log softmax over the candidate set, the maximum is the first selected score
+	float max_v = scores[order[0]] * inv_t;
+	float lane_sum[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	int i = 0;
+	for (; i + 8 <= n; i += 8){
+		for (int l = 0; l < 8; l++){
+			float v = scores[i + l];
+			lane_sum[l] += (v == v) ? expf(v * inv_t - max_v) : 0.0f;
+		}
+	}
+	float sum = 0;
+	for (; i < n; i++){
+		float v = scores[i];
+		sum += (v == v) ? expf(v * inv_t - max_v) : 0.0f;
+	}
+	for (int l = 0; l < 8; l++){
+		sum += lane_sum[l];
+	}
+	float log_sum = logf(sum);
+
+	ids.resize(order.size());
+	logprobs.resize(order.size());
+	for (size_t j = 0; j < order.size(); j++){
+		ids[j] = full ? order[j] : shortlist[order[j]];
+		logprobs[j] = scores[order[j]] * inv_t - max_v - log_sum;
+	}
+}
@@ -0,0 +1,79 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA fugumt output layer token selection
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#ifndef _FUGUMT_OUTPUT_H_
+#define _FUGUMT_OUTPUT_H_
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+struct OutputConfig{
+	int vocab_size;
+	int pad_token;		// never generated
+	int eos_token;		// always in the shortlist
+	int common_tokens;	// ids below this are always in the shortlist, sentencepiece orders pieces by score
+
+	OutputConfig(){
+		vocab_size = 32001;
+		pad_token = 32000;
+		eos_token = 0;
+		common_tokens = 2000;
+	}
+};
+
+struct OutputStats{
+	int steps;			// topk calls
+	int fallbacks;		// steps computed over the full vocabulary
+
+	OutputStats() : steps(0), fallbacks(0) {}
+};
+
+// argmax of logits[0..n) without skip_token, ties go to the lower index. No softmax is needed because it
+// does not change the order
+int output_argmax(const float *logits, int n, int skip_token);
+
+// Token selection from one row of decoder logits.
+// Greedy decoding only needs argmax. Sampling and beam search need log probabilities of the best tokens,
+// these are computed over a per sentence shortlist (common pieces, the source copied as target pieces and
+// their translations from a lexical table) instead of the whole vocabulary. When the argmax of the full
+// vocabulary is outside the shortlist the step falls back to the full vocabulary
+class OutputLayer{
+public:
+	OutputLayer(const OutputConfig &config);
+
+	int argmax(const float *logits) const { return output_argmax(logits, config.vocab_size, config.pad_token); }
+
+	// Lines of "source_id target_id [target_id ...]", source ids of the source tokenizer and target ids of
+	// the target tokenizer
+	int load_lexicon(const std::string &path);
+	int lexicon_size() const { return (int)lexicon.size(); }
+
+	// source_tokens are the source sentence in source ids, source_as_target the same text in target ids
+	void set_shortlist(const std::vector<int> &source_tokens, const std::vector<int> &source_as_target);
+	void clear_shortlist();
+	int shortlist_size() const { return (int)shortlist.size(); }
+
+	// k best tokens of logits / temperature with their log probabilities, best first
+	void topk(const float *logits, int k, float temperature, std::vector<int> &ids, std::vector<float> &logprobs);
+
+	const OutputStats &stats() const { return statistics; }
+
+private:
+	OutputConfig config;
+	OutputStats statistics;
+	std::unordered_map<int, std::vector<int>> lexicon;
+	std::vector<int> shortlist;				// sorted ids, empty for the full vocabulary
+	std::vector<unsigned char> in_shortlist;
+	std::vector<float> scores;
+	std::vector<int> order;
+};
+
+#endif
@@ -0,0 +1,162 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA fugumt speculative greedy decoding
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "ailia.h"
+#include "fugumt_speculative.h"
+#include "fugumt_output.h"
+
+// ======================
+// Draft
+// ======================
+
+static uint64_t ngram_hash(const int *tokens, int n)
+{
+	uint64_t h = 1469598103934665603ULL;
+	for (int i = 0; i < n; i++){
+		uint32_t v = (uint32_t)tokens[i];
+		for (int b = 0; b < 4; b++){
+			h ^= (v >> (b * 8)) & 0xff;
+			h *= 1099511628211ULL;
+		}
+	}
+	return h ^ ((uint64_t)n << 56);
+}
+
+void NgramDraft::add_document(const std::vector<int> &tokens)
+{
+	int doc = (int)documents.size();
+	documents.push_back(tokens);
+	for (int n = min_ngram; n <= max_ngram; n++){
+		for (int pos = 0; pos + n < (int)tokens.size(); pos++){
+			latest[ngram_hash(&tokens[pos], n)] = std::make_pair(doc, pos + n);
+		}
+	}
+}
+
+void NgramDraft::clear()
+{
+	documents.clear();
+	latest.clear();
+}
+
+void NgramDraft::propose(const std::vector<int> &output, int k, std::vector<int> &draft) const
+{
+	draft.clear();
+	int length = (int)output.size();
+	for (int n = std::min(max_ngram, length); n >= min_ngram && n > 0 && k > 0; n--){
+		const int *suffix = &output[length - n];
+
+		// repetition inside the output, latest occurrence first
+		for (int j = length - n - 1; j >= 0; j--){
+			if (memcmp(&output[j], suffix, n * sizeof(int)) == 0){
+				for (int i = j + n; i < length && (int)draft.size() < k; i++){
+					draft.push_back(output[i]);
+				}
+				return;
+			}
+		}
+
+		// reference documents, the hash hit is checked against the tokens
+		std::map<uint64_t, std::pair<int, int>>::const_iterator it = latest.find(ngram_hash(suffix, n));
+		if (it != latest.end()){
+			const std::vector<int> &doc = documents[it->second.first];
+			int pos = it->second.second;
+			if (memcmp(&doc[pos - n], suffix, n * sizeof(int)) == 0){
+				for (int i = pos; i < (int)doc.size() && (int)draft.size() < k; i++){
+					draft.push_back(doc[i]);
+				}
+				return;
+			}
+		}
+	}
+}
+
+// ======================
+// Decoding
+// ======================
+
+int speculative_greedy(const DecoderStepFunc &step, const DecoderRollbackFunc &rollback, const NgramDraft &draft,
+	const SpeculativeConfig &config, std::vector<int> &output, SpeculativeStats &stats)
+{
+	output.clear();
+	stats = SpeculativeStats();
+
+	std::vector<int> proposal;
+	std::vector<int> feed;
+	std::vector<float> logits;
+	int last = config.start_token;
+	while ((int)output.size() < config.max_length){
+		// the last pass can emit at most max_length - output.size() tokens
+		int k = std::min(config.draft_tokens, config.max_length - (int)output.size() - 1);
+		proposal.clear();
+		if (k > 0){
+			draft.propose(output, k, proposal);
+		}
+
+		feed.assign(1, last);
+		feed.insert(feed.end(), proposal.begin(), proposal.end());
+		int status = step(feed, logits);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+		if (logits.size() < feed.size() * (size_t)config.vocab_size){
+			return AILIA_STATUS_INVALID_ARGUMENT;
+		}
+		stats.steps++;
+		stats.proposed += (int)proposal.size();
+
+		// row j predicts the token after feed[j], the draft is kept while it matches the prediction
+		int accepted = 0;
+		bool finished = false;
+		for (int j = 0; j < (int)feed.size(); j++){
+			int token = output_argmax(&logits[(size_t)j * config.vocab_size], config.vocab_size, config.pad_token);
+			output.push_back(token);
+			if (token == config.eos_token){
+				finished = true;
+				break;
+			}
+			if (j >= (int)proposal.size() || proposal[j] != token){
+				break;
+			}
+			accepted++;
+		}
+		stats.accepted += accepted;
+
+		// the cache holds feed[0..accepted], the rejected draft positions are dropped
+		int drop = (int)feed.size() - 1 - accepted;
+		if (drop > 0){
+			rollback(drop);
+		}
+		if (finished){
+			break;
+		}
+		last = output.back();
+	}
+
+	stats.tokens = (int)output.size();
+	return AILIA_STATUS_SUCCESS;
+}
+
+void truncate_past(std::vector<float> &past, int heads, int head_dim, int length)
+{
+	int old_length = (int)(past.size() / heads / head_dim);
+	if (length >= old_length){
+		return;
+	}
+	for (int h = 1; h < heads; h++){
+		memmove(&past[(size_t)h * length * head_dim], &past[(size_t)h * old_length * head_dim], (size_t)length * head_dim * sizeof(float));
+	}
+	past.resize((size_t)heads * length * head_dim);
+}
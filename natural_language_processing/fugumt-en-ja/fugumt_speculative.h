@@ -0,0 +1,79 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA fugumt speculative greedy decoding
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#ifndef _FUGUMT_SPECULATIVE_H_
+#define _FUGUMT_SPECULATIVE_H_
+
+#include <vector>
+#include <map>
+#include <functional>
+#include <stdint.h>
+
+// Run the decoder on the tokens following the cached positions, logits receives one row of vocab_size
+// per token and the cache grows by tokens.size()
+typedef std::function<int(const std::vector<int> &tokens, std::vector<float> &logits)> DecoderStepFunc;
+
+// Drop the last n positions of the decoder self attention cache
+typedef std::function<void(int n)> DecoderRollbackFunc;
+
+struct SpeculativeConfig{
+	int draft_tokens;	// tokens proposed per step, 0 for plain greedy decoding
+	int max_length;
+	int vocab_size;
+	int start_token;	// decoder start token
+	int eos_token;
+	int pad_token;		// never generated
+
+	SpeculativeConfig(){
+		draft_tokens = 4;
+		max_length = 384;
+		vocab_size = 32001;
+		start_token = 32000;
+		eos_token = 0;
+		pad_token = 32000;
+	}
+};
+
+struct SpeculativeStats{
+	int steps;		// decoder passes
+	int proposed;	// draft tokens verified
+	int accepted;	// draft tokens kept
+	int tokens;		// generated tokens
+
+	SpeculativeStats() : steps(0), proposed(0), accepted(0), tokens(0) {}
+};
+
+// Draft tokens looked up from reference token sequences (the source re-encoded with the target tokenizer,
+// earlier translations) and from the output so far. The longest n-gram suffix of the output that occurred
+// before proposes the tokens which followed its latest occurrence
+class NgramDraft{
+public:
+	NgramDraft(int max_ngram = 3, int min_ngram = 1) : max_ngram(max_ngram), min_ngram(min_ngram) {}
+
+	void add_document(const std::vector<int> &tokens);
+	void clear();
+	void propose(const std::vector<int> &output, int k, std::vector<int> &draft) const;
+
+private:
+	int max_ngram;
+	int min_ngram;
+	std::vector<std::vector<int>> documents;
+	std::map<uint64_t, std::pair<int, int>> latest;	// n-gram hash -> (document, position after the n-gram)
+};
+
+// Greedy decoding where each pass verifies the draft, the result is the token sequence plain greedy
+// decoding produces for the same logits. output ends with eos_token unless max_length was reached
+int speculative_greedy(const DecoderStepFunc &step, const DecoderRollbackFunc &rollback, const NgramDraft &draft,
+	const SpeculativeConfig &config, std::vector<int> &output, SpeculativeStats &stats);
+
+// Shorten the sequence axis of a past key value tensor of shape (1, heads, length, head_dim)
+void truncate_past(std::vector<float> &past, int heads, int head_dim, int length);
+
+#endif
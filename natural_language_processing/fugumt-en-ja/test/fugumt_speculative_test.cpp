@@ -0,0 +1,311 @@
+﻿#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+#include "ailia.h"
+#include "fugumt_speculative.h"
+
+// Checks that speculative_greedy returns the tokens of plain greedy decoding for every draft size,
+// with a mock decoder whose self attention cache is the list of fed tokens. The mock predicts the
+// next token of a script while the cache holds the script prefix, and a hash of the cache otherwise,
+// so a missed or wrong rollback changes the output.
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+	if (!(cond)){ \
+		fprintf(stderr, "FAILED %s:%d ", __FILE__, __LINE__); \
+		fprintf(stderr, __VA_ARGS__); \
+		fprintf(stderr, "\n"); \
+		failures++; \
+	}
+
+static const int VOCAB_SIZE = 64;
+static const int EOS_TOKEN = 0;
+static const int PAD_TOKEN = VOCAB_SIZE - 1;
+
+// ======================
+// Mock decoder
+// ======================
+
+struct MockDecoder{
+	std::vector<int> script;	// greedy output of the mock
+	std::vector<int> cache;		// fed tokens
+	int steps;
+	int rolled_back;
+
+	MockDecoder(const std::vector<int> &script) : script(script), steps(0), rolled_back(0) {}
+
+	int predict() const
+	{
+		// cache[0] is the start token, cache[1..] follow the script while it matches
+		bool on_script = (int)cache.size() - 1 < (int)script.size();
+		for (int i = 1; i < (int)cache.size() && on_script; i++){
+			on_script = cache[i] == script[i - 1];
+		}
+		if (on_script){
+			return script[cache.size() - 1];
+		}
+		uint32_t h = 2166136261u;
+		for (int i = 0; i < (int)cache.size(); i++){
+			h = (h ^ (uint32_t)cache[i]) * 16777619u;
+		}
+		return 1 + (int)(h % (VOCAB_SIZE - 2));
+	}
+
+	int step(const std::vector<int> &tokens, std::vector<float> &logits)
+	{
+		steps++;
+		logits.assign(tokens.size() * VOCAB_SIZE, 0.0f);
+		for (int j = 0; j < (int)tokens.size(); j++){
+			cache.push_back(tokens[j]);
+			float *row = &logits[(size_t)j * VOCAB_SIZE];
+			for (int v = 0; v < VOCAB_SIZE; v++){
+				row[v] = (float)((v * 7 + (int)cache.size() * 13) % 17) * 0.1f;
+			}
+			row[predict()] = 5.0f;
+			row[PAD_TOKEN] = 10.0f;	// never generated
+		}
+		return AILIA_STATUS_SUCCESS;
+	}
+
+	void rollback(int n)
+	{
+		rolled_back += n;
+		cache.resize(cache.size() - n);
+	}
+};
+
+static SpeculativeConfig make_config(int draft_tokens, int max_length)
+{
+	SpeculativeConfig config;
+	config.draft_tokens = draft_tokens;
+	config.max_length = max_length;
+	config.vocab_size = VOCAB_SIZE;
+	config.start_token = PAD_TOKEN;
+	config.eos_token = EOS_TOKEN;
+	config.pad_token = PAD_TOKEN;
+	return config;
+}
+
+static int decode(MockDecoder &decoder, const NgramDraft &draft, const SpeculativeConfig &config,
+	std::vector<int> &output, SpeculativeStats &stats)
+{
+	decoder.cache.clear();
+	decoder.steps = 0;
+	decoder.rolled_back = 0;
+	DecoderStepFunc step = [&decoder](const std::vector<int> &tokens, std::vector<float> &logits){
+		return decoder.step(tokens, logits);
+	};
+	DecoderRollbackFunc rollback = [&decoder](int n){
+		decoder.rollback(n);
+	};
+	return speculative_greedy(step, rollback, draft, config, output, stats);
+}
+
+// ======================
+// Scripts
+// ======================
+
+static uint32_t rng_state = 20261019u;
+
+static int random_token()
+{
+	rng_state = rng_state * 1664525u + 1013904223u;
+	return 1 + (int)((rng_state >> 8) % (VOCAB_SIZE - 2));
+}
+
+// a script with repeated phrases so that the output itself proposes drafts
+static std::vector<int> make_script(int length, bool eos)
+{
+	std::vector<int> phrase;
+	for (int i = 0; i < 5; i++){
+		phrase.push_back(random_token());
+	}
+	std::vector<int> script;
+	while ((int)script.size() < length){
+		if (random_token() % 3 == 0){
+			script.insert(script.end(), phrase.begin(), phrase.end());
+		}else{
+			script.push_back(random_token());
+		}
+	}
+	script.resize(length);
+	if (eos){
+		script.push_back(EOS_TOKEN);
+	}
+	return script;
+}
+
+// ======================
+// Tests
+// ======================
+
+static void test_equivalence()
+{
+	const int draft_sizes[] = {1, 2, 3, 4, 8};
+	for (int t = 0; t < 50; t++){
+		std::vector<int> script = make_script(10 + t, t % 5 != 0);
+		MockDecoder decoder(script);
+
+		// the script itself, a corrupted copy and an unrelated document
+		NgramDraft draft;
+		std::vector<int> corrupted = script;
+		for (int i = 0; i < (int)corrupted.size(); i += 3){
+			corrupted[i] = random_token();
+		}
+		draft.add_document(corrupted);
+		if (t % 2 == 0){
+			draft.add_document(script);
+		}
+		draft.add_document(make_script(20, false));
+
+		int max_length = 8 + t;
+		std::vector<int> expected;
+		SpeculativeStats stats;
+		int status = decode(decoder, draft, make_config(0, max_length), expected, stats);
+		CHECK(status == AILIA_STATUS_SUCCESS, "greedy status %d", status);
+		CHECK(stats.steps == (int)expected.size() && stats.proposed == 0, "greedy trial %d steps %d", t, stats.steps);
+		CHECK(decoder.rolled_back == 0, "greedy trial %d rolled back", t);
+
+		std::vector<int> prefix(script.begin(), script.begin() + std::min((int)script.size(), max_length));
+		CHECK(expected == prefix, "greedy trial %d does not follow the script", t);
+
+		for (int k : draft_sizes){
+			std::vector<int> output;
+			status = decode(decoder, draft, make_config(k, max_length), output, stats);
+			CHECK(status == AILIA_STATUS_SUCCESS, "speculative status %d", status);
+			CHECK(output == expected, "trial %d draft_tokens %d output differs from greedy", t, k);
+			CHECK(stats.tokens == (int)output.size(), "trial %d draft_tokens %d tokens %d", t, k, stats.tokens);
+			CHECK(stats.accepted <= stats.proposed, "trial %d draft_tokens %d accepted %d proposed %d", t, k, stats.accepted, stats.proposed);
+			CHECK(stats.steps + stats.accepted == (int)output.size(), "trial %d draft_tokens %d steps %d accepted %d", t, k, stats.steps, stats.accepted);
+
+			// the cache holds the start token and every output token but the last
+			CHECK(decoder.cache.size() == output.size(), "trial %d draft_tokens %d cache %d output %d", t, k, (int)decoder.cache.size(), (int)output.size());
+		}
+	}
+}
+
+static void test_full_rejection()
+{
+	// distinct script tokens, the draft follows each of them with a token outside the script
+	std::vector<int> script;
+	for (int i = 1; i <= 30; i++){
+		script.push_back(i);
+	}
+	script.push_back(EOS_TOKEN);
+	MockDecoder decoder(script);
+	NgramDraft draft(1, 1);
+	std::vector<int> wrong;
+	for (int i = 1; i <= 30; i++){
+		wrong.push_back(i);
+		wrong.push_back(i + 32);
+	}
+
+	std::vector<int> expected;
+	SpeculativeStats stats;
+	decode(decoder, draft, make_config(0, 100), expected, stats);
+
+	draft.add_document(wrong);
+	std::vector<int> output;
+	int status = decode(decoder, draft, make_config(4, 100), output, stats);
+	CHECK(status == AILIA_STATUS_SUCCESS, "status %d", status);
+	CHECK(output == expected, "full rejection output differs from greedy");
+	CHECK(stats.proposed > 0 && stats.accepted == 0, "full rejection proposed %d accepted %d", stats.proposed, stats.accepted);
+	CHECK(decoder.rolled_back == stats.proposed, "full rejection rolled back %d proposed %d", decoder.rolled_back, stats.proposed);
+	CHECK(decoder.cache.size() == output.size(), "full rejection cache %d output %d", (int)decoder.cache.size(), (int)output.size());
+}
+
+static void test_eos_in_draft()
+{
+	// the draft continues past eos, decoding stops at eos inside the accepted part
+	std::vector<int> script = make_script(12, true);
+	std::vector<int> document = script;
+	for (int i = 0; i < 6; i++){
+		document.push_back(random_token());
+	}
+	MockDecoder decoder(script);
+	NgramDraft draft;
+	draft.add_document(document);
+
+	for (int k = 1; k <= 8; k++){
+		std::vector<int> output;
+		SpeculativeStats stats;
+		int status = decode(decoder, draft, make_config(k, 100), output, stats);
+		CHECK(status == AILIA_STATUS_SUCCESS, "status %d", status);
+		CHECK(output == script, "eos draft_tokens %d output length %d", k, (int)output.size());
+		CHECK(output.back() == EOS_TOKEN, "eos draft_tokens %d does not end with eos", k);
+		CHECK(decoder.cache.size() == output.size(), "eos draft_tokens %d cache %d output %d", k, (int)decoder.cache.size(), (int)output.size());
+	}
+
+	// eos is the first token
+	std::vector<int> empty(1, EOS_TOKEN);
+	MockDecoder eos_decoder(empty);
+	std::vector<int> output;
+	SpeculativeStats stats;
+	decode(eos_decoder, draft, make_config(4, 100), output, stats);
+	CHECK(output == empty && stats.steps == 1, "immediate eos output length %d steps %d", (int)output.size(), stats.steps);
+}
+
+static void test_max_length()
+{
+	// no eos, the draft always matches, the output stops exactly at max_length
+	std::vector<int> script = make_script(64, false);
+	MockDecoder decoder(script);
+	NgramDraft draft;
+	draft.add_document(script);
+
+	for (int max_length = 1; max_length <= 20; max_length++){
+		for (int k = 0; k <= 8; k++){
+			std::vector<int> output;
+			SpeculativeStats stats;
+			int status = decode(decoder, draft, make_config(k, max_length), output, stats);
+			CHECK(status == AILIA_STATUS_SUCCESS, "status %d", status);
+			CHECK((int)output.size() == max_length, "max_length %d draft_tokens %d output length %d", max_length, k, (int)output.size());
+			CHECK(std::vector<int>(script.begin(), script.begin() + max_length) == output, "max_length %d draft_tokens %d output differs", max_length, k);
+		}
+	}
+
+	std::vector<int> output;
+	SpeculativeStats stats;
+	decode(decoder, draft, make_config(4, 0), output, stats);
+	CHECK(output.empty() && stats.steps == 0, "max_length 0 output length %d", (int)output.size());
+}
+
+static void test_step_errors()
+{
+	NgramDraft draft;
+	std::vector<int> output;
+	SpeculativeStats stats;
+	DecoderRollbackFunc rollback = [](int n){};
+
+	DecoderStepFunc failing = [](const std::vector<int> &tokens, std::vector<float> &logits){
+		return AILIA_STATUS_INVALID_STATE;
+	};
+	int status = speculative_greedy(failing, rollback, draft, make_config(4, 10), output, stats);
+	CHECK(status == AILIA_STATUS_INVALID_STATE, "step error status %d", status);
+
+	DecoderStepFunc short_logits = [](const std::vector<int> &tokens, std::vector<float> &logits){
+		logits.assign(VOCAB_SIZE - 1, 0.0f);
+		return AILIA_STATUS_SUCCESS;
+	};
+	status = speculative_greedy(short_logits, rollback, draft, make_config(4, 10), output, stats);
+	CHECK(status == AILIA_STATUS_INVALID_ARGUMENT, "short logits status %d", status);
+}
+
+int main(int argc, char **argv)
+{
+	test_equivalence();
+	test_full_rejection();
+	test_eos_in_draft();
+	test_max_length();
+	test_step_errors();
+
+	if (failures > 0){
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	printf("fugumt_speculative_test passed\n");
+	return 0;
+}
@@ -14,11 +14,17 @@
 #include <vector>
 #include <string>
 #include <math.h>
+#include <fstream>
+#include <map>
+#include <chrono>
 
 #undef UNICODE
 
 #include "ailia.h"
 #include "ailia_tokenizer.h"
+#include "translation_memory.h"
+#include "utils.h"
+#include "fugumt_batch.h"
 
 bool debug = false;
 
@@ -59,6 +65,12 @@ static int args_env_id = -1;
 
 std::string input_text = "これは猫です";
 
+static std::string input_file = "";
+static int max_batch = 16;
+
+static std::string tm_path = "";
+static float tm_fuzzy = 0.0f;
+
 #define MAX_LENGTH 512
 
 
@@ -68,7 +80,8 @@ std::string input_text = "これは猫です";
 
 static void print_usage()
 {
-	PRINT_OUT("usage: fugumt [-h] [-i TEXT] [-b] [-e ENV_ID]\n");
+	PRINT_OUT("usage: fugumt [-h] [-i TEXT] [-f FILE] [-b] [-e ENV_ID] [--batch BATCH]\n");
+	PRINT_OUT("              [--tm TM] [--tm_fuzzy TM_FUZZY]\n");
 	return;
 }
 
@@ -82,11 +95,19 @@ static void print_help()
 	PRINT_OUT("  -h, --help            show this help message and exit\n");
 	PRINT_OUT("  -i TEXT, --input TEXT\n");
 	PRINT_OUT("                        The input text.\n");
+	PRINT_OUT("  -f FILE, --file FILE  Translate the document. Every line is split into\n");
+	PRINT_OUT("                        sentences and the sentences are translated in batches.\n");
 	PRINT_OUT("  -b, --benchmark       Running the inference on the same input 5 times to\n");
 	PRINT_OUT("                        measure execution performance. (Cannot be used in\n");
 	PRINT_OUT("                        video mode)\n");
 	PRINT_OUT("  -e ENV_ID, --env_id ENV_ID\n");
 	PRINT_OUT("                        The backend environment id.\n");
+	PRINT_OUT("  --batch BATCH         Sentences per batch for FILE. (default: 16)\n");
+	PRINT_OUT("  --tm TM               Translation memory file. Sentences found in it are not\n");
+	PRINT_OUT("                        translated again, new translations are added to it.\n");
+	PRINT_OUT("  --tm_fuzzy TM_FUZZY   Reuse the translation of the most similar sentence\n");
+	PRINT_OUT("                        whose similarity is at least this value (0 to 1). 0\n");
+	PRINT_OUT("                        disables fuzzy matching. (default: 0)\n");
 	return;
 }
 
@@ -119,6 +140,18 @@ static int argument_parser(int argc, char **argv)
 			else if (arg == "-e" || arg == "--env_id") {
 				status = 4;
 			}
+			else if (arg == "-f" || arg == "--file") {
+				status = 5;
+			}
+			else if (arg == "--batch") {
+				status = 6;
+			}
+			else if (arg == "--tm") {
+				status = 7;
+			}
+			else if (arg == "--tm_fuzzy") {
+				status = 8;
+			}
 			else {
 				print_usage();
 				print_error(arg);
@@ -133,6 +166,18 @@ static int argument_parser(int argc, char **argv)
 			case 4:
 				args_env_id = atoi(arg.c_str());
 				break;
+			case 5:
+				input_file = arg;
+				break;
+			case 6:
+				max_batch = atoi(arg.c_str());
+				break;
+			case 7:
+				tm_path = arg;
+				break;
+			case 8:
+				tm_fuzzy = (float)atof(arg.c_str());
+				break;
 			default:
 				print_usage();
 				print_error(arg);
@@ -405,12 +450,179 @@ int ailia_decode(AILIANetwork *ailia_decoder,
 }
 
 
+// entries written by another model or tokenizer are invalidated on load
+static std::string memory_model_version()
+{
+	std::vector<std::string> model_files;
+	model_files.push_back(encoder_weight);
+	model_files.push_back(decoder_weight);
+	model_files.push_back("source.spm");
+	model_files.push_back("target.spm");
+	return model_file_version(model_files);
+}
+
+static TranslationMemoryConfig memory_config()
+{
+	TranslationMemoryConfig tm_config;
+	tm_config.fuzzy_threshold = tm_fuzzy;
+	return tm_config;
+}
+
+static int load_memory(TranslationMemory &memory)
+{
+	if (memory.load(tm_path) != 0){
+		return AILIA_STATUS_ERROR_FILE_API;
+	}
+	if (memory.stats().invalidated > 0){
+		PRINT_OUT("Translation memory : %d entries of another model version were discarded\n", memory.stats().invalidated);
+	}
+	return AILIA_STATUS_SUCCESS;
+}
+
+static int translate_document(AILIANetwork* encoder_net, AILIANetwork* decoder_net, struct AILIATokenizer *tokenizer_source, struct AILIATokenizer *tokenizer_target)
+{
+	std::ifstream ifs(input_file);
+	if (ifs.fail()){
+		PRINT_ERR("%s not found\n", input_file.c_str());
+		return AILIA_STATUS_ERROR_FILE_API;
+	}
+
+	// sentences of all lines, line_begin[l] is the first sentence of line l
+	std::vector<std::string> sentences;
+	std::vector<int> line_begin;
+	std::string line;
+	std::vector<std::string> line_sentences;
+	while (std::getline(ifs, line)){
+		line_begin.push_back((int)sentences.size());
+		split_sentences(line, line_sentences);
+		sentences.insert(sentences.end(), line_sentences.begin(), line_sentences.end());
+	}
+	line_begin.push_back((int)sentences.size());
+
+	TranslationMemory memory(memory_model_version(), memory_config());
+	if (tm_path != ""){
+		int status = load_memory(memory);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+	}
+
+	// only the sentences missing from the memory are translated, repeated sentences once
+	std::vector<std::string> translations(sentences.size());
+	std::vector<std::vector<int>> sources;
+	std::vector<int> source_sentence;
+	std::map<std::string, int> pending;
+	std::vector<int> same_as(sentences.size(), -1);
+	for (int i = 0; i < sentences.size(); i++){
+		TranslationMemoryMatch match;
+		if (tm_path != "" && memory.lookup(sentences[i], match)){
+			translations[i] = match.target;
+			continue;
+		}
+		std::map<std::string, int>::iterator it = pending.find(sentences[i]);
+		if (it != pending.end()){
+			same_as[i] = it->second;
+			continue;
+		}
+		std::vector<int> tokens = encode(sentences[i], tokenizer_source);
+		if (tokens.size() > MAX_LENGTH){
+			tokens[MAX_LENGTH - 1] = tokens[tokens.size() - 1];
+			tokens.resize(MAX_LENGTH);
+		}
+		pending[sentences[i]] = i;
+		sources.push_back(tokens);
+		source_sentence.push_back(i);
+	}
+
+	BatchConfig config;
+	config.max_batch = std::max(max_batch, 1);
+	config.max_length = MAX_LENGTH;
+	BatchTranslator translator(encoder_net, decoder_net, config);
+	std::vector<std::vector<int>> outputs;
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	int status = translator.translate(sources, outputs);
+	if (status != AILIA_STATUS_SUCCESS){
+		return status;
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < outputs.size(); i++){
+		int s = source_sentence[i];
+		translations[s] = outputs[i].empty() ? std::string("") : decode(outputs[i], tokenizer_target);
+		if (tm_path != ""){
+			memory.store(sentences[s], translations[s]);
+		}
+	}
+	for (int i = 0; i < sentences.size(); i++){
+		if (same_as[i] >= 0){
+			translations[i] = translations[same_as[i]];
+		}
+	}
+
+	// reassembled in the order of the document
+	for (int l = 0; l + 1 < line_begin.size(); l++){
+		std::string text;
+		for (int i = line_begin[l]; i < line_begin[l + 1]; i++){
+			if (text != "" && translations[i] != ""){
+				text += " ";
+			}
+			text += translations[i];
+		}
+		PRINT_OUT("%s\n", text.c_str());
+	}
+
+	const BatchStats &stats = translator.stats();
+	PRINT_OUT("Sentences %d translated %d encoder passes %d decoder passes %d (%d rows) padding %.1f %% %.0f ms\n",
+		(int)sentences.size(), (int)sources.size(), stats.encoder_passes, stats.decoder_passes, stats.row_steps,
+		stats.padded_tokens > 0 ? 100.0 * (stats.padded_tokens - stats.source_tokens) / stats.padded_tokens : 0.0,
+		(double)std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count());
+
+	if (tm_path != ""){
+		const TranslationMemoryStats &tm_stats = memory.stats();
+		PRINT_OUT("Translation memory : lookups %d exact %d fuzzy %d miss %d entries %d\n",
+			tm_stats.lookups, tm_stats.exact_hits, tm_stats.fuzzy_hits, tm_stats.misses, memory.size());
+		if (tm_stats.stored > 0 || tm_stats.invalidated > 0){
+			if (memory.save(tm_path) != 0){
+				return AILIA_STATUS_ERROR_FILE_API;
+			}
+		}
+	}
+
+	PRINT_OUT("Program finished successfully.\n");
+
+	return AILIA_STATUS_SUCCESS;
+}
+
 static int recognize_from_text(AILIANetwork* encoder_net, AILIANetwork* decoder_net, struct AILIATokenizer *tokenizer_source, struct AILIATokenizer *tokenizer_target)
 {
+	if (input_file != ""){
+		return translate_document(encoder_net, decoder_net, tokenizer_source, tokenizer_target);
+	}
+
     int status = AILIA_STATUS_SUCCESS;
 	int pad_token_id = 32000;
 
     PRINT_OUT("Input : %s\n", input_text.c_str());
+
+	TranslationMemory memory(memory_model_version(), memory_config());
+	if (tm_path != ""){
+		status = load_memory(memory);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+		TranslationMemoryMatch match;
+		if (memory.lookup(input_text, match)){
+			if (match.exact){
+				PRINT_OUT("Output : %s (translation memory)\n", match.target.c_str());
+			}else{
+				PRINT_OUT("Output : %s (translation memory, similarity %.2f)\n", match.target.c_str(), match.similarity);
+			}
+			PRINT_OUT("Program finished successfully.\n");
+			return AILIA_STATUS_SUCCESS;
+		}
+	}
+
     std::vector<int> tokens = encode(input_text, tokenizer_source);
 	if (tokens.size() > MAX_LENGTH){
 		tokens[MAX_LENGTH - 1] = tokens[tokens.size() - 1];
@@ -521,6 +733,14 @@ static int recognize_from_text(AILIANetwork* encoder_net, AILIANetwork* decoder_
 	}
 	PRINT_OUT("\n");
 
+	if (tm_path != ""){
+		memory.store(input_text, text);
+		if (memory.save(tm_path) != 0){
+			return AILIA_STATUS_ERROR_FILE_API;
+		}
+		PRINT_OUT("Translation memory : entries %d\n", memory.size());
+	}
+
     PRINT_OUT("Program finished successfully.\n");
 
 	return AILIA_STATUS_SUCCESS;
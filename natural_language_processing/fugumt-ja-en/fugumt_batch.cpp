@@ -0,0 +1,353 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA fugumt sentence batch translation
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "fugumt_batch.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf_s(stderr, __VA_ARGS__)
+#else
+#define PRINT_OUT(...) fprintf(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+// ======================
+// Sentences
+// ======================
+
+static bool starts_with(const std::string &text, size_t pos, const char *s)
+{
+	size_t n = strlen(s);
+	return pos + n <= text.size() && memcmp(&text[pos], s, n) == 0;
+}
+
+// byte length of the terminator at pos, 0 otherwise
+static int terminator_length(const std::string &text, size_t pos)
+{
+	static const char *terminators[] = {"\xe3\x80\x82", "\xef\xbc\x8e", "\xef\xbc\x81", "\xef\xbc\x9f", "!", "?"};	// 。．！？
+	for (size_t i = 0; i < sizeof(terminators) / sizeof(terminators[0]); i++){
+		if (starts_with(text, pos, terminators[i])){
+			return (int)strlen(terminators[i]);
+		}
+	}
+	// a period ends a sentence only before a space, so that 3.14 and e.g. in a word stay together
+	if (text[pos] == '.' && (pos + 1 == text.size() || text[pos + 1] == ' ')){
+		return 1;
+	}
+	return 0;
+}
+
+// byte length of the closing quote or bracket at pos, 0 otherwise
+static int closing_length(const std::string &text, size_t pos)
+{
+	static const char *closings[] = {"\xe3\x80\x8d", "\xe3\x80\x8f", "\xef\xbc\x89", "\"", ")", "'"};	// 」』）
+	for (size_t i = 0; i < sizeof(closings) / sizeof(closings[0]); i++){
+		if (starts_with(text, pos, closings[i])){
+			return (int)strlen(closings[i]);
+		}
+	}
+	return 0;
+}
+
+static void push_sentence(const std::string &text, size_t begin, size_t end, std::vector<std::string> &sentences)
+{
+	while (begin < end && (text[begin] == ' ' || text[begin] == '\t' || text[begin] == '\r' || text[begin] == '\n')){
+		begin++;
+	}
+	while (end > begin && (text[end - 1] == ' ' || text[end - 1] == '\t' || text[end - 1] == '\r' || text[end - 1] == '\n')){
+		end--;
+	}
+	if (end > begin){
+		sentences.push_back(text.substr(begin, end - begin));
+	}
+}
+
+void split_sentences(const std::string &text, std::vector<std::string> &sentences)
+{
+	sentences.clear();
+	size_t begin = 0;
+	size_t pos = 0;
+	while (pos < text.size()){
+		int n = terminator_length(text, pos);
+		if (n == 0){
+			pos++;
+			continue;
+		}
+		pos += n;
+		// runs like ?! and the closing brackets belong to the sentence
+		while (pos < text.size()){
+			int m = terminator_length(text, pos);
+			if (m == 0){
+				m = closing_length(text, pos);
+			}
+			if (m == 0){
+				break;
+			}
+			pos += m;
+		}
+		push_sentence(text, begin, pos, sentences);
+		begin = pos;
+	}
+	push_sentence(text, begin, text.size(), sentences);
+}
+
+void compact_rows(std::vector<float> &data, int rows, const std::vector<int> &keep)
+{
+	if (rows == 0 || data.empty()){
+		return;
+	}
+	size_t row_size = data.size() / rows;
+	for (size_t i = 0; i < keep.size(); i++){
+		if (keep[i] != (int)i){
+			memmove(&data[i * row_size], &data[(size_t)keep[i] * row_size], row_size * sizeof(float));
+		}
+	}
+	data.resize(keep.size() * row_size);
+}
+
+// ======================
+// Inference
+// ======================
+
+static int set_input(AILIANetwork *net, int index, const AILIAShape &shape, const std::vector<float> &data)
+{
+	unsigned int blob_idx = 0;
+	int status = ailiaGetBlobIndexByInputIndex(net, &blob_idx, index);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("ailiaGetBlobIndexByInputIndex failed %s\n", ailiaGetErrorDetail(net));
+		return status;
+	}
+	status = ailiaSetInputBlobShape(net, &shape, blob_idx, AILIA_SHAPE_VERSION);
+	if (status != AILIA_STATUS_SUCCESS){
+		// reported by the caller, a batch shape may be rejected by a model exported with batch 1
+		return status;
+	}
+	if (data.size() > 0){
+		status = ailiaSetInputBlobData(net, &data[0], data.size() * sizeof(float), blob_idx);
+		if (status != AILIA_STATUS_SUCCESS){
+			PRINT_ERR("ailiaSetInputBlobData failed %s\n", ailiaGetErrorDetail(net));
+			return status;
+		}
+	}
+	return AILIA_STATUS_SUCCESS;
+}
+
+static int get_output(AILIANetwork *net, int index, std::vector<float> &data)
+{
+	unsigned int blob_idx = 0;
+	int status = ailiaGetBlobIndexByOutputIndex(net, &blob_idx, index);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("ailiaGetBlobIndexByOutputIndex failed %s\n", ailiaGetErrorDetail(net));
+		return status;
+	}
+	AILIAShape shape;
+	status = ailiaGetBlobShape(net, &shape, blob_idx, AILIA_SHAPE_VERSION);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("ailiaGetBlobShape failed %s\n", ailiaGetErrorDetail(net));
+		return status;
+	}
+	data.resize((size_t)shape.x * shape.y * shape.z * shape.w);
+	if (data.size() > 0){
+		status = ailiaGetBlobData(net, &data[0], data.size() * sizeof(float), blob_idx);
+		if (status != AILIA_STATUS_SUCCESS){
+			PRINT_ERR("ailiaGetBlobData failed %s\n", ailiaGetErrorDetail(net));
+			return status;
+		}
+	}
+	return AILIA_STATUS_SUCCESS;
+}
+
+static AILIAShape make_shape(int x, int y, int z, int w, int dim)
+{
+	AILIAShape shape;
+	shape.x = x;
+	shape.y = y;
+	shape.z = z;
+	shape.w = w;
+	shape.dim = dim;
+	return shape;
+}
+
+int BatchTranslator::encode(const std::vector<float> &input_ids, const std::vector<float> &attention_mask, int batch, int length, std::vector<float> &hidden)
+{
+	int status = set_input(encoder, 0, make_shape(length, batch, 1, 1, 2), input_ids);
+	if (status == AILIA_STATUS_SUCCESS){
+		status = set_input(encoder, 1, make_shape(length, batch, 1, 1, 2), attention_mask);
+	}
+	if (status != AILIA_STATUS_SUCCESS){
+		return status;
+	}
+	status = ailiaUpdate(encoder);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("ailiaUpdate failed %s\n", ailiaGetErrorDetail(encoder));
+		return status;
+	}
+	statistics.encoder_passes++;
+	return get_output(encoder, 0, hidden);
+}
+
+int BatchTranslator::decode(const std::vector<float> &attention_mask, const std::vector<float> &input_ids, const std::vector<float> &hidden,
+	std::vector<float> *past, int batch, int length, std::vector<float> &logits)
+{
+	int status = set_input(decoder, 0, make_shape(length, batch, 1, 1, 2), attention_mask);
+	if (status == AILIA_STATUS_SUCCESS){
+		status = set_input(decoder, 1, make_shape(1, batch, 1, 1, 2), input_ids);
+	}
+	if (status == AILIA_STATUS_SUCCESS){
+		status = set_input(decoder, 2, make_shape(config.hidden_size, length, batch, 1, 3), hidden);
+	}
+	for (int i = 0; i < config.num_past_key && status == AILIA_STATUS_SUCCESS; i++){
+		int seq = (int)(past[i].size() / config.head_dim / config.heads / batch);
+		status = set_input(decoder, 3 + i, make_shape(config.head_dim, seq, config.heads, batch, 4), past[i]);
+	}
+	if (status != AILIA_STATUS_SUCCESS){
+		return status;
+	}
+	status = ailiaUpdate(decoder);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("ailiaUpdate failed %s\n", ailiaGetErrorDetail(decoder));
+		return status;
+	}
+	statistics.decoder_passes++;
+	statistics.row_steps += batch;
+
+	status = get_output(decoder, 0, logits);
+	for (int i = 0; i < config.num_past_key && status == AILIA_STATUS_SUCCESS; i++){
+		status = get_output(decoder, 1 + i, past[i]);
+	}
+	return status;
+}
+
+int BatchTranslator::translate_bucket(const std::vector<std::vector<int>> &sources, const std::vector<int> &bucket, std::vector<std::vector<int>> &outputs)
+{
+	int batch = (int)bucket.size();
+	int length = 0;
+	for (int b = 0; b < batch; b++){
+		length = std::max(length, (int)sources[bucket[b]].size());
+		outputs[bucket[b]].clear();
+	}
+
+	// padding is masked out in the encoder and in the decoder cross attention
+	std::vector<float> input_ids((size_t)batch * length, (float)config.start_token);
+	std::vector<float> attention_mask((size_t)batch * length, 0.0f);
+	for (int b = 0; b < batch; b++){
+		const std::vector<int> &tokens = sources[bucket[b]];
+		for (int i = 0; i < (int)tokens.size(); i++){
+			input_ids[(size_t)b * length + i] = (float)tokens[i];
+			attention_mask[(size_t)b * length + i] = 1;
+		}
+	}
+
+	std::vector<float> hidden;
+	int status = encode(input_ids, attention_mask, batch, length, hidden);
+	if (status != AILIA_STATUS_SUCCESS){
+		return status;
+	}
+	if (hidden.size() != (size_t)batch * length * config.hidden_size){
+		PRINT_ERR("unexpected last_hidden_state size %d\n", (int)hidden.size());
+		return AILIA_STATUS_INVALID_ARGUMENT;
+	}
+	statistics.padded_tokens += batch * length;
+
+	std::vector<int> rows = bucket;		// sentence of each active row
+	std::vector<float> decoder_input_ids(batch, (float)config.start_token);
+	std::vector<std::vector<float>> past(config.num_past_key);
+	std::vector<float> logits;
+	std::vector<int> keep;
+	std::vector<float> next_ids;
+	while (!rows.empty()){
+		int active = (int)rows.size();
+		status = decode(attention_mask, decoder_input_ids, hidden, &past[0], active, length, logits);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+		int vocab_size = (int)(logits.size() / active);
+
+		keep.clear();
+		next_ids.clear();
+		for (int r = 0; r < active; r++){
+			const float *row = &logits[(size_t)r * vocab_size];
+			float prob = -INFINITY;
+			int arg_max = 0;
+			for (int i = 0; i < vocab_size; i++){
+				if (i != config.pad_token && prob < row[i]){
+					prob = row[i];
+					arg_max = i;
+				}
+			}
+			std::vector<int> &output = outputs[rows[r]];
+			output.push_back(arg_max);
+			if (arg_max != config.eos_token && (int)output.size() < config.max_length){
+				keep.push_back(r);
+				next_ids.push_back((float)arg_max);
+			}
+		}
+
+		// finished sentences leave the batch, every per row tensor drops their rows
+		if ((int)keep.size() < active){
+			compact_rows(attention_mask, active, keep);
+			compact_rows(hidden, active, keep);
+			for (int i = 0; i < config.num_past_key; i++){
+				compact_rows(past[i], active, keep);
+			}
+			for (size_t k = 0; k < keep.size(); k++){
+				rows[k] = rows[keep[k]];
+			}
+			rows.resize(keep.size());
+		}
+		decoder_input_ids.swap(next_ids);
+	}
+	return AILIA_STATUS_SUCCESS;
+}
+
+int BatchTranslator::translate(const std::vector<std::vector<int>> &sources, std::vector<std::vector<int>> &outputs)
+{
+	outputs.assign(sources.size(), std::vector<int>());
+
+	// longest first, a bucket is padded to its first sentence
+	std::vector<int> order;
+	for (int i = 0; i < (int)sources.size(); i++){
+		if (sources[i].empty()){
+			continue;
+		}
+		order.push_back(i);
+		statistics.source_tokens += (int)sources[i].size();
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b){ return sources[a].size() > sources[b].size(); });
+
+	size_t start = 0;
+	std::vector<int> bucket;
+	while (start < order.size()){
+		int length = (int)sources[order[start]].size();
+		bucket.assign(1, order[start]);
+		while (batch_supported && start + bucket.size() < order.size() && (int)bucket.size() < config.max_batch &&
+			((int)bucket.size() + 1) * length <= config.max_tokens){
+			bucket.push_back(order[start + bucket.size()]);
+		}
+
+		int status = translate_bucket(sources, bucket, outputs);
+		if (status != AILIA_STATUS_SUCCESS){
+			if (bucket.size() > 1){
+				// the model was exported with a fixed batch
+				PRINT_OUT("batch inference is not supported, falling back to one sentence per inference\n");
+				batch_supported = false;
+				continue;
+			}
+			return status;
+		}
+		start += bucket.size();
+	}
+	return AILIA_STATUS_SUCCESS;
+}
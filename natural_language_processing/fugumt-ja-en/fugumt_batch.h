@@ -0,0 +1,89 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA fugumt sentence batch translation
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#ifndef _FUGUMT_BATCH_H_
+#define _FUGUMT_BATCH_H_
+
+#include <vector>
+#include <string>
+
+#include "ailia.h"
+
+struct BatchConfig{
+	int max_batch;		// sentences per batch
+	int max_tokens;		// padded source tokens per batch
+	int max_length;		// generated tokens per sentence
+	int hidden_size;	// encoder last_hidden_state width
+	int heads;
+	int head_dim;
+	int num_past_key;
+	int start_token;	// decoder start token, also the source padding
+	int eos_token;
+	int pad_token;		// never generated
+
+	BatchConfig(){
+		max_batch = 16;
+		max_tokens = 4096;
+		max_length = 512;
+		hidden_size = 512;
+		heads = 8;
+		head_dim = 64;
+		num_past_key = 24;
+		start_token = 32000;
+		eos_token = 0;
+		pad_token = 32000;
+	}
+};
+
+struct BatchStats{
+	int encoder_passes;
+	int decoder_passes;
+	int row_steps;		// sum of the active rows over the decoder passes
+	int source_tokens;
+	int padded_tokens;	// source tokens including padding
+
+	BatchStats() : encoder_passes(0), decoder_passes(0), row_steps(0), source_tokens(0), padded_tokens(0) {}
+};
+
+// Greedy translation of many sentences at once. Sentences are sorted by source length and cut into buckets,
+// each bucket is encoded as one padded batch and decoded in lock step. A sentence that emits eos is removed
+// from the batch, its rows of the encoder states and of every past key value are compacted out so that later
+// passes only compute the unfinished sentences
+class BatchTranslator{
+public:
+	BatchTranslator(AILIANetwork *encoder, AILIANetwork *decoder, const BatchConfig &config)
+		: encoder(encoder), decoder(decoder), config(config), batch_supported(true) {}
+
+	// sources are token ids ending with eos, outputs are in the order of sources and end with eos unless
+	// max_length was reached
+	int translate(const std::vector<std::vector<int>> &sources, std::vector<std::vector<int>> &outputs);
+
+	const BatchStats &stats() const { return statistics; }
+
+private:
+	AILIANetwork *encoder;
+	AILIANetwork *decoder;
+	BatchConfig config;
+	bool batch_supported;
+	BatchStats statistics;
+
+	int translate_bucket(const std::vector<std::vector<int>> &sources, const std::vector<int> &bucket, std::vector<std::vector<int>> &outputs);
+	int encode(const std::vector<float> &input_ids, const std::vector<float> &attention_mask, int batch, int length, std::vector<float> &hidden);
+	int decode(const std::vector<float> &attention_mask, const std::vector<float> &input_ids, const std::vector<float> &hidden,
+		std::vector<float> *past, int batch, int length, std::vector<float> &logits);
+};
+
+// Split text after sentence terminators (。．！？!? and . followed by a space), the terminators stay with the sentence
+void split_sentences(const std::string &text, std::vector<std::string> &sentences);
+
+// Keep the rows of keep (ascending) of a tensor whose outermost axis has rows entries
+void compact_rows(std::vector<float> &data, int rows, const std::vector<int> &keep);
+
+#endif
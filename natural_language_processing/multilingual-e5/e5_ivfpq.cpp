@@ -0,0 +1,516 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA Multilingual E5 IVF-PQ passage index
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <random>
+#include <thread>
+
+#include "ailia.h"
+#include "e5_ivfpq.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf_s(stderr, __VA_ARGS__)
+#else
+#define PRINT_OUT(...) fprintf(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+static const char IVFPQ_MAGIC[8] = {'E', '5', 'I', 'V', 'F', 'P', 'Q', '1'};
+
+// Points per centroid below which k-means is not meaningful
+static const int MIN_POINTS_PER_CENTROID = 39;
+
+static const int MAX_KSUB = 256;
+
+// ======================
+// Kernels
+// ======================
+
+static float l2sq(const float *a, const float *b, int d)
+{
+	// independent lanes so that the compiler can vectorize the loop
+	float lane[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	int i = 0;
+	for (; i + 8 <= d; i += 8){
+		for (int l = 0; l < 8; l++){
+			float v = a[i + l] - b[i + l];
+			lane[l] += v * v;
+		}
+	}
+	float sum = 0;
+	for (; i < d; i++){
+		float v = a[i] - b[i];
+		sum += v * v;
+	}
+	for (int l = 0; l < 8; l++){
+		sum += lane[l];
+	}
+	return sum;
+}
+
+static int nearest(const float *x, const float *centers, int k, int d)
+{
+	int best = 0;
+	float best_d = FLT_MAX;
+	for (int c = 0; c < k; c++){
+		float v = l2sq(x, centers + (size_t)c * d, d);
+		if (v < best_d){
+			best_d = v;
+			best = c;
+		}
+	}
+	return best;
+}
+
+static void parallel_for(int n, const std::function<void(int begin, int end)> &func)
+{
+	int thread_n = std::max(1, (int)std::thread::hardware_concurrency());
+	thread_n = std::min(thread_n, std::max(1, n / 1024));
+	if (thread_n == 1){
+		func(0, n);
+		return;
+	}
+	std::vector<std::thread> threads;
+	for (int t = 0; t < thread_n; t++){
+		int begin = (int)((int64_t)n * t / thread_n);
+		int end = (int)((int64_t)n * (t + 1) / thread_n);
+		threads.push_back(std::thread(func, begin, end));
+	}
+	for (size_t t = 0; t < threads.size(); t++){
+		threads[t].join();
+	}
+}
+
+// Lloyd k-means of n points of stride ld (the first d values are used), initialized with distinct random points
+static void kmeans(const float *data, int n, int ld, int d, int k, int iter, std::mt19937 &rng, std::vector<float> &centers)
+{
+	std::vector<int> perm(n);
+	for (int i = 0; i < n; i++){
+		perm[i] = i;
+	}
+	centers.resize((size_t)k * d);
+	for (int c = 0; c < k; c++){
+		int j = c + (int)(rng() % (unsigned int)(n - c));
+		std::swap(perm[c], perm[j]);
+		memcpy(&centers[(size_t)c * d], data + (size_t)perm[c] * ld, d * sizeof(float));
+	}
+
+	std::vector<int> assign(n);
+	std::vector<double> sum((size_t)k * d);
+	std::vector<int> hist(k);
+	for (int it = 0; it < iter; it++){
+		parallel_for(n, [&](int begin, int end){
+			for (int i = begin; i < end; i++){
+				assign[i] = nearest(data + (size_t)i * ld, &centers[0], k, d);
+			}
+		});
+
+		std::fill(sum.begin(), sum.end(), 0.0);
+		std::fill(hist.begin(), hist.end(), 0);
+		for (int i = 0; i < n; i++){
+			const float *x = data + (size_t)i * ld;
+			double *s = &sum[(size_t)assign[i] * d];
+			for (int j = 0; j < d; j++){
+				s[j] += x[j];
+			}
+			hist[assign[i]]++;
+		}
+		for (int c = 0; c < k; c++){
+			if (hist[c] == 0){
+				continue;
+			}
+			for (int j = 0; j < d; j++){
+				centers[(size_t)c * d + j] = (float)(sum[(size_t)c * d + j] / hist[c]);
+			}
+		}
+
+		// an empty cluster takes half of the largest cluster by splitting its centroid
+		for (int c = 0; c < k; c++){
+			if (hist[c] != 0){
+				continue;
+			}
+			int big = (int)(std::max_element(hist.begin(), hist.end()) - hist.begin());
+			for (int j = 0; j < d; j++){
+				float v = centers[(size_t)big * d + j];
+				float eps = (j % 2 == 0) ? 1.0f / 1024 : -1.0f / 1024;
+				centers[(size_t)c * d + j] = v * (1 + eps);
+				centers[(size_t)big * d + j] = v * (1 - eps);
+			}
+			hist[c] = hist[big] / 2;
+			hist[big] -= hist[c];
+		}
+	}
+}
+
+// ======================
+// Index
+// ======================
+
+int IvfPqIndex::train(const float *data, int n, int dim, const IvfPqConfig &config)
+{
+	if (count > 0){
+		PRINT_ERR("ivfpq: train failed, the index is not empty\n");
+		return AILIA_STATUS_INVALID_STATE;
+	}
+	if (n <= 0 || config.m <= 0 || dim % config.m != 0){
+		PRINT_ERR("ivfpq: train failed, n %d dim %d m %d\n", n, dim, config.m);
+		return AILIA_STATUS_INVALID_ARGUMENT;
+	}
+
+	std::mt19937 rng(config.seed);
+
+	// sample the training set
+	std::vector<int> perm(n);
+	for (int i = 0; i < n; i++){
+		perm[i] = i;
+	}
+	int train_n = std::min(n, std::max(1, config.max_train));
+	for (int i = 0; i < train_n; i++){
+		int j = i + (int)(rng() % (unsigned int)(n - i));
+		std::swap(perm[i], perm[j]);
+	}
+	std::sort(perm.begin(), perm.begin() + train_n);
+	std::vector<float> train_data((size_t)train_n * dim);
+	for (int i = 0; i < train_n; i++){
+		memcpy(&train_data[(size_t)i * dim], data + (size_t)perm[i] * dim, dim * sizeof(float));
+	}
+
+	this->dim = dim;
+	m = config.m;
+	dsub = dim / m;
+	nlist = std::max(1, std::min(config.nlist, train_n / MIN_POINTS_PER_CENTROID));
+	ksub = std::min(MAX_KSUB, train_n);
+	if (nlist != config.nlist){
+		PRINT_OUT("ivfpq: nlist %d is reduced to %d for %d training vectors\n", config.nlist, nlist, train_n);
+	}
+
+	// coarse quantizer
+	kmeans(&train_data[0], train_n, dim, dim, nlist, config.kmeans_iter, rng, centroids);
+
+	// residual codebooks
+	std::vector<float> residuals((size_t)train_n * dim);
+	parallel_for(train_n, [&](int begin, int end){
+		for (int i = begin; i < end; i++){
+			const float *x = &train_data[(size_t)i * dim];
+			const float *c = &centroids[(size_t)nearest(x, &centroids[0], nlist, dim) * dim];
+			for (int j = 0; j < dim; j++){
+				residuals[(size_t)i * dim + j] = x[j] - c[j];
+			}
+		}
+	});
+	codebooks.resize((size_t)m * ksub * dsub);
+	std::vector<float> sub_centers;
+	for (int s = 0; s < m; s++){
+		kmeans(&residuals[s * dsub], train_n, dim, dsub, ksub, config.kmeans_iter, rng, sub_centers);
+		memcpy(&codebooks[(size_t)s * ksub * dsub], &sub_centers[0], sub_centers.size() * sizeof(float));
+	}
+
+	list_ids.assign(nlist, std::vector<int32_t>());
+	list_codes.assign(nlist, std::vector<uint8_t>());
+	return AILIA_STATUS_SUCCESS;
+}
+
+int IvfPqIndex::add(const float *data, int n, const std::vector<std::string> &texts)
+{
+	if (!is_trained()){
+		PRINT_ERR("ivfpq: add failed, the index is not trained\n");
+		return AILIA_STATUS_INVALID_STATE;
+	}
+	if ((int)texts.size() != n){
+		PRINT_ERR("ivfpq: add failed, %d vectors and %d texts\n", n, (int)texts.size());
+		return AILIA_STATUS_INVALID_ARGUMENT;
+	}
+
+	std::vector<int> lists(n);
+	std::vector<uint8_t> codes((size_t)n * m);
+	parallel_for(n, [&](int begin, int end){
+		std::vector<float> residual(dim);
+		for (int i = begin; i < end; i++){
+			const float *x = data + (size_t)i * dim;
+			lists[i] = nearest(x, &centroids[0], nlist, dim);
+			const float *c = &centroids[(size_t)lists[i] * dim];
+			for (int j = 0; j < dim; j++){
+				residual[j] = x[j] - c[j];
+			}
+			for (int s = 0; s < m; s++){
+				codes[(size_t)i * m + s] = (uint8_t)nearest(&residual[s * dsub], &codebooks[(size_t)s * ksub * dsub], ksub, dsub);
+			}
+		}
+	});
+
+	for (int i = 0; i < n; i++){
+		list_ids[lists[i]].push_back(count + i);
+		list_codes[lists[i]].insert(list_codes[lists[i]].end(), codes.begin() + (size_t)i * m, codes.begin() + (size_t)(i + 1) * m);
+		this->texts.push_back(texts[i]);
+	}
+	count += n;
+	return AILIA_STATUS_SUCCESS;
+}
+
+// Asymmetric distance table, squared distance between each sub vector of the query residual and each code
+void IvfPqIndex::compute_tables(const float *query, int list, float *tables) const
+{
+	const float *c = &centroids[(size_t)list * dim];
+	std::vector<float> residual(dim);
+	for (int j = 0; j < dim; j++){
+		residual[j] = query[j] - c[j];
+	}
+	for (int s = 0; s < m; s++){
+		const float *book = &codebooks[(size_t)s * ksub * dsub];
+		for (int k = 0; k < ksub; k++){
+			tables[s * ksub + k] = l2sq(&residual[s * dsub], book + (size_t)k * dsub, dsub);
+		}
+	}
+}
+
+void IvfPqIndex::search(const float *query, int k, int nprobe, std::vector<IvfPqResult> &results) const
+{
+	results.clear();
+	if (!is_trained() || k <= 0){
+		return;
+	}
+	nprobe = std::max(1, std::min(nprobe, nlist));
+
+	// nearest clusters, ties go to the lower cluster index
+	std::vector<std::pair<float, int>> coarse(nlist);
+	for (int c = 0; c < nlist; c++){
+		coarse[c] = std::make_pair(l2sq(query, &centroids[(size_t)c * dim], dim), c);
+	}
+	std::partial_sort(coarse.begin(), coarse.begin() + nprobe, coarse.end());
+
+	// max heap of the k best (distance, id), the larger id is evicted first on ties
+	std::priority_queue<std::pair<float, int>> heap;
+	std::vector<float> tables((size_t)m * ksub);
+	for (int p = 0; p < nprobe; p++){
+		int list = coarse[p].second;
+		const std::vector<int32_t> &ids = list_ids[list];
+		if (ids.size() == 0){
+			continue;
+		}
+		compute_tables(query, list, &tables[0]);
+		const uint8_t *codes = &list_codes[list][0];
+		for (size_t i = 0; i < ids.size(); i++){
+			const uint8_t *code = codes + i * m;
+			float d = 0;
+			for (int s = 0; s < m; s++){
+				d += tables[s * ksub + code[s]];
+			}
+			std::pair<float, int> item(d, ids[i]);
+			if ((int)heap.size() < k){
+				heap.push(item);
+			}else if (item < heap.top()){
+				heap.pop();
+				heap.push(item);
+			}
+		}
+	}
+
+	results.resize(heap.size());
+	for (int i = (int)heap.size() - 1; i >= 0; i--){
+		results[i].id = heap.top().second;
+		results[i].distance = heap.top().first;
+		heap.pop();
+	}
+}
+
+// ======================
+// Persistence
+// ======================
+
+struct IvfPqHeader{
+	char magic[8];
+	int32_t dim;
+	int32_t nlist;
+	int32_t m;
+	int32_t ksub;
+	int32_t count;
+	int32_t reserved;
+};
+
+int IvfPqIndex::save(const std::string &path) const
+{
+	if (!is_trained()){
+		PRINT_ERR("ivfpq: save failed, the index is not trained\n");
+		return AILIA_STATUS_INVALID_STATE;
+	}
+
+	// write to a temporary file so that an interrupted save keeps the previous index
+	std::string tmp_path = path + ".tmp";
+	FILE *fp = fopen(tmp_path.c_str(), "wb");
+	if (fp == NULL){
+		PRINT_ERR("\'%s\' open failed\n", tmp_path.c_str());
+		return AILIA_STATUS_ERROR_FILE_API;
+	}
+
+	IvfPqHeader header;
+	memcpy(header.magic, IVFPQ_MAGIC, sizeof(header.magic));
+	header.dim = dim;
+	header.nlist = nlist;
+	header.m = m;
+	header.ksub = ksub;
+	header.count = count;
+	header.reserved = 0;
+
+	bool success = fwrite(&header, sizeof(header), 1, fp) == 1;
+	success = success && fwrite(&centroids[0], sizeof(float), centroids.size(), fp) == centroids.size();
+	success = success && fwrite(&codebooks[0], sizeof(float), codebooks.size(), fp) == codebooks.size();
+	for (int c = 0; c < nlist && success; c++){
+		int32_t size = (int32_t)list_ids[c].size();
+		success = fwrite(&size, sizeof(size), 1, fp) == 1;
+		if (size > 0){
+			success = success && fwrite(&list_ids[c][0], sizeof(int32_t), size, fp) == (size_t)size;
+			success = success && fwrite(&list_codes[c][0], 1, list_codes[c].size(), fp) == list_codes[c].size();
+		}
+	}
+	for (int i = 0; i < count && success; i++){
+		uint32_t len = (uint32_t)texts[i].size();
+		success = fwrite(&len, sizeof(len), 1, fp) == 1;
+		success = success && (len == 0 || fwrite(texts[i].c_str(), 1, len, fp) == len);
+	}
+	success = (fclose(fp) == 0) && success;
+
+	if (!success || rename(tmp_path.c_str(), path.c_str()) != 0){
+		// rename does not replace an existing file on windows
+		if (success && remove(path.c_str()) == 0 && rename(tmp_path.c_str(), path.c_str()) == 0){
+			return AILIA_STATUS_SUCCESS;
+		}
+		PRINT_ERR("\'%s\' write failed\n", path.c_str());
+		remove(tmp_path.c_str());
+		return AILIA_STATUS_ERROR_FILE_API;
+	}
+	return AILIA_STATUS_SUCCESS;
+}
+
+int IvfPqIndex::load(const std::string &path)
+{
+	FILE *fp = fopen(path.c_str(), "rb");
+	if (fp == NULL){
+		PRINT_ERR("\'%s\' open failed\n", path.c_str());
+		return AILIA_STATUS_ERROR_FILE_API;
+	}
+
+	IvfPqHeader header;
+	bool success = fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.magic, IVFPQ_MAGIC, sizeof(header.magic)) == 0;
+	success = success && header.dim > 0 && header.m > 0 && header.dim % header.m == 0;
+	success = success && header.nlist > 0 && header.ksub > 0 && header.ksub <= MAX_KSUB && header.count >= 0;
+	if (!success){
+		fclose(fp);
+		PRINT_ERR("\'%s\' is not an ivfpq index\n", path.c_str());
+		return AILIA_STATUS_INVALID_ARGUMENT;
+	}
+
+	dim = header.dim;
+	nlist = header.nlist;
+	m = header.m;
+	ksub = header.ksub;
+	dsub = dim / m;
+	count = header.count;
+	centroids.resize((size_t)nlist * dim);
+	codebooks.resize((size_t)m * ksub * dsub);
+	list_ids.assign(nlist, std::vector<int32_t>());
+	list_codes.assign(nlist, std::vector<uint8_t>());
+	texts.assign(count, std::string());
+
+	success = fread(&centroids[0], sizeof(float), centroids.size(), fp) == centroids.size();
+	success = success && fread(&codebooks[0], sizeof(float), codebooks.size(), fp) == codebooks.size();
+	int total = 0;
+	for (int c = 0; c < nlist && success; c++){
+		int32_t size = 0;
+		success = fread(&size, sizeof(size), 1, fp) == 1 && size >= 0 && size <= count - total;
+		if (success && size > 0){
+			list_ids[c].resize(size);
+			list_codes[c].resize((size_t)size * m);
+			success = fread(&list_ids[c][0], sizeof(int32_t), size, fp) == (size_t)size;
+			success = success && fread(&list_codes[c][0], 1, list_codes[c].size(), fp) == list_codes[c].size();
+
+			// ids index texts and codes index the codebooks, an out of range value would be read out of bounds by search
+			for (int32_t j = 0; j < size && success; j++){
+				success = list_ids[c][j] >= 0 && list_ids[c][j] < count;
+			}
+			for (size_t j = 0; j < list_codes[c].size() && success; j++){
+				success = list_codes[c][j] < ksub;
+			}
+		}
+		total += size;
+	}
+	success = success && total == count;
+	std::vector<char> buf;
+	for (int i = 0; i < count && success; i++){
+		uint32_t len = 0;
+		success = fread(&len, sizeof(len), 1, fp) == 1;
+		if (success && len > 0){
+			buf.resize(len);
+			success = fread(&buf[0], 1, len, fp) == len;
+			texts[i].assign(buf.begin(), buf.end());
+		}
+	}
+	fclose(fp);
+
+	if (!success){
+		PRINT_ERR("\'%s\' is broken\n", path.c_str());
+		*this = IvfPqIndex();
+		return AILIA_STATUS_INVALID_ARGUMENT;
+	}
+	return AILIA_STATUS_SUCCESS;
+}
+
+// ======================
+// Evaluation
+// ======================
+
+void ivfpq_exact_search(const float *data, int n, int dim, const float *query, int k, std::vector<IvfPqResult> &results)
+{
+	std::priority_queue<std::pair<float, int>> heap;
+	for (int i = 0; i < n && k > 0; i++){
+		std::pair<float, int> item(l2sq(query, data + (size_t)i * dim, dim), i);
+		if ((int)heap.size() < k){
+			heap.push(item);
+		}else if (item < heap.top()){
+			heap.pop();
+			heap.push(item);
+		}
+	}
+	results.resize(heap.size());
+	for (int i = (int)heap.size() - 1; i >= 0; i--){
+		results[i].id = heap.top().second;
+		results[i].distance = heap.top().first;
+		heap.pop();
+	}
+}
+
+float ivfpq_recall(const IvfPqIndex &index, const float *data, int n, const float *queries, int nq, int k, int nprobe)
+{
+	int dim = index.dimension();
+	int found = 0;
+	int total = 0;
+	std::vector<IvfPqResult> exact;
+	std::vector<IvfPqResult> approx;
+	for (int q = 0; q < nq; q++){
+		const float *query = queries + (size_t)q * dim;
+		ivfpq_exact_search(data, n, dim, query, k, exact);
+		index.search(query, k, nprobe, approx);
+		for (size_t i = 0; i < exact.size(); i++){
+			for (size_t j = 0; j < approx.size(); j++){
+				if (approx[j].id == exact[i].id){
+					found++;
+					break;
+				}
+			}
+		}
+		total += (int)exact.size();
+	}
+	return total > 0 ? (float)found / total : 0.0f;
+}
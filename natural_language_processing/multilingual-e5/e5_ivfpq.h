@@ -0,0 +1,85 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA Multilingual E5 IVF-PQ passage index
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#ifndef _E5_IVFPQ_H_
+#define _E5_IVFPQ_H_
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+struct IvfPqConfig{
+	int nlist;			// number of coarse clusters, clamped to the training set size
+	int m;				// number of sub quantizers, dim must be a multiple of m
+	int kmeans_iter;	// lloyd iterations of the coarse and the sub quantizers
+	int max_train;		// training vectors are sampled down to this count
+	unsigned int seed;
+
+	IvfPqConfig(){
+		nlist = 1024;
+		m = 48;
+		kmeans_iter = 20;
+		max_train = 100000;
+		seed = 1234;
+	}
+};
+
+struct IvfPqResult{
+	int id;
+	float distance;		// squared L2, 2 - 2 * cosine for normalized embeddings
+};
+
+// Inverted file of coarse clusters, the residual to the cluster centroid is product quantized to m bytes
+class IvfPqIndex{
+public:
+	IvfPqIndex() : dim(0), nlist(0), m(0), ksub(0), dsub(0), count(0) {}
+
+	// Train the coarse quantizer and the residual codebooks, the index must be empty
+	int train(const float *data, int n, int dim, const IvfPqConfig &config);
+
+	// Encode and append the vectors with their passages, ids are assigned in the order of addition
+	int add(const float *data, int n, const std::vector<std::string> &texts);
+
+	// k nearest vectors of the nprobe clusters nearest to the query, sorted by distance
+	void search(const float *query, int k, int nprobe, std::vector<IvfPqResult> &results) const;
+
+	int save(const std::string &path) const;
+	int load(const std::string &path);
+
+	bool is_trained() const { return nlist > 0; }
+	int size() const { return count; }
+	int dimension() const { return dim; }
+	int list_n() const { return nlist; }
+	int code_size() const { return m; }
+	const std::string &text(int id) const { return texts[id]; }
+
+private:
+	int dim;
+	int nlist;
+	int m;
+	int ksub;
+	int dsub;
+	int count;
+	std::vector<float> centroids;				// nlist x dim
+	std::vector<float> codebooks;				// m x ksub x dsub
+	std::vector<std::vector<int32_t>> list_ids;
+	std::vector<std::vector<uint8_t>> list_codes;	// list size x m
+	std::vector<std::string> texts;
+
+	void compute_tables(const float *query, int list, float *tables) const;
+};
+
+// Brute force k nearest neighbors of the query in data (n x dim), used as the ground truth
+void ivfpq_exact_search(const float *data, int n, int dim, const float *query, int k, std::vector<IvfPqResult> &results);
+
+// Fraction of the exact k nearest neighbors found in the index results, averaged over the queries
+float ivfpq_recall(const IvfPqIndex &index, const float *data, int n, const float *queries, int nq, int k, int nprobe);
+
+#endif
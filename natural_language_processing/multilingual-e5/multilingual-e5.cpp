@@ -10,15 +10,20 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <vector>
 #include <string>
 #include <math.h>
+#include <chrono>
+#include <random>
 
 #undef UNICODE
 
 #include "ailia.h"
 #include "ailia_tokenizer.h"
+#include "topk_utils.h"
+#include "e5_ivfpq.h"
 
 bool debug = false;
 
@@ -44,6 +49,8 @@ bool debug = false;
 #define NUM_OUTPUTS 1
 #define NUM_STATE 768
 
+#define INDEX_PATH "multilingual-e5.ivfpq"
+
 static std::string weight(WEIGHT_PATH);
 static std::string model(MODEL_PATH);
 
@@ -52,6 +59,16 @@ static int args_env_id = -1;
 
 std::string input_text = "nnapiの速度";
 
+static std::string index_path(INDEX_PATH);
+static std::string build_path = "";
+static std::string add_path = "";
+static bool use_index = false;
+static bool recall_mode = false;
+static int nprobe = 16;
+static int topk_n = 1;
+static int args_nlist = -1;
+static IvfPqConfig ivfpq_config;
+
 
 // ======================
 // Arguemnt Parser
@@ -59,7 +76,9 @@ std::string input_text = "nnapiの速度";
 
 static void print_usage()
 {
-	PRINT_OUT("usage: multilingual-e5 [-h] [-i TEXT] [-b] [-e ENV_ID]\n");
+	PRINT_OUT("usage: multilingual-e5 [-h] [-i TEXT] [-b] [-e ENV_ID] [--index INDEX]\n");
+	PRINT_OUT("                       [--build TEXT_FILE] [--add TEXT_FILE] [--nprobe NPROBE]\n");
+	PRINT_OUT("                       [--nlist NLIST] [--pq_m PQ_M] [-k TOPK] [--recall]\n");
 	return;
 }
 
@@ -78,6 +97,17 @@ static void print_help()
 	PRINT_OUT("                        video mode)\n");
 	PRINT_OUT("  -e ENV_ID, --env_id ENV_ID\n");
 	PRINT_OUT("                        The backend environment id.\n");
+	PRINT_OUT("  --index INDEX         Search the passages of the IVF-PQ index file.\n");
+	PRINT_OUT("                        (default: " INDEX_PATH ")\n");
+	PRINT_OUT("  --build TEXT_FILE     Create the index from the sentences of the text file.\n");
+	PRINT_OUT("  --add TEXT_FILE       Append the sentences of the text file to the index.\n");
+	PRINT_OUT("  --nprobe NPROBE       Number of clusters scanned by a query. (default: 16)\n");
+	PRINT_OUT("  --nlist NLIST         Number of clusters of a new index. (default: 1024,\n");
+	PRINT_OUT("                        128 with --recall)\n");
+	PRINT_OUT("  --pq_m PQ_M           Bytes per passage of a new index. (default: 48)\n");
+	PRINT_OUT("  -k TOPK, --topk TOPK  Number of passages shown. (default: 1)\n");
+	PRINT_OUT("  --recall              Measure the recall@10 of the index against exact\n");
+	PRINT_OUT("                        search on synthetic data.\n");
 	return;
 }
 
@@ -110,6 +140,33 @@ static int argument_parser(int argc, char **argv)
 			else if (arg == "-e" || arg == "--env_id") {
 				status = 4;
 			}
+			else if (arg == "--index") {
+				use_index = true;
+				status = 5;
+			}
+			else if (arg == "--build") {
+				use_index = true;
+				status = 6;
+			}
+			else if (arg == "--add") {
+				use_index = true;
+				status = 7;
+			}
+			else if (arg == "--nprobe") {
+				status = 8;
+			}
+			else if (arg == "--nlist") {
+				status = 9;
+			}
+			else if (arg == "--pq_m") {
+				status = 10;
+			}
+			else if (arg == "-k" || arg == "--topk") {
+				status = 11;
+			}
+			else if (arg == "--recall") {
+				recall_mode = true;
+			}
 			else {
 				print_usage();
 				print_error(arg);
@@ -124,6 +181,27 @@ static int argument_parser(int argc, char **argv)
 			case 4:
 				args_env_id = atoi(arg.c_str());
 				break;
+			case 5:
+				index_path = arg;
+				break;
+			case 6:
+				build_path = arg;
+				break;
+			case 7:
+				add_path = arg;
+				break;
+			case 8:
+				nprobe = atoi(arg.c_str());
+				break;
+			case 9:
+				args_nlist = atoi(arg.c_str());
+				break;
+			case 10:
+				ivfpq_config.m = atoi(arg.c_str());
+				break;
+			case 11:
+				topk_n = atoi(arg.c_str());
+				break;
 			default:
 				print_usage();
 				print_error(arg);
@@ -158,27 +236,7 @@ void softmax(float *data, int n){
 
 std::vector<int> topk(const float *logits, int num_words, int kn){
 	std::vector<int> results;
-	for (int k = 0; k < kn; k++){
-		float prob = -INFINITY;
-		int arg_max = 0;
-		for (int j = 0; j < num_words; j++){
-			if (prob < logits[j]){
-				bool already = false;
-				for (int l = 0; l < k; l++){
-					if (results[l] == j){
-						already = true;
-						break;
-					}
-				}
-				if (already){
-					continue;
-				}
-				prob = logits[j];
-				arg_max = j;
-			}
-		}
-		results.push_back(arg_max);
-	}
+	topk_indices(logits, num_words, kn, results);
 	return results;
 }
 
@@ -353,12 +411,16 @@ std::vector<std::string> split(std::string text) {
 	return sents;
 }
 
-std::vector<std::string> open_texts(std::string parh){
-	FILE *fp = fopen("sample.txt", "r");
+std::vector<std::string> open_texts(std::string path){
 	std::vector<char> text;
-	while(!feof(fp)){
-		char c = fgetc(fp);
-		text.push_back(c);
+	FILE *fp = fopen(path.c_str(), "r");
+	if (fp == NULL){
+		PRINT_ERR("\'%s\' open failed\n", path.c_str());
+		return std::vector<std::string>();
+	}
+	int c;
+	while((c = fgetc(fp)) != EOF){
+		text.push_back((char)c);
 	}
 	text.push_back('\0');
 	fclose(fp);
@@ -415,6 +477,15 @@ float norm(std::vector<float> & vec1){
 	return norm1;
 }
 
+void normalize(std::vector<float> & vec1){
+	float norm1 = norm(vec1);
+	if (norm1 > 0){
+		for (int i = 0; i < vec1.size(); i++){
+			vec1[i] /= norm1;
+		}
+	}
+}
+
 float cos_similarity(std::vector<float> & vec1, std::vector<float> & vec2){
 	float sum = 0;
 	float norm1 = norm(vec1);
@@ -425,8 +496,194 @@ float cos_similarity(std::vector<float> & vec1, std::vector<float> & vec2){
 	return sum;
 }
 
+static int embed_passages(AILIANetwork* net, struct AILIATokenizer *tokenizer, std::vector<std::string> &texts, std::vector<float> &embeddings)
+{
+	embeddings.resize(texts.size() * NUM_STATE);
+	PRINT_OUT("Calculating embeddings\n");
+	for (int i = 0; i < texts.size(); i++){
+		PRINT_OUT("\r%d/%d", i, (int)texts.size());
+		fflush(stdout);
+		std::vector<float> embedding = calc_embedding(net, tokenizer, std::string("passage: ") + texts[i], false);
+		if (embedding.size() != NUM_STATE){
+			return -1;
+		}
+		normalize(embedding);
+		memcpy(&embeddings[i * NUM_STATE], &embedding[0], NUM_STATE * sizeof(float));
+	}
+	PRINT_OUT("\n");
+	return AILIA_STATUS_SUCCESS;
+}
+
+static int recognize_from_index(AILIANetwork* net, struct AILIATokenizer *tokenizer)
+{
+	int status = AILIA_STATUS_SUCCESS;
+	IvfPqIndex index;
+
+	// Create or open the index
+	if (build_path != ""){
+		std::vector<std::string> texts = open_texts(build_path);
+		if (texts.size() == 0){
+			PRINT_ERR("no passages in %s\n", build_path.c_str());
+			return -1;
+		}
+		std::vector<float> embeddings;
+		status = embed_passages(net, tokenizer, texts, embeddings);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+		PRINT_OUT("Training index\n");
+		IvfPqConfig config = ivfpq_config;
+		if (args_nlist > 0){
+			config.nlist = args_nlist;
+		}
+		status = index.train(&embeddings[0], texts.size(), NUM_STATE, config);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+		status = index.add(&embeddings[0], texts.size(), texts);
+	}else{
+		status = index.load(index_path);
+	}
+	if (status != AILIA_STATUS_SUCCESS){
+		return status;
+	}
+
+	// Append passages
+	if (add_path != ""){
+		std::vector<std::string> texts = open_texts(add_path);
+		std::vector<float> embeddings;
+		status = embed_passages(net, tokenizer, texts, embeddings);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+		if (texts.size() > 0){
+			status = index.add(&embeddings[0], texts.size(), texts);
+			if (status != AILIA_STATUS_SUCCESS){
+				return status;
+			}
+		}
+	}
+
+	if (build_path != "" || add_path != ""){
+		status = index.save(index_path);
+		if (status != AILIA_STATUS_SUCCESS){
+			return status;
+		}
+		PRINT_OUT("Saved %s (passages %d clusters %d code %d bytes)\n", index_path.c_str(), index.size(), index.list_n(), index.code_size());
+	}
+
+	// Embedding Query
+	std::vector<float> query_embedding = calc_embedding(net, tokenizer, std::string("query: ") + input_text, true);
+	if (query_embedding.size() != NUM_STATE){
+		return -1;
+	}
+	normalize(query_embedding);
+
+	// Search
+	std::vector<IvfPqResult> results;
+	index.search(&query_embedding[0], topk_n, nprobe, results);
+
+	PRINT_OUT("Query : %s\n", input_text.c_str());
+	for (int i = 0; i < results.size(); i++){
+		PRINT_OUT("Result : %s\n", index.text(results[i].id).c_str());
+		PRINT_OUT("Similarity : %f\n", 1.0f - results[i].distance / 2);
+	}
+	PRINT_OUT("Program finished successfully.\n");
+
+	return AILIA_STATUS_SUCCESS;
+}
+
+static int evaluate_recall()
+{
+	const int N = 20000;
+	const int NQ = 100;
+	const int K = 10;
+	const int CLUSTERS = 256;
+	const int LATENT = 32;
+
+	// unit vectors around random topics varying in a low dimensional subspace like sentence embeddings
+	std::mt19937 rng(ivfpq_config.seed);
+	std::normal_distribution<float> normal(0.0f, 1.0f);
+	std::vector<float> topics(CLUSTERS * NUM_STATE);
+	std::vector<float> basis(LATENT * NUM_STATE);
+	for (int i = 0; i < topics.size(); i++){
+		topics[i] = normal(rng);
+	}
+	for (int i = 0; i < basis.size(); i++){
+		basis[i] = normal(rng) / sqrt((float)LATENT);
+	}
+	std::vector<float> vecs((N + NQ) * NUM_STATE);
+	std::vector<float> v(NUM_STATE);
+	std::vector<float> z(LATENT);
+	for (int i = 0; i < N + NQ; i++){
+		const float *topic = &topics[(rng() % CLUSTERS) * NUM_STATE];
+		for (int l = 0; l < LATENT; l++){
+			z[l] = normal(rng);
+		}
+		for (int j = 0; j < NUM_STATE; j++){
+			v[j] = topic[j] + normal(rng) * 0.1f;
+		}
+		for (int l = 0; l < LATENT; l++){
+			for (int j = 0; j < NUM_STATE; j++){
+				v[j] += z[l] * basis[l * NUM_STATE + j];
+			}
+		}
+		normalize(v);
+		memcpy(&vecs[i * NUM_STATE], &v[0], NUM_STATE * sizeof(float));
+	}
+	const float *data = &vecs[0];
+	const float *queries = &vecs[N * NUM_STATE];
+	std::vector<std::string> texts(N);
+
+	PRINT_OUT("Synthetic data : passages %d queries %d dim %d\n", N, NQ, NUM_STATE);
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	IvfPqConfig config = ivfpq_config;
+	config.nlist = (args_nlist > 0) ? args_nlist : 128;
+	IvfPqIndex index;
+	int status = index.train(data, N, NUM_STATE, config);
+	if (status != AILIA_STATUS_SUCCESS){
+		return status;
+	}
+	status = index.add(data, N, texts);
+	if (status != AILIA_STATUS_SUCCESS){
+		return status;
+	}
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	PRINT_OUT("Build : %lld ms (clusters %d)\n", (long long)std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count(), index.list_n());
+	PRINT_OUT("Memory per passage : %d bytes (float32 %d bytes)\n", index.code_size() + (int)sizeof(int32_t), NUM_STATE * (int)sizeof(float));
+
+	std::vector<IvfPqResult> results;
+	begin = std::chrono::steady_clock::now();
+	for (int q = 0; q < NQ; q++){
+		ivfpq_exact_search(data, N, NUM_STATE, queries + q * NUM_STATE, K, results);
+	}
+	end = std::chrono::steady_clock::now();
+	PRINT_OUT("Exact search : %.3f ms/query\n", std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / 1000.0 / NQ);
+
+	const int probes[] = {1, 2, 4, 8, 16, 32, 64};
+	for (int p = 0; p < sizeof(probes) / sizeof(probes[0]); p++){
+		if (p > 0 && probes[p - 1] >= index.list_n()){
+			break;
+		}
+		begin = std::chrono::steady_clock::now();
+		for (int q = 0; q < NQ; q++){
+			index.search(queries + q * NUM_STATE, K, probes[p], results);
+		}
+		end = std::chrono::steady_clock::now();
+		float recall = ivfpq_recall(index, data, N, queries, NQ, K, probes[p]);
+		PRINT_OUT("nprobe %3d : recall@%d %.3f %.3f ms/query\n", probes[p], K, recall, std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() / 1000.0 / NQ);
+	}
+	PRINT_OUT("Program finished successfully.\n");
+
+	return AILIA_STATUS_SUCCESS;
+}
+
 static int recognize_from_text(AILIANetwork* net, struct AILIATokenizer *tokenizer)
 {
+	if (use_index){
+		return recognize_from_index(net, tokenizer);
+	}
+
 	int status = AILIA_STATUS_SUCCESS;
 
 	// Open database
@@ -479,6 +736,10 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
+	if (recall_mode){
+		return evaluate_recall();
+	}
+
 	// env list
 	unsigned int env_count;
 	status = ailiaGetEnvironmentCount(&env_count);
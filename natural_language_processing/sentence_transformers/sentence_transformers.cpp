@@ -14,11 +14,15 @@
 #include <vector>
 #include <string>
 #include <math.h>
+#include <thread>
+#include <algorithm>
 
 #undef UNICODE
 
 #include "ailia.h"
 #include "ailia_tokenizer.h"
+#include "topk_utils.h"
+#include "st_corpus.h"
 
 bool debug = false;
 
@@ -44,6 +48,9 @@ bool debug = false;
 #define NUM_OUTPUTS 2
 #define NUM_STATE 768
 
+#define CORPUS_PATH "sample.txt"
+#define QUEUE_SIZE 64
+
 static std::string weight(WEIGHT_PATH);
 static std::string model(MODEL_PATH);
 
@@ -52,6 +59,10 @@ static int args_env_id = -1;
 
 std::string input_text = "nnapiの速度";
 
+static std::string corpus_path(CORPUS_PATH);
+static int queue_size = QUEUE_SIZE;
+static CorpusConfig corpus_config;
+
 
 // ======================
 // Arguemnt Parser
@@ -59,7 +70,9 @@ std::string input_text = "nnapiの速度";
 
 static void print_usage()
 {
-	PRINT_OUT("usage: sentenace_transformers [-h] [-i TEXT] [-b] [-e ENV_ID]\n");
+	PRINT_OUT("usage: sentenace_transformers [-h] [-i TEXT] [-b] [-e ENV_ID] [-f CORPUS]\n");
+	PRINT_OUT("                              [--max_tokens MAX_TOKENS] [--overlap OVERLAP]\n");
+	PRINT_OUT("                              [--pack] [--paragraph] [--queue QUEUE]\n");
 	return;
 }
 
@@ -78,6 +91,16 @@ static void print_help()
 	PRINT_OUT("                        video mode)\n");
 	PRINT_OUT("  -e ENV_ID, --env_id ENV_ID\n");
 	PRINT_OUT("                        The backend environment id.\n");
+	PRINT_OUT("  -f CORPUS, --file CORPUS\n");
+	PRINT_OUT("                        The UTF-8 text file or the directory of text files\n");
+	PRINT_OUT("                        to search. (default: " CORPUS_PATH ")\n");
+	PRINT_OUT("  --max_tokens MAX_TOKENS\n");
+	PRINT_OUT("                        Longer sentences are split. (default: 128)\n");
+	PRINT_OUT("  --overlap OVERLAP     Tokens of the previous chunk repeated with --pack.\n");
+	PRINT_OUT("                        (default: 0)\n");
+	PRINT_OUT("  --pack                Pack consecutive sentences up to MAX_TOKENS.\n");
+	PRINT_OUT("  --paragraph           Split at blank lines instead of sentences.\n");
+	PRINT_OUT("  --queue QUEUE         Chunks read ahead of the embedding. (default: %d)\n", QUEUE_SIZE);
 	return;
 }
 
@@ -110,6 +133,24 @@ static int argument_parser(int argc, char **argv)
 			else if (arg == "-e" || arg == "--env_id") {
 				status = 4;
 			}
+			else if (arg == "-f" || arg == "--file") {
+				status = 5;
+			}
+			else if (arg == "--max_tokens") {
+				status = 6;
+			}
+			else if (arg == "--overlap") {
+				status = 7;
+			}
+			else if (arg == "--queue") {
+				status = 8;
+			}
+			else if (arg == "--pack") {
+				corpus_config.pack = true;
+			}
+			else if (arg == "--paragraph") {
+				corpus_config.paragraph = true;
+			}
 			else {
 				print_usage();
 				print_error(arg);
@@ -124,6 +165,18 @@ static int argument_parser(int argc, char **argv)
 			case 4:
 				args_env_id = atoi(arg.c_str());
 				break;
+			case 5:
+				corpus_path = arg;
+				break;
+			case 6:
+				corpus_config.max_tokens = atoi(arg.c_str());
+				break;
+			case 7:
+				corpus_config.overlap_tokens = atoi(arg.c_str());
+				break;
+			case 8:
+				queue_size = std::max(1, atoi(arg.c_str()));
+				break;
 			default:
 				print_usage();
 				print_error(arg);
@@ -158,27 +211,7 @@ void softmax(float *data, int n){
 
 std::vector<int> topk(const float *logits, int num_words, int kn){
 	std::vector<int> results;
-	for (int k = 0; k < kn; k++){
-		float prob = -INFINITY;
-		int arg_max = 0;
-		for (int j = 0; j < num_words; j++){
-			if (prob < logits[j]){
-				bool already = false;
-				for (int l = 0; l < k; l++){
-					if (results[l] == j){
-						already = true;
-						break;
-					}
-				}
-				if (already){
-					continue;
-				}
-				prob = logits[j];
-				arg_max = j;
-			}
-		}
-		results.push_back(arg_max);
-	}
+	topk_indices(logits, num_words, kn, results);
 	return results;
 }
 
@@ -322,53 +355,8 @@ std::vector<float> mean_pool(std::vector<float> &features){
 	return mean;
 }
 
-std::vector<std::string> split(std::string text) {
-	const int MIN_LENGTH = 5;
-	std::string delimiter = u8"。";
-	std::vector<std::string> sents;
-	
-	// Replace newline characters and split into sentences
-	size_t pos = 0;
-	while ((pos = text.find("\n", pos)) != std::string::npos) {
-		text.replace(pos, 1, "");
-	}
-	
-	pos = 0;
-	while ((pos = text.find(delimiter, pos)) != std::string::npos) {
-		text.replace(pos, delimiter.length(), delimiter + " ");
-		pos += delimiter.length() + 1;
-	}
-
-	// Split sentences and filter based on minimum length
-	pos = 0;
-	while ((pos = text.find(delimiter, pos)) != std::string::npos) {
-		std::string sentence = text.substr(0, pos + delimiter.length());
-		text.erase(0, pos + delimiter.length());
-		if (sentence.length() > MIN_LENGTH) {
-			sents.push_back(sentence);
-		}
-		pos = 0;
-	}
-	
-	return sents;
-}
-
-std::vector<std::string> open_texts(std::string parh){
-	FILE *fp = fopen("sample.txt", "r");
-	std::vector<char> text;
-	while(!feof(fp)){
-		char c = fgetc(fp);
-		text.push_back(c);
-	}
-	text.push_back('\0');
-	fclose(fp);
-	return split(&text[0]);
-}
-
-std::vector<float> calc_embedding(AILIANetwork* net, struct AILIATokenizer *tokenizer, std::string text, bool prompt)
+std::vector<float> calc_embedding(AILIANetwork* net, const std::vector<int> &tokens, bool prompt)
 {
-	std::vector<int> tokens = encode(text, tokenizer);
-
 	std::vector<float> input_ids(tokens.size());
 	std::vector<float> attention_mask(tokens.size());
 
@@ -407,6 +395,12 @@ std::vector<float> calc_embedding(AILIANetwork* net, struct AILIATokenizer *toke
 	return pool_features;
 }
 
+std::vector<float> calc_embedding(AILIANetwork* net, struct AILIATokenizer *tokenizer, std::string text, bool prompt)
+{
+	std::vector<int> tokens = encode(text, tokenizer);
+	return calc_embedding(net, tokens, prompt);
+}
+
 float norm(std::vector<float> & vec1){
 	float norm1 = 0;
 	for (int i = 0; i < vec1.size(); i++){
@@ -426,23 +420,46 @@ float cos_similarity(std::vector<float> & vec1, std::vector<float> & vec2){
 	return sum;
 }
 
-static int recognize_from_text(AILIANetwork* net, struct AILIATokenizer *tokenizer)
+static int recognize_from_text(AILIANetwork* net, struct AILIATokenizer *tokenizer, struct AILIATokenizer *reader_tokenizer)
 {
 	int status = AILIA_STATUS_SUCCESS;
 
-	// Open database
-	std::vector<std::string> texts = open_texts(std::string("sample.txt"));
+	// Read and tokenize the corpus on a separate thread while the chunks are embedded
+	CorpusQueue queue(queue_size);
+	int reader_status = AILIA_STATUS_SUCCESS;
+	CorpusEncodeFunc reader_encode = [reader_tokenizer](const std::string &text){
+		return encode(text, reader_tokenizer);
+	};
+	std::thread reader([&](){
+		reader_status = ingest_corpus(corpus_path, corpus_config, reader_encode, queue);
+	});
 
 	// Embedding
+	std::vector<std::string> texts;
 	std::vector< std::vector<float> > embeddings;
 	PRINT_OUT("Calculating embeddings\n");
-	for (int i = 0; i < texts.size(); i++){
-		PRINT_OUT("\r%d/%d", i, texts.size());
+	CorpusChunk chunk;
+	while (queue.pop(chunk)){
+		PRINT_OUT("\r%d", (int)texts.size());
 		fflush(stdout);
-		std::vector<float> embedding = calc_embedding(net, tokenizer, texts[i], false);
+		std::vector<float> embedding = calc_embedding(net, chunk.tokens, false);
+		if (embedding.size() == 0){
+			status = -1;
+			break;
+		}
+		texts.push_back(chunk.text);
 		embeddings.push_back(embedding);
 	}
+	queue.close();
+	reader.join();
 	PRINT_OUT("\n");
+	if (status != AILIA_STATUS_SUCCESS){
+		return status;
+	}
+	if (texts.size() == 0){
+		PRINT_ERR("no sentences in %s\n", corpus_path.c_str());
+		return reader_status != AILIA_STATUS_SUCCESS ? reader_status : -1;
+	}
 
 	// Embedding Query
 	std::vector<float> query_embedding = calc_embedding(net, tokenizer, input_text, true);
@@ -560,8 +577,22 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
-	status = recognize_from_text(ailia, tokenizer);
+	// the corpus reader tokenizes on its own thread
+	AILIATokenizer *reader_tokenizer;
+	status = ailiaTokenizerCreate(&reader_tokenizer, AILIA_TOKENIZER_TYPE_XLM_ROBERTA, AILIA_TOKENIZER_FLAG_NONE);
+	if (status != 0){
+		printf("ailiaTokenizerCreate error %d\n", status);
+		return -1;
+	}
+	status = ailiaTokenizerOpenModelFile(reader_tokenizer, "sentencepiece.bpe.model");
+	if (status != 0){
+		printf("ailiaTokenizerOpenModelFile error %d\n", status);
+		return -1;
+	}
+
+	status = recognize_from_text(ailia, tokenizer, reader_tokenizer);
 
+	ailiaTokenizerDestroy(reader_tokenizer);
 	ailiaTokenizerDestroy(tokenizer);
 
 	ailiaDestroy(ailia);
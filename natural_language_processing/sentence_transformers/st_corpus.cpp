@@ -0,0 +1,462 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA Sentence Transformers streaming corpus ingestion
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(_WIN32) || defined(_WIN64)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "ailia.h"
+#include "st_corpus.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf_s(stderr, __VA_ARGS__)
+#else
+#define PRINT_OUT(...) fprintf(stdout, __VA_ARGS__)
+#define PRINT_ERR(...) fprintf(stderr, __VA_ARGS__)
+#endif
+
+// ======================
+// Segmenter
+// ======================
+
+static bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool is_ascii(char c)
+{
+	return (unsigned char)c < 0x80;
+}
+
+// Closing quotes and brackets kept with the sentence they end
+static size_t closing_length(const std::string &text, size_t pos)
+{
+	static const char *closings[] = {"\"", "'", ")", u8"」", u8"』", u8"）", u8"”", u8"’"};
+	for (size_t i = 0; i < sizeof(closings) / sizeof(closings[0]); i++){
+		size_t len = strlen(closings[i]);
+		if (text.compare(pos, len, closings[i]) == 0){
+			return len;
+		}
+	}
+	return 0;
+}
+
+// The bytes from pos to the end of text are the start of a closing quote or bracket cut by the read
+static bool closing_prefix(const std::string &text, size_t pos)
+{
+	static const char *closings[] = {u8"」", u8"』", u8"）", u8"”", u8"’"};
+	size_t rest = text.size() - pos;
+	for (size_t i = 0; i < sizeof(closings) / sizeof(closings[0]); i++){
+		if (rest > 0 && rest < strlen(closings[i]) && text.compare(pos, rest, closings[i], rest) == 0){
+			return true;
+		}
+	}
+	return false;
+}
+
+void SentenceSegmenter::emit(size_t begin, size_t end, const CorpusSegmentFunc &callback)
+{
+	// a single line break is a wrapped line, words are joined with a space and CJK without
+	std::string segment;
+	segment.reserve(end - begin);
+	for (size_t i = begin; i < end; i++){
+		char c = pending[i];
+		if (c == '\r'){
+			continue;
+		}
+		if (c == '\n'){
+			char next = (i + 1 < end) ? pending[i + 1] : ' ';
+			if (segment.size() > 0 && is_ascii(segment.back()) && !is_space(segment.back()) && is_ascii(next) && !is_space(next)){
+				segment += ' ';
+			}
+			continue;
+		}
+		segment += c;
+	}
+
+	size_t first = 0;
+	while (first < segment.size() && is_space(segment[first])){
+		first++;
+	}
+	size_t last = segment.size();
+	while (last > first && is_space(segment[last - 1])){
+		last--;
+	}
+	if ((int)(last - first) > config.min_length){
+		callback(segment.substr(first, last - first));
+	}
+}
+
+void SentenceSegmenter::scan(bool final, const CorpusSegmentFunc &callback)
+{
+	size_t begin = 0;
+	size_t i = scan_pos;
+	bool wait = false;
+	while (i < pending.size() && !wait){
+		if (pending[i] == '\n'){
+			// blank line is a paragraph boundary
+			size_t j = i + 1;
+			while (j < pending.size() && (pending[j] == ' ' || pending[j] == '\t' || pending[j] == '\r')){
+				j++;
+			}
+			if (j == pending.size() && !final){
+				break;
+			}
+			if (j < pending.size() && pending[j] == '\n'){
+				emit(begin, i, callback);
+				begin = j + 1;
+				i = j + 1;
+				continue;
+			}
+			i++;
+			continue;
+		}
+
+		if (!config.paragraph){
+			size_t end = 0;
+			for (size_t t = 0; t < config.terminators.size(); t++){
+				const std::string &term = config.terminators[t];
+				size_t rest = pending.size() - i;
+				if (rest < term.size()){
+					// a terminator cut by the read
+					if (!final && pending.compare(i, rest, term, 0, rest) == 0){
+						wait = true;
+						break;
+					}
+					continue;
+				}
+				if (pending.compare(i, term.size(), term) != 0){
+					continue;
+				}
+				size_t next = i + term.size();
+				if (next == pending.size() && !final){
+					wait = true;
+					break;
+				}
+				if (!final && closing_prefix(pending, next)){
+					wait = true;
+					break;
+				}
+				// "1.5" or "e.g" is not the end of a sentence
+				if (term.size() == 1 && next < pending.size() && !is_space(pending[next]) && closing_length(pending, next) == 0){
+					continue;
+				}
+				end = next;
+				break;
+			}
+			if (wait){
+				break;
+			}
+			if (end > 0){
+				size_t len;
+				while (end < pending.size() && (len = closing_length(pending, end)) > 0){
+					end += len;
+				}
+				// more closings may follow in the next read, the sentence is scanned again from its terminator
+				if (!final && (end == pending.size() || closing_prefix(pending, end))){
+					wait = true;
+					break;
+				}
+				emit(begin, end, callback);
+				begin = end;
+				i = end;
+				continue;
+			}
+		}
+		i++;
+	}
+
+	pending.erase(0, begin);
+	scan_pos = i - begin;
+}
+
+void SentenceSegmenter::feed(const char *data, size_t size, const CorpusSegmentFunc &callback)
+{
+	pending.append(data, size);
+	if (start_of_file){
+		if (pending.size() < 3){
+			return;
+		}
+		if (pending.compare(0, 3, "\xEF\xBB\xBF") == 0){
+			pending.erase(0, 3);
+		}
+		start_of_file = false;
+	}
+	scan(false, callback);
+}
+
+void SentenceSegmenter::finish(const CorpusSegmentFunc &callback)
+{
+	if (start_of_file && pending.compare(0, 3, "\xEF\xBB\xBF") == 0){
+		pending.erase(0, 3);
+	}
+	scan(true, callback);
+	emit(0, pending.size(), callback);
+	pending.clear();
+	scan_pos = 0;
+	start_of_file = true;
+}
+
+// ======================
+// Chunker
+// ======================
+
+static std::string join_segments(const std::vector<std::string> &segments, size_t begin, size_t end)
+{
+	std::string text;
+	for (size_t i = begin; i < end; i++){
+		if (text.size() > 0 && is_ascii(text.back()) && is_ascii(segments[i][0])){
+			text += ' ';
+		}
+		text += segments[i];
+	}
+	return text;
+}
+
+bool TokenChunker::split_long(const std::string &text, std::vector<int> &tokens, const CorpusChunkFunc &callback)
+{
+	if (config.max_tokens <= 0 || (int)tokens.size() <= config.max_tokens){
+		CorpusChunk chunk;
+		chunk.text = text;
+		chunk.tokens.swap(tokens);
+		return callback(chunk);
+	}
+
+	// halve at a character boundary, preferring a space near the middle
+	size_t mid = text.size() / 2;
+	while (mid > 0 && (text[mid] & 0xC0) == 0x80){
+		mid--;
+	}
+	size_t space = text.rfind(' ', mid);
+	if (space != std::string::npos && space > 0 && mid - space < text.size() / 8){
+		mid = space + 1;
+	}
+	if (mid == 0 || mid >= text.size()){
+		CorpusChunk chunk;
+		chunk.text = text;
+		chunk.tokens.swap(tokens);
+		return callback(chunk);
+	}
+
+	std::string left = text.substr(0, mid);
+	std::string right = text.substr(mid);
+	std::vector<int> left_tokens = encode(left);
+	std::vector<int> right_tokens = encode(right);
+	return split_long(left, left_tokens, callback) && split_long(right, right_tokens, callback);
+}
+
+bool TokenChunker::emit_packed(bool keep_overlap, const CorpusChunkFunc &callback)
+{
+	if (packed.size() == 0){
+		return true;
+	}
+	std::string text = join_segments(packed, 0, packed.size());
+	std::vector<int> tokens = encode(text);
+	if (tokens.size() > 0 && !split_long(text, tokens, callback)){
+		return false;
+	}
+
+	// trailing segments within overlap_tokens, the first one is always dropped so that the chunker advances
+	size_t keep_from = packed.size();
+	int kept = 0;
+	if (keep_overlap){
+		while (keep_from > 1 && kept + packed_counts[keep_from - 1] <= config.overlap_tokens){
+			keep_from--;
+			kept += packed_counts[keep_from];
+		}
+	}
+	packed.erase(packed.begin(), packed.begin() + keep_from);
+	packed_counts.erase(packed_counts.begin(), packed_counts.begin() + keep_from);
+	packed_tokens = kept;
+	return true;
+}
+
+bool TokenChunker::push(const std::string &segment, const CorpusChunkFunc &callback)
+{
+	std::vector<int> tokens = encode(segment);
+	if (tokens.size() == 0){
+		return true;
+	}
+	int count = (int)tokens.size();
+
+	if (config.max_tokens > 0 && count > config.max_tokens){
+		return flush(callback) && split_long(segment, tokens, callback);
+	}
+	if (!config.pack){
+		CorpusChunk chunk;
+		chunk.text = segment;
+		chunk.tokens.swap(tokens);
+		return callback(chunk);
+	}
+
+	// the per segment counts include the special tokens, so the packed chunk never exceeds max_tokens
+	if (packed.size() > 0 && config.max_tokens > 0 && packed_tokens + count > config.max_tokens){
+		if (!emit_packed(true, callback)){
+			return false;
+		}
+		if (packed_tokens + count > config.max_tokens){
+			packed.clear();
+			packed_counts.clear();
+			packed_tokens = 0;
+		}
+	}
+	packed.push_back(segment);
+	packed_counts.push_back(count);
+	packed_tokens += count;
+	return true;
+}
+
+bool TokenChunker::flush(const CorpusChunkFunc &callback)
+{
+	bool success = emit_packed(false, callback);
+	packed.clear();
+	packed_counts.clear();
+	packed_tokens = 0;
+	return success;
+}
+
+// ======================
+// Reader
+// ======================
+
+static void walk_directory(const std::string &dir, std::vector<std::string> &files)
+{
+#if defined(_WIN32) || defined(_WIN64)
+	WIN32_FIND_DATAA data;
+	HANDLE handle = FindFirstFileA((dir + "\\*").c_str(), &data);
+	if (handle == INVALID_HANDLE_VALUE){
+		return;
+	}
+	do{
+		std::string name = data.cFileName;
+		if (name[0] == '.'){
+			continue;
+		}
+		std::string path = dir + "/" + name;
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY){
+			walk_directory(path, files);
+		}else{
+			files.push_back(path);
+		}
+	}while (FindNextFileA(handle, &data));
+	FindClose(handle);
+#else
+	DIR *d = opendir(dir.c_str());
+	if (d == NULL){
+		return;
+	}
+	struct dirent *entry;
+	while ((entry = readdir(d)) != NULL){
+		std::string name = entry->d_name;
+		if (name[0] == '.'){
+			continue;
+		}
+		std::string path = dir + "/" + name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0){
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)){
+			walk_directory(path, files);
+		}else if (S_ISREG(st.st_mode)){
+			files.push_back(path);
+		}
+	}
+	closedir(d);
+#endif
+}
+
+int list_corpus_files(const std::string &path, std::vector<std::string> &files)
+{
+	files.clear();
+#if defined(_WIN32) || defined(_WIN64)
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES){
+		return AILIA_STATUS_ERROR_FILE_API;
+	}
+	bool is_dir = (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0){
+		return AILIA_STATUS_ERROR_FILE_API;
+	}
+	bool is_dir = S_ISDIR(st.st_mode);
+#endif
+	if (!is_dir){
+		files.push_back(path);
+		return AILIA_STATUS_SUCCESS;
+	}
+
+	std::string root = path;
+	while (root.size() > 1 && (root.back() == '/' || root.back() == '\\')){
+		root.pop_back();
+	}
+	walk_directory(root, files);
+	std::sort(files.begin(), files.end());
+	return AILIA_STATUS_SUCCESS;
+}
+
+int ingest_corpus(const std::string &path, const CorpusConfig &config, const CorpusEncodeFunc &encode, CorpusQueue &queue)
+{
+	std::vector<std::string> files;
+	int status = list_corpus_files(path, files);
+	if (status != AILIA_STATUS_SUCCESS){
+		PRINT_ERR("\'%s\' not found\n", path.c_str());
+		queue.close();
+		return status;
+	}
+
+	// the consumer closes the queue to stop ingestion early
+	bool stopped = false;
+	CorpusChunkFunc push_chunk = [&](CorpusChunk &chunk){
+		return queue.push(chunk);
+	};
+	TokenChunker chunker(config, encode);
+	CorpusSegmentFunc on_segment = [&](const std::string &segment){
+		if (!stopped && !chunker.push(segment, push_chunk)){
+			stopped = true;
+		}
+	};
+
+	std::vector<char> buf(std::max(config.read_size, 4096));
+	for (size_t f = 0; f < files.size() && !stopped; f++){
+		FILE *fp = fopen(files[f].c_str(), "rb");
+		if (fp == NULL){
+			PRINT_ERR("\'%s\' open failed\n", files[f].c_str());
+			status = AILIA_STATUS_ERROR_FILE_API;
+			continue;
+		}
+		SentenceSegmenter segmenter(config);
+		size_t n;
+		while (!stopped && (n = fread(&buf[0], 1, buf.size(), fp)) > 0){
+			segmenter.feed(&buf[0], n, on_segment);
+		}
+		fclose(fp);
+		if (!stopped){
+			segmenter.finish(on_segment);
+		}
+		if (!stopped && !chunker.flush(push_chunk)){
+			stopped = true;
+		}
+	}
+
+	queue.close();
+	return status;
+}
@@ -0,0 +1,144 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA Sentence Transformers streaming corpus ingestion
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#ifndef _ST_CORPUS_H_
+#define _ST_CORPUS_H_
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+struct CorpusConfig{
+	bool paragraph;		// split only at blank lines instead of at sentence terminators
+	int min_length;		// shorter segments (in bytes) are dropped
+	int max_tokens;		// longer segments are split, 0 for no limit
+	bool pack;			// pack consecutive segments into chunks of up to max_tokens
+	int overlap_tokens;	// trailing segments of a packed chunk repeated at the head of the next one
+	int read_size;		// bytes per file read
+	std::vector<std::string> terminators;	// ascii terminators only split before whitespace
+
+	CorpusConfig(){
+		paragraph = false;
+		min_length = 5;
+		max_tokens = 128;
+		pack = false;
+		overlap_tokens = 0;
+		read_size = 1 << 20;
+		const char *defaults[] = {u8"。", u8"！", u8"？", u8"．", ".", "!", "?", u8"؟", u8"।", u8"۔"};
+		terminators.assign(defaults, defaults + sizeof(defaults) / sizeof(defaults[0]));
+	}
+};
+
+struct CorpusChunk{
+	std::string text;
+	std::vector<int> tokens;
+};
+
+typedef std::function<std::vector<int>(const std::string &text)> CorpusEncodeFunc;
+typedef std::function<void(const std::string &segment)> CorpusSegmentFunc;
+typedef std::function<bool(CorpusChunk &chunk)> CorpusChunkFunc;
+
+// Fixed capacity queue between one producer and one consumer, push blocks while full and pop blocks while empty
+template <class T> class BoundedQueue{
+public:
+	BoundedQueue(int capacity) : capacity(capacity), closed(false) {}
+
+	// false when the queue was closed
+	bool push(T &item){
+		std::unique_lock<std::mutex> lock(mutex);
+		not_full.wait(lock, [this]{ return closed || (int)items.size() < capacity; });
+		if (closed){
+			return false;
+		}
+		items.push_back(T());
+		std::swap(items.back(), item);
+		not_empty.notify_one();
+		return true;
+	}
+
+	// false when the queue was closed and is empty
+	bool pop(T &item){
+		std::unique_lock<std::mutex> lock(mutex);
+		not_empty.wait(lock, [this]{ return closed || items.size() > 0; });
+		if (items.size() == 0){
+			return false;
+		}
+		std::swap(item, items.front());
+		items.pop_front();
+		not_full.notify_one();
+		return true;
+	}
+
+	void close(){
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		not_full.notify_all();
+		not_empty.notify_all();
+	}
+
+private:
+	int capacity;
+	bool closed;
+	std::deque<T> items;
+	std::mutex mutex;
+	std::condition_variable not_full;
+	std::condition_variable not_empty;
+};
+
+typedef BoundedQueue<CorpusChunk> CorpusQueue;
+
+// Incremental UTF-8 segmenter, text can be fed in pieces cut anywhere
+class SentenceSegmenter{
+public:
+	SentenceSegmenter(const CorpusConfig &config) : config(config), scan_pos(0), start_of_file(true) {}
+	void feed(const char *data, size_t size, const CorpusSegmentFunc &callback);
+	void finish(const CorpusSegmentFunc &callback);
+
+private:
+	const CorpusConfig &config;
+	std::string pending;
+	size_t scan_pos;
+	bool start_of_file;
+
+	void scan(bool final, const CorpusSegmentFunc &callback);
+	void emit(size_t begin, size_t end, const CorpusSegmentFunc &callback);
+};
+
+// Turn segments into chunks of at most max_tokens tokens
+class TokenChunker{
+public:
+	TokenChunker(const CorpusConfig &config, const CorpusEncodeFunc &encode) : config(config), encode(encode), packed_tokens(0) {}
+
+	// false when the callback asked to stop
+	bool push(const std::string &segment, const CorpusChunkFunc &callback);
+	bool flush(const CorpusChunkFunc &callback);
+
+private:
+	const CorpusConfig &config;
+	CorpusEncodeFunc encode;
+	std::vector<std::string> packed;
+	std::vector<int> packed_counts;
+	int packed_tokens;
+
+	bool emit_packed(bool keep_overlap, const CorpusChunkFunc &callback);
+	bool split_long(const std::string &text, std::vector<int> &tokens, const CorpusChunkFunc &callback);
+};
+
+// The file itself, or the files under the directory in sorted order (hidden files are skipped)
+int list_corpus_files(const std::string &path, std::vector<std::string> &files);
+
+// Read, segment and tokenize the corpus into the queue, the queue is closed on return.
+// Runs on the producer thread, encode must not share its tokenizer with the consumer
+int ingest_corpus(const std::string &path, const CorpusConfig &config, const CorpusEncodeFunc &encode, CorpusQueue &queue);
+
+#endif
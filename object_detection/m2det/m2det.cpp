@@ -19,6 +19,7 @@
 
 #include "ailia.h"
 #include "utils.h"
+#include "nms_utils.h"
 
 
 // ======================
@@ -189,50 +190,6 @@ static int argument_parser(int argc, char **argv)
 // Secondary functions
 // ======================
 
-static void nms(std::vector<float>& c_scores, std::vector<box>& c_boxes,
-                std::vector<int>& keep, float thresh)
-{
-    // calculate area of the boxes
-    std::vector<float> areas(c_scores.size());
-    for (int i = 0; i < c_scores.size(); i++) {
-        areas[i] = (c_boxes[i].x2-c_boxes[i].x1+1.0f)*(c_boxes[i].y2-c_boxes[i].y1+1.0f);
-    }
-
-    // get sorted indices of the score
-    cv::Mat mat_scores = cv::Mat_<float>(1, c_scores.size(), &c_scores[0]);
-    cv::Mat mat_order  = cv::Mat_<int>(1, c_scores.size());
-    cv::sortIdx(mat_scores, mat_order, cv::SORT_EVERY_ROW|cv::SORT_DESCENDING);
-
-    std::vector<int> order; 
-    order.insert(order.end(), (int*)mat_order.data, (int*)mat_order.data+mat_order.cols);
-
-    while (order.size() > 0) {
-        std::vector<int> inds;
-        int i = order[0];
-        keep.push_back(i);
-        for (int j = 1; j < order.size(); j++) {
-            int k = order[j];
-            float xx1 = std::max(c_boxes[i].x1, c_boxes[k].x1);
-            float yy1 = std::max(c_boxes[i].y1, c_boxes[k].y1);
-            float xx2 = std::min(c_boxes[i].x2, c_boxes[k].x2);
-            float yy2 = std::min(c_boxes[i].y2, c_boxes[k].y2);
-
-            float w = std::max(0.0f, xx2 - xx1 + 1.0f);
-            float h = std::max(0.0f, yy2 - yy1 + 1.0f);
-            float inter = w * h;
-            float ovr = inter / (areas[i] + areas[k] - inter);
-            if (ovr <= thresh) {
-                inds.push_back(order[j]);
-            }
-        }
-
-        order = inds;
-    }
-
-    return;
-}
-
-
 static void preprocess(const cv::Mat& simg, cv::Mat& dimg, int resize = 512,
                        std::vector<float> rgb_means = {104, 117, 123},
                        std::vector<int> swap = {2, 0, 1})
@@ -377,42 +334,36 @@ static int detect_objects(const cv::Mat& img, AILIANetwork *detector, ioIndices
     }
 
     // filter boxes for every class
-    for (int cls = 1; cls < out1_shape.x; cls++) {
-        std::vector<float> c_scores;
-        std::vector<box>   c_boxes;
-        for (int obj = 0; obj < out1_shape.y; obj++) {
+    std::vector<float> c_boxes;
+    std::vector<float> c_scores;
+    std::vector<int>   c_classes;
+    for (int obj = 0; obj < out1_shape.y; obj++) {
+        for (int cls = 1; cls < out1_shape.x; cls++) {
             float score = dst1[obj*out1_shape.x+cls];
             if (score >= THRESHOLD) {
-                box c_box;
-                c_box.x1 = dst0[obj*out0_shape.x+0];
-                c_box.y1 = dst0[obj*out0_shape.x+1];
-                c_box.x2 = dst0[obj*out0_shape.x+2];
-                c_box.y2 = dst0[obj*out0_shape.x+3];
+                c_boxes.insert(c_boxes.end(), &dst0[obj*out0_shape.x], &dst0[obj*out0_shape.x+4]);
                 c_scores.push_back(score);
-                c_boxes.push_back(c_box);
+                c_classes.push_back(cls);
             }
         }
-        if (c_scores.empty()) {
-            continue;
-        }
-
-        std::vector<int> keep;
-        nms(c_scores, c_boxes, keep, IOU);
-        if (keep.size() > KEEP_PER_CLASS) {
-            keep.resize(KEEP_PER_CLASS);
-        }
+    }
 
-        for (int i = 0; i < keep.size(); i++) {
-            int j = keep[i];
-            box c_box;
-            c_box.x1 = c_boxes[j].x1*imgw;
-            c_box.y1 = c_boxes[j].y1*imgh;
-            c_box.x2 = c_boxes[j].x2*imgw;
-            c_box.y2 = c_boxes[j].y2*imgh;
-            boxes.push_back(c_box);
-            scores.push_back(c_scores[j]);
-            cls_inds.push_back(cls);
-        }
+    // nms of all classes in one pass
+    NmsConfig nms_config(IOU);
+    nms_config.max_keep = KEEP_PER_CLASS;
+    std::vector<int> keep;
+    batched_nms(c_boxes.data(), c_scores.data(), c_classes.data(), c_scores.size(), keep, nms_config);
+
+    for (int i = 0; i < keep.size(); i++) {
+        int j = keep[i];
+        box c_box;
+        c_box.x1 = c_boxes[j*4+0]*imgw;
+        c_box.y1 = c_boxes[j*4+1]*imgh;
+        c_box.x2 = c_boxes[j*4+2]*imgw;
+        c_box.y2 = c_boxes[j*4+3]*imgh;
+        boxes.push_back(c_box);
+        scores.push_back(c_scores[j]);
+        cls_inds.push_back(c_classes[j]);
     }
 
     return AILIA_STATUS_SUCCESS;
@@ -255,14 +255,16 @@ static int recognize_from_video(AILIADetector* detector)
         }
     }
 
+    LetterboxContext letterbox(IMAGE_WIDTH, IMAGE_HEIGHT);
+
     while (1) {
         cv::Mat frame;
         capture >> frame;
         if ((char)cv::waitKey(1) == 'q' || frame.empty()) {
             break;
         }
-        cv::Mat resized_img, img;
-        adjust_frame_size(frame, resized_img, IMAGE_WIDTH, IMAGE_HEIGHT);
+        cv::Mat img;
+        cv::Mat resized_img = letterbox.resize(frame);
         cv::cvtColor(resized_img, img, cv::COLOR_BGR2BGRA);
 
         int status = ailiaDetectorCompute(detector, img.data,
@@ -22,6 +22,7 @@
 #include "utils.h"
 #include "detector_utils.h"
 #include "webcamera_utils.h"
+#include "yolox_motion.h"
 
 
 // ======================
@@ -78,6 +79,8 @@ static const std::vector<const char*> COCO_CATEGORY = {
 static bool benchmark  = false;
 static bool video_mode = false;
 static int args_env_id = -1;
+static bool motion_mode = false;
+static MotionConfig motion_config;
 
 
 // ======================
@@ -87,6 +90,7 @@ static int args_env_id = -1;
 static void print_usage()
 {
     PRINT_OUT("usage: yolox [-h] [-i IMAGE] [-v VIDEO] [-s SAVE_IMAGE_PATH] [-b] [-e ENV_ID]\n");
+    PRINT_OUT("             [-m] [--max_skip MAX_SKIP] [--crop]\n");
     return;
 }
 
@@ -110,6 +114,12 @@ static void print_help()
     PRINT_OUT("                        video mode)\n");
     PRINT_OUT("  -e ENV_ID, --env_id ENV_ID\n");
     PRINT_OUT("                        The backend environment id.\n");
+    PRINT_OUT("  -m, --motion          Skip the inference of video frames without motion and\n");
+    PRINT_OUT("                        reuse the previous detections. (For static cameras)\n");
+    PRINT_OUT("  --max_skip MAX_SKIP   Maximum number of consecutive skipped frames in motion\n");
+    PRINT_OUT("                        mode. (default: 30)\n");
+    PRINT_OUT("  --crop                Run the inference on the motion region only in motion\n");
+    PRINT_OUT("                        mode.\n");
     return;
 }
 
@@ -149,6 +159,15 @@ static int argument_parser(int argc, char **argv)
             else if (arg == "-e" || arg == "--env_id") {
                 status = 4;
             }
+            else if (arg == "-m" || arg == "--motion") {
+                motion_mode = true;
+            }
+            else if (arg == "--max_skip") {
+                status = 5;
+            }
+            else if (arg == "--crop") {
+                motion_config.crop = true;
+            }
             else {
                 print_usage();
                 print_error(arg);
@@ -169,6 +188,9 @@ static int argument_parser(int argc, char **argv)
             case 4:
                 args_env_id = atoi(arg.c_str());
                 break;
+            case 5:
+                motion_config.max_skip = atoi(arg.c_str());
+                break;
             default:
                 print_usage();
                 print_error(arg);
@@ -242,6 +264,47 @@ static int recognize_from_image(AILIADetector* detector)
 }
 
 
+static int detect_region(AILIADetector* detector, const cv::Mat& img, const cv::Rect& roi, cv::Size& input_shape,
+                         std::vector<AILIADetectorObject>& objects)
+{
+    // the detector input shape follows the crop to reduce the computation,
+    // crop sizes are aligned by MotionGate so only a few shapes are used
+    bool crop = (roi.width < img.cols || roi.height < img.rows);
+    cv::Size shape = crop ? roi.size() : cv::Size(MODEL_INPUT_WIDTH, MODEL_INPUT_HEIGHT);
+    if (shape != input_shape) {
+        int status = ailiaDetectorSetInputShape(detector, shape.width, shape.height);
+        if (status != AILIA_STATUS_SUCCESS) {
+            PRINT_ERR("ailiaDetectorSetInputShape(w=%u, h=%u) failed %d\n",
+                      shape.width, shape.height, status);
+            return -1;
+        }
+        input_shape = shape;
+    }
+
+    const unsigned char* data = img.data + roi.y*img.step + roi.x*4;
+    int status = ailiaDetectorCompute(detector, data,
+                                      img.step, roi.width, roi.height,
+                                      AILIA_IMAGE_FORMAT_BGRA, THRESHOLD, IOU);
+    if (status != AILIA_STATUS_SUCCESS) {
+        PRINT_ERR("ailiaDetectorCompute failed %d\n", status);
+        return -1;
+    }
+
+    if (!crop) {
+        return get_detector_objects(detector, objects);
+    }
+
+    std::vector<AILIADetectorObject> roi_objects;
+    status = get_detector_objects(detector, roi_objects);
+    if (status != AILIA_STATUS_SUCCESS) {
+        return -1;
+    }
+    merge_roi_objects(objects, roi_objects, roi, img.cols, img.rows);
+
+    return AILIA_STATUS_SUCCESS;
+}
+
+
 static int recognize_from_video(AILIADetector* detector)
 {
     // inference
@@ -264,14 +327,46 @@ static int recognize_from_video(AILIADetector* detector)
         }
     }
 
+    MotionGate motion_gate(motion_config);
+    std::vector<AILIADetectorObject> objects;
+    cv::Size input_shape(MODEL_INPUT_WIDTH, MODEL_INPUT_HEIGHT);
+    int frame_count = 0;
+    int skip_count = 0;
+    int crop_count = 0;
+    LetterboxContext letterbox(IMAGE_WIDTH, IMAGE_HEIGHT);
+
     while (1) {
         cv::Mat frame;
         capture >> frame;
         if ((char)cv::waitKey(1) == 'q' || frame.empty()) {
             break;
         }
-        cv::Mat resized_img, img;
-        adjust_frame_size(frame, resized_img, IMAGE_WIDTH, IMAGE_HEIGHT);
+        cv::Mat img;
+        cv::Mat resized_img = letterbox.resize(frame);
+
+        if (motion_mode) {
+            cv::Rect roi;
+            MotionDecision decision = motion_gate.update(resized_img, roi);
+            frame_count++;
+            if (decision == MOTION_SKIP) {
+                skip_count++;
+            }
+            else {
+                if (decision == MOTION_CROP) {
+                    crop_count++;
+                }
+                cv::cvtColor(resized_img, img, cv::COLOR_BGR2BGRA);
+                int status = detect_region(detector, img, roi, input_shape, objects);
+                if (status != AILIA_STATUS_SUCCESS) {
+                    return -1;
+                }
+            }
+
+            plot_result(objects, resized_img, COCO_CATEGORY, false);
+            cv::imshow("frame", resized_img);
+            continue;
+        }
+
         cv::cvtColor(resized_img, img, cv::COLOR_BGR2BGRA);
 
         int status = ailiaDetectorCompute(detector, img.data,
@@ -291,6 +386,10 @@ static int recognize_from_video(AILIADetector* detector)
     capture.release();
     cv::destroyAllWindows();
 
+    if (motion_mode) {
+        PRINT_OUT("frames %d skipped %d cropped %d\n", frame_count, skip_count, crop_count);
+    }
+
     PRINT_OUT("Program finished successfully.\n");
 
     return AILIA_STATUS_SUCCESS;
@@ -0,0 +1,119 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA yolox motion gating for static cameras
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "yolox_motion.h"
+
+
+void MotionGate::reset()
+{
+    background.release();
+    skipped = 0;
+}
+
+
+cv::Rect MotionGate::motion_roi(const cv::Mat& frame)
+{
+    cv::Rect r = cv::boundingRect(mask);
+    float sx = (float)frame.cols / mask.cols;
+    float sy = (float)frame.rows / mask.rows;
+    int x1 = (int)(r.x * sx) - config.crop_margin;
+    int y1 = (int)(r.y * sy) - config.crop_margin;
+    int x2 = (int)((r.x + r.width) * sx) + config.crop_margin;
+    int y2 = (int)((r.y + r.height) * sy) + config.crop_margin;
+
+    // round the size up and keep the region centered on the motion
+    int align = std::max(1, config.crop_align);
+    int w = std::min(frame.cols, (x2 - x1 + align - 1) / align * align);
+    int h = std::min(frame.rows, (y2 - y1 + align - 1) / align * align);
+    int x = std::max(0, std::min(frame.cols - w, (x1 + x2 - w) / 2));
+    int y = std::max(0, std::min(frame.rows - h, (y1 + y2 - h) / 2));
+
+    return cv::Rect(x, y, w, h);
+}
+
+
+MotionDecision MotionGate::update(const cv::Mat& frame, cv::Rect& roi)
+{
+    roi = cv::Rect(0, 0, frame.cols, frame.rows);
+
+    int scale_height = std::max(1, frame.rows * config.scale_width / frame.cols);
+    cv::resize(frame, small, cv::Size(config.scale_width, scale_height), 0, 0, cv::INTER_AREA);
+    if (small.channels() == 4) {
+        cv::cvtColor(small, gray, cv::COLOR_BGRA2GRAY);
+    }
+    else if (small.channels() == 3) {
+        cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+    }
+    else {
+        small.copyTo(gray);
+    }
+
+    if (background.empty() || background.size() != gray.size()) {
+        gray.convertTo(background, CV_32F);
+        skipped = 0;
+        return MOTION_FULL;
+    }
+
+    // moving pixels against the running average background
+    background.convertTo(background8, CV_8U);
+    cv::absdiff(gray, background8, mask);
+    cv::threshold(mask, mask, config.pixel_threshold, 255, cv::THRESH_BINARY);
+    cv::dilate(mask, mask, cv::Mat(), cv::Point(-1, -1), 2);
+    cv::accumulateWeighted(gray, background, config.background_alpha);
+
+    float moving = (float)cv::countNonZero(mask) / (float)mask.total();
+    if (moving < config.area_threshold) {
+        if (skipped < config.max_skip) {
+            skipped++;
+            return MOTION_SKIP;
+        }
+        skipped = 0;
+        return MOTION_FULL;
+    }
+    skipped = 0;
+
+    if (config.crop) {
+        cv::Rect r = motion_roi(frame);
+        if (r.area() < config.crop_max_ratio * frame.cols * frame.rows) {
+            roi = r;
+            return MOTION_CROP;
+        }
+    }
+    return MOTION_FULL;
+}
+
+
+void merge_roi_objects(std::vector<AILIADetectorObject>& objects, const std::vector<AILIADetectorObject>& roi_objects,
+                       const cv::Rect& roi, int width, int height)
+{
+    // previous objects inside the crop are superseded by the new detections
+    std::vector<AILIADetectorObject> merged;
+    for (size_t i = 0; i < objects.size(); i++) {
+        const AILIADetectorObject& obj = objects[i];
+        cv::Rect box((int)(obj.x * width), (int)(obj.y * height), (int)(obj.w * width), (int)(obj.h * height));
+        if ((box & roi).area() == 0) {
+            merged.push_back(obj);
+        }
+    }
+
+    for (size_t i = 0; i < roi_objects.size(); i++) {
+        AILIADetectorObject obj = roi_objects[i];
+        obj.x = (roi.x + obj.x * roi.width) / width;
+        obj.y = (roi.y + obj.y * roi.height) / height;
+        obj.w = obj.w * roi.width / width;
+        obj.h = obj.h * roi.height / height;
+        merged.push_back(obj);
+    }
+
+    objects.swap(merged);
+}
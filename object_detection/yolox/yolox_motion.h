@@ -0,0 +1,72 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA yolox motion gating for static cameras
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#ifndef _YOLOX_MOTION_H_
+#define _YOLOX_MOTION_H_
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "ailia_detector.h"
+
+enum MotionDecision {
+    MOTION_SKIP = 0,    // reuse the previous detections
+    MOTION_FULL,        // run the detector on the whole frame
+    MOTION_CROP         // run the detector on the motion region only
+};
+
+struct MotionConfig {
+    int   scale_width;      // width of the downsampled difference image
+    int   pixel_threshold;  // gray level difference counted as motion
+    float area_threshold;   // ratio of moving pixels which triggers the detector
+    float background_alpha; // update rate of the running average background
+    int   max_skip;         // force a full frame after this many skipped frames
+    bool  crop;             // run the detector on the union of the motion regions
+    float crop_max_ratio;   // larger motion regions run on the full frame
+    int   crop_margin;      // margin around the motion region in frame pixels
+    int   crop_align;       // the crop size is a multiple of this to limit the input shapes
+
+    MotionConfig() {
+        scale_width = 160;
+        pixel_threshold = 25;
+        area_threshold = 0.002f;
+        background_alpha = 0.05f;
+        max_skip = 30;
+        crop = false;
+        crop_max_ratio = 0.5f;
+        crop_margin = 32;
+        crop_align = 128;
+    }
+};
+
+class MotionGate {
+private:
+    MotionConfig config;
+    cv::Mat small;
+    cv::Mat gray;
+    cv::Mat background;
+    cv::Mat background8;
+    cv::Mat mask;
+    int skipped;
+
+    cv::Rect motion_roi(const cv::Mat& frame);
+
+public:
+    MotionGate(const MotionConfig& motion_config) : config(motion_config), skipped(0) {}
+
+    // Decide how to process the frame, roi receives the region to run the detector on
+    MotionDecision update(const cv::Mat& frame, cv::Rect& roi);
+    void reset();
+};
+
+// Replace the objects overlapping roi by the objects detected in roi (normalized to roi)
+void merge_roi_objects(std::vector<AILIADetectorObject>& objects, const std::vector<AILIADetectorObject>& roi_objects,
+                       const cv::Rect& roi, int width, int height);
+
+#endif
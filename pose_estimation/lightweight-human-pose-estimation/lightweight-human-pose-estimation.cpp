@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <opencv2/opencv.hpp>
@@ -19,9 +20,12 @@
 
 #include "ailia.h"
 #include "ailia_pose_estimator.h"
+#include "ailia_detector.h"
 #include "utils.h"
+#include "detector_utils.h"
 #include "image_utils.h"
 #include "webcamera_utils.h"
+#include "pose_tracker.h"
 
 
 // ======================
@@ -60,6 +64,9 @@ static std::string save_image_path(SAVE_IMAGE_PATH);
 
 static bool benchmark  = false;
 static bool video_mode = false;
+static bool track_mode = false;
+static int  skip_frames = 0;
+static PoseTrackerConfig tracker_config;
 
 
 // ======================
@@ -69,7 +76,8 @@ static bool video_mode = false;
 static void print_usage()
 {
     PRINT_OUT("usage: lightweight-human-pose-estimation [-h] [-i IMAGE] [-v VIDEO] [-n]\n");
-    PRINT_OUT("                                         [-s SAVE_IMAGE_PATH] [-b]\n");
+    PRINT_OUT("                                         [-s SAVE_IMAGE_PATH] [-b] [-t]\n");
+    PRINT_OUT("                                         [--skip SKIP] [--horizon HORIZON]\n");
     return;
 }
 
@@ -93,6 +101,12 @@ static void print_help()
     PRINT_OUT("  -b, --benchmark       Running the inference on the same input 5 times to\n");
     PRINT_OUT("                        measure execution performance. (Cannot be used in\n");
     PRINT_OUT("                        video mode)\n");
+    PRINT_OUT("  -t, --track           Track the persons across video frames with stable ids\n");
+    PRINT_OUT("                        and smooth the keypoints.\n");
+    PRINT_OUT("  --skip SKIP           Skip the inference of SKIP frames after each inference\n");
+    PRINT_OUT("                        and extrapolate the tracks instead. (default: 0)\n");
+    PRINT_OUT("  --horizon HORIZON     Maximum number of frames a track is extrapolated.\n");
+    PRINT_OUT("                        (default: 2)\n");
     return;
 }
 
@@ -124,6 +138,16 @@ static int argument_parser(int argc, char **argv)
             else if (arg == "-b" || arg == "--benchmark") {
                 benchmark = true;
             }
+            else if (arg == "-t" || arg == "--track") {
+                track_mode = true;
+            }
+            else if (arg == "--skip") {
+                track_mode = true;
+                status = 4;
+            }
+            else if (arg == "--horizon") {
+                status = 5;
+            }
             else if (arg == "-n" || arg == "--normal") {
                 weight = WEIGHT_PATH_NORMAL;
                 model  = MODEL_PATH_NORMAL;
@@ -150,6 +174,12 @@ static int argument_parser(int argc, char **argv)
             case 3:
                 save_image_path = arg;
                 break;
+            case 4:
+                skip_frames = std::max(0, atoi(arg.c_str()));
+                break;
+            case 5:
+                tracker_config.max_extrapolate = std::max(0, atoi(arg.c_str()));
+                break;
             default:
                 print_usage();
                 print_error(arg);
@@ -172,35 +202,84 @@ static int argument_parser(int argc, char **argv)
 // Utils
 // ======================
 
-static cv::Scalar hsv_to_rgb(int h, int s, int v)
-{
-    cv::Mat hsv(1, 1, CV_8UC3, cv::Scalar(h, s, v));
-    cv::Mat bgr;
+static const int LIMB_CNT = 18;
+
+static const int LIMBS[LIMB_CNT][2] = {
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_NOSE,           AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_CENTER},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_LEFT,  AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_CENTER},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_RIGHT, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_CENTER},
+
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EYE_LEFT,       AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_NOSE},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EYE_RIGHT,      AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_NOSE},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EAR_LEFT,       AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EYE_LEFT},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EAR_RIGHT,      AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EYE_RIGHT},
+
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ELBOW_LEFT,     AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_LEFT},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ELBOW_RIGHT,    AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_RIGHT},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_WRIST_LEFT,     AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ELBOW_LEFT},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_WRIST_RIGHT,    AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ELBOW_RIGHT},
+
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_BODY_CENTER,    AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_CENTER},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_HIP_LEFT,       AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_BODY_CENTER},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_HIP_RIGHT,      AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_BODY_CENTER},
+
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_KNEE_LEFT,      AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_HIP_LEFT},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ANKLE_LEFT,     AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_KNEE_LEFT},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_KNEE_RIGHT,     AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_HIP_RIGHT},
+    {AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ANKLE_RIGHT,    AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_KNEE_RIGHT},
+};
+
+// Limb segments of all persons grouped by limb, the point buffers keep their capacity across frames
+class PoseRenderer {
+public:
+    PoseRenderer()
+    {
+        for (int i = 0; i < LIMB_CNT; i++) {
+            // the limbs have always been drawn with r and b swapped
+            cv::Scalar bgr = hsv_to_rgb((float)(255*LIMBS[i][0])/(float)AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_CNT, 255, 255);
+            colors[i] = cv::Scalar(bgr[2], bgr[1], bgr[0]);
+        }
+    }
 
-    cv::cvtColor(hsv, bgr, cv::COLOR_HSV2BGR);
+    void begin(void)
+    {
+        for (int i = 0; i < LIMB_CNT; i++) {
+            segments[i].clear();
+        }
+    }
 
-    return cv::Scalar(bgr.data[2], bgr.data[1], bgr.data[0]);
-}
+    void add(const cv::Mat& img, const AILIAPoseEstimatorObjectPose& person)
+    {
+        float threshold = 0.3f;
 
+        for (int i = 0; i < LIMB_CNT; i++) {
+            const AILIAPoseEstimatorKeypoint& p1 = person.points[LIMBS[i][0]];
+            const AILIAPoseEstimatorKeypoint& p2 = person.points[LIMBS[i][1]];
+            if (p1.score > threshold && p2.score > threshold) {
+                segments[i].push_back(cv::Point(img.cols * p1.x, img.rows * p1.y));
+                segments[i].push_back(cv::Point(img.cols * p2.x, img.rows * p2.y));
+            }
+        }
+    }
 
-static void line(cv::Mat& img, AILIAPoseEstimatorObjectPose person, int point1, int point2)
-{
-    float threshold = 0.3f;
+    void end(cv::Mat& img)
+    {
+        for (int i = 0; i < LIMB_CNT; i++) {
+            for (size_t j = 0; j + 1 < segments[i].size(); j += 2) {
+                cv::line(img, segments[i][j], segments[i][j + 1], colors[i], 5);
+            }
+        }
+    }
 
-    if (person.points[point1].score > threshold &&
-        person.points[point2].score > threshold) {
-        cv::Scalar color = hsv_to_rgb((float)(255*point1)/(float)AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_CNT, 255, 255);
+private:
+    cv::Scalar colors[LIMB_CNT];
+    std::vector<cv::Point> segments[LIMB_CNT];     // point pairs of the segments of each limb
+};
 
-        int x1 = img.cols * person.points[point1].x;
-        int y1 = img.rows * person.points[point1].y;
-        int x2 = img.cols * person.points[point2].x;
-        int y2 = img.rows * person.points[point2].y;
-        cv::line(img, cv::Point(x1, y1), cv::Point(x2, y2), color, 5);
-    }
-}
+static PoseRenderer renderer;
 
 
-static int display_result(cv::Mat& img, AILIAPoseEstimator* pose, bool logging = true)
+static int get_persons(AILIAPoseEstimator* pose, std::vector<AILIAPoseEstimatorObjectPose>& persons)
 {
     unsigned int obj_count;
     int status = ailiaPoseEstimatorGetObjectCount(pose, &obj_count);
@@ -209,69 +288,72 @@ static int display_result(cv::Mat& img, AILIAPoseEstimator* pose, bool logging =
         return -1;
     }
 
-    if (logging) {
-        PRINT_OUT("person_count=%d\n", obj_count);
-    }
-
+    persons.resize(obj_count);
     for (int i = 0; i < obj_count ;i++) {
-        AILIAPoseEstimatorObjectPose person;
-        status = ailiaPoseEstimatorGetObjectPose(pose, &person, i, AILIA_POSE_ESTIMATOR_OBJECT_POSE_VERSION);
+        status = ailiaPoseEstimatorGetObjectPose(pose, &persons[i], i, AILIA_POSE_ESTIMATOR_OBJECT_POSE_VERSION);
         if (status != AILIA_STATUS_SUCCESS) {
             PRINT_ERR("ailiaPoseEstimatorGetObjectPose failed %d\n", status);
             return -1;
         }
+    }
+
+    return AILIA_STATUS_SUCCESS;
+}
+
+
+static int display_result(cv::Mat& img, AILIAPoseEstimator* pose, bool logging = true)
+{
+    std::vector<AILIAPoseEstimatorObjectPose> persons;
+    int status = get_persons(pose, persons);
+    if (status != AILIA_STATUS_SUCCESS){
+        return -1;
+    }
+
+    if (logging) {
+        PRINT_OUT("person_count=%d\n", (int)persons.size());
+    }
+
+    renderer.begin();
+    for (int i = 0; i < persons.size() ;i++) {
 /*
         PRINT_OUT("person %d\n",i);
         for (int j = 0; j < AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_CNT; j++) {
-            PRINT_OUT("keypoint %d (%f,%f)\n", j, person.points[j].x, person.points[j].y);
+            PRINT_OUT("keypoint %d (%f,%f)\n", j, persons[i].points[j].x, persons[i].points[j].y);
         }
 */
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_NOSE,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_CENTER);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_LEFT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_CENTER);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_RIGHT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_CENTER);
-
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EYE_LEFT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_NOSE);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EYE_RIGHT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_NOSE);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EAR_LEFT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EYE_LEFT);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EAR_RIGHT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_EYE_RIGHT);
-
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ELBOW_LEFT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_LEFT);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ELBOW_RIGHT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_RIGHT);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_WRIST_LEFT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ELBOW_LEFT);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_WRIST_RIGHT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ELBOW_RIGHT);
-
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_BODY_CENTER,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_CENTER);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_HIP_LEFT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_BODY_CENTER);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_HIP_RIGHT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_BODY_CENTER);
-
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_KNEE_LEFT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_HIP_LEFT);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ANKLE_LEFT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_KNEE_LEFT);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_KNEE_RIGHT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_HIP_RIGHT);
-        line(img, person, AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_ANKLE_RIGHT,
-             AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_KNEE_RIGHT);
+        renderer.add(img, persons[i]);
     }
+    renderer.end(img);
 
     return AILIA_STATUS_SUCCESS;
 }
 
 
+static void display_tracks(cv::Mat& img, const PoseTracker& tracker)
+{
+    std::vector<const PoseTrack*> visible;
+    tracker.get_visible(visible);
+
+    renderer.begin();
+    for (int i = 0; i < visible.size(); i++) {
+        renderer.add(img, visible[i]->pose);
+    }
+    renderer.end(img);
+
+    for (int i = 0; i < visible.size(); i++) {
+        const AILIAPoseEstimatorObjectPose& person = visible[i]->pose;
+
+        const AILIAPoseEstimatorKeypoint& anchor = person.points[AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_SHOULDER_CENTER];
+        if (anchor.score > tracker_config.score_threshold) {
+            char text[32];
+            snprintf(text, sizeof(text), "%d", visible[i]->id);
+            cv::putText(img, text, cv::Point(img.cols * anchor.x, img.rows * anchor.y - 8),
+                        cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 255), 1);
+        }
+    }
+}
+
+
 // ======================
 // Main functions
 // ======================
@@ -356,14 +438,50 @@ static int recognize_from_video(AILIAPoseEstimator* pose)
         }
     }
 
+    // the filters run on the frame time of the video
+    double fps = capture.get(cv::CAP_PROP_FPS);
+    float dt = (fps > 0) ? (float)(1.0 / fps) : 1.0f / 30.0f;
+    PoseTracker tracker(tracker_config);
+    int skipped = 0;
+    LetterboxContext letterbox(IMAGE_WIDTH, IMAGE_HEIGHT);
+
     while (1) {
         cv::Mat frame;
         capture >> frame;
         if ((char)cv::waitKey(1) == 'q' || frame.empty()) {
             break;
         }
-        cv::Mat input_img, input_data0, input_data;
-        adjust_frame_size(frame, input_img, input_data0, IMAGE_WIDTH, IMAGE_HEIGHT);
+        cv::Mat input_data;
+        cv::Mat input_img = letterbox.padded(frame);
+        cv::Mat input_data0 = letterbox.resize(frame);
+
+        if (track_mode) {
+            if (skipped < skip_frames && tracker.can_extrapolate()) {
+                tracker.extrapolate(dt);
+                skipped++;
+            }
+            else {
+                cv::cvtColor(input_data0, input_data, cv::COLOR_BGR2BGRA);
+                int status = ailiaPoseEstimatorCompute(pose, input_data.data,
+                                                       MODEL_INPUT_WIDTH*4, MODEL_INPUT_WIDTH, MODEL_INPUT_HEIGHT,
+                                                       AILIA_IMAGE_FORMAT_BGRA);
+                if (status != AILIA_STATUS_SUCCESS) {
+                    PRINT_ERR("ailiaPoseEstimatorCompute failed %d\n", status);
+                    return -1;
+                }
+                std::vector<AILIAPoseEstimatorObjectPose> persons;
+                status = get_persons(pose, persons);
+                if (status != AILIA_STATUS_SUCCESS) {
+                    return -1;
+                }
+                tracker.update(persons, dt);
+                skipped = 0;
+            }
+            display_tracks(input_img, tracker);
+            cv::imshow("frame", input_img);
+            continue;
+        }
+
         cv::cvtColor(input_data0, input_data, cv::COLOR_BGR2BGRA);
 
         int status = ailiaPoseEstimatorCompute(pose, input_data.data,
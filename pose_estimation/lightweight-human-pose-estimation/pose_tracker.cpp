@@ -0,0 +1,257 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA lightweight-human-pose-estimation person tracker
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "pose_tracker.h"
+
+#define KEYPOINT_CNT AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_CNT
+
+// per keypoint falloff of the COCO keypoint similarity, in the AILIA keypoint order
+// (COCO 17 keypoints followed by the shoulder center and the body center)
+static const float OKS_SIGMAS[KEYPOINT_CNT] = {
+    0.026f, 0.025f, 0.025f, 0.035f, 0.035f, 0.079f, 0.079f, 0.072f, 0.072f, 0.062f,
+    0.062f, 0.107f, 0.107f, 0.087f, 0.087f, 0.089f, 0.089f, 0.079f, 0.107f
+};
+
+
+static float smoothing_factor(float dt, float cutoff)
+{
+    const float pi = 3.14159265358979f;
+    float r = 2.0f * pi * cutoff * dt;
+    return r / (r + 1.0f);
+}
+
+
+float OneEuroFilter::filter(float x, float dt, float min_cutoff, float beta, float d_cutoff)
+{
+    if (!initialized || dt <= 0.0f) {
+        initialized = true;
+        x_prev = x;
+        dx_prev = 0.0f;
+        return x;
+    }
+
+    float dx = (x - x_prev) / dt;
+    float a_d = smoothing_factor(dt, d_cutoff);
+    dx_prev = a_d * dx + (1.0f - a_d) * dx_prev;
+
+    float cutoff = min_cutoff + beta * fabsf(dx_prev);
+    float a = smoothing_factor(dt, cutoff);
+    x_prev = a * x + (1.0f - a) * x_prev;
+
+    return x_prev;
+}
+
+
+void hungarian(const std::vector<float>& cost, int rows, int cols, std::vector<int>& assignment)
+{
+    // Kuhn-Munkres with potentials on a square matrix padded with zero cost
+    int n = std::max(rows, cols);
+    std::vector<double> u(n + 1, 0.0), v(n + 1, 0.0), minv(n + 1);
+    std::vector<int> p(n + 1, 0), way(n + 1, 0);
+    std::vector<char> used(n + 1);
+
+    for (int i = 1; i <= n; i++) {
+        p[0] = i;
+        int j0 = 0;
+        std::fill(minv.begin(), minv.end(), DBL_MAX);
+        std::fill(used.begin(), used.end(), 0);
+        do {
+            used[j0] = 1;
+            int i0 = p[j0];
+            int j1 = 0;
+            double delta = DBL_MAX;
+            for (int j = 1; j <= n; j++) {
+                if (used[j]) {
+                    continue;
+                }
+                double c = (i0 <= rows && j <= cols) ? cost[(i0 - 1) * cols + (j - 1)] : 0.0;
+                double cur = c - u[i0] - v[j];
+                if (cur < minv[j]) {
+                    minv[j] = cur;
+                    way[j] = j0;
+                }
+                if (minv[j] < delta) {
+                    delta = minv[j];
+                    j1 = j;
+                }
+            }
+            for (int j = 0; j <= n; j++) {
+                if (used[j]) {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                }
+                else {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+        do {
+            int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+
+    assignment.assign(rows, -1);
+    for (int j = 1; j <= n; j++) {
+        if (p[j] >= 1 && p[j] <= rows && j <= cols) {
+            assignment[p[j] - 1] = j - 1;
+        }
+    }
+}
+
+
+float PoseTracker::oks(const AILIAPoseEstimatorObjectPose& a, const AILIAPoseEstimatorObjectPose& b) const
+{
+    // object scale from the extent of the visible keypoints of a
+    float x1 = FLT_MAX, y1 = FLT_MAX, x2 = -FLT_MAX, y2 = -FLT_MAX;
+    for (int k = 0; k < KEYPOINT_CNT; k++) {
+        if (a.points[k].score > config.score_threshold) {
+            x1 = std::min(x1, a.points[k].x);
+            y1 = std::min(y1, a.points[k].y);
+            x2 = std::max(x2, a.points[k].x);
+            y2 = std::max(y2, a.points[k].y);
+        }
+    }
+    if (x2 < x1) {
+        return 0.0f;
+    }
+    float area = std::max((x2 - x1) * (y2 - y1), 1e-4f);
+
+    float sum = 0.0f;
+    int count = 0;
+    for (int k = 0; k < KEYPOINT_CNT; k++) {
+        if (a.points[k].score <= config.score_threshold || b.points[k].score <= config.score_threshold) {
+            continue;
+        }
+        float dx = a.points[k].x - b.points[k].x;
+        float dy = a.points[k].y - b.points[k].y;
+        float s = 2.0f * OKS_SIGMAS[k];
+        sum += expf(-(dx * dx + dy * dy) / (2.0f * area * s * s));
+        count++;
+    }
+    return (count > 0) ? sum / count : 0.0f;
+}
+
+
+void PoseTracker::smooth(PoseTrack& track, const AILIAPoseEstimatorObjectPose& pose, float dt)
+{
+    AILIAPoseEstimatorObjectPose smoothed = pose;
+    for (int k = 0; k < KEYPOINT_CNT; k++) {
+        if (pose.points[k].score <= config.score_threshold) {
+            track.fx[k].reset();
+            track.fy[k].reset();
+            continue;
+        }
+        smoothed.points[k].x = track.fx[k].filter(pose.points[k].x, dt, config.min_cutoff, config.beta, config.d_cutoff);
+        smoothed.points[k].y = track.fy[k].filter(pose.points[k].y, dt, config.min_cutoff, config.beta, config.d_cutoff);
+    }
+    track.pose = smoothed;
+}
+
+
+void PoseTracker::update(const std::vector<AILIAPoseEstimatorObjectPose>& poses, float dt)
+{
+    int rows = tracks.size();
+    int cols = poses.size();
+    std::vector<float> cost(rows * cols);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            cost[i * cols + j] = 1.0f - oks(tracks[i].pose, poses[j]);
+        }
+    }
+    std::vector<int> assignment;
+    hungarian(cost, rows, cols, assignment);
+
+    std::vector<char> matched(cols, 0);
+    for (int i = 0; i < rows; i++) {
+        PoseTrack& track = tracks[i];
+        int j = assignment[i];
+        if (j >= 0 && 1.0f - cost[i * cols + j] >= config.min_oks) {
+            // the filters were advanced while extrapolating, so the step is one frame
+            smooth(track, poses[j], dt);
+            track.pose.id = track.id;
+            track.missed = 0;
+            matched[j] = 1;
+        }
+        else {
+            track.missed++;
+        }
+        track.extrapolated = 0;
+    }
+
+    tracks.erase(std::remove_if(tracks.begin(), tracks.end(),
+                                [this](const PoseTrack& t) { return t.missed > config.max_missed; }),
+                 tracks.end());
+
+    for (int j = 0; j < cols; j++) {
+        if (matched[j]) {
+            continue;
+        }
+        PoseTrack track;
+        track.id = next_id++;
+        track.missed = 0;
+        track.extrapolated = 0;
+        smooth(track, poses[j], dt);
+        track.pose.id = track.id;
+        tracks.push_back(track);
+    }
+}
+
+
+void PoseTracker::extrapolate(float dt)
+{
+    for (int i = 0; i < tracks.size(); i++) {
+        PoseTrack& track = tracks[i];
+        if (track.missed > 0) {
+            continue;
+        }
+        for (int k = 0; k < KEYPOINT_CNT; k++) {
+            if (track.pose.points[k].score <= config.score_threshold) {
+                continue;
+            }
+            float dx = track.fx[k].velocity() * dt;
+            float dy = track.fy[k].velocity() * dt;
+            track.pose.points[k].x += dx;
+            track.pose.points[k].y += dy;
+            track.fx[k].shift(dx);
+            track.fy[k].shift(dy);
+        }
+        track.extrapolated++;
+    }
+}
+
+
+bool PoseTracker::can_extrapolate() const
+{
+    for (int i = 0; i < tracks.size(); i++) {
+        if (tracks[i].missed == 0 && tracks[i].extrapolated >= config.max_extrapolate) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void PoseTracker::get_visible(std::vector<const PoseTrack*>& visible) const
+{
+    visible.clear();
+    for (int i = 0; i < tracks.size(); i++) {
+        if (tracks[i].missed == 0) {
+            visible.push_back(&tracks[i]);
+        }
+    }
+}
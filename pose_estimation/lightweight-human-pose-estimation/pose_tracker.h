@@ -0,0 +1,86 @@
+﻿/*******************************************************************
+*
+*    DESCRIPTION:
+*      AILIA lightweight-human-pose-estimation person tracker
+*    AUTHOR:
+*
+*    DATE:2026/10/19
+*
+*******************************************************************/
+
+#ifndef _POSE_TRACKER_H_
+#define _POSE_TRACKER_H_
+
+#include <vector>
+#include "ailia_pose_estimator.h"
+
+struct PoseTrackerConfig {
+    float min_oks;          // minimum keypoint similarity to continue a track
+    float score_threshold;  // keypoints below this score are not matched nor smoothed
+    int   max_missed;       // inference frames a track survives without a match
+    int   max_extrapolate;  // frames a track may be extrapolated without inference
+    float min_cutoff;       // one euro filter
+    float beta;
+    float d_cutoff;
+
+    PoseTrackerConfig() {
+        min_oks = 0.3f;
+        score_threshold = 0.3f;
+        max_missed = 5;
+        max_extrapolate = 2;
+        min_cutoff = 1.0f;
+        beta = 0.5f;
+        d_cutoff = 1.0f;
+    }
+};
+
+// One Euro filter, low pass with a cutoff rising with the speed
+class OneEuroFilter {
+private:
+    float x_prev;
+    float dx_prev;
+    bool  initialized;
+
+public:
+    OneEuroFilter() : x_prev(0), dx_prev(0), initialized(false) {}
+    float filter(float x, float dt, float min_cutoff, float beta, float d_cutoff);
+    float velocity() const { return dx_prev; }
+    void  reset() { initialized = false; dx_prev = 0; }
+    void  shift(float dx) { x_prev += dx; }
+};
+
+struct PoseTrack {
+    int id;
+    int missed;         // inference frames without a match
+    int extrapolated;   // frames since the last inference
+    AILIAPoseEstimatorObjectPose pose;  // smoothed pose
+    OneEuroFilter fx[AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_CNT];
+    OneEuroFilter fy[AILIA_POSE_ESTIMATOR_POSE_KEYPOINT_CNT];
+};
+
+class PoseTracker {
+private:
+    PoseTrackerConfig config;
+    std::vector<PoseTrack> tracks;
+    int next_id;
+
+    float oks(const AILIAPoseEstimatorObjectPose& a, const AILIAPoseEstimatorObjectPose& b) const;
+    void  smooth(PoseTrack& track, const AILIAPoseEstimatorObjectPose& pose, float dt);
+
+public:
+    PoseTracker(const PoseTrackerConfig& tracker_config) : config(tracker_config), next_id(0) {}
+
+    // Match the poses of an inference frame to the tracks, dt is the time since the previous frame
+    void update(const std::vector<AILIAPoseEstimatorObjectPose>& poses, float dt);
+    // Advance the tracks by their velocity on a frame without inference
+    void extrapolate(float dt);
+    // True while no track has reached the extrapolation limit
+    bool can_extrapolate() const;
+    // Tracks visible in the current frame
+    void get_visible(std::vector<const PoseTrack*>& visible) const;
+};
+
+// Minimum cost assignment of a rows x cols cost matrix, assignment[row] is a column or -1
+void hungarian(const std::vector<float>& cost, int rows, int cols, std::vector<int>& assignment);
+
+#endif
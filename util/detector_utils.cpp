@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <string>
 #include <vector>
+#include <map>
+#include <memory>
+#include <math.h>
 #include <opencv2/opencv.hpp>
 
 #include "detector_utils.h"
@@ -40,50 +43,260 @@ int load_image(cv::Mat& img, const char* path)
 
 cv::Scalar hsv_to_rgb(int h, int s, int v)
 {
-    cv::Mat hsv(1, 1, CV_8UC3, cv::Scalar(h, s, v));
-    cv::Mat rgb;
+    // same as cv::cvtColor(COLOR_HSV2BGR) of one CV_8UC3 pixel, without the temporary Mat
+    static const int sector_data[][3] = {{1, 3, 0}, {1, 0, 2}, {3, 0, 1}, {0, 2, 1}, {0, 1, 3}, {2, 1, 0}};
 
-    cv::cvtColor(hsv, rgb, cv::COLOR_HSV2BGR);
+    float hf = std::min(std::max(h, 0), 255) * (6.0f / 180.0f);
+    float sf = std::min(std::max(s, 0), 255) * (1.0f / 255.0f);
+    float vf = std::min(std::max(v, 0), 255) * (1.0f / 255.0f);
 
-    return cv::Scalar(rgb.data[0], rgb.data[1], rgb.data[2], 255);
+    float b, g, r;
+    if (sf == 0.0f) {
+        b = g = r = vf;
+    }
+    else {
+        hf = fmodf(hf, 6.0f);
+        int sector = cvFloor(hf);
+        hf -= sector;
+        if ((unsigned)sector >= 6u) {
+            sector = 0;
+            hf = 0.0f;
+        }
+        float tab[4];
+        tab[0] = vf;
+        tab[1] = vf * (1.0f - sf);
+        tab[2] = vf * (1.0f - sf * hf);
+        tab[3] = vf * (1.0f - sf * (1.0f - hf));
+        b = tab[sector_data[sector][0]];
+        g = tab[sector_data[sector][1]];
+        r = tab[sector_data[sector][2]];
+    }
+
+    return cv::Scalar(cv::saturate_cast<uchar>(b * 255.0f), cv::saturate_cast<uchar>(g * 255.0f),
+                      cv::saturate_cast<uchar>(r * 255.0f), 255);
 }
 
 
-int plot_result(AILIADetector* detector, cv::Mat& img, const std::vector<const char*> category, bool logging)
+const std::vector<cv::Scalar>& category_palette(int category_count)
 {
-    unsigned int obj_count;
-    int status = ailiaDetectorGetObjectCount(detector, &obj_count);
-    if (status != AILIA_STATUS_SUCCESS){
-        PRINT_ERR("ailiaDetectorGetObjectCount failed %d\n",status);
+    // one table per category count, map nodes never move so the reference stays valid
+    static std::map<int, std::vector<cv::Scalar>> palettes;
+
+    std::map<int, std::vector<cv::Scalar>>::iterator it = palettes.find(category_count);
+    if (it != palettes.end()) {
+        return it->second;
+    }
+
+    std::vector<cv::Scalar>& palette = palettes[category_count];
+    for (int i = 0; i < category_count; i++) {
+        palette.push_back(hsv_to_rgb(256*((float)i/(float)category_count), 255, 255));
+    }
+    return palette;
+}
+
+
+cv::Rect LabelCache::draw(cv::Mat& img, const char* text, cv::Point org, double font_scale, const cv::Scalar& color, int thickness)
+{
+    char key_suffix[32];
+    snprintf(key_suffix, sizeof(key_suffix), "|%g|%d", font_scale, thickness);
+    std::string key = std::string(text) + key_suffix;
+
+    std::map<std::string, Glyph>::iterator it = glyphs.find(key);
+    if (it == glyphs.end()) {
+        // rasterize once into a mask, org of putText is the bottom left of the text
+        int baseline = 0;
+        cv::Size size = cv::getTextSize(text, cv::FONT_HERSHEY_SIMPLEX, font_scale, thickness, &baseline);
+        Glyph glyph;
+        glyph.ascent = size.height + thickness;
+        glyph.mask = cv::Mat::zeros(glyph.ascent + baseline + thickness, size.width + thickness * 2, CV_8UC1);
+        cv::putText(glyph.mask, text, cv::Point(thickness, glyph.ascent), cv::FONT_HERSHEY_SIMPLEX, font_scale, cv::Scalar(255), thickness);
+        glyph.offset = thickness;
+        it = glyphs.insert(std::make_pair(key, glyph)).first;
+    }
+
+    const Glyph& glyph = it->second;
+    cv::Rect dst(org.x - glyph.offset, org.y - glyph.ascent, glyph.mask.cols, glyph.mask.rows);
+    cv::Rect clipped = dst & cv::Rect(0, 0, img.cols, img.rows);
+    if (clipped.area() == 0) {
+        return clipped;
+    }
+    cv::Mat mask = glyph.mask(cv::Rect(clipped.x - dst.x, clipped.y - dst.y, clipped.width, clipped.height));
+    img(clipped).setTo(color, mask);
+    return clipped;
+}
+
+
+cv::Mat& OverlayCanvas::begin(cv::Mat& img)
+{
+    if (alpha >= 1.0f) {
+        return img;
+    }
+
+    // only the region drawn in the previous frame has to be cleared
+    if (overlay.rows != img.rows || overlay.cols != img.cols) {
+        overlay = cv::Mat::zeros(img.rows, img.cols, CV_8UC4);
+    }
+    else if (prev_dirty.area() > 0) {
+        overlay(prev_dirty).setTo(cv::Scalar::all(0));
+    }
+    dirty = cv::Rect();
+    return overlay;
+}
+
+
+void OverlayCanvas::mark(const cv::Rect& rect)
+{
+    if (rect.area() <= 0) {
+        return;
+    }
+    dirty = (dirty.area() == 0) ? rect : (dirty | rect);
+}
+
+
+void OverlayCanvas::end(cv::Mat& img)
+{
+    if (alpha >= 1.0f) {
+        return;
+    }
+
+    cv::Rect r = dirty & cv::Rect(0, 0, img.cols, img.rows);
+    int a = (int)(alpha * 256.0f);
+    int channels = img.channels();
+    for (int y = r.y; y < r.y + r.height; y++) {
+        const unsigned char* o = overlay.ptr<unsigned char>(y) + r.x * 4;
+        unsigned char* p = img.ptr<unsigned char>(y) + r.x * channels;
+        for (int x = 0; x < r.width; x++, o += 4, p += channels) {
+            if (o[3] == 0) {
+                continue;
+            }
+            for (int c = 0; c < 3; c++) {
+                p[c] = (unsigned char)(p[c] + (((o[c] - p[c]) * a) >> 8));
+            }
+        }
+    }
+    prev_dirty = r;
+}
+
+
+DetectorRenderer::DetectorRenderer(const std::vector<const char*>& category_names, float alpha)
+    : category(category_names), palette(&category_palette(category_names.size())), box_points(category_names.size())
+{
+    canvas.set_alpha(alpha);
+}
+
+
+int DetectorRenderer::plot(AILIADetector* detector, cv::Mat& img, bool logging)
+{
+    int status = get_detector_objects(detector, objects);
+    if (status != AILIA_STATUS_SUCCESS) {
         return -1;
     }
+
+    plot(objects, img, logging);
+
+    return 0;
+}
+
+
+void DetectorRenderer::plot(const std::vector<AILIADetectorObject>& objs, cv::Mat& img, bool logging)
+{
+    unsigned int obj_count = objs.size();
     if (logging) {
         PRINT_OUT("object_count=%d\n", obj_count);
     }
 
+    for (int c = 0; c < box_points.size(); c++) {
+        box_points[c].clear();
+    }
+
+    cv::Mat& dst = canvas.begin(img);
+
+    // boxes of the same color are drawn with one polylines call
     for (int i = 0; i < obj_count; i++) {
-        AILIADetectorObject obj;
-        // print result
-        status = ailiaDetectorGetObject(detector, &obj, i, AILIA_DETECTOR_OBJECT_VERSION);
-        if (status != AILIA_STATUS_SUCCESS) {
-            PRINT_ERR("ailiaDetectorGetObjectCount failed %d\n", status);
-            return -1;
-        }
+        const AILIADetectorObject& obj = objs[i];
         if (logging) {
             PRINT_OUT("+ idx=%d\n  category=%d[ %s ]\n  prob=%.15f\n  x=%.15f\n  y=%.15f\n  w=%.15f\n  h=%.15f\n",
                       i, obj.category, category[obj.category], obj.prob, obj.x, obj.y, obj.w, obj.h);
         }
 
-        cv::Point top_left((int)(img.cols*obj.x), (int)(img.rows*obj.y));
-        cv::Point bottom_right((int)(img.cols*(obj.x+obj.w)), (int)(img.rows*(obj.y+obj.h)));
+        int x1 = (int)(img.cols*obj.x);
+        int y1 = (int)(img.rows*obj.y);
+        int x2 = (int)(img.cols*(obj.x+obj.w));
+        int y2 = (int)(img.rows*(obj.y+obj.h));
+        std::vector<cv::Point>& points = box_points[obj.category];
+        points.push_back(cv::Point(x1, y1));
+        points.push_back(cv::Point(x2, y1));
+        points.push_back(cv::Point(x2, y2));
+        points.push_back(cv::Point(x1, y2));
+        canvas.mark(cv::Rect(cv::Point(x1 - 2, y1 - 2), cv::Point(x2 + 3, y2 + 3)));
+    }
+    for (int c = 0; c < box_points.size(); c++) {
+        int box_count = box_points[c].size() / 4;
+        if (box_count == 0) {
+            continue;
+        }
+        box_contours.resize(box_count);
+        box_sizes.assign(box_count, 4);
+        for (int b = 0; b < box_count; b++) {
+            box_contours[b] = &box_points[c][b * 4];
+        }
+        cv::polylines(dst, &box_contours[0], &box_sizes[0], box_count, true, (*palette)[c], 4);
+    }
+
+    float fontScale = (float)img.cols / 512.0f;
+    for (int i = 0; i < obj_count; i++) {
+        const AILIADetectorObject& obj = objs[i];
         cv::Point text_position((int)(img.cols*obj.x)+4, (int)(img.rows*(obj.y+obj.h)-8));
+        // labels can be wider or lower than their box, their rect is cleared with the next frame too
+        canvas.mark(labels.draw(dst, category[obj.category], text_position, fontScale, (*palette)[obj.category], 1));
+    }
 
-        // update image
-        cv::Scalar color = hsv_to_rgb(256*((float)obj.category/(float)category.size()), 255, 255);
-        float fontScale = (float)img.cols / 512.0f;
-        cv::rectangle(img, top_left, bottom_right, color, 4);
-        cv::putText(img, category[obj.category], text_position, cv::FONT_HERSHEY_SIMPLEX, fontScale, color, 1);
+    canvas.end(img);
+}
+
+
+static DetectorRenderer& shared_renderer(const std::vector<const char*>& category)
+{
+    // plot_result keeps the palette and the label glyphs of the last category list
+    static std::unique_ptr<DetectorRenderer> renderer;
+    if (!renderer || !renderer->has_category(category)) {
+        renderer.reset(new DetectorRenderer(category));
     }
+    return *renderer;
+}
+
+
+int get_detector_objects(AILIADetector* detector, std::vector<AILIADetectorObject>& objects)
+{
+    unsigned int obj_count;
+    int status = ailiaDetectorGetObjectCount(detector, &obj_count);
+    if (status != AILIA_STATUS_SUCCESS){
+        PRINT_ERR("ailiaDetectorGetObjectCount failed %d\n",status);
+        return -1;
+    }
+
+    objects.resize(obj_count);
+    for (int i = 0; i < obj_count; i++) {
+        status = ailiaDetectorGetObject(detector, &objects[i], i, AILIA_DETECTOR_OBJECT_VERSION);
+        if (status != AILIA_STATUS_SUCCESS) {
+            PRINT_ERR("ailiaDetectorGetObjectCount failed %d\n", status);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+int plot_result(AILIADetector* detector, cv::Mat& img, const std::vector<const char*>& category, bool logging)
+{
+    return shared_renderer(category).plot(detector, img, logging);
+}
+
+
+int plot_result(const std::vector<AILIADetectorObject>& objects, cv::Mat& img, const std::vector<const char*>& category, bool logging)
+{
+    shared_renderer(category).plot(objects, img, logging);
 
     return 0;
 }
@@ -2,6 +2,8 @@
 #define _DETECTOR_UTILS_H_
 
 #include <vector>
+#include <map>
+#include <string>
 #include <opencv2/opencv.hpp>
 #include "ailia_detector.h"
 
@@ -11,7 +13,60 @@ extern "C" {
 
 int load_image(cv::Mat& img, const char* path);
 cv::Scalar hsv_to_rgb(int h, int s, int v);
-int plot_result(AILIADetector* detector, cv::Mat& img, const std::vector<const char*> category, bool logging = true);
+const std::vector<cv::Scalar>& category_palette(int category_count);
+int get_detector_objects(AILIADetector* detector, std::vector<AILIADetectorObject>& objects);
+int plot_result(AILIADetector* detector, cv::Mat& img, const std::vector<const char*>& category, bool logging = true);
+int plot_result(const std::vector<AILIADetectorObject>& objects, cv::Mat& img, const std::vector<const char*>& category, bool logging = true);
+
+// Text labels rasterized once and stamped through their mask
+class LabelCache {
+public:
+    // returns the drawn rectangle of img
+    cv::Rect draw(cv::Mat& img, const char* text, cv::Point org, double font_scale, const cv::Scalar& color, int thickness = 1);
+    void clear() { glyphs.clear(); }
+
+private:
+    struct Glyph {
+        cv::Mat mask;
+        int ascent;
+        int offset;
+    };
+    std::map<std::string, Glyph> glyphs;
+};
+
+// Reused BGRA overlay blended into the frame once, alpha 1 draws on the frame directly
+class OverlayCanvas {
+public:
+    OverlayCanvas() : alpha(1.0f) {}
+    void set_alpha(float overlay_alpha) { alpha = overlay_alpha; }
+    cv::Mat& begin(cv::Mat& img);
+    void mark(const cv::Rect& rect);
+    void end(cv::Mat& img);
+
+private:
+    float alpha;
+    cv::Mat overlay;
+    cv::Rect dirty;
+    cv::Rect prev_dirty;
+};
+
+class DetectorRenderer {
+public:
+    DetectorRenderer(const std::vector<const char*>& category_names, float alpha = 1.0f);
+    int  plot(AILIADetector* detector, cv::Mat& img, bool logging = false);
+    void plot(const std::vector<AILIADetectorObject>& objs, cv::Mat& img, bool logging = false);
+    bool has_category(const std::vector<const char*>& category_names) const { return category == category_names; }
+
+private:
+    std::vector<const char*> category;
+    const std::vector<cv::Scalar>* palette;
+    std::vector<AILIADetectorObject> objects;
+    std::vector<std::vector<cv::Point>> box_points;  // 4 corners per box of each category, capacity kept across frames
+    std::vector<const cv::Point*> box_contours;
+    std::vector<int> box_sizes;
+    LabelCache labels;
+    OverlayCanvas canvas;
+};
 
 #ifndef __cplusplus
 }
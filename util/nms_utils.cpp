@@ -0,0 +1,279 @@
+﻿#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "nms_utils.h"
+
+
+// boxes gathered in descending score order into separate coordinate arrays,
+// so that the overlap of one box against all the others is a plain loop
+struct SortedBoxes {
+    std::vector<int>   order;
+    std::vector<float> x1;
+    std::vector<float> y1;
+    std::vector<float> x2;
+    std::vector<float> y2;
+    std::vector<float> area;
+};
+
+
+static void sort_boxes(const float* boxes, const float* scores, int n, const NmsConfig& config,
+                       const std::vector<float>* shift, SortedBoxes& s)
+{
+    s.order.resize(n);
+    for (int i = 0; i < n; i++) {
+        s.order[i] = i;
+    }
+    // stable sort keeps the lower index first on ties
+    std::stable_sort(s.order.begin(), s.order.end(), [scores](int a, int b) { return scores[a] > scores[b]; });
+
+    s.x1.resize(n);
+    s.y1.resize(n);
+    s.x2.resize(n);
+    s.y2.resize(n);
+    s.area.resize(n);
+    for (int i = 0; i < n; i++) {
+        const float* b = boxes + (size_t)s.order[i] * config.stride;
+        float d = (shift != nullptr) ? (*shift)[s.order[i]] : 0.0f;
+        s.x1[i] = b[0] + d;
+        s.y1[i] = b[1] + d;
+        s.x2[i] = b[2] + d;
+        s.y2[i] = b[3] + d;
+        s.area[i] = (b[2] - b[0] + config.area_offset) * (b[3] - b[1] + config.area_offset);
+    }
+}
+
+
+// marks every box after i overlapping box i by more than the threshold
+static void suppress(const SortedBoxes& s, int i, int n, float thresh, float offset, unsigned char* removed)
+{
+    const float ix1 = s.x1[i];
+    const float iy1 = s.y1[i];
+    const float ix2 = s.x2[i];
+    const float iy2 = s.y2[i];
+    const float iarea = s.area[i];
+    const float* x1 = s.x1.data();
+    const float* y1 = s.y1.data();
+    const float* x2 = s.x2.data();
+    const float* y2 = s.y2.data();
+    const float* area = s.area.data();
+
+    for (int j = i + 1; j < n; j++) {
+        float w = std::max(0.0f, std::min(ix2, x2[j]) - std::max(ix1, x1[j]) + offset);
+        float h = std::max(0.0f, std::min(iy2, y2[j]) - std::max(iy1, y1[j]) + offset);
+        float inter = w * h;
+        float ovr = inter / (iarea + area[j] - inter);
+        removed[j] |= (unsigned char)!(ovr <= thresh);
+    }
+}
+
+
+void nms(const float* boxes, const float* scores, int n, std::vector<int>& keep, const NmsConfig& config)
+{
+    keep.clear();
+    if (n <= 0) {
+        return;
+    }
+
+    SortedBoxes s;
+    sort_boxes(boxes, scores, n, config, nullptr, s);
+
+    std::vector<unsigned char> removed(n, 0);
+    for (int i = 0; i < n; i++) {
+        if (removed[i]) {
+            continue;
+        }
+        keep.push_back(s.order[i]);
+        if (config.max_keep > 0 && (int)keep.size() >= config.max_keep) {
+            break;
+        }
+        suppress(s, i, n, config.iou_threshold, config.area_offset, &removed[0]);
+    }
+}
+
+
+void soft_nms(const float* boxes, const float* scores, int n, std::vector<int>& keep, std::vector<float>& kept_scores, const NmsConfig& config)
+{
+    keep.clear();
+    kept_scores.clear();
+    if (n <= 0) {
+        return;
+    }
+
+    SortedBoxes s;
+    sort_boxes(boxes, scores, n, config, nullptr, s);
+    std::vector<float> sc(n);
+    for (int i = 0; i < n; i++) {
+        sc[i] = scores[s.order[i]];
+    }
+
+    const float offset = config.area_offset;
+    const float thresh = config.iou_threshold;
+    int m = n;
+    while (m > 0) {
+        // highest decayed score, the first one on ties
+        int top = 0;
+        for (int j = 1; j < m; j++) {
+            if (sc[j] > sc[top]) {
+                top = j;
+            }
+        }
+        if (sc[top] < config.score_threshold) {
+            break;
+        }
+        keep.push_back(s.order[top]);
+        kept_scores.push_back(sc[top]);
+        if (config.max_keep > 0 && (int)keep.size() >= config.max_keep) {
+            break;
+        }
+
+        const float ix1 = s.x1[top];
+        const float iy1 = s.y1[top];
+        const float ix2 = s.x2[top];
+        const float iy2 = s.y2[top];
+        const float iarea = s.area[top];
+
+        // decay the others and compact the survivors in place
+        int dst = 0;
+        for (int j = 0; j < m; j++) {
+            if (j == top) {
+                continue;
+            }
+            float w = std::max(0.0f, std::min(ix2, s.x2[j]) - std::max(ix1, s.x1[j]) + offset);
+            float h = std::max(0.0f, std::min(iy2, s.y2[j]) - std::max(iy1, s.y1[j]) + offset);
+            float inter = w * h;
+            float ovr = inter / (iarea + s.area[j] - inter);
+
+            float weight = 1.0f;
+            if (config.method == NMS_SOFT_GAUSSIAN) {
+                weight = expf(-(ovr * ovr) / config.sigma);
+            }
+            else if (ovr > thresh) {
+                weight = (config.method == NMS_SOFT_LINEAR) ? 1.0f - ovr : 0.0f;
+            }
+            float score = sc[j] * weight;
+            if (weight <= 0.0f || score < config.score_threshold) {
+                continue;
+            }
+            s.order[dst] = s.order[j];
+            s.x1[dst] = s.x1[j];
+            s.y1[dst] = s.y1[j];
+            s.x2[dst] = s.x2[j];
+            s.y2[dst] = s.y2[j];
+            s.area[dst] = s.area[j];
+            sc[dst] = score;
+            dst++;
+        }
+        m = dst;
+    }
+}
+
+
+void batched_nms(const float* boxes, const float* scores, const int* classes, int n, std::vector<int>& keep, const NmsConfig& config)
+{
+    keep.clear();
+    if (n <= 0) {
+        return;
+    }
+
+    // shift every class by more than the extent of all boxes
+    float lo = boxes[0];
+    float hi = boxes[0];
+    int max_class = 0;
+    for (int i = 0; i < n; i++) {
+        const float* b = boxes + (size_t)i * config.stride;
+        for (int k = 0; k < 4; k++) {
+            lo = std::min(lo, b[k]);
+            hi = std::max(hi, b[k]);
+        }
+        max_class = std::max(max_class, classes[i]);
+    }
+    float span = hi - lo + config.area_offset + 1.0f;
+    std::vector<float> shift(n);
+    for (int i = 0; i < n; i++) {
+        shift[i] = classes[i] * span;
+    }
+
+    SortedBoxes s;
+    sort_boxes(boxes, scores, n, config, &shift, s);
+
+    std::vector<int> class_count(max_class + 1, 0);
+    std::vector<unsigned char> removed(n, 0);
+    for (int i = 0; i < n; i++) {
+        if (removed[i]) {
+            continue;
+        }
+        // a full class only has its own lower score boxes left to suppress
+        int cls = classes[s.order[i]];
+        if (config.max_keep > 0 && class_count[cls] >= config.max_keep) {
+            continue;
+        }
+        class_count[cls]++;
+        keep.push_back(s.order[i]);
+        suppress(s, i, n, config.iou_threshold, config.area_offset, &removed[0]);
+    }
+
+    std::stable_sort(keep.begin(), keep.end(), [classes](int a, int b) { return classes[a] < classes[b]; });
+}
+
+
+void weighted_nms(const float* rows, int n, int stride, int coord_n, int score_index, float iou_threshold, std::vector<float>& dst, float area_offset)
+{
+    dst.clear();
+    if (n <= 0) {
+        return;
+    }
+
+    std::vector<float> scores(n);
+    for (int i = 0; i < n; i++) {
+        scores[i] = rows[(size_t)i * stride + score_index];
+    }
+
+    NmsConfig config(iou_threshold);
+    config.stride = stride;
+    config.area_offset = area_offset;
+    SortedBoxes s;
+    sort_boxes(rows, &scores[0], n, config, nullptr, s);
+
+    // unlike nms the first box of a cluster is compared with itself, so every cluster has at least one member
+    std::vector<unsigned char> removed(n, 0);
+    std::vector<unsigned char> hit(n, 0);
+    std::vector<int> overlapping;
+    std::vector<float> sum(coord_n);
+    for (int i = 0; i < n; i++) {
+        if (removed[i]) {
+            continue;
+        }
+        std::fill(hit.begin() + i, hit.end(), 0);
+        suppress(s, i, n, iou_threshold, area_offset, &hit[0]);
+        overlapping.assign(1, i);
+        for (int j = i + 1; j < n; j++) {
+            if (hit[j] && !removed[j]) {
+                removed[j] = 1;
+                overlapping.push_back(j);
+            }
+        }
+
+        const float* first = rows + (size_t)s.order[i] * stride;
+        size_t base = dst.size();
+        dst.insert(dst.end(), first, first + stride);
+        if (overlapping.size() > 1) {
+            float total_score = 0.0f;
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            for (size_t k = 0; k < overlapping.size(); k++) {
+                const float* r = rows + (size_t)s.order[overlapping[k]] * stride;
+                float score = scores[s.order[overlapping[k]]];
+                total_score += score;
+                for (int c = 0; c < coord_n; c++) {
+                    sum[c] += r[c] * score;
+                }
+            }
+            for (int c = 0; c < coord_n; c++) {
+                dst[base + c] = sum[c] / total_score;
+            }
+            dst[base + score_index] = total_score / overlapping.size();
+        }
+    }
+}
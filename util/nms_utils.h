@@ -0,0 +1,56 @@
+﻿#ifndef _NMS_UTILS_H_
+#define _NMS_UTILS_H_
+
+#include <vector>
+
+#ifndef __cplusplus
+extern "C" {
+#endif
+
+// Boxes are contiguous (x1, y1, x2, y2) rows, box i starts at boxes[i*stride]
+
+enum NmsMethod {
+    NMS_HARD = 0,
+    NMS_SOFT_LINEAR,
+    NMS_SOFT_GAUSSIAN
+};
+
+struct NmsConfig {
+    float iou_threshold;    // boxes overlapping more than this are suppressed
+    int   max_keep;         // stop after this many boxes (per class in batched_nms), 0 for no limit
+    float area_offset;      // 1 for inclusive pixel coordinates, 0 for normalized coordinates
+    int   stride;           // floats per box row
+    int   method;           // NmsMethod
+    float sigma;            // gaussian soft nms
+    float score_threshold;  // soft nms drops boxes decayed below this
+
+    NmsConfig(float iou = 0.45f) {
+        iou_threshold = iou;
+        max_keep = 0;
+        area_offset = 1.0f;
+        stride = 4;
+        method = NMS_HARD;
+        sigma = 0.5f;
+        score_threshold = 0.001f;
+    }
+};
+
+// Indices of the kept boxes in descending score order
+void nms(const float* boxes, const float* scores, int n, std::vector<int>& keep, const NmsConfig& config);
+
+// Soft nms, scores receives the decayed score of every kept box
+void soft_nms(const float* boxes, const float* scores, int n, std::vector<int>& keep, std::vector<float>& kept_scores, const NmsConfig& config);
+
+// Class aware nms in one sweep, boxes of different classes are moved apart so that they never overlap.
+// keep is ordered by class, then by descending score
+void batched_nms(const float* boxes, const float* scores, const int* classes, int n, std::vector<int>& keep, const NmsConfig& config);
+
+// Weighted nms, every kept row is the score weighted average of the first coord_n values of its overlapping rows
+// and its score (at score_index) is their mean score. dst receives the merged rows of stride floats
+void weighted_nms(const float* rows, int n, int stride, int coord_n, int score_index, float iou_threshold, std::vector<float>& dst, float area_offset = 0.0f);
+
+#ifndef __cplusplus
+}
+#endif
+
+#endif
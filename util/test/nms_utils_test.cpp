@@ -0,0 +1,279 @@
+﻿#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+#include "nms_utils.h"
+
+// Compares nms and batched_nms with the per sample implementations they replaced
+// (retinaface nms, m2det per class nms) on random box sets with tied scores and identical boxes.
+// The references sort with stable_sort, their own sorts left the order of tied scores unspecified.
+
+static int failures = 0;
+
+#define CHECK(cond, ...) \
+    if (!(cond)) { \
+        fprintf(stderr, "FAILED %s:%d ", __FILE__, __LINE__); \
+        fprintf(stderr, __VA_ARGS__); \
+        fprintf(stderr, "\n"); \
+        failures++; \
+    }
+
+
+// ======================
+// Reference implementations
+// ======================
+
+static std::vector<int> reference_nms(const std::vector<float>& boxes, const std::vector<float>& scores, float thresh)
+{
+    int n = scores.size();
+    std::vector<float> areas(n);
+    for (int i = 0; i < n; i++) {
+        areas[i] = (boxes[i*4+2] - boxes[i*4+0] + 1.0f) * (boxes[i*4+3] - boxes[i*4+1] + 1.0f);
+    }
+
+    std::vector<int> order(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&scores](int a, int b) { return scores[a] > scores[b]; });
+
+    std::vector<int> keep;
+    while (!order.empty()) {
+        int i = order[0];
+        keep.push_back(i);
+
+        std::vector<int> inds;
+        for (size_t j = 1; j < order.size(); j++) {
+            int k = order[j];
+            float xx1 = std::max(boxes[i*4+0], boxes[k*4+0]);
+            float yy1 = std::max(boxes[i*4+1], boxes[k*4+1]);
+            float xx2 = std::min(boxes[i*4+2], boxes[k*4+2]);
+            float yy2 = std::min(boxes[i*4+3], boxes[k*4+3]);
+
+            float w = std::max(0.0f, xx2 - xx1 + 1.0f);
+            float h = std::max(0.0f, yy2 - yy1 + 1.0f);
+            float inter = w * h;
+            float ovr = inter / (areas[i] + areas[k] - inter);
+            if (ovr <= thresh) {
+                inds.push_back(k);
+            }
+        }
+        order = inds;
+    }
+    return keep;
+}
+
+static std::vector<int> reference_batched_nms(const std::vector<float>& boxes, const std::vector<float>& scores,
+                                              const std::vector<int>& classes, int class_n, float thresh, int keep_per_class)
+{
+    std::vector<int> keep;
+    for (int cls = 0; cls < class_n; cls++) {
+        std::vector<float> c_boxes;
+        std::vector<float> c_scores;
+        std::vector<int>   c_index;
+        for (size_t i = 0; i < scores.size(); i++) {
+            if (classes[i] == cls) {
+                c_boxes.insert(c_boxes.end(), &boxes[i*4], &boxes[i*4+4]);
+                c_scores.push_back(scores[i]);
+                c_index.push_back(i);
+            }
+        }
+        if (c_scores.empty()) {
+            continue;
+        }
+
+        std::vector<int> c_keep = reference_nms(c_boxes, c_scores, thresh);
+        if (keep_per_class > 0 && (int)c_keep.size() > keep_per_class) {
+            c_keep.resize(keep_per_class);
+        }
+        for (size_t i = 0; i < c_keep.size(); i++) {
+            keep.push_back(c_index[c_keep[i]]);
+        }
+    }
+    return keep;
+}
+
+
+// ======================
+// Random box sets
+// ======================
+
+// Pixel boxes on a coarse grid so that boxes coincide, scores from a few levels so that they tie
+static void random_pixel_boxes(std::mt19937& rng, int n, std::vector<float>& boxes, std::vector<float>& scores)
+{
+    std::uniform_int_distribution<int> pos(0, 15);
+    std::uniform_int_distribution<int> size(1, 8);
+    std::uniform_int_distribution<int> level(1, 6);
+    std::uniform_int_distribution<int> dup(0, 3);
+
+    boxes.clear();
+    scores.clear();
+    for (int i = 0; i < n; i++) {
+        if (i > 0 && dup(rng) == 0) {
+            // identical box, sometimes with the same score
+            std::uniform_int_distribution<int> pick(0, i - 1);
+            int j = pick(rng);
+            boxes.insert(boxes.end(), boxes.begin() + j*4, boxes.begin() + j*4 + 4);
+            scores.push_back(dup(rng) < 2 ? scores[j] : level(rng) / 6.0f);
+            continue;
+        }
+        float x = pos(rng) * 4.0f;
+        float y = pos(rng) * 4.0f;
+        boxes.push_back(x);
+        boxes.push_back(y);
+        boxes.push_back(x + size(rng) * 4.0f);
+        boxes.push_back(y + size(rng) * 4.0f);
+        scores.push_back(level(rng) / 6.0f);
+    }
+}
+
+// Normalized boxes as m2det outputs them
+static void random_normalized_boxes(std::mt19937& rng, int n, std::vector<float>& boxes, std::vector<float>& scores)
+{
+    std::uniform_real_distribution<float> pos(0.0f, 0.8f);
+    std::uniform_real_distribution<float> size(0.01f, 0.3f);
+    std::uniform_int_distribution<int> level(1, 20);
+    std::uniform_int_distribution<int> dup(0, 4);
+
+    boxes.clear();
+    scores.clear();
+    for (int i = 0; i < n; i++) {
+        if (i > 0 && dup(rng) == 0) {
+            std::uniform_int_distribution<int> pick(0, i - 1);
+            int j = pick(rng);
+            boxes.insert(boxes.end(), boxes.begin() + j*4, boxes.begin() + j*4 + 4);
+            scores.push_back(scores[j]);
+            continue;
+        }
+        float x = pos(rng);
+        float y = pos(rng);
+        boxes.push_back(x);
+        boxes.push_back(y);
+        boxes.push_back(x + size(rng));
+        boxes.push_back(y + size(rng));
+        scores.push_back(level(rng) / 20.0f);
+    }
+}
+
+
+// ======================
+// Tests
+// ======================
+
+static void test_nms(std::mt19937& rng)
+{
+    const float thresholds[] = {0.0f, 0.3f, 0.4f, 0.5f, 1.0f};
+    std::uniform_int_distribution<int> count(0, 200);
+
+    for (int t = 0; t < 500; t++) {
+        std::vector<float> boxes;
+        std::vector<float> scores;
+        random_pixel_boxes(rng, count(rng), boxes, scores);
+        int n = scores.size();
+
+        for (float thresh : thresholds) {
+            std::vector<int> expected = reference_nms(boxes, scores, thresh);
+
+            std::vector<int> keep;
+            NmsConfig config(thresh);
+            nms(boxes.data(), scores.data(), n, keep, config);
+            CHECK(keep == expected, "nms trial %d n %d thresh %.2f kept %d expected %d", t, n, thresh, (int)keep.size(), (int)expected.size());
+
+            // early stop equals truncating the full result (retinaface KEEP_TOP_K)
+            config.max_keep = 5;
+            nms(boxes.data(), scores.data(), n, keep, config);
+            std::vector<int> top(expected.begin(), expected.begin() + std::min((size_t)5, expected.size()));
+            CHECK(keep == top, "nms max_keep trial %d n %d thresh %.2f", t, n, thresh);
+        }
+    }
+}
+
+static void test_identical_boxes()
+{
+    // all boxes identical and tied, only the first one survives
+    std::vector<float> boxes;
+    std::vector<float> scores;
+    for (int i = 0; i < 16; i++) {
+        float b[4] = {10.0f, 20.0f, 30.0f, 40.0f};
+        boxes.insert(boxes.end(), b, b + 4);
+        scores.push_back(0.5f);
+    }
+    std::vector<int> keep;
+    nms(boxes.data(), scores.data(), scores.size(), keep, NmsConfig(0.5f));
+    CHECK(keep.size() == 1 && keep[0] == 0, "identical boxes kept %d", (int)keep.size());
+
+    // iou 1 is never above a threshold of 1, nothing is suppressed
+    nms(boxes.data(), scores.data(), scores.size(), keep, NmsConfig(1.0f));
+    CHECK(keep == reference_nms(boxes, scores, 1.0f), "identical boxes threshold 1");
+    CHECK(keep.size() == 16, "identical boxes threshold 1 kept %d", (int)keep.size());
+
+    // identical boxes of different classes never suppress each other
+    std::vector<int> classes(scores.size());
+    for (size_t i = 0; i < classes.size(); i++) {
+        classes[i] = i % 4;
+    }
+    batched_nms(boxes.data(), scores.data(), classes.data(), scores.size(), keep, NmsConfig(0.5f));
+    std::vector<int> expected = {0, 1, 2, 3};
+    CHECK(keep == expected, "identical boxes batched kept %d", (int)keep.size());
+
+    nms(boxes.data(), scores.data(), 0, keep, NmsConfig(0.5f));
+    CHECK(keep.empty(), "empty input");
+}
+
+static void test_batched_nms(std::mt19937& rng)
+{
+    const float thresholds[] = {0.3f, 0.45f, 0.6f};
+    const int keep_per_class[] = {0, 1, 3};
+    std::uniform_int_distribution<int> count(0, 300);
+    std::uniform_int_distribution<int> class_n(1, 21);
+
+    for (int t = 0; t < 300; t++) {
+        std::vector<float> boxes;
+        std::vector<float> scores;
+        if (t % 2 == 0) {
+            random_pixel_boxes(rng, count(rng), boxes, scores);
+        }
+        else {
+            random_normalized_boxes(rng, count(rng), boxes, scores);
+        }
+        int n = scores.size();
+        int c = class_n(rng);
+        std::uniform_int_distribution<int> cls(0, c - 1);
+        std::vector<int> classes(n);
+        for (int i = 0; i < n; i++) {
+            classes[i] = cls(rng);
+        }
+
+        for (float thresh : thresholds) {
+            for (int k : keep_per_class) {
+                std::vector<int> expected = reference_batched_nms(boxes, scores, classes, c, thresh, k);
+
+                std::vector<int> keep;
+                NmsConfig config(thresh);
+                config.max_keep = k;
+                batched_nms(boxes.data(), scores.data(), classes.data(), n, keep, config);
+                CHECK(keep == expected, "batched_nms trial %d n %d classes %d thresh %.2f keep %d kept %d expected %d",
+                      t, n, c, thresh, k, (int)keep.size(), (int)expected.size());
+            }
+        }
+    }
+}
+
+
+int main(int argc, char **argv)
+{
+    std::mt19937 rng(20261019);
+
+    test_nms(rng);
+    test_identical_boxes();
+    test_batched_nms(rng);
+
+    if (failures > 0) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("nms_utils_test passed\n");
+    return 0;
+}
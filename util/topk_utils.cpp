@@ -0,0 +1,183 @@
+﻿#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include "topk_utils.h"
+
+
+// below this size the sample costs more than the heap saves
+static const int PREFILTER_MIN_N = 1 << 16;
+
+static const int PREFILTER_SAMPLE_N = 4096;
+
+
+// strict order of the selection, higher score first then lower index
+struct TopkBetter {
+    const float* scores;
+    TopkBetter(const float* s) : scores(s) {}
+    bool operator()(int a, int b) const {
+        return scores[a] > scores[b] || (scores[a] == scores[b] && a < b);
+    }
+};
+
+struct TopkScratch {
+    std::vector<int>   heap;
+    std::vector<int>   order;
+    std::vector<float> sample;
+    std::vector<int>   candidates;
+};
+
+
+// candidates is the list of indices to select from, or NULL for 0..n-1
+static void heap_select(const float* scores, const int* candidates, int n, int k, std::vector<int>& heap, std::vector<int>& indices)
+{
+    TopkBetter better(scores);
+    heap.clear();
+    for (int i = 0; i < n; i++) {
+        int idx = candidates ? candidates[i] : i;
+        float v = scores[idx];
+        if (v != v) {
+            continue;
+        }
+        if ((int)heap.size() < k) {
+            heap.push_back(idx);
+            std::push_heap(heap.begin(), heap.end(), better);
+            continue;
+        }
+        // heap[0] is the worst of the kept scores
+        if (v < scores[heap[0]] || !better(idx, heap[0])) {
+            continue;
+        }
+        std::pop_heap(heap.begin(), heap.end(), better);
+        heap.back() = idx;
+        std::push_heap(heap.begin(), heap.end(), better);
+    }
+    std::sort_heap(heap.begin(), heap.end(), better);
+    indices.assign(heap.begin(), heap.end());
+}
+
+static void partial_select(const float* scores, int n, int k, std::vector<int>& order, std::vector<int>& indices)
+{
+    TopkBetter better(scores);
+    order.clear();
+    for (int i = 0; i < n; i++) {
+        if (scores[i] == scores[i]) {
+            order.push_back(i);
+        }
+    }
+    int kk = std::min(k, (int)order.size());
+    if (kk < (int)order.size()) {
+        std::nth_element(order.begin(), order.begin() + kk, order.end(), better);
+    }
+    std::sort(order.begin(), order.begin() + kk, better);
+    indices.assign(order.begin(), order.begin() + kk);
+}
+
+static void prefilter_select(const float* scores, int n, int k, TopkScratch& scratch, std::vector<int>& indices)
+{
+    // threshold at about 2k expected survivors from a strided sample
+    int stride = std::max(1, n / PREFILTER_SAMPLE_N);
+    scratch.sample.clear();
+    for (int i = 0; i < n; i += stride) {
+        if (scores[i] == scores[i]) {
+            scratch.sample.push_back(scores[i]);
+        }
+    }
+    if (scratch.sample.size() == 0) {
+        heap_select(scores, NULL, n, k, scratch.heap, indices);
+        return;
+    }
+    int rank = (int)((double)k * 2 * scratch.sample.size() / n) + 8;
+    rank = std::min(rank, (int)scratch.sample.size() - 1);
+    std::nth_element(scratch.sample.begin(), scratch.sample.begin() + rank, scratch.sample.end(), std::greater<float>());
+    float threshold = scratch.sample[rank];
+
+    // blocks of 8 are tested with independent compares so that the compiler can vectorize the loop,
+    // only blocks holding a survivor are scanned again
+    std::vector<int>& candidates = scratch.candidates;
+    candidates.clear();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const float* s = scores + i;
+        int hit = 0;
+        for (int l = 0; l < 8; l++) {
+            hit |= (s[l] >= threshold);
+        }
+        if (hit) {
+            for (int l = 0; l < 8; l++) {
+                if (s[l] >= threshold) {
+                    candidates.push_back(i + l);
+                }
+            }
+        }
+    }
+    for (; i < n; i++) {
+        if (scores[i] >= threshold) {
+            candidates.push_back(i);
+        }
+    }
+
+    // all of the top-k are above the threshold once k scores are
+    if ((int)candidates.size() < k) {
+        heap_select(scores, NULL, n, k, scratch.heap, indices);
+        return;
+    }
+    heap_select(scores, &candidates[0], (int)candidates.size(), k, scratch.heap, indices);
+}
+
+static void select_topk(const float* scores, int n, int k, TopkScratch& scratch, std::vector<int>& indices)
+{
+    if (n <= 0 || k <= 0) {
+        indices.clear();
+        return;
+    }
+    if (k >= n / 16) {
+        partial_select(scores, n, k, scratch.order, indices);
+    } else if (n >= PREFILTER_MIN_N) {
+        prefilter_select(scores, n, k, scratch, indices);
+    } else {
+        heap_select(scores, NULL, n, k, scratch.heap, indices);
+    }
+}
+
+
+void topk_heap(const float* scores, int n, int k, std::vector<int>& indices)
+{
+    std::vector<int> heap;
+    heap_select(scores, NULL, std::max(n, 0), k, heap, indices);
+}
+
+void topk_partial(const float* scores, int n, int k, std::vector<int>& indices)
+{
+    std::vector<int> order;
+    partial_select(scores, n, std::max(k, 0), order, indices);
+}
+
+void topk_prefilter(const float* scores, int n, int k, std::vector<int>& indices)
+{
+    if (n <= 0 || k <= 0) {
+        indices.clear();
+        return;
+    }
+    TopkScratch scratch;
+    prefilter_select(scores, n, k, scratch, indices);
+}
+
+void topk_indices(const float* scores, int n, int k, std::vector<int>& indices)
+{
+    TopkScratch scratch;
+    select_topk(scores, n, k, scratch, indices);
+}
+
+void topk_batched(const float* scores, int rows, int n, int k, std::vector<int>& indices)
+{
+    int kk = std::max(0, std::min(k, n));
+    indices.assign((size_t)std::max(rows, 0) * kk, -1);
+    TopkScratch scratch;
+    std::vector<int> row;
+    for (int r = 0; r < rows; r++) {
+        select_topk(scores + (size_t)r * n, n, kk, scratch, row);
+        std::copy(row.begin(), row.end(), indices.begin() + (size_t)r * kk);
+    }
+}
@@ -0,0 +1,26 @@
+﻿#ifndef _TOPK_UTILS_H_
+#define _TOPK_UTILS_H_
+
+#include <vector>
+
+// Indices of the k largest scores in descending score order.
+// Ties go to the lower index and NaN scores are never selected, so every path returns the same indices.
+
+// Bounded min-heap, O(n log k), for k much smaller than n
+void topk_heap(const float* scores, int n, int k, std::vector<int>& indices);
+
+// nth_element then sort of the first k, O(n + k log k), for k comparable to n
+void topk_partial(const float* scores, int n, int k, std::vector<int>& indices);
+
+// Threshold estimated from a strided sample, only the scores above it are selected.
+// Falls back to the heap when the threshold keeps fewer than k scores
+void topk_prefilter(const float* scores, int n, int k, std::vector<int>& indices);
+
+// Selects one of the paths above from n and k
+void topk_indices(const float* scores, int n, int k, std::vector<int>& indices);
+
+// Top-k of each of the rows (row r starts at scores[r*n]), indices receives rows x min(k, n) with -1 for
+// missing entries. The scratch buffers are shared by the rows
+void topk_batched(const float* scores, int rows, int n, int k, std::vector<int>& indices);
+
+#endif
@@ -0,0 +1,364 @@
+﻿#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "translation_memory.h"
+
+
+static const int STATUS_SUCCESS = 0;
+static const int STATUS_BROKEN = -1;
+static const int STATUS_ERROR_FILE_API = -2;
+
+static const char TM_MAGIC[8] = {'F', 'U', 'G', 'U', 'T', 'M', '0', '1'};
+
+
+static uint64_t fnv1a(const char* data, size_t n, uint64_t h = 1469598103934665603ULL)
+{
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// invalid bytes are kept as single code points so that any input can be compared
+static void utf8_codepoints(const std::string& text, std::vector<uint32_t>& codepoints)
+{
+    codepoints.clear();
+    size_t i = 0;
+    while (i < text.size()) {
+        unsigned char c = (unsigned char)text[i];
+        int len = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 1;
+        if (i + len > text.size()) {
+            len = 1;
+        }
+        uint32_t cp = len == 1 ? c : c & (0x7F >> len);
+        for (int j = 1; j < len; j++) {
+            unsigned char cc = (unsigned char)text[i + j];
+            if ((cc & 0xC0) != 0x80) {
+                cp = c;
+                len = 1;
+                break;
+            }
+            cp = (cp << 6) | (cc & 0x3F);
+        }
+        codepoints.push_back(cp);
+        i += len;
+    }
+}
+
+static void unique_bigrams(const std::vector<uint32_t>& codepoints, std::vector<uint64_t>& bigrams)
+{
+    bigrams.clear();
+    for (size_t i = 0; i + 1 < codepoints.size(); i++) {
+        bigrams.push_back(((uint64_t)codepoints[i] << 32) | codepoints[i + 1]);
+    }
+    std::sort(bigrams.begin(), bigrams.end());
+    bigrams.erase(std::unique(bigrams.begin(), bigrams.end()), bigrams.end());
+}
+
+static int edit_distance(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b)
+{
+    std::vector<int> prev(b.size() + 1);
+    std::vector<int> cur(b.size() + 1);
+    for (size_t j = 0; j <= b.size(); j++) {
+        prev[j] = (int)j;
+    }
+    for (size_t i = 1; i <= a.size(); i++) {
+        cur[0] = (int)i;
+        for (size_t j = 1; j <= b.size(); j++) {
+            int sub = prev[j - 1] + (a[i - 1] == b[j - 1] ? 0 : 1);
+            cur[j] = std::min(sub, std::min(prev[j], cur[j - 1]) + 1);
+        }
+        prev.swap(cur);
+    }
+    return prev[b.size()];
+}
+
+// number of bytes of the whitespace character at text[i], 0 otherwise
+static int whitespace_length(const std::string& text, size_t i)
+{
+    unsigned char c = (unsigned char)text[i];
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\v' || c == '\f') {
+        return 1;
+    }
+    if (c == 0xC2 && i + 1 < text.size() && (unsigned char)text[i + 1] == 0xA0) {
+        return 2;   // no-break space
+    }
+    if (c == 0xE3 && i + 2 < text.size() && (unsigned char)text[i + 1] == 0x80 && (unsigned char)text[i + 2] == 0x80) {
+        return 3;   // ideographic space
+    }
+    return 0;
+}
+
+
+TranslationMemory::TranslationMemory(const std::string& model_version, const TranslationMemoryConfig& config)
+    : version(model_version), config(config)
+{
+}
+
+std::string TranslationMemory::normalize(const std::string& text)
+{
+    std::string out;
+    out.reserve(text.size());
+    bool pending_space = false;
+    size_t i = 0;
+    while (i < text.size()) {
+        int ws = whitespace_length(text, i);
+        if (ws > 0) {
+            pending_space = !out.empty();
+            i += ws;
+            continue;
+        }
+        if (pending_space) {
+            out += ' ';
+            pending_space = false;
+        }
+        out += text[i];
+        i++;
+    }
+    return out;
+}
+
+int TranslationMemory::find_exact(const std::string& normalized, uint64_t hash) const
+{
+    auto range = exact_index.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (sources[it->second] == normalized) {
+            return it->second;
+        }
+    }
+    return -1;
+}
+
+void TranslationMemory::add_entry(const std::string& normalized, const std::string& target)
+{
+    uint64_t hash = fnv1a(normalized.c_str(), normalized.size());
+    int entry = find_exact(normalized, hash);
+    if (entry >= 0) {
+        targets[entry] = target;
+        return;
+    }
+
+    entry = (int)sources.size();
+    sources.push_back(normalized);
+    targets.push_back(target);
+    codepoints.push_back(std::vector<uint32_t>());
+    utf8_codepoints(normalized, codepoints.back());
+    exact_index.insert(std::make_pair(hash, entry));
+
+    std::vector<uint64_t> bigrams;
+    unique_bigrams(codepoints.back(), bigrams);
+    for (size_t i = 0; i < bigrams.size(); i++) {
+        bigram_index[bigrams[i]].push_back(entry);
+    }
+}
+
+bool TranslationMemory::find_fuzzy(const std::string& normalized, TranslationMemoryMatch& match) const
+{
+    std::vector<uint32_t> query;
+    utf8_codepoints(normalized, query);
+    std::vector<uint64_t> bigrams;
+    unique_bigrams(query, bigrams);
+    if (bigrams.empty()) {
+        return false;
+    }
+
+    // shared bigram count of every entry reachable from the query bigrams. Bigrams found in most entries
+    // would make every lookup walk the whole memory and hardly separate the candidates, they are skipped
+    size_t max_postings = std::max((size_t)std::max(config.fuzzy_min_df, 0), (size_t)(config.fuzzy_max_df * codepoints.size()));
+    std::unordered_map<int, int> shared;
+    for (size_t i = 0; i < bigrams.size(); i++) {
+        auto it = bigram_index.find(bigrams[i]);
+        if (it == bigram_index.end() || it->second.size() > max_postings) {
+            continue;
+        }
+        for (size_t j = 0; j < it->second.size(); j++) {
+            shared[it->second[j]]++;
+        }
+    }
+
+    // the similarity can not exceed the length ratio, shorter or longer entries are skipped
+    struct Candidate {
+        float dice;
+        int entry;
+    };
+    std::vector<Candidate> candidates;
+    std::vector<uint64_t> entry_bigrams;
+    for (auto it = shared.begin(); it != shared.end(); ++it) {
+        const std::vector<uint32_t>& cp = codepoints[it->first];
+        size_t shorter = std::min(cp.size(), query.size());
+        size_t longer = std::max(cp.size(), query.size());
+        if ((float)shorter < config.fuzzy_threshold * (float)longer) {
+            continue;
+        }
+        int entry_n = std::max((int)cp.size() - 1, 1);
+        Candidate c = {2.0f * it->second / (float)(bigrams.size() + entry_n), it->first};
+        candidates.push_back(c);
+    }
+    if (candidates.empty()) {
+        return false;
+    }
+    size_t n = std::min(candidates.size(), (size_t)std::max(config.fuzzy_candidates, 1));
+    std::partial_sort(candidates.begin(), candidates.begin() + n, candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.dice > b.dice || (a.dice == b.dice && a.entry < b.entry);
+    });
+
+    int best = -1;
+    float best_similarity = 0;
+    for (size_t i = 0; i < n; i++) {
+        const std::vector<uint32_t>& cp = codepoints[candidates[i].entry];
+        size_t longer = std::max(cp.size(), query.size());
+        float similarity = 1.0f - (float)edit_distance(query, cp) / (float)longer;
+        if (similarity > best_similarity) {
+            best_similarity = similarity;
+            best = candidates[i].entry;
+        }
+    }
+    if (best < 0 || best_similarity < config.fuzzy_threshold) {
+        return false;
+    }
+    match.source = sources[best];
+    match.target = targets[best];
+    match.similarity = best_similarity;
+    match.exact = false;
+    return true;
+}
+
+bool TranslationMemory::lookup(const std::string& source, TranslationMemoryMatch& match)
+{
+    statistics.lookups++;
+    std::string normalized = normalize(source);
+    int entry = find_exact(normalized, fnv1a(normalized.c_str(), normalized.size()));
+    if (entry >= 0) {
+        match.source = sources[entry];
+        match.target = targets[entry];
+        match.similarity = 1.0f;
+        match.exact = true;
+        statistics.exact_hits++;
+        return true;
+    }
+    if (config.fuzzy_threshold > 0 && find_fuzzy(normalized, match)) {
+        statistics.fuzzy_hits++;
+        return true;
+    }
+    statistics.misses++;
+    return false;
+}
+
+void TranslationMemory::store(const std::string& source, const std::string& target)
+{
+    std::string normalized = normalize(source);
+    if (normalized.empty()) {
+        return;
+    }
+    add_entry(normalized, target);
+    statistics.stored++;
+}
+
+void TranslationMemory::clear()
+{
+    sources.clear();
+    targets.clear();
+    codepoints.clear();
+    exact_index.clear();
+    bigram_index.clear();
+}
+
+
+// ======================
+// Persistence
+// ======================
+
+static bool write_string(FILE* fp, const std::string& s)
+{
+    uint32_t len = (uint32_t)s.size();
+    return fwrite(&len, sizeof(len), 1, fp) == 1 && (len == 0 || fwrite(s.c_str(), 1, len, fp) == len);
+}
+
+static bool read_string(FILE* fp, std::string& s)
+{
+    uint32_t len = 0;
+    if (fread(&len, sizeof(len), 1, fp) != 1 || len > (1u << 28)) {
+        return false;
+    }
+    s.resize(len);
+    return len == 0 || fread(&s[0], 1, len, fp) == len;
+}
+
+int TranslationMemory::save(const std::string& path) const
+{
+    // write to a temporary file so that an interrupted save keeps the previous memory
+    std::string tmp_path = path + ".tmp";
+    FILE* fp = fopen(tmp_path.c_str(), "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "\'%s\' open failed\n", tmp_path.c_str());
+        return STATUS_ERROR_FILE_API;
+    }
+
+    uint32_t count = (uint32_t)sources.size();
+    bool success = fwrite(TM_MAGIC, sizeof(TM_MAGIC), 1, fp) == 1;
+    success = success && write_string(fp, version);
+    success = success && fwrite(&count, sizeof(count), 1, fp) == 1;
+    for (uint32_t i = 0; i < count && success; i++) {
+        uint64_t hash = fnv1a(sources[i].c_str(), sources[i].size());
+        success = fwrite(&hash, sizeof(hash), 1, fp) == 1;
+        success = success && write_string(fp, sources[i]);
+        success = success && write_string(fp, targets[i]);
+    }
+    success = (fclose(fp) == 0) && success;
+
+    if (!success || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        // rename does not replace an existing file on windows
+        if (success && remove(path.c_str()) == 0 && rename(tmp_path.c_str(), path.c_str()) == 0) {
+            return STATUS_SUCCESS;
+        }
+        fprintf(stderr, "\'%s\' write failed\n", path.c_str());
+        remove(tmp_path.c_str());
+        return STATUS_ERROR_FILE_API;
+    }
+    return STATUS_SUCCESS;
+}
+
+int TranslationMemory::load(const std::string& path)
+{
+    clear();
+    statistics = TranslationMemoryStats();
+
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        return STATUS_SUCCESS;
+    }
+
+    char magic[sizeof(TM_MAGIC)];
+    std::string file_version;
+    uint32_t count = 0;
+    bool success = fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, TM_MAGIC, sizeof(magic)) == 0;
+    success = success && read_string(fp, file_version);
+    success = success && fread(&count, sizeof(count), 1, fp) == 1;
+    if (success && file_version != version) {
+        // translations of another model are not reused, the file is replaced on the next save
+        fclose(fp);
+        statistics.invalidated = (int)count;
+        return STATUS_SUCCESS;
+    }
+
+    std::string source, target;
+    for (uint32_t i = 0; i < count && success; i++) {
+        uint64_t hash = 0;
+        success = fread(&hash, sizeof(hash), 1, fp) == 1;
+        success = success && read_string(fp, source) && read_string(fp, target);
+        success = success && hash == fnv1a(source.c_str(), source.size());
+        if (success) {
+            add_entry(source, target);
+        }
+    }
+    fclose(fp);
+
+    if (!success) {
+        fprintf(stderr, "\'%s\' is broken\n", path.c_str());
+        clear();
+        return STATUS_BROKEN;
+    }
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,81 @@
+﻿#ifndef _TRANSLATION_MEMORY_H_
+#define _TRANSLATION_MEMORY_H_
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+// Sentence level translation memory kept in a local file.
+// Sources are normalized (trimmed, whitespace runs collapsed to one space) and indexed by a 64 bit hash for
+// exact lookup. Fuzzy lookup ranks the entries by shared character bigrams, skipping bigrams common to many
+// entries (such as "e " or "。"), and returns the best one whose edit distance similarity reaches the threshold.
+// The file records the model version, a file written by another model version is discarded on load.
+
+struct TranslationMemoryConfig {
+    float fuzzy_threshold;  // similarity in (0, 1] for fuzzy reuse, 0 disables fuzzy lookup
+    int   fuzzy_candidates; // entries ranked by bigram overlap that are checked by edit distance
+    float fuzzy_max_df;     // bigrams found in more than this fraction of the entries are not used for ranking
+    int   fuzzy_min_df;     // ... unless they are found in at most this many entries
+
+    TranslationMemoryConfig() {
+        fuzzy_threshold = 0.0f;
+        fuzzy_candidates = 16;
+        fuzzy_max_df = 0.05f;
+        fuzzy_min_df = 64;
+    }
+};
+
+struct TranslationMemoryStats {
+    int lookups;
+    int exact_hits;
+    int fuzzy_hits;
+    int misses;
+    int stored;         // entries added or replaced since load
+    int invalidated;    // entries dropped on load because of a model version change
+
+    TranslationMemoryStats() : lookups(0), exact_hits(0), fuzzy_hits(0), misses(0), stored(0), invalidated(0) {}
+};
+
+struct TranslationMemoryMatch {
+    std::string source;     // normalized source of the entry
+    std::string target;
+    float similarity;       // 1 for exact matches
+    bool exact;
+};
+
+class TranslationMemory {
+public:
+    TranslationMemory(const std::string& model_version, const TranslationMemoryConfig& config = TranslationMemoryConfig());
+
+    // Return 0 on success and a negative value on failure.
+    // A missing file leaves the memory empty and is not an error
+    int load(const std::string& path);
+    int save(const std::string& path) const;
+
+    bool lookup(const std::string& source, TranslationMemoryMatch& match);
+    void store(const std::string& source, const std::string& target);
+    void clear();
+
+    int size() const { return (int)sources.size(); }
+    const TranslationMemoryStats& stats() const { return statistics; }
+
+    static std::string normalize(const std::string& text);
+
+private:
+    std::string version;
+    TranslationMemoryConfig config;
+    TranslationMemoryStats statistics;
+
+    std::vector<std::string> sources;
+    std::vector<std::string> targets;
+    std::vector<std::vector<uint32_t>> codepoints;
+    std::unordered_multimap<uint64_t, int> exact_index;                 // source hash -> entry
+    std::unordered_map<uint64_t, std::vector<int>> bigram_index;        // bigram -> entries containing it
+
+    int find_exact(const std::string& normalized, uint64_t hash) const;
+    void add_entry(const std::string& normalized, const std::string& target);
+    bool find_fuzzy(const std::string& normalized, TranslationMemoryMatch& match) const;
+};
+
+#endif
@@ -1,5 +1,11 @@
 ﻿#include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+
+#include "utils.h"
+
+// leading bytes of each file hashed into the model version
+static const size_t VERSION_HASH_BYTES = 1 << 20;
 
 
 #if defined(_WIN32) || defined(_WIN64)
@@ -18,6 +24,24 @@ bool check_file_existance(const char* path)
     }
 }
 
+static FILE* open_binary(const char* path)
+{
+    FILE* fp;
+    if (fopen_s(&fp, path, "rb") != 0) {
+        return NULL;
+    }
+    return fp;
+}
+
+// long is 32bit on Windows, model files exceed 2GB
+static long long file_size(FILE* fp)
+{
+    if (_fseeki64(fp, 0, SEEK_END) != 0) {
+        return -1;
+    }
+    return _ftelli64(fp);
+}
+
 #else
 // for Linux and MacOS
 
@@ -34,4 +58,46 @@ bool check_file_existance(const char* path)
     }
 }
 
+static FILE* open_binary(const char* path)
+{
+    return fopen(path, "rb");
+}
+
+static long long file_size(FILE* fp)
+{
+    if (fseeko(fp, 0, SEEK_END) != 0) {
+        return -1;
+    }
+    return (long long)ftello(fp);
+}
+
 #endif
+
+
+std::string model_file_version(const std::vector<std::string>& files)
+{
+    std::string version;
+    std::vector<char> buffer(VERSION_HASH_BYTES);
+    for (size_t i = 0; i < files.size(); i++) {
+        FILE* fp = open_binary(files[i].c_str());
+        long long size = -1;
+        uint64_t hash = 1469598103934665603ULL;
+        if (fp != NULL) {
+            // FNV-1a of the leading bytes
+            size_t n = fread(&buffer[0], 1, buffer.size(), fp);
+            for (size_t j = 0; j < n; j++) {
+                hash ^= (unsigned char)buffer[j];
+                hash *= 1099511628211ULL;
+            }
+            size = file_size(fp);
+            fclose(fp);
+        }
+        size_t slash = files[i].find_last_of("/\\");
+        std::string name = slash == std::string::npos ? files[i] : files[i].substr(slash + 1);
+
+        char entry[64];
+        snprintf(entry, sizeof(entry), ":%lld:%016llx;", size, (unsigned long long)hash);
+        version += name + entry;
+    }
+    return version;
+}
@@ -11,4 +11,12 @@ bool check_file_existance(const char* path);
 }
 #endif
 
+#ifdef __cplusplus
+#include <string>
+#include <vector>
+
+// Identifies a model from the names, sizes and leading bytes of its files, a replaced file changes the version
+std::string model_file_version(const std::vector<std::string>& files);
+#endif
+
 #endif
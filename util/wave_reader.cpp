@@ -26,18 +26,25 @@ struct FormatHeader{
 	unsigned short block_size;
 	unsigned short bit_per_sample;
 };
-#pragma pack()
 
-struct WaveReader{
-	FileHeader fh;
-	FormatHeader format;
-	FILE *fp;
-	int data_n;
+struct FormatExtensible{
+	unsigned short cb_size;
+	unsigned short valid_bits_per_sample;
+	unsigned int channel_mask;
+	unsigned char sub_format[16];
 };
+#pragma pack()
 
 static const int STATUS_SUCCESS = 0;
 static const int STATUS_BROKEN = -1;
 static const int STATUS_ERROR_FILE_API = -2;
+static const int STATUS_UNSUPPORTED = -3;
+
+static const int FORMAT_PCM = 1;
+static const int FORMAT_IEEE_FLOAT = 3;
+static const int FORMAT_EXTENSIBLE = 0xFFFE;
+
+static const int BLOCK_FRAMES = 16384;
 
 namespace{
 
@@ -53,7 +60,9 @@ unsigned int get_tag_size(FILE *fp){
 int skip_tag(FILE *fp,const char *target_tag1,const char *target_tag2){
 	while(1){
 		char type[4];
-		fread(type,4,1,fp);
+		if(fread(type,4,1,fp)!=1){
+			return STATUS_BROKEN;
+		}
 		
 		if(strncmp(type,target_tag1,4)==0 || strncmp(type,target_tag2,4)==0){
 			return STATUS_SUCCESS;
@@ -69,7 +78,9 @@ int skip_tag(FILE *fp,const char *target_tag1,const char *target_tag2){
 }
 
 int read_file_header(FileHeader *fh, FILE *fp){
-	fread(fh,sizeof(struct FileHeader),1,fp);
+	if(fread(fh,sizeof(struct FileHeader),1,fp)!=1){
+		return STATUS_BROKEN;
+	}
 	if(strncmp(fh->filetype,"RIFF",4)!=0 && strncmp(fh->filetype,"riff",4)!=0){
 		return STATUS_BROKEN;
 	}
@@ -79,117 +90,237 @@ int read_file_header(FileHeader *fh, FILE *fp){
 	return STATUS_SUCCESS;
 }
 
-int read_format_header(FormatHeader *format, FILE *fp){
+int read_format_header(FormatHeader *format, int *format_id, FILE *fp){
 	int status=skip_tag(fp,"FMT ","fmt ");
 	if(status!=STATUS_SUCCESS){
 		return status;
 	}
 
-	fread(format,sizeof(FormatHeader),1,fp);
+	if(fread(format,sizeof(FormatHeader),1,fp)!=1){
+		return STATUS_BROKEN;
+	}
 	
 	unsigned int size=format->size;
 	size-=16;
+	*format_id=format->id;
+
+	// the actual format is the first 2 bytes of the sub format guid
+	if(format->id==FORMAT_EXTENSIBLE && size>=sizeof(FormatExtensible)){
+		FormatExtensible ext;
+		if(fread(&ext,sizeof(FormatExtensible),1,fp)!=1){
+			return STATUS_BROKEN;
+		}
+		*format_id=ext.sub_format[0] | (ext.sub_format[1]<<8);
+		size-=sizeof(FormatExtensible);
+	}
+
+	if(size%2==1){	// size word padding
+		size++;
+	}
 	fseek(fp,size,SEEK_CUR);
 	
 	return STATUS_SUCCESS;
 }
 
-int read_data_n(WaveReader *instance){
-	int ret=skip_tag(instance->fp,"DATA","data");
-	if(ret){
-		return ret;
+bool is_supported(int format_id, int bit_per_sample){
+	if(format_id==FORMAT_PCM){
+		return bit_per_sample==8 || bit_per_sample==16 || bit_per_sample==24 || bit_per_sample==32;
 	}
-	
-	fread(&instance->data_n,4,1,instance->fp);
-	instance->data_n/=(instance->format.bit_per_sample/8);
-	
-	return STATUS_SUCCESS;
+	if(format_id==FORMAT_IEEE_FLOAT){
+		return bit_per_sample==32;
+	}
+	return false;
+}
+
+} // namespace
+
+WaveStreamReader::WaveStreamReader(){
+	fp=NULL;
+	format_id=0;
+	channel_n=0;
+	sampling_rate=0;
+	bit_per_sample=0;
+	frame_n=0;
+	frame_pos=0;
+	data_offset=0;
+	downmix=false;
 }
 
-int open_file_core(WaveReader *instance){
-	int ret=read_file_header(&instance->fh, instance->fp);
-	if(ret){
-		return ret;
+WaveStreamReader::~WaveStreamReader(){
+	close();
+}
+
+int WaveStreamReader::open(const char *path, bool downmix_to_mono){
+	close();
+	if(path==NULL){
+		return STATUS_ERROR_FILE_API;
 	}
-	
-	ret=read_format_header(&instance->format, instance->fp);
-	if(ret){
-		return ret;
+	fp=fopen(path,"rb");
+	if(fp==NULL){
+		return STATUS_ERROR_FILE_API;
 	}
-	
-	ret=read_data_n(instance);
-	if(ret){
-		return ret;
+
+	FileHeader fh;
+	int status=read_file_header(&fh, fp);
+	if(status!=STATUS_SUCCESS){
+		close();
+		return status;
+	}
+
+	FormatHeader format;
+	status=read_format_header(&format, &format_id, fp);
+	if(status!=STATUS_SUCCESS){
+		close();
+		return status;
+	}
+
+	status=skip_tag(fp,"DATA","data");
+	if(status!=STATUS_SUCCESS){
+		close();
+		return status;
+	}
+	unsigned int data_size=0;
+	fread(&data_size,4,1,fp);
+	data_offset=ftell(fp);
+
+	// streamed files may have an unknown or too large data size
+	fseek(fp,0,SEEK_END);
+	long file_end=ftell(fp);
+	if(file_end>=data_offset && data_size>(unsigned long)(file_end-data_offset)){
+		data_size=file_end-data_offset;
+	}
+	fseek(fp,data_offset,SEEK_SET);
+
+	channel_n=format.channel_n;
+	sampling_rate=format.sampling_rate;
+	bit_per_sample=format.bit_per_sample;
+	downmix=downmix_to_mono;
+	frame_pos=0;
+	frame_n=0;
+	if(channel_n>0 && bit_per_sample>=8){
+		frame_n=data_size/(channel_n*(bit_per_sample/8));
+	}
+
+	if(!is_supported(format_id, bit_per_sample) || channel_n==0){
+		return STATUS_UNSUPPORTED;
 	}
-	
 	return STATUS_SUCCESS;
 }
 
-int open_a(WaveReader *instance, const char *path){
-	if(path==NULL){
-		return STATUS_ERROR_FILE_API;
+void WaveStreamReader::close(void){
+	if(fp!=NULL){
+		fclose(fp);
+		fp=NULL;
 	}
-	instance->fp=fopen(path,"rb");
-	if(instance->fp==NULL){
-		return STATUS_ERROR_FILE_API;
+}
+
+void WaveStreamReader::convert(const unsigned char *src, float *dst, int sample_n){
+	if(format_id==FORMAT_IEEE_FLOAT){
+		memcpy(dst,src,sample_n*sizeof(float));
+		return;
+	}
+	switch(bit_per_sample){
+	case 8:
+		for(int i=0;i<sample_n;i++){
+			dst[i]=((int)src[i]-128) * 1.0f / (1<<7);
+		}
+		break;
+	case 16:
+		for(int i=0;i<sample_n;i++){
+			short v=(short)(src[i*2+0] | (src[i*2+1]<<8));
+			dst[i]=v * 1.0f / (1<<15);
+		}
+		break;
+	case 24:
+		for(int i=0;i<sample_n;i++){
+			int v = (int)(((unsigned int)src[i*3+2]<<24) | (src[i*3+1]<<16) | (src[i*3+0]<<8));
+			dst[i]=v * 1.0f / 2147483648.0f;
+		}
+		break;
+	case 32:
+		for(int i=0;i<sample_n;i++){
+			int v = (int)((unsigned int)src[i*4+0] | ((unsigned int)src[i*4+1]<<8) | ((unsigned int)src[i*4+2]<<16) | ((unsigned int)src[i*4+3]<<24));
+			dst[i]=v * 1.0f / 2147483648.0f;
+		}
+		break;
 	}
-	int status=open_file_core(instance);
-	return status;
 }
 
-void close(WaveReader *instance){
-	if(instance->fp!=NULL){
-		fclose(instance->fp);
-		instance->fp=NULL;
+int WaveStreamReader::read(float *dst, int frames){
+	if(fp==NULL || !is_supported(format_id, bit_per_sample)){
+		return 0;
 	}
+	int bytes_per_frame=channel_n*(bit_per_sample/8);
+	int total=0;
+	while(total<frames && frame_pos<frame_n){
+		int n=std::min(std::min(frames-total, frame_n-frame_pos), BLOCK_FRAMES);
+		block.resize(n*bytes_per_frame);
+		int read_n=fread(&block[0],bytes_per_frame,n,fp);
+		if(read_n<=0){
+			break;
+		}
+
+		if(downmix && channel_n>1){
+			plane.resize(read_n*channel_n);
+			convert(&block[0], &plane[0], read_n*channel_n);
+			for(int i=0;i<read_n;i++){
+				float v=0;
+				for(int ch=0;ch<channel_n;ch++){
+					v+=plane[i*channel_n+ch];
+				}
+				dst[(total+i)]=v/channel_n;
+			}
+		}else{
+			convert(&block[0], &dst[total*channel_n], read_n*channel_n);
+		}
+
+		total+=read_n;
+		frame_pos+=read_n;
+		if(read_n<n){
+			break;
+		}
+	}
+	return total;
 }
 
-} // namespace
+int WaveStreamReader::seek(int frame){
+	if(fp==NULL){
+		return STATUS_ERROR_FILE_API;
+	}
+	frame=std::max(0, std::min(frame, frame_n));
+	long offset=(long)frame*channel_n*(bit_per_sample/8);
+	if(fseek(fp,data_offset+offset,SEEK_SET)!=0){
+		return STATUS_ERROR_FILE_API;
+	}
+	frame_pos=frame;
+	return STATUS_SUCCESS;
+}
 
 std::vector<float> read_wave_file(const char *path, int *sampleRate, int *nChannels, int *nSamples){
-	//Create instance
-	WaveReader instance;
-	instance.fp=NULL;
-	memset(&instance.format,0,sizeof(instance.format));
-	instance.data_n=0;
+	WaveStreamReader reader;
 
 	//Open file
-	int status = open_a(&instance, path);
+	int status = reader.open(path);
 	std::vector<float> buf;
-	if(status!=STATUS_SUCCESS){
+	if(status!=STATUS_SUCCESS && status!=STATUS_UNSUPPORTED){
 		return buf;
 	}
 
 	//Format conversion
-	if(instance.format.bit_per_sample==24){
-		buf.resize(instance.data_n);
-		std::vector<unsigned char> plane_buf;
-		plane_buf.resize(instance.data_n * 3);
-		fread(&plane_buf[0],3*instance.data_n,1,instance.fp);
-		for(int i=0;i<instance.data_n;i++){
-			int v = (int)((plane_buf[i*3+2]<<24) | (plane_buf[i*3+1]<<16) | (plane_buf[i*3+0]<<8));
-			buf[i]=v * 1.0f / (1<<31);
-		}
+	if(status==STATUS_UNSUPPORTED){
+		printf("unknown bit per sample\n");
 	}else{
-		if(instance.format.bit_per_sample==16){
-			buf.resize(instance.data_n);
-			std::vector<short> plane_buf;
-			plane_buf.resize(instance.data_n);
-			fread(&plane_buf[0],sizeof(short)*instance.data_n,1,instance.fp);
-			for(int i=0;i<instance.data_n;i++){
-				buf[i]=plane_buf[i] * 1.0f / (1<<15);
-			}
-		}else{
-			printf("unknown bit per sample\n");
-		}
+		buf.resize((size_t)reader.frames() * reader.channels());
+		int frames = reader.read(buf.size() > 0 ? &buf[0] : NULL, reader.frames());
+		buf.resize((size_t)frames * reader.channels());
 	}
 
 	//Set return value
-	*sampleRate = instance.format.sampling_rate;
-	*nChannels = instance.format.channel_n;
-	*nSamples = instance.data_n / instance.format.channel_n;
+	*sampleRate = reader.sample_rate();
+	*nChannels = reader.channels();
+	*nSamples = buf.size() / std::max(1, reader.channels());
 
-	close(&instance);
+	reader.close();
 
 	return buf;
 }
\ No newline at end of file
@@ -16,3 +16,41 @@
 #include <vector>
 
 std::vector<float> read_wave_file(const char *path, int *sampleRate, int *nChannels, int *nSamples);
+
+// Streaming reader which parses the header once and returns float blocks on demand
+// Supports 8/16/24/32bit PCM, 32bit float and WAVE_FORMAT_EXTENSIBLE
+class WaveStreamReader{
+private:
+	FILE *fp;
+	int format_id;
+	int channel_n;
+	int sampling_rate;
+	int bit_per_sample;
+	int frame_n;
+	int frame_pos;
+	long data_offset;
+	bool downmix;
+	std::vector<unsigned char> block;
+	std::vector<float> plane;
+
+	void convert(const unsigned char *src, float *dst, int sample_n);
+
+public:
+	WaveStreamReader();
+	~WaveStreamReader();
+
+	// Returns 0 on success, downmix averages all channels into mono
+	int open(const char *path, bool downmix = false);
+	void close(void);
+
+	// Read up to frames frames into dst (frames * channels() floats), returns the number of frames read
+	int read(float *dst, int frames);
+	int seek(int frame);
+
+	int sample_rate(void) const { return sampling_rate; }
+	int channels(void) const { return downmix ? 1 : channel_n; }
+	int source_channels(void) const { return channel_n; }
+	int bits(void) const { return bit_per_sample; }
+	int frames(void) const { return frame_n; }
+	int position(void) const { return frame_pos; }
+};
@@ -9,6 +9,8 @@
 *******************************************************************/
 
 #include "wave_writer.h"
+#include <math.h>
+#include <string.h>
 #include <algorithm>
 
 #pragma pack(1)
@@ -29,8 +31,14 @@ struct FormatHeader{
 };
 #pragma pack()
 
-static const int BIT_PER_SAMPLE=16;
-static const int FORMAT_ID=1;
+static const int FORMAT_PCM=1;
+static const int FORMAT_IEEE_FLOAT=3;
+
+static const int STATUS_SUCCESS = 0;
+static const int STATUS_INVALID_ARGUMENT = -1;
+static const int STATUS_ERROR_FILE_API = -2;
+
+static const size_t BLOCK_BYTES=1024*1024;
 
 #define TAG_FORMAT "fmt "
 #define TAG_DATA "data"
@@ -47,14 +55,14 @@ static void create_file_header(FileHeader *fh){
 	fh->rifftype[3]='E';
 }
 	
-static void create_format_header(FormatHeader *format,int data_n,int channel_n,int sampling_rate){
+static void create_format_header(FormatHeader *format,int format_id,int bit_per_sample,int channel_n,int sampling_rate){
 	format->size=sizeof(FormatHeader)-4;
-	format->id=FORMAT_ID;
+	format->id=format_id;
 	format->channel_n=channel_n;
 	format->sampling_rate=sampling_rate;
-	format->data_speed=sampling_rate*(BIT_PER_SAMPLE/8)*channel_n;
-	format->block_size=(BIT_PER_SAMPLE/8)*channel_n;
-	format->bit_per_sample=BIT_PER_SAMPLE;
+	format->data_speed=sampling_rate*(bit_per_sample/8)*channel_n;
+	format->block_size=(bit_per_sample/8)*channel_n;
+	format->bit_per_sample=bit_per_sample;
 }
 
 static void zero_padding(FILE *fp,int n){
@@ -64,14 +72,14 @@ static void zero_padding(FILE *fp,int n){
 	}
 }
 
-static void write_header(FILE *fp, int data_n,int channel_n,int sampling_rate){
+static void write_header(FILE *fp, unsigned int data_bytes,int format_id,int bit_per_sample,int channel_n,int sampling_rate){
 	FileHeader fh;
 	create_file_header(&fh);
 	
 	FormatHeader format;
-	create_format_header(&format,data_n,channel_n,sampling_rate);
+	create_format_header(&format,format_id,bit_per_sample,channel_n,sampling_rate);
 	
-	fh.filesize=(sizeof(fh)-8)+(8+format.size)+(8+data_n*(BIT_PER_SAMPLE/8));
+	fh.filesize=(sizeof(fh)-8)+(8+format.size)+(8+data_bytes);
 	fwrite(&fh,sizeof(struct FileHeader),1,fp);
 
 	fprintf(fp,TAG_FORMAT);
@@ -81,24 +89,139 @@ static void write_header(FILE *fp, int data_n,int channel_n,int sampling_rate){
 	zero_padding(fp,n);
 
 	fprintf(fp,TAG_DATA);
-	int data_size=data_n*(BIT_PER_SAMPLE/8);
-	fwrite(&data_size,4,1,fp);
+	fwrite(&data_bytes,4,1,fp);
 }
 
-void write_wave_file(const char *path, std::vector<float> data, int sampling_rate){
-	if(path==NULL){
-		return;
+WaveStreamWriter::WaveStreamWriter(){
+	fp=NULL;
+	channel_n=1;
+	bit_per_sample=16;
+	is_float=false;
+	dither=false;
+	data_bytes=0;
+	rng=0x12345678;
+	block_n=0;
+}
+
+WaveStreamWriter::~WaveStreamWriter(){
+	finalize();
+}
+
+int WaveStreamWriter::open(const char *path, int sampling_rate, int channels, int bits, bool use_float, bool use_dither){
+	finalize();
+	if(path==NULL || channels<=0){
+		return STATUS_INVALID_ARGUMENT;
+	}
+	if(use_float ? (bits!=32) : (bits!=16 && bits!=24 && bits!=32)){
+		return STATUS_INVALID_ARGUMENT;
+	}
+	fp=fopen(path,"wb");
+	if(fp==NULL){
+		return STATUS_ERROR_FILE_API;
+	}
+	channel_n=channels;
+	bit_per_sample=bits;
+	is_float=use_float;
+	dither=use_dither && !use_float;
+	data_bytes=0;
+	block.resize(BLOCK_BYTES);
+	block_n=0;
+
+	// sizes are patched on finalize
+	write_header(fp, 0, is_float ? FORMAT_IEEE_FLOAT : FORMAT_PCM, bit_per_sample, channel_n, sampling_rate);
+	return STATUS_SUCCESS;
+}
+
+// triangular noise of +-1 LSB, sum of two uniform noises
+float WaveStreamWriter::tpdf(void){
+	float r[2];
+	for(int i=0;i<2;i++){
+		rng^=rng<<13;
+		rng^=rng>>17;
+		rng^=rng<<5;
+		r[i]=(rng>>8)*(1.0f/16777216.0f);
+	}
+	return r[0]-r[1];
+}
+
+int WaveStreamWriter::flush(void){
+	if(block_n==0){
+		return STATUS_SUCCESS;
 	}
-	FILE *fp=fopen(path,"wb");
+	if(fwrite(&block[0],1,block_n,fp)!=block_n){
+		return STATUS_ERROR_FILE_API;
+	}
+	block_n=0;
+	return STATUS_SUCCESS;
+}
+
+int WaveStreamWriter::append(const float *data, int frames){
 	if(fp==NULL){
+		return STATUS_ERROR_FILE_API;
+	}
+	int bytes_per_sample=bit_per_sample/8;
+	int sample_n=frames*channel_n;
+	// double holds 2^31-1 exactly, a float would round it up to 2^31 and overflow the 32bit clamp
+	double max_value=(double)((1u<<(bit_per_sample-1))-1);
+	for(int i=0;i<sample_n;i++){
+		if(block_n+bytes_per_sample>block.size()){
+			int status=flush();
+			if(status!=STATUS_SUCCESS){
+				return status;
+			}
+		}
+		unsigned char *dst=&block[block_n];
+		if(is_float){
+			memcpy(dst,&data[i],4);
+		}else{
+			double v=data[i]*max_value;
+			if(dither){
+				v+=tpdf();
+			}
+			v=floor(v+0.5);
+			v=std::max(std::min(v,max_value),-max_value-1);
+			long long pcm=(long long)v;
+			for(int b=0;b<bytes_per_sample;b++){
+				dst[b]=(unsigned char)((pcm>>(8*b))&0xff);
+			}
+		}
+		block_n+=bytes_per_sample;
+	}
+	data_bytes+=sample_n*bytes_per_sample;
+	return STATUS_SUCCESS;
+}
+
+int WaveStreamWriter::finalize(void){
+	if(fp==NULL){
+		return STATUS_SUCCESS;
+	}
+	int status=flush();
+
+	// RIFF data is word aligned
+	if(data_bytes%2==1){
+		fputc(0,fp);
+	}
+
+	unsigned int riff_size=4+(8+sizeof(FormatHeader)-4)+(8+data_bytes+(data_bytes%2));
+	fseek(fp,4,SEEK_SET);
+	fwrite(&riff_size,4,1,fp);
+	fseek(fp,sizeof(FileHeader)+4+sizeof(FormatHeader)+4,SEEK_SET);
+	fwrite(&data_bytes,4,1,fp);
+
+	if(fclose(fp)!=0){
+		status=STATUS_ERROR_FILE_API;
+	}
+	fp=NULL;
+	return status;
+}
+
+void write_wave_file(const char *path, const std::vector<float> &data, int sampling_rate){
+	WaveStreamWriter writer;
+	if(writer.open(path, sampling_rate)!=STATUS_SUCCESS){
 		return;
 	}
-	int channel_n = 1;
-	write_header(fp, data.size(), channel_n, sampling_rate);
-	for (int i = 0; i < data.size(); i++){
-		int pcm = data[i] * 32767;
-		short pcm_16bit = std::max(std::min(pcm, 32767), -32768);
-		fwrite(&pcm_16bit,2,1,fp);
+	if(data.size()>0){
+		writer.append(&data[0], data.size());
 	}
-	fclose(fp);
+	writer.finalize();
 }
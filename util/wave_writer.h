@@ -13,4 +13,35 @@
 #include <stdio.h>
 #include <vector>
 
-void write_wave_file(const char *path, std::vector<float> data, int sampling_rate);
+void write_wave_file(const char *path, const std::vector<float> &data, int sampling_rate);
+
+// Streaming writer, the RIFF sizes are patched on finalize
+// Supports 16/24/32bit PCM and 32bit float with optional TPDF dithering
+class WaveStreamWriter{
+private:
+	FILE *fp;
+	int channel_n;
+	int bit_per_sample;
+	bool is_float;
+	bool dither;
+	unsigned int data_bytes;
+	unsigned int rng;
+	std::vector<unsigned char> block;
+	size_t block_n;
+
+	int flush(void);
+	float tpdf(void);
+
+public:
+	WaveStreamWriter();
+	~WaveStreamWriter();
+
+	// Returns 0 on success
+	int open(const char *path, int sampling_rate, int channels = 1, int bit_per_sample = 16, bool is_float = false, bool dither = false);
+
+	// Append frames of interleaved pcm (frames * channels floats)
+	int append(const float *data, int frames);
+
+	// Write the buffered pcm, patch the header and close the file
+	int finalize(void);
+};
@@ -4,6 +4,7 @@
 
 #include "mat_utils.h"
 #include "image_utils.h"
+#include "webcamera_utils.h"
 
 #if defined(_WIN32) || defined(_WIN64)
 #define PRINT_OUT(...) fprintf_s(stdout, __VA_ARGS__)
@@ -14,47 +15,182 @@
 #endif
 
 
-int adjust_frame_size(const cv::Mat& sframe, cv::Mat& dframe, int d_width, int d_height)
+LetterboxContext::LetterboxContext(int d_width, int d_height)
+    : d_width(d_width), d_height(d_height), s_width(0), s_height(0), s_type(-1),
+      pad_width(0), pad_height(0), start_x(0), start_y(0), lut_rgb(false)
 {
-    int s_width  = sframe.cols;
-    int s_height = sframe.rows;
+}
+
+
+void LetterboxContext::prepare(const cv::Mat& sframe)
+{
+    if (sframe.cols == s_width && sframe.rows == s_height && sframe.type() == s_type) {
+        return;
+    }
+    s_width  = sframe.cols;
+    s_height = sframe.rows;
+    s_type   = sframe.type();
 
     float scale = std::max<float>((float)s_width/(float)d_width, (float)s_height/(float)d_height);
+    pad_width  = std::round(scale*(float)d_width);
+    pad_height = std::round(scale*(float)d_height);
+    start_x = (pad_width  - s_width)  / 2;
+    start_y = (pad_height - s_height) / 2;
+
+    // sampling positions of cv::resize(INTER_LINEAR) on the padded frame, shifted into the source frame
+    float fx = (float)pad_width  / (float)d_width;
+    float fy = (float)pad_height / (float)d_height;
+    cv::Mat map(d_height, d_width, CV_32FC2);
+    for (int y = 0; y < d_height; y++) {
+        cv::Vec2f* row = map.ptr<cv::Vec2f>(y);
+        float sy = std::min(std::max(((float)y + 0.5f) * fy - 0.5f, 0.0f), (float)(pad_height - 1)) - start_y;
+        for (int x = 0; x < d_width; x++) {
+            float sx = std::min(std::max(((float)x + 0.5f) * fx - 0.5f, 0.0f), (float)(pad_width - 1)) - start_x;
+            row[x] = cv::Vec2f(sx, sy);
+        }
+    }
+    cv::convertMaps(map, cv::Mat(), map1, map2, CV_16SC2);
 
-    // padding base
-    cv::Mat dframe0 = cv::Mat(std::round(scale*(float)d_height), std::round(scale*(float)d_width), sframe.type(), cv::Scalar(0, 0, 0, 255));
+    pad.release();
+}
 
-    int start_x = (dframe0.cols - s_width)  / 2;
-    int start_y = (dframe0.rows - s_height) / 2;
-    cv::Rect roi(start_x, start_y, s_width, s_height);
 
-    cv::Mat dframe0_roi = dframe0(roi);
-    sframe.copyTo(dframe0_roi);
+const cv::Mat& LetterboxContext::resize(const cv::Mat& sframe)
+{
+    resize(sframe, dst);
+    return dst;
+}
 
-    cv::resize(dframe0, dframe, cv::Size(d_width, d_height), 0, 0);
 
-    return 0;
+void LetterboxContext::resize(const cv::Mat& sframe, cv::Mat& dframe)
+{
+    prepare(sframe);
+
+    if (pad_width == d_width && pad_height == d_height && start_x == 0 && start_y == 0) {
+        sframe.copyTo(dframe);
+        return;
+    }
+    cv::remap(sframe, dframe, map1, map2, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0, 255));
 }
 
 
-int adjust_frame_size(const cv::Mat& sframe, cv::Mat& dframe0, cv::Mat& dframe, int d_width, int d_height)
+const cv::Mat& LetterboxContext::padded(const cv::Mat& sframe)
 {
-    int s_width  = sframe.cols;
-    int s_height = sframe.rows;
+    prepare(sframe);
 
-    float scale = std::max<float>((float)s_width/(float)d_width, (float)s_height/(float)d_height);
+    // the buffer is kept, only the padding bands are refilled since the caller may have drawn on them
+    cv::Scalar pad_color(0, 0, 0, 255);
+    if (pad.empty()) {
+        pad = cv::Mat(pad_height, pad_width, s_type, pad_color);
+    }
+    else {
+        pad(cv::Rect(0, 0, pad_width, start_y)).setTo(pad_color);
+        pad(cv::Rect(0, start_y + s_height, pad_width, pad_height - start_y - s_height)).setTo(pad_color);
+        pad(cv::Rect(0, start_y, start_x, s_height)).setTo(pad_color);
+        pad(cv::Rect(start_x + s_width, start_y, pad_width - start_x - s_width, s_height)).setTo(pad_color);
+    }
+    cv::Mat roi = pad(cv::Rect(start_x, start_y, s_width, s_height));
+    sframe.copyTo(roi);
+
+    return pad;
+}
+
+
+void LetterboxContext::prepare_lut(bool rgb, const std::string& normalize_type)
+{
+    if (lut_type == normalize_type && lut_rgb == rgb) {
+        return;
+    }
+    lut_type = normalize_type;
+    lut_rgb  = rgb;
+
+    // indexed by the output channel, ImageNet statistics are in RGB order like normalize_image
+    float mean[] = {0.485f, 0.456f, 0.406f};
+    float std[]  = {0.229f, 0.224f, 0.225f};
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 256; i++) {
+            float col = i;
+            if (normalize_type == "127.5") {
+                lut[c][i] = col / 127.5f - 1.0f;
+            }
+            else if (normalize_type == "ImageNet") {
+                lut[c][i] = (col/255.0f-mean[c])/std[c];
+            }
+            else {
+                lut[c][i] = col / 255.0f;
+            }
+        }
+    }
+}
+
+
+const cv::Mat& LetterboxContext::tensor(const cv::Mat& sframe, bool rgb, const std::string& normalize_type)
+{
+    resize(sframe, dst);
+    prepare_lut(rgb, normalize_type);
+
+    int size[] = {3, d_height, d_width};
+    if (data.dims != 3 || data.size[1] != d_height || data.size[2] != d_width) {
+        data = cv::Mat(3, size, CV_32FC1);
+    }
+
+    int channels = dst.channels();
+    int plane = d_width * d_height;
+    float* ddata = (float*)data.data;
+    for (int y = 0; y < d_height; y++) {
+        const unsigned char* sdata = dst.ptr<unsigned char>(y);
+        float* d0 = ddata + y * d_width;
+        float* d1 = d0 + plane;
+        float* d2 = d1 + plane;
+        for (int x = 0; x < d_width; x++, sdata += channels) {
+            d0[x] = lut[0][sdata[rgb ? 2 : 0]];
+            d1[x] = lut[1][sdata[1]];
+            d2[x] = lut[2][sdata[rgb ? 0 : 2]];
+        }
+    }
 
-    // padding base
-    dframe0 = cv::Mat(std::round(scale*(float)d_height), std::round(scale*(float)d_width), sframe.type(), cv::Scalar(0, 0, 0, 255));
+    return data;
+}
+
+
+cv::Point2f LetterboxContext::to_source(const cv::Point2f& point) const
+{
+    return cv::Point2f(point.x * pad_width - start_x, point.y * pad_height - start_y);
+}
+
+
+cv::Rect2f LetterboxContext::to_source(const cv::Rect2f& rect) const
+{
+    cv::Point2f top_left = to_source(rect.tl());
+    return cv::Rect2f(top_left.x, top_left.y, rect.width * pad_width, rect.height * pad_height);
+}
+
+
+static LetterboxContext& shared_letterbox(int d_width, int d_height)
+{
+    // the maps are kept while the frame and destination sizes stay the same
+    static thread_local LetterboxContext* letterbox = nullptr;
+    if (letterbox == nullptr || letterbox->dst_size() != cv::Size(d_width, d_height)) {
+        delete letterbox;
+        letterbox = new LetterboxContext(d_width, d_height);
+    }
+    return *letterbox;
+}
+
+
+int adjust_frame_size(const cv::Mat& sframe, cv::Mat& dframe, int d_width, int d_height)
+{
+    shared_letterbox(d_width, d_height).resize(sframe, dframe);
 
-    int start_x = (dframe0.cols - s_width)  / 2;
-    int start_y = (dframe0.rows - s_height) / 2;
-    cv::Rect roi(start_x, start_y, s_width, s_height);
+    return 0;
+}
 
-    cv::Mat dframe0_roi = dframe0(roi);
-    sframe.copyTo(dframe0_roi);
 
-    cv::resize(dframe0, dframe, cv::Size(d_width, d_height), 0, 0);
+int adjust_frame_size(const cv::Mat& sframe, cv::Mat& dframe0, cv::Mat& dframe, int d_width, int d_height)
+{
+    LetterboxContext& letterbox = shared_letterbox(d_width, d_height);
+    letterbox.padded(sframe).copyTo(dframe0);
+    letterbox.resize(sframe, dframe);
 
     return 0;
 }
@@ -63,25 +199,19 @@ int adjust_frame_size(const cv::Mat& sframe, cv::Mat& dframe0, cv::Mat& dframe,
 int preprocess_frame(const cv::Mat& sframe, cv::Mat& dframe0, cv::Mat& dframe, int d_width, int d_height,
                      bool rgb, std::string normalize_type)
 {
-    cv::Mat resized_img0;
-    adjust_frame_size(sframe, dframe0, resized_img0, d_width, d_height);
-
-    cv::Mat resized_img1;
     if (rgb) {
-        cv::cvtColor(resized_img0, resized_img1, cv::COLOR_BGR2RGB);
-    }
-    else {
-        resized_img0.copyTo(resized_img1);
+        LetterboxContext& letterbox = shared_letterbox(d_width, d_height);
+        letterbox.padded(sframe).copyTo(dframe0);
+        letterbox.tensor(sframe, true, normalize_type).copyTo(dframe);
+        return 0;
     }
 
+    cv::Mat resized_img0;
+    adjust_frame_size(sframe, dframe0, resized_img0, d_width, d_height);
+
     cv::Mat data;
-    normalize_image(resized_img1, data, normalize_type);
-    if (rgb) {
-        transpose(data, dframe, {2, 0, 1});
-    }
-    else {
-        cv::cvtColor(data, dframe, cv::COLOR_BGR2GRAY);
-    }
+    normalize_image(resized_img0, data, normalize_type);
+    cv::cvtColor(data, dframe, cv::COLOR_BGR2GRAY);
 
     return 0;
 }
@@ -1,6 +1,7 @@
 ﻿#ifndef _WEBCAMERA_UTILS_H_
 #define _WEBCAMERA_UTILS_H_
 
+#include <string>
 #include <opencv2/opencv.hpp>
 
 #ifndef __cplusplus
@@ -13,6 +14,43 @@ int preprocess_frame(const cv::Mat& sframe, cv::Mat& dframe0, cv::Mat& dframe, i
                      bool rgb = true, std::string normalize_type = {"255"});
 int get_writer(cv::VideoWriter& writer, const char* path, cv::Size size, bool rgb = true);
 
+// Letterbox of a fixed destination size, the source size and type are taken from the first frame
+// and the scale, padding and resize maps are only recomputed when they change
+class LetterboxContext {
+public:
+    LetterboxContext(int d_width, int d_height);
+
+    // same result as adjust_frame_size, written into a persistent buffer
+    const cv::Mat& resize(const cv::Mat& sframe);
+    void resize(const cv::Mat& sframe, cv::Mat& dframe);
+    // source resolution frame with the padding (dframe0 of adjust_frame_size)
+    const cv::Mat& padded(const cv::Mat& sframe);
+    // letterboxed frame as a float C x H x W tensor, same values as preprocess_frame
+    const cv::Mat& tensor(const cv::Mat& sframe, bool rgb = true, const std::string& normalize_type = "255");
+
+    // normalized coordinates of the letterboxed frame to pixel coordinates of the source frame
+    cv::Point2f to_source(const cv::Point2f& point) const;
+    cv::Rect2f to_source(const cv::Rect2f& rect) const;
+
+    cv::Size dst_size() const { return cv::Size(d_width, d_height); }
+    cv::Size padded_size() const { return cv::Size(pad_width, pad_height); }
+    cv::Point offset() const { return cv::Point(start_x, start_y); }
+
+private:
+    void prepare(const cv::Mat& sframe);
+    void prepare_lut(bool rgb, const std::string& normalize_type);
+
+    int d_width, d_height;
+    int s_width, s_height, s_type;
+    int pad_width, pad_height;
+    int start_x, start_y;
+    cv::Mat map1, map2;
+    cv::Mat dst, pad, data;
+    bool lut_rgb;
+    std::string lut_type;
+    float lut[3][256];
+};
+
 #ifndef __cplusplus
 }
 #endif